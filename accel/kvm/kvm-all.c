@@ -24,6 +24,7 @@
 #include "qemu/option.h"
 #include "qemu/config-file.h"
 #include "qemu/error-report.h"
+#include "qemu/latency.h"
 #include "qapi/error.h"
 #include "hw/hw.h"
 #include "hw/pci/msi.h"
@@ -1979,6 +1980,7 @@ int kvm_cpu_exec(CPUState *cpu)
 {
     struct kvm_run *run = cpu->kvm_run;
     int ret, run_ret;
+    int64_t exit_start;
 
     DPRINTF("kvm_cpu_exec()\n");
 
@@ -2015,6 +2017,7 @@ int kvm_cpu_exec(CPUState *cpu)
         smp_rmb();
 
         run_ret = kvm_vcpu_ioctl(cpu, KVM_RUN, 0);
+        exit_start = qemu_latency_start();
 
         attrs = kvm_arch_post_run(cpu, run);
 
@@ -2116,6 +2119,7 @@ int kvm_cpu_exec(CPUState *cpu)
             ret = kvm_arch_handle_exit(cpu, run);
             break;
         }
+        qemu_latency_end(QEMU_LATENCY_VCPU_EXIT, exit_start);
     } while (ret == 0);
 
     cpu_exec_end(cpu);
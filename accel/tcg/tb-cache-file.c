@@ -0,0 +1,120 @@
+/*
+ * File format of the on-disk cache of translated code
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * A header naming what the code was made for, then the entries one after
+ * the other, each with a crc32c of its contents.  Nothing here depends on
+ * the target.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+#include "exec/tb-cache.h"
+
+#define TB_CACHE_MAGIC      0x43425451  /* "QTBC" */
+#define TB_CACHE_VERSION    2
+
+typedef struct TBCacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t abi;           /* tcg_host_code_abi() */
+    uint32_t key_len;       /* of the key that follows */
+} TBCacheFileHeader;
+
+size_t tb_cache_entry_bytes(const TBCacheEntryHeader *h)
+{
+    return sizeof(*h) + h->size + h->code_size + h->search_size
+        + h->nb_relocs * sizeof(TCGHostReloc);
+}
+
+uint32_t tb_cache_entry_crc(const TBCacheEntry *e)
+{
+    uint32_t crc;
+
+    crc = crc32c(0, e->data, e->h.size + e->h.code_size + e->h.search_size);
+    return crc32c(crc, (const uint8_t *)e->relocs,
+                  e->h.nb_relocs * sizeof(TCGHostReloc));
+}
+
+void tb_cache_entry_free(TBCacheEntry *e)
+{
+    g_free(e->data);
+    g_free(e->relocs);
+    g_free(e);
+}
+
+void tb_cache_file_start(GByteArray *buf, const char *key, uint32_t abi)
+{
+    TBCacheFileHeader header = {
+        .magic = TB_CACHE_MAGIC,
+        .version = TB_CACHE_VERSION,
+        .abi = abi,
+        .key_len = strlen(key),
+    };
+
+    g_byte_array_append(buf, (const guint8 *)&header, sizeof(header));
+    g_byte_array_append(buf, (const guint8 *)key, header.key_len);
+}
+
+void tb_cache_file_add(GByteArray *buf, const TBCacheEntry *e)
+{
+    g_byte_array_append(buf, (const guint8 *)&e->h, sizeof(e->h));
+    g_byte_array_append(buf, e->data,
+                        e->h.size + e->h.code_size + e->h.search_size);
+    g_byte_array_append(buf, (const guint8 *)e->relocs,
+                        e->h.nb_relocs * sizeof(TCGHostReloc));
+}
+
+int tb_cache_file_parse(const uint8_t *data, size_t length, const char *key,
+                        uint32_t abi, TBCacheEntryFunc *func, void *opaque)
+{
+    const uint8_t *p = data, *end = data + length;
+    TBCacheFileHeader header;
+    int count = 0;
+
+    if (length < sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    if (header.magic != TB_CACHE_MAGIC || header.version != TB_CACHE_VERSION
+        || header.abi != abi
+        || header.key_len != strlen(key)
+        || end - p < header.key_len
+        || memcmp(p, key, header.key_len)) {
+        return -1;
+    }
+    p += header.key_len;
+
+    while (end - p >= sizeof(TBCacheEntryHeader)) {
+        TBCacheEntry *e = g_new0(TBCacheEntry, 1);
+        size_t data_size, relocs_size;
+
+        memcpy(&e->h, p, sizeof(e->h));
+        p += sizeof(e->h);
+        data_size = (size_t)e->h.size + e->h.code_size + e->h.search_size;
+        relocs_size = (size_t)e->h.nb_relocs * sizeof(TCGHostReloc);
+        if (e->h.nb_relocs > TCG_MAX_HOST_RELOCS
+            || end - p < data_size + relocs_size) {
+            g_free(e);
+            break;
+        }
+        e->data = g_memdup(p, data_size);
+        p += data_size;
+        e->relocs = g_memdup(p, relocs_size);
+        p += relocs_size;
+        if (tb_cache_entry_crc(e) != e->h.crc) {
+            tb_cache_entry_free(e);
+            break;
+        }
+        count++;
+        if (!func(e, opaque)) {
+            break;
+        }
+    }
+    return count;
+}
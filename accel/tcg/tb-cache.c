@@ -0,0 +1,333 @@
+/*
+ * On-disk cache of translated code
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Booting the same system image translates the same guest code, the
+ * kernel and the libraries of the system, run after run.  The host code
+ * of the TBs translated by a run is kept, along with the guest code it
+ * was made from and the relocations recorded by the backend, and the next
+ * run copies it into the code buffer instead of translating again.
+ *
+ * A TB is only taken from the cache when the guest code it was made from
+ * is still what the guest has at its physical address, byte for byte.
+ * TBs spanning two pages, and TBs whose code refers to things the backend
+ * can't describe (host pointers given by the translator), are not kept.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "exec/tb-cache.h"
+#include "exec/tb-profile.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "sysemu/sysemu.h"
+#include "tcg.h"
+
+/* Translations past this are not kept.  */
+#define TB_CACHE_MAX_BYTES  (64 * 1024 * 1024)
+
+static struct {
+    QemuMutex lock;
+    bool enabled;
+    bool dirty;
+    bool full;
+    char *path;
+    char *key;
+    uint32_t abi;
+    GHashTable *entries;
+    size_t bytes;
+    Notifier exit_notifier;
+
+    /* Statistics */
+    size_t loaded;
+    size_t hits;
+    size_t misses;
+    size_t stale;
+    size_t rejected;
+    size_t stored;
+} tb_cache;
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntryHeader *h = p;
+
+    return g_int64_hash(&h->pc) ^ h->flags ^ (h->cflags << 16);
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntryHeader *x = a;
+    const TBCacheEntryHeader *y = b;
+
+    return x->pc == y->pc && x->cs_base == y->cs_base
+        && x->flags == y->flags && x->cflags == y->cflags
+        && x->trace_vcpu_dstate == y->trace_vcpu_dstate;
+}
+
+/* Adds @e in place of the entry with the same key, if it fits.  Called
+   with the lock held.  */
+static bool tb_cache_insert(TBCacheEntry *e)
+{
+    TBCacheEntry *old = g_hash_table_lookup(tb_cache.entries, &e->h);
+    size_t bytes = tb_cache.bytes + tb_cache_entry_bytes(&e->h);
+
+    if (old) {
+        bytes -= tb_cache_entry_bytes(&old->h);
+    }
+    if (bytes > TB_CACHE_MAX_BYTES) {
+        tb_cache.full = true;
+        tb_cache_entry_free(e);
+        return false;
+    }
+    tb_cache.bytes = bytes;
+    g_hash_table_replace(tb_cache.entries, &e->h, e);
+    return true;
+}
+
+static bool tb_cache_read_entry(TBCacheEntry *e, void *opaque)
+{
+    if (!tb_cache_insert(e)) {
+        return false;
+    }
+    tb_cache.loaded++;
+    return true;
+}
+
+static void tb_cache_read(void)
+{
+    gchar *contents;
+    gsize length;
+
+    if (!g_file_get_contents(tb_cache.path, &contents, &length, NULL)) {
+        return;
+    }
+    tb_cache_file_parse((const uint8_t *)contents, length, tb_cache.key,
+                        tb_cache.abi, tb_cache_read_entry, NULL);
+    g_free(contents);
+}
+
+static void tb_cache_write(void)
+{
+    GByteArray *buf = g_byte_array_new();
+    GHashTableIter iter;
+    gpointer value;
+    GError *err = NULL;
+
+    tb_cache_file_start(buf, tb_cache.key, tb_cache.abi);
+    g_hash_table_iter_init(&iter, tb_cache.entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        tb_cache_file_add(buf, value);
+    }
+
+    /* Written aside and renamed into place, another emulator sharing the
+       directory reads either the old or the new file.  */
+    if (!g_file_set_contents(tb_cache.path, (const gchar *)buf->data,
+                             buf->len, &err)) {
+        error_report("Could not save the translation cache: %s",
+                     err->message);
+        g_error_free(err);
+    }
+    g_byte_array_free(buf, true);
+}
+
+static void tb_cache_exit(Notifier *n, void *data)
+{
+    qemu_mutex_lock(&tb_cache.lock);
+    if (tb_cache.dirty) {
+        tb_cache_write();
+        tb_cache.dirty = false;
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+bool tb_cache_init(const char *dir, const char *key)
+{
+#if defined(TCG_TARGET_NEED_HOST_RELOCS) && TCG_TARGET_HAS_direct_jump
+    gchar *full_key, *name;
+
+    if (!tcg_enabled() || !first_cpu || tb_cache.enabled) {
+        return false;
+    }
+    if (g_mkdir_with_parents(dir, 0755) != 0) {
+        return false;
+    }
+
+    /* The code depends on the guest, the CPU model, the emulator build,
+       the layout of the CPU state and the host.  */
+    tb_cache.abi = tcg_host_code_abi();
+    full_key = g_strdup_printf("%s|%s|%s|%s|%08x", key, TARGET_NAME,
+                               object_get_typename(OBJECT(first_cpu)),
+                               QEMU_VERSION, tb_cache.abi);
+    name = g_compute_checksum_for_string(G_CHECKSUM_SHA1, full_key, -1);
+
+    qemu_mutex_init(&tb_cache.lock);
+    tb_cache.key = full_key;
+    tb_cache.path = g_strdup_printf("%s/%s.tbc", dir, name);
+    tb_cache.entries = g_hash_table_new_full(
+        tb_cache_entry_hash, tb_cache_entry_equal, NULL,
+        (GDestroyNotify)tb_cache_entry_free);
+    g_free(name);
+
+    tb_cache_read();
+
+    tb_cache.exit_notifier.notify = tb_cache_exit;
+    qemu_add_exit_notifier(&tb_cache.exit_notifier);
+    atomic_set(&tb_cache.enabled, true);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Only TBs translated the same way each time, from RAM, are kept.  */
+static bool tb_cache_wanted(CPUState *cpu, TranslationBlock *tb,
+                            tb_page_addr_t phys_pc)
+{
+    return atomic_read(&tb_cache.enabled)
+        && !atomic_read(&tb_profile_enabled)
+        && !(tb->cflags & CF_NOCACHE)
+        && !cpu->singlestep_enabled
+        && QTAILQ_EMPTY(&cpu->breakpoints)
+        && phys_pc != -1;
+}
+
+bool tb_cache_load(CPUState *cpu, TranslationBlock *tb,
+                   tb_page_addr_t phys_pc, int *code_size, int *search_size)
+{
+    TBCacheEntryHeader key;
+    TBCacheEntry *e;
+    const uint8_t *guest;
+    size_t page_left;
+
+    tcg_ctx->record_host_relocs = false;
+    if (!tb_cache_wanted(cpu, tb, phys_pc)) {
+        return false;
+    }
+
+    key.pc = tb->pc;
+    key.cs_base = tb->cs_base;
+    key.flags = tb->flags;
+    key.cflags = tb->cflags;
+    key.trace_vcpu_dstate = tb->trace_vcpu_dstate;
+    page_left = TARGET_PAGE_SIZE - (phys_pc & ~TARGET_PAGE_MASK);
+    guest = qemu_map_ram_ptr(NULL, phys_pc);
+
+    qemu_mutex_lock(&tb_cache.lock);
+    e = g_hash_table_lookup(tb_cache.entries, &key);
+    if (!e) {
+        tb_cache.misses++;
+        goto miss;
+    }
+    if (e->h.size > page_left || memcmp(guest, e->data, e->h.size)) {
+        /* Another program, or another version of it.  */
+        tb_cache.stale++;
+        goto miss;
+    }
+    if ((void *)tb->tc.ptr + e->h.code_size + e->h.search_size
+        > tcg_ctx->code_gen_highwater) {
+        /* Let the translation find out the buffer needs a flush.  */
+        goto miss;
+    }
+
+    memcpy(tb->tc.ptr, e->data + e->h.size,
+           e->h.code_size + e->h.search_size);
+    tb->size = e->h.size;
+    tb->icount = e->h.icount;
+    tb->tc.size = e->h.code_size;
+    tb->jmp_reset_offset[0] = e->h.jmp_reset_offset[0];
+    tb->jmp_reset_offset[1] = e->h.jmp_reset_offset[1];
+    tb->jmp_target_arg[0] = e->h.jmp_insn_offset[0];
+    tb->jmp_target_arg[1] = e->h.jmp_insn_offset[1];
+    if (!tcg_host_reloc_apply(tcg_ctx, tb, e->relocs, e->h.nb_relocs)) {
+        /* Doesn't reach from where this process put the code.  */
+        tb_cache.rejected++;
+        tb_cache.bytes -= tb_cache_entry_bytes(&e->h);
+        g_hash_table_remove(tb_cache.entries, &e->h);
+        goto miss;
+    }
+    tb_cache.hits++;
+    *code_size = e->h.code_size;
+    *search_size = e->h.search_size;
+    qemu_mutex_unlock(&tb_cache.lock);
+
+    flush_icache_range((uintptr_t)tb->tc.ptr,
+                       (uintptr_t)tb->tc.ptr + *code_size);
+    return true;
+
+miss:
+    tcg_ctx->record_host_relocs = !tb_cache.full;
+    qemu_mutex_unlock(&tb_cache.lock);
+    return false;
+}
+
+void tb_cache_store(CPUState *cpu, TranslationBlock *tb,
+                    tb_page_addr_t phys_pc, int code_size, int search_size)
+{
+    TBCacheEntry *e;
+
+    if (!tcg_ctx->record_host_relocs) {
+        return;
+    }
+    tcg_ctx->record_host_relocs = false;
+    if (tcg_ctx->host_relocs_failed
+        || (tb->pc & TARGET_PAGE_MASK)
+           != ((tb->pc + tb->size - 1) & TARGET_PAGE_MASK)) {
+        return;
+    }
+
+    e = g_new0(TBCacheEntry, 1);
+    e->h.pc = tb->pc;
+    e->h.cs_base = tb->cs_base;
+    e->h.flags = tb->flags;
+    e->h.cflags = tb->cflags;
+    e->h.trace_vcpu_dstate = tb->trace_vcpu_dstate;
+    e->h.size = tb->size;
+    e->h.icount = tb->icount;
+    e->h.code_size = code_size;
+    e->h.search_size = search_size;
+    e->h.nb_relocs = tcg_ctx->nb_host_relocs;
+    e->h.jmp_reset_offset[0] = tb->jmp_reset_offset[0];
+    e->h.jmp_reset_offset[1] = tb->jmp_reset_offset[1];
+    e->h.jmp_insn_offset[0] = tb->jmp_target_arg[0];
+    e->h.jmp_insn_offset[1] = tb->jmp_target_arg[1];
+
+    e->data = g_malloc(tb->size + code_size + search_size);
+    memcpy(e->data, qemu_map_ram_ptr(NULL, phys_pc), tb->size);
+    memcpy(e->data + tb->size, tb->tc.ptr, code_size + search_size);
+    e->relocs = g_memdup(tcg_ctx->host_relocs,
+                         e->h.nb_relocs * sizeof(TCGHostReloc));
+    e->h.crc = tb_cache_entry_crc(e);
+
+    qemu_mutex_lock(&tb_cache.lock);
+    if (tb_cache_insert(e)) {
+        tb_cache.stored++;
+        tb_cache.dirty = true;
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+}
+
+void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf)
+{
+    if (!atomic_read(&tb_cache.enabled)) {
+        return;
+    }
+    qemu_mutex_lock(&tb_cache.lock);
+    cpu_fprintf(f, "\nTB cache:\n");
+    cpu_fprintf(f, "TB cache file       %s\n", tb_cache.path);
+    cpu_fprintf(f, "TB cache entries    %u (%zu loaded, %zu KiB%s)\n",
+                g_hash_table_size(tb_cache.entries), tb_cache.loaded,
+                tb_cache.bytes / 1024, tb_cache.full ? ", full" : "");
+    cpu_fprintf(f, "TB cache hits       %zu\n", tb_cache.hits);
+    cpu_fprintf(f, "TB cache misses     %zu (%zu stale, %zu rejected)\n",
+                tb_cache.misses + tb_cache.stale + tb_cache.rejected,
+                tb_cache.stale, tb_cache.rejected);
+    cpu_fprintf(f, "TB cache stores     %zu\n", tb_cache.stored);
+    qemu_mutex_unlock(&tb_cache.lock);
+}
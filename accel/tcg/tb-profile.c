@@ -0,0 +1,301 @@
+/*
+ * Execution counts of translated blocks
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * While profiling, each TB starts by bumping a counter kept for its guest
+ * pc, cs_base and flags, which outlives the TB: retranslations of the
+ * same block add up.  The cost of a block is estimated from the size of
+ * the host code it runs each time, which leaves out the helpers it calls
+ * but tells the blocks that dominate the time spent in generated code.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qapi/error.h"
+#include "cpu.h"
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "exec/tb-profile.h"
+#include "qemu/thread.h"
+#include "tcg/tcg.h"
+#include "tcg/tcg-op.h"
+#include "translate-all.h"
+
+typedef struct TBProfileEntry {
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    /* Bumped by the code of the TB without atomics: vCPUs running the
+       same TB at once may lose counts.  */
+    uint64_t execs;
+    /* Of the last translation.  */
+    uint32_t guest_size;
+    uint32_t icount;
+    uint32_t host_size;
+    uint32_t translations;
+} TBProfileEntry;
+
+bool tb_profile_enabled;
+
+static struct {
+    QemuMutex lock;
+    GHashTable *entries;
+} tb_profile;
+
+static guint tb_profile_hash(gconstpointer p)
+{
+    const TBProfileEntry *e = p;
+
+    return (guint)e->pc ^ (guint)((uint64_t)e->pc >> 32) ^ e->flags;
+}
+
+static gboolean tb_profile_equal(gconstpointer a, gconstpointer b)
+{
+    const TBProfileEntry *x = a;
+    const TBProfileEntry *y = b;
+
+    return x->pc == y->pc && x->cs_base == y->cs_base && x->flags == y->flags;
+}
+
+static void tb_profile_init(void)
+{
+    static bool initialized;
+
+    if (!initialized) {
+        qemu_mutex_init(&tb_profile.lock);
+        /* Entries are never freed, the code of TBs may still point to
+           them.  */
+        tb_profile.entries = g_hash_table_new(tb_profile_hash,
+                                              tb_profile_equal);
+        initialized = true;
+    }
+}
+
+static TBProfileEntry *tb_profile_entry(TranslationBlock *tb)
+{
+    TBProfileEntry key = {
+        .pc = tb->pc,
+        .cs_base = tb->cs_base,
+        .flags = tb->flags,
+    };
+    TBProfileEntry *e;
+
+    qemu_mutex_lock(&tb_profile.lock);
+    e = g_hash_table_lookup(tb_profile.entries, &key);
+    if (!e) {
+        e = g_new(TBProfileEntry, 1);
+        *e = key;
+        g_hash_table_insert(tb_profile.entries, e, e);
+    }
+    qemu_mutex_unlock(&tb_profile.lock);
+    return e;
+}
+
+void tb_profile_gen_count(TranslationBlock *tb)
+{
+    TBProfileEntry *e;
+    TCGv_ptr ptr;
+    TCGv_i64 count;
+
+    if (!atomic_read(&tb_profile_enabled)) {
+        return;
+    }
+    e = tb_profile_entry(tb);
+    ptr = tcg_const_ptr(&e->execs);
+    count = tcg_temp_new_i64();
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+void tb_profile_translated(TranslationBlock *tb)
+{
+    TBProfileEntry *e;
+
+    if (!atomic_read(&tb_profile_enabled)) {
+        return;
+    }
+    e = tb_profile_entry(tb);
+    qemu_mutex_lock(&tb_profile.lock);
+    e->guest_size = tb->size;
+    e->icount = tb->icount;
+    e->host_size = tb->tc.size;
+    e->translations++;
+    qemu_mutex_unlock(&tb_profile.lock);
+}
+
+void tb_profile_start(void)
+{
+    tb_profile_init();
+    if (!atomic_read(&tb_profile_enabled)) {
+        atomic_set(&tb_profile_enabled, true);
+        tb_flush(first_cpu);
+    }
+}
+
+void tb_profile_stop(void)
+{
+    if (atomic_read(&tb_profile_enabled)) {
+        atomic_set(&tb_profile_enabled, false);
+        tb_flush(first_cpu);
+    }
+}
+
+void tb_profile_reset(void)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    tb_profile_init();
+    qemu_mutex_lock(&tb_profile.lock);
+    g_hash_table_iter_init(&iter, tb_profile.entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        TBProfileEntry *e = value;
+
+        e->execs = 0;
+        e->translations = 0;
+    }
+    qemu_mutex_unlock(&tb_profile.lock);
+}
+
+typedef struct TBProfileRow {
+    const char *name;       /* of the symbol, for the symbol rows */
+    const TBProfileEntry *entry;
+    uint64_t execs;
+    uint64_t insns;
+    uint64_t cost;          /* host bytes run */
+} TBProfileRow;
+
+static gint tb_profile_row_cmp(gconstpointer a, gconstpointer b)
+{
+    const TBProfileRow *x = a;
+    const TBProfileRow *y = b;
+
+    return x->cost < y->cost ? 1 : x->cost > y->cost ? -1 : 0;
+}
+
+void tb_profile_dump(FILE *f, fprintf_function cpu_fprintf, int max)
+{
+    GArray *blocks, *symbols;
+    GHashTable *by_symbol;
+    GHashTableIter iter;
+    gpointer value;
+    uint64_t total_cost = 0, total_execs = 0;
+    guint i;
+
+    tb_profile_init();
+    blocks = g_array_new(false, false, sizeof(TBProfileRow));
+    symbols = g_array_new(false, false, sizeof(TBProfileRow));
+    by_symbol = g_hash_table_new(g_str_hash, g_str_equal);
+
+    qemu_mutex_lock(&tb_profile.lock);
+    g_hash_table_iter_init(&iter, tb_profile.entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const TBProfileEntry *e = value;
+        TBProfileRow row = {
+            .name = lookup_symbol(e->pc),
+            .entry = e,
+            .execs = e->execs,
+        };
+        gpointer index;
+
+        if (!row.execs) {
+            continue;
+        }
+        row.insns = row.execs * e->icount;
+        row.cost = row.execs * e->host_size;
+        total_execs += row.execs;
+        total_cost += row.cost;
+        g_array_append_val(blocks, row);
+
+        if (!row.name[0]) {
+            continue;
+        }
+        if (g_hash_table_lookup_extended(by_symbol, row.name, NULL, &index)) {
+            TBProfileRow *sym = &g_array_index(symbols, TBProfileRow,
+                                               GPOINTER_TO_UINT(index));
+            sym->execs += row.execs;
+            sym->insns += row.insns;
+            sym->cost += row.cost;
+        } else {
+            row.entry = NULL;
+            g_hash_table_insert(by_symbol, (gpointer)row.name,
+                                GUINT_TO_POINTER(symbols->len));
+            g_array_append_val(symbols, row);
+        }
+    }
+    qemu_mutex_unlock(&tb_profile.lock);
+
+    g_array_sort(blocks, tb_profile_row_cmp);
+    g_array_sort(symbols, tb_profile_row_cmp);
+    if (!total_cost) {
+        total_cost = 1;
+    }
+
+    cpu_fprintf(f, "TB profile: %s, %u blocks run %" PRIu64 " times\n",
+                atomic_read(&tb_profile_enabled) ? "running" : "stopped",
+                blocks->len, total_execs);
+    cpu_fprintf(f, "%-18s %12s %14s %6s %5s %5s %3s  %s\n",
+                "pc", "execs", "insns", "cost%", "insn", "host", "tr",
+                "symbol");
+    for (i = 0; i < blocks->len && i < (guint)max; i++) {
+        const TBProfileRow *row = &g_array_index(blocks, TBProfileRow, i);
+        const TBProfileEntry *e = row->entry;
+
+        cpu_fprintf(f, "0x" TARGET_FMT_lx " %12" PRIu64 " %14" PRIu64
+                    " %6.2f %5u %5u %3u  %s\n",
+                    e->pc, row->execs, row->insns,
+                    row->cost * 100.0 / total_cost, e->icount, e->host_size,
+                    e->translations, row->name);
+    }
+
+    if (symbols->len) {
+        cpu_fprintf(f, "\n%-40s %12s %14s %6s\n",
+                    "symbol", "execs", "insns", "cost%");
+        for (i = 0; i < symbols->len && i < (guint)max; i++) {
+            const TBProfileRow *row = &g_array_index(symbols, TBProfileRow, i);
+
+            cpu_fprintf(f, "%-40s %12" PRIu64 " %14" PRIu64 " %6.2f\n",
+                        row->name, row->execs, row->insns,
+                        row->cost * 100.0 / total_cost);
+        }
+    }
+
+    g_hash_table_destroy(by_symbol);
+    g_array_free(symbols, true);
+    g_array_free(blocks, true);
+}
+
+static gboolean tb_perf_map_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    FILE *file = data;
+    const char *name = lookup_symbol(tb->pc);
+
+    fprintf(file, "%" PRIxPTR " %zx tb@0x" TARGET_FMT_lx "%s%s\n",
+            (uintptr_t)tb->tc.ptr, tb->tc.size, tb->pc,
+            name[0] ? " " : "", name);
+    return false;
+}
+
+bool tb_profile_write_perf_map(const char *path, Error **errp)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file) {
+        error_setg_errno(errp, errno, "Could not open '%s'", path);
+        return false;
+    }
+    tb_foreach(tb_perf_map_iter, file);
+    if (fclose(file) != 0) {
+        error_setg_errno(errp, errno, "Could not write '%s'", path);
+        return false;
+    }
+    return true;
+}
@@ -51,6 +51,8 @@
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
+#include "exec/tb-cache.h"
+#include "exec/tb-profile.h"
 #include "translate-all.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
@@ -1281,6 +1283,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
     tcg_ctx->tb_cflags = cflags;
 
+    if (tb_cache_load(cpu, tb, phys_pc, &gen_code_size, &search_size)) {
+        goto code_ready;
+    }
+
 #ifdef CONFIG_PROFILER
     /* includes aborted translations because of exceptions */
     atomic_set(&prof->tb_count1, prof->tb_count1 + 1);
@@ -1327,6 +1333,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+    tb_cache_store(cpu, tb, phys_pc, gen_code_size, search_size);
+    tb_profile_translated(tb);
 
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
@@ -1367,6 +1375,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
 #endif
 
+ code_ready:
     atomic_set(&tcg_ctx->code_gen_ptr, (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN));
@@ -1874,6 +1883,14 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+/* Calls @func on each TB of the code buffer, which is its value.  */
+void tb_foreach(GTraverseFunc func, gpointer data)
+{
+    tb_lock();
+    g_tree_foreach(tb_ctx.tb_tree, func, data);
+    tb_unlock();
+}
+
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
     struct tb_tree_stats tst = {};
@@ -1918,6 +1935,8 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "TB invalidate count %d\n", tb_ctx.tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %zu\n", tlb_flush_count());
     tcg_dump_info(f, cpu_fprintf);
+    dump_tlb_info(f, cpu_fprintf);
+    tb_cache_dump_info(f, cpu_fprintf);
 
     tb_unlock();
 }
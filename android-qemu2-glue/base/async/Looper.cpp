@@ -12,6 +12,8 @@
 #include "android-qemu2-glue/base/async/Looper.h"
 
 #include "android/base/Log.h"
+#include "android/base/Tracing.h"
+#include "android/base/async/PostedCallbackQueue.h"
 #include "android/base/sockets/SocketUtils.h"
 #include "android/base/system/System.h"
 #include "android/emulation/control/vm_operations.h"
@@ -26,6 +28,7 @@ extern "C" {
 }  // extern "C"
 
 #include <list>
+#include <mutex>
 #include <unordered_map>
 #include <utility>
 
@@ -63,6 +66,9 @@ typedef ::android::base::Looper::FdWatch BaseFdWatch;
 // The implementation uses a bottom-half handler to process pending
 // FdWatch instances, see the comment in the declaration of FdWatch
 // below to understand why.
+// Callbacks posted with scheduleCallback() usually come from other threads
+// (gRPC, UI, ...) in bursts. Instead of one bottom-half per callback, they
+// are pushed to a lock-free queue and a single bottom-half runs all of them.
 //
 class QemuLooper : public BaseLooper {
 public:
@@ -72,6 +78,9 @@ public:
         if (mQemuBh) {
             qemu_bh_delete(mQemuBh);
         }
+        if (mCallbackBh) {
+            qemu_bh_delete(mCallbackBh);
+        }
         DCHECK(mPendingFdWatches.empty());
     }
 
@@ -253,6 +262,7 @@ public:
 
     private:
         static void qemuTimerCallbackAdapter(void* opaque) {
+            AEMU_SCOPED_TRACE("QemuLooper::Timer");
             Timer* timer = static_cast<Timer*>(opaque);
             timer->mCallback(timer->mOpaque, timer);
         }
@@ -300,24 +310,14 @@ public:
         QEMUBH* const mBottomHalf;
     };
 
-    class SelfDeletingTask : public Task {
-    public:
-        SelfDeletingTask(Looper* looper, BaseLooper::Task::Callback&& callback)
-            : Task(looper, std::move(callback)) {}
-
-        void run() override {
-            Task::run();
-            delete this;
-        }
-    };
-
     BaseLooper::TaskPtr createTask(TaskCallback&& callback) override {
         return BaseLooper::TaskPtr(new Task(this, std::move(callback)));
     }
 
     void scheduleCallback(BaseLooper::TaskCallback&& callback) override {
-        // Create a task and forget it - it will take care of itself.
-        (new SelfDeletingTask(this, std::move(callback)))->schedule();
+        if (mCallbacks.post(std::move(callback))) {
+            qemu_bh_schedule(callbackBh());
+        }
     }
 
     //
@@ -387,7 +387,29 @@ private:
         }
     }
 
+    // Most loopers never get a callback posted, so their bottom-half is
+    // only created by the first post, from whichever thread it comes.
+    QEMUBH* callbackBh() {
+        std::call_once(mCallbackBhOnce, [this]() {
+            mCallbackBh = qemu_bh_new(&QemuLooper::handleCallbacks, this);
+        });
+        return mCallbackBh;
+    }
+
+    // Called by QEMU on the main loop to run the callbacks queued by
+    // scheduleCallback().
+    static void handleCallbacks(void* opaque) {
+        AEMU_SCOPED_TRACE("QemuLooper::handleCallbacks");
+        QemuLooper* looper = reinterpret_cast<QemuLooper*>(opaque);
+        if (looper->mCallbacks.runPending()) {
+            qemu_bh_schedule(looper->mCallbackBh);
+        }
+    }
+
     QEMUBH* mQemuBh = nullptr;
+    std::once_flag mCallbackBhOnce;
+    QEMUBH* mCallbackBh = nullptr;
+    android::base::PostedCallbackQueue mCallbacks;
     FdWatchSet mFdWatchIterMap;
     FdWatchList mPendingFdWatches;
 };
@@ -221,7 +221,11 @@ static const AndroidPipeHwFuncs android_pipe_hw_funcs = {
         // lookupPipeById()
         [](int id) {
             return (void*)goldfish_pipe_lookup_by_id(id);
-        }
+        },
+        // beginWakeBatch()
+        []() { goldfish_pipe_begin_wake_batch(); },
+        // endWakeBatch()
+        []() { goldfish_pipe_end_wake_batch(); },
 };
 
 // android_pipe_hw_funcs but for virtio-gpu
@@ -319,8 +319,12 @@ static const TypeInfo types[] = {
 
 DEFINE_TYPES(types)
 
+int android_virtio_input_accepts(int type) {
+    return type == EV_ABS || type == EV_SYN || type == EV_SW;
+}
+
 int android_virtio_input_send(int type, int code, int value, int displayId) {
-    if (type != EV_ABS && type != EV_SYN && type != EV_SW) {
+    if (!android_virtio_input_accepts(type)) {
         return 0;
     }
     if (displayId < 0 || displayId >= VIRTIO_INPUT_MAX_NUM) {
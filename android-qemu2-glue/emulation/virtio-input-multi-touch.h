@@ -21,6 +21,9 @@ ANDROID_BEGIN_HEADER
 /* Maximum number of virtio input devices*/
 #define VIRTIO_INPUT_MAX_NUM 11
 
+/* Returns true if events of |type| are handled by the virtio input device,
+ * i.e. whether android_virtio_input_send() will take them. */
+extern int android_virtio_input_accepts(int type);
 extern int android_virtio_input_send(int type,
                                      int code,
                                      int value,
@@ -12,11 +12,13 @@
 #include "android-qemu2-glue/net-android.h"
 
 #include "android/android.h"
+#include "android/featurecontrol/feature_control.h"
 #include "android/network/constants.h"
 #include "android/network/globals.h"
 #include "android/telephony/modem_driver.h"
 #include "android/shaper.h"
 #include "android/tcpdump.h"
+#include "android/utils/debug.h"
 
 extern "C" {
 #include "qemu/osdep.h"
@@ -34,9 +36,9 @@ void android_qemu_init_slirp_shapers(void)
     }
     android_net_delay_in = netdelay_create(
             [](void* data, size_t size, void* opaque) {
-                net_slirp_receive_raw(s_opaque,
-                                      static_cast<const uint8_t*>(data),
-                                      static_cast<int>(size));
+                net_slirp_receive_shaped(opaque,
+                                         static_cast<const uint8_t*>(data),
+                                         size);
             });
 
     android_net_shaper_in = netshaper_create(1,
@@ -68,12 +70,18 @@ void android_qemu_init_slirp_shapers(void)
                                    (char*)data, len, s_opaque);
             },
             android_net_shaper_in,
-            [](void* opaque, const void* data, int len) {
+            [](void* opaque, const void* data, int len, void* frame_opaque) {
                 if (qemu_tcpdump_active) {
                     qemu_tcpdump_packet(data, len);
                 }
 
                 netshaper_send_aux(static_cast<NetShaper>(opaque),
-                                   (void*)data, len, s_opaque);
+                                   (void*)data, len, frame_opaque);
             });
+
+    if (feature_is_enabled(kFeature_SlirpThread) &&
+        !net_slirp_start_thread()) {
+        dwarning("Could not poll the network sockets from a thread, "
+                 "keeping them in the main loop");
+    }
 }
@@ -12,6 +12,7 @@
 #include "android-qemu2-glue/proxy/slirp_proxy.h"
 
 #include "android/base/Log.h"
+#include "android/base/async/ThreadLooper.h"
 #include "android/base/memory/LazyInstance.h"
 #include "android/proxy/proxy_common.h"
 #include "android/utils/sockets.h"
@@ -27,28 +28,41 @@ extern "C" {
 #include <netinet/in.h>
 #endif
 
+#include <stdint.h>
 #include <unordered_map>
 #include <utility>
 
 extern "C" const char* op_http_proxy;
 
+using android::base::ThreadLooper;
+
 namespace {
 
-// NOTE: The SLIRP stack only runs in the main thread, so don't
-//       use a mutex to protect global variables from multiple threads.
+// NOTE: The proxy manager only runs in the main thread. The SLIRP stack may
+//       run in a thread of its own, it then calls try_connect() and remove()
+//       from there: the proxy manager calls are posted to the main thread,
+//       and the maps below are only used with the SLIRP lock held.
 
 struct Globals {
-    // Implement a global map |connect_opaque| -> { |af|, |connect_func| }
-    // to be used in the android_tcp_proxy_event() function to map opaque
-    // handles to the appropriate callback and address family.
+    // Every connection gets an id of its own, which is what the proxy
+    // manager hands back to android_tcp_proxy_event(). The |connect_opaque|
+    // of a connection that was removed can be reused by the next one before
+    // the events of the first one are all delivered.
     struct Info {
         Info() = default;
-        Info(int af_, SlirpProxyConnectFunc* connect_func_) : af(af_), connect_func(connect_func_) {}
+        Info(void* connect_opaque_, int af_,
+             SlirpProxyConnectFunc* connect_func_)
+            : connect_opaque(connect_opaque_),
+              af(af_),
+              connect_func(connect_func_) {}
+        void* connect_opaque = nullptr;
         int af = 0;
         SlirpProxyConnectFunc* connect_func = nullptr;
     };
-    using MapType = std::unordered_map<void*, Info>;
+    using MapType = std::unordered_map<uintptr_t, Info>;
     MapType mMap;
+    std::unordered_map<void*, uintptr_t> mIds;
+    uintptr_t mNextId = 1;
 };
 
 android::base::LazyInstance<Globals> sGlobals = LAZY_INSTANCE_INIT;
@@ -58,13 +72,23 @@ android::base::LazyInstance<Globals> sGlobals = LAZY_INSTANCE_INIT;
 using MapType = Globals::MapType;
 
 static void android_tcp_proxy_event(void* opaque, int fd, ProxyEvent event) {
+    const uintptr_t id = reinterpret_cast<uintptr_t>(opaque);
+    slirp_proxy_lock();
     MapType* map = &sGlobals->mMap;
-    auto it = map->find(opaque);
-    DCHECK(it != map->end());
+    auto it = map->find(id);
+    if (it == map->end()) {
+        // Removed by the SLIRP thread while this event was on its way.
+        slirp_proxy_unlock();
+        if (fd >= 0) {
+            socket_close(fd);
+        }
+        return;
+    }
     if (event != PROXY_EVENT_CONNECTED) {
         fd = -1;
     }
-    it->second.connect_func(opaque, fd, it->second.af);
+    it->second.connect_func(it->second.connect_opaque, fd, it->second.af);
+    slirp_proxy_unlock();
 }
 
 static bool android_proxy_try_connect(const struct sockaddr_storage *addr,
@@ -89,22 +113,50 @@ static bool android_proxy_try_connect(const struct sockaddr_storage *addr,
             return false;
     }
 
-    MapType* map = &sGlobals->mMap;
-    (*map)[connect_opaque] = Globals::Info({af, connect_func});
+    const uintptr_t id = sGlobals->mNextId++;
+    void* eventOpaque = reinterpret_cast<void*>(id);
+    sGlobals->mMap[id] = Globals::Info(connect_opaque, af, connect_func);
+    sGlobals->mIds[connect_opaque] = id;
+
+    if (slirp_proxy_threaded()) {
+        // The outcome is only known in the main thread, a connection the
+        // proxy can't take is reported as refused.
+        ThreadLooper::runOnMainLooper([sockaddr, eventOpaque]() {
+            if (proxy_manager_add(&sockaddr, SOCKET_STREAM,
+                                  android_tcp_proxy_event, eventOpaque)) {
+                android_tcp_proxy_event(eventOpaque, -1,
+                                        PROXY_EVENT_CONNECTION_REFUSED);
+            }
+        });
+        return true;
+    }
 
     if (!proxy_manager_add(&sockaddr, SOCKET_STREAM, android_tcp_proxy_event,
-                           connect_opaque)) {
+                           eventOpaque)) {
         return true;
     }
 
     // No proxy possible here, to remove from map.
-    map->erase(connect_opaque);
+    sGlobals->mMap.erase(id);
+    sGlobals->mIds.erase(connect_opaque);
     return false;
 }
 
 static void android_proxy_remove(void* connect_opaque) {
-    sGlobals->mMap.erase(connect_opaque);
-    proxy_manager_del(connect_opaque);
+    auto it = sGlobals->mIds.find(connect_opaque);
+    if (it == sGlobals->mIds.end()) {
+        return;
+    }
+    void* eventOpaque = reinterpret_cast<void*>(it->second);
+    sGlobals->mMap.erase(it->second);
+    sGlobals->mIds.erase(it);
+
+    if (slirp_proxy_threaded()) {
+        ThreadLooper::runOnMainLooper(
+                [eventOpaque]() { proxy_manager_del(eventOpaque); });
+    } else {
+        proxy_manager_del(eventOpaque);
+    }
 }
 
 static const struct SlirpProxyOps android_proxy_ops = {
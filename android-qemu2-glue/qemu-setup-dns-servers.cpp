@@ -15,8 +15,12 @@
 #include "android-qemu2-glue/qemu-setup.h"
 
 #include "android/base/Log.h"
+#include "android/base/StringFormat.h"
+#include "android/base/files/PathUtils.h"
 #include "android/base/network/IpAddress.h"
 #include "android/base/network/Dns.h"
+#include "android/emulation/ConfigDirs.h"
+#include "android/featurecontrol/feature_control.h"
 #include "android/utils/debug.h"
 
 extern "C" {
@@ -25,6 +29,8 @@ extern "C" {
 #include "slirp/libslirp.h"
 }  // extern "C"
 
+#include <functional>
+#include <string>
 #include <vector>
 
 #include <errno.h>
@@ -33,9 +39,13 @@ extern "C" {
 
 using android::base::IpAddress;
 using android::base::Dns;
+using android::base::PathUtils;
+using android::base::StringFormat;
 
 static int s_num_dns_server_addresses = 0;
 static sockaddr_storage s_dns_server_addresses[MAX_DNS_SERVERS] = {};
+// The answers of different servers aren't mixed up in the DNS cache.
+static std::string s_dns_cache_name = "dns-cache";
 
 // Convert IpAddress instance |src| into a sockaddr_storage |dst|.
 // Return true on success, false on failure (invalid IpAddress type).
@@ -131,6 +141,8 @@ bool qemu_android_emulation_setup_dns_servers(const char* dns_servers,
 
     // Save it for qemu_android_emulator_init_slirp().
     s_num_dns_server_addresses = count;
+    s_dns_cache_name = StringFormat("dns-cache-%zx",
+                                    std::hash<std::string>()(dns_servers));
     memcpy(s_dns_server_addresses, &server_addresses[0],
            count * sizeof(server_addresses[0]));
 
@@ -139,8 +151,16 @@ bool qemu_android_emulation_setup_dns_servers(const char* dns_servers,
 }
 
 void qemu_android_emulation_init_slirp(void) {
-    slirp_init_custom_dns_servers(static_cast<Slirp*>(net_slirp_state()),
-                                  s_dns_server_addresses,
+    auto slirp = static_cast<Slirp*>(net_slirp_state());
+    slirp_init_custom_dns_servers(slirp, s_dns_server_addresses,
                                   s_num_dns_server_addresses);
+
+    // Shared by the emulators running the same tests one after the other,
+    // or side by side.
+    if (feature_is_enabled(kFeature_SlirpDnsCache)) {
+        const std::string path = PathUtils::join(
+                android::ConfigDirs::getUserDirectory(), s_dns_cache_name);
+        slirp_dns_cache_enable(slirp, path.c_str());
+    }
 }
 
@@ -51,8 +51,11 @@
 #include "android/android.h"
 #include "android/avd/info.h"
 #include "android/base/CpuUsage.h"
+#include "android/base/LatencyTracker.h"
 #include "android/base/Log.h"
+#include "android/base/files/IniFile.h"
 #include "android/base/files/MemStream.h"
+#include "android/base/files/PathUtils.h"
 #include "android/base/memory/ScopedPtr.h"
 #include "android/cmdline-option.h"
 #include "android/console.h"
@@ -64,6 +67,7 @@
 #include "android/emulation/AudioOutputEngine.h"
 #include "android/emulation/DmaMap.h"
 #include "android/emulation/QemuMiscPipe.h"
+#include "android/emulation/ConfigDirs.h"
 #include "android/emulation/VmLock.h"
 #include "android/emulation/address_space_device.h"
 #include "android/emulation/address_space_device.hpp"
@@ -84,6 +88,7 @@
 #include "android/snapshot/interface.h"
 #include "android/utils/Random.h"
 #include "android/utils/debug.h"
+#include "android/version.h"
 #include "snapshot_service.grpc.pb.h"
 
 #ifdef ANDROID_WEBRTC
@@ -92,10 +97,13 @@
 
 extern "C" {
 
+#include "qemu/osdep.h"
 #include "android/proxy/proxy_int.h"
+#include "exec/cpu-common.h"
+#include "exec/tb-cache.h"
 #include "qemu/abort.h"
+#include "qemu/latency.h"
 #include "qemu/main-loop.h"
-#include "qemu/osdep.h"
 #include "qemu/thread.h"
 #include "sysemu/device_tree.h"
 #include "sysemu/sysemu.h"
@@ -377,6 +385,44 @@ int qemu_setup_grpc() {
     return port;
 }
 
+// Keeps the code translated by TCG across boots of the same system image.
+static void setupTbCache() {
+    const auto buildProps = avdInfo_getBuildProperties(android_avdInfo);
+    android::base::IniFile ini((const char*)buildProps->data, buildProps->size);
+    auto build = ini.getString("ro.build.fingerprint", "");
+    if (build.empty()) {
+        build = ini.getString("ro.build.display.id", "");
+    }
+    if (build.empty()) {
+        return;
+    }
+    android::base::ScopedCPtr<const char> arch(
+            avdInfo_getTargetCpuArch(android_avdInfo));
+    // Another emulator build may lay out the CPU state or the helpers in
+    // another way, with the same QEMU version.
+    const std::string key = build + "|" + (arch ? arch.get() : "") + "|" +
+                            EMULATOR_FULL_VERSION_STRING "|" EMULATOR_CL_SHA1;
+    const std::string dir = PathUtils::join(
+            android::ConfigDirs::getUserDirectory(), "tb-cache");
+    if (!tb_cache_init(dir.c_str(), key.c_str())) {
+        VERBOSE_PRINT(init, "Translation cache not used by this accelerator");
+    }
+}
+
+// Feeds the latencies measured by QEMU to the histograms of LatencyTracker.
+static void recordQemuLatency(QemuLatency which, int64_t ns) {
+    using Area = android::base::LatencyTracker::Area;
+    static constexpr Area kAreas[] = {
+            Area::MainLoopIteration,
+            Area::BqlHold,
+            Area::VcpuExit,
+    };
+    static_assert(sizeof(kAreas) / sizeof(kAreas[0]) == QEMU_LATENCY__MAX,
+                  "Every QemuLatency needs an area");
+    android::base::LatencyTracker::get()->record(kAreas[which],
+                                                 std::max<int64_t>(ns, 0));
+}
+
 bool qemu_android_emulation_setup() {
     android_qemu_init_slirp_shapers();
 
@@ -425,6 +471,20 @@ bool qemu_android_emulation_setup() {
     if (!android_qemu_mode)
         return true;
 
+    if (feature_is_enabled(kFeature_TcgTbCache)) {
+        setupTbCache();
+    }
+
+    if (feature_is_enabled(kFeature_LatencyHistograms)) {
+        qemu_set_latency_recorder(recordQemuLatency);
+    }
+
+    // Incremental snapshot saves trust the dirty log only if they know
+    // where the host writes to the guest RAM.
+    if (feature_is_enabled(kFeature_SnapshotDirtyPageTracking)) {
+        qemu_ram_track_host_mappings();
+    }
+
     android::base::ScopedCPtr<const char> arch(
             avdInfo_getTargetCpuArch(android_avdInfo));
     const bool isX86 =
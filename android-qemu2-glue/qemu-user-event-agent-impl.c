@@ -87,11 +87,44 @@ static void user_event_generic(SkinGenericEventCode event) {
     }
 }
 
-static void user_event_generic_events(SkinGenericEventCode* events, int count) {
+/*
+ * Events that don't go to virtio input are handed to goldfish_events in
+ * batches, so that a whole multi-touch frame (or gesture) is delivered to the
+ * guest with one interrupt instead of one per event. The pending batch is
+ * flushed before any event goes to virtio input, so that events reach the
+ * guest in the order they were given. Returns the number of dropped events.
+ */
+static int user_event_generic_events(SkinGenericEventCode* events, int count) {
+    if (count <= 0) {
+        return 0;
+    }
+
+    const bool virtio = feature_is_enabled(kFeature_VirtioInput);
+    GoldfishEvent* batch = g_new(GoldfishEvent, count);
+    int batch_count = 0;
+    int dropped = 0;
     int i;
     for (i = 0; i < count; i++) {
-        user_event_generic(events[i]);
+        if (virtio && android_virtio_input_accepts(events[i].type)) {
+            if (batch_count) {
+                dropped += goldfish_event_send_batch(batch, batch_count);
+                batch_count = 0;
+            }
+            android_virtio_input_send(events[i].type, events[i].code,
+                                      events[i].value, events[i].displayId);
+            continue;
+        }
+        batch[batch_count].type = events[i].type;
+        batch[batch_count].code = events[i].code;
+        batch[batch_count].value = events[i].value;
+        batch_count++;
+    }
+
+    if (batch_count) {
+        dropped += goldfish_event_send_batch(batch, batch_count);
     }
+    g_free(batch);
+    return dropped;
 }
 
 static void user_event_mouse(int dx,
@@ -28,6 +28,7 @@
 #include "android/emulation/VmLock.h"                 // for RecursiveScoped...
 #include "android/emulation/control/callbacks.h"      // for LineConsumerCal...
 #include "android/emulation/control/vm_operations.h"  // for SnapshotCallbacks
+#include "android/featurecontrol/feature_control.h"   // for feature_is_enabled
 #include "android/snapshot/MemoryWatch.h"             // for set_address_tra...
 #include "android/snapshot/PathUtils.h"               // for getSnapshotBaseDir
 #include "android/snapshot/Snapshotter.h"             // for Snapshotter
@@ -77,6 +78,7 @@ extern "C" {
 #include <algorithm>                                  // for find_if
 #include <cstdio>                                     // for NULL, rename
 #include <string>                                     // for string, operator+
+#include <unordered_map>                              // for unordered_map
 #include <vector>                                     // for vector
 
 /* set to 1 for very verbose debugging */
@@ -506,12 +508,89 @@ static bool qemu_snapshot_remap(bool shared,
 static SnapshotCallbacks sSnapshotCallbacks = {};
 static void* sSnapshotCallbacksOpaque = nullptr;
 
+// The pages the guest wrote to since startDirtyPageTracking(), per RAM block
+// offset, one bit per android::snapshot::kDefaultPageSize page.
+static bool sDirtyPageTracking = false;
+static std::unordered_map<ram_addr_t, std::vector<unsigned long>> sDirtyPages;
+static constexpr size_t kBitsPerLong = sizeof(unsigned long) * 8;
+
+static bool start_dirty_page_tracking() {
+    // The other hypervisors do not tell us what the guest wrote to. Without
+    // the host mappings tracked since the start, the host writes are unknown.
+    if (!feature_is_enabled(kFeature_SnapshotDirtyPageTracking) ||
+        (!kvm_enabled() && !tcg_enabled())) {
+        return false;
+    }
+    android::RecursiveScopedVmLock vmlock;
+    qemu_ram_dirty_log_start();
+    sDirtyPages.clear();
+    sDirtyPageTracking = true;
+    return true;
+}
+
+static void stop_dirty_page_tracking() {
+    android::RecursiveScopedVmLock vmlock;
+    if (sDirtyPageTracking) {
+        qemu_ram_dirty_log_stop();
+        sDirtyPages.clear();
+        sDirtyPageTracking = false;
+    }
+}
+
+// Moves the written pages out of the QEMU dirty log, which RAM migration is
+// about to reset.
+static void collect_dirty_pages() {
+    qemu_ram_dirty_log_collect(
+            android::snapshot::kDefaultPageSize,
+            [](const char* block_name, ram_addr_t offset, ram_addr_t length,
+               void* opaque) {
+                auto& bitmap = sDirtyPages[offset];
+                const size_t pages =
+                        (length + android::snapshot::kDefaultPageSize - 1) /
+                        android::snapshot::kDefaultPageSize;
+                bitmap.resize((pages + kBitsPerLong - 1) / kBitsPerLong);
+                return bitmap.data();
+            },
+            nullptr);
+}
+
+static bool get_dirty_pages(int64_t ramOffset,
+                            int64_t size,
+                            uint64_t* bitmap) {
+    android::RecursiveScopedVmLock vmlock;
+    if (!sDirtyPageTracking) {
+        return false;
+    }
+    auto it = sDirtyPages.find(ram_addr_t(ramOffset));
+    if (it == sDirtyPages.end()) {
+        return false;
+    }
+
+    const auto& dirty = it->second;
+    const size_t pages = std::min<size_t>(
+            size / android::snapshot::kDefaultPageSize,
+            dirty.size() * kBitsPerLong);
+    for (size_t page = 0; page < pages; ++page) {
+        if (dirty[page / kBitsPerLong] & (1UL << (page % kBitsPerLong))) {
+            bitmap[page / 64] |= 1ULL << (page % 64);
+        }
+    }
+    return true;
+}
+
 static int onSaveVmStart(const char* name) {
+    if (sDirtyPageTracking) {
+        collect_dirty_pages();
+    }
     return sSnapshotCallbacks.ops[SNAPSHOT_SAVE].onStart(
             sSnapshotCallbacksOpaque, name);
 }
 
 static void onSaveVmEnd(const char* name, int res) {
+    // RAM migration turns the dirty log off when it is done.
+    if (sDirtyPageTracking) {
+        qemu_ram_dirty_log_start();
+    }
     sSnapshotCallbacks.ops[SNAPSHOT_SAVE].onEnd(sSnapshotCallbacksOpaque, name,
                                                 res);
 }
@@ -526,6 +605,13 @@ static bool saveVmQueryCanceled(const char* name) {
             sSnapshotCallbacksOpaque, name);
 }
 
+static void onSaveVmPhase(const char* name) {
+    if (sSnapshotCallbacks.ops[SNAPSHOT_SAVE].onPhase) {
+        sSnapshotCallbacks.ops[SNAPSHOT_SAVE].onPhase(sSnapshotCallbacksOpaque,
+                                                      name);
+    }
+}
+
 static int onLoadVmStart(const char* name) {
     return sSnapshotCallbacks.ops[SNAPSHOT_LOAD].onStart(
             sSnapshotCallbacksOpaque, name);
@@ -546,6 +632,13 @@ static bool loadVmQueryCanceled(const char* name) {
             sSnapshotCallbacksOpaque, name);
 }
 
+static void onLoadVmPhase(const char* name) {
+    if (sSnapshotCallbacks.ops[SNAPSHOT_LOAD].onPhase) {
+        sSnapshotCallbacks.ops[SNAPSHOT_LOAD].onPhase(sSnapshotCallbacksOpaque,
+                                                      name);
+    }
+}
+
 static int onDelVmStart(const char* name) {
     return sSnapshotCallbacks.ops[SNAPSHOT_DEL].onStart(
             sSnapshotCallbacksOpaque, name);
@@ -568,9 +661,9 @@ static bool delVmQueryCanceled(const char* name) {
 
 static const QEMUSnapshotCallbacks sQemuSnapshotCallbacks = {
         .savevm = {onSaveVmStart, onSaveVmEnd, onSaveVmQuickFail,
-                   saveVmQueryCanceled},
+                   saveVmQueryCanceled, onSaveVmPhase},
         .loadvm = {onLoadVmStart, onLoadVmEnd, onLoadVmQuickFail,
-                   loadVmQueryCanceled},
+                   loadVmQueryCanceled, onLoadVmPhase},
         .delvm = {onDelVmStart, onDelVmEnd, onDelVmQuickFail,
                   delVmQueryCanceled}};
 
@@ -964,6 +1057,9 @@ static const QAndroidVmOperations sQAndroidVmOperations = {
         .hostmemUnregister = android_emulation_hostmem_unregister,
         .hostmemGetInfo = android_emulation_hostmem_get_info,
         .getRunState = qemu_get_runstate,
+        .startDirtyPageTracking = start_dirty_page_tracking,
+        .stopDirtyPageTracking = stop_dirty_page_tracking,
+        .getDirtyPages = get_dirty_pages,
 };
 
 const QAndroidVmOperations* const gQAndroidVmOperations =
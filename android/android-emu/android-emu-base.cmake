@@ -22,8 +22,10 @@ android_add_library(
       android/base/CpuUsage.cpp
       android/base/Debug.cpp
       android/base/GLObjectCounter.cpp
+      android/base/HdrHistogram.cpp
       android/base/IOVector.cpp
       android/base/JsonWriter.cpp
+      android/base/LatencyTracker.cpp
       android/base/LayoutResolver.cpp
       android/base/Log.cpp
       android/base/Pool.cpp
@@ -192,6 +192,7 @@ set(android-emu-common
     android/opengl/EmuglBackendList.cpp
     android/opengl/EmuglBackendScanner.cpp
     android/opengl/emugl_config.cpp
+    android/opengl/FrameHub.cpp
     android/opengl/GpuFrameBridge.cpp
     android/opengl/GLProcessPipe.cpp
     android/opengl/gpuinfo.cpp
@@ -227,6 +228,7 @@ set(android-emu-common
     android/snapshot/interface.cpp
     android/snapshot/Loader.cpp
     android/snapshot/MemoryWatch_common.cpp
+    android/snapshot/PageScan.cpp
     android/snapshot/PathUtils.cpp
     android/snapshot/Hierarchy.cpp
     android/snapshot/Quickboot.cpp
@@ -235,6 +237,7 @@ set(android-emu-common
     android/snapshot/RamSnapshotTesting.cpp
     android/snapshot/Saver.cpp
     android/snapshot/Snapshot.cpp
+    android/snapshot/SnapshotProfile.cpp
     android/snapshot/Snapshotter.cpp
     android/snapshot/TextureLoader.cpp
     android/snapshot/TextureSaver.cpp
@@ -571,6 +574,7 @@ set(android-emu-min
     android/opengl/EmuglBackendList.cpp
     android/opengl/EmuglBackendScanner.cpp
     android/opengl/emugl_config.cpp
+    android/opengl/FrameHub.cpp
     android/opengl/GpuFrameBridge.cpp
     android/opengl/GLProcessPipe.cpp
     android/opengl/gpuinfo.cpp
@@ -588,6 +592,7 @@ set(android-emu-min
     android/snapshot/interface.cpp
     android/snapshot/Loader.cpp
     android/snapshot/MemoryWatch_common.cpp
+    android/snapshot/PageScan.cpp
     android/snapshot/PathUtils.cpp
     android/snapshot/Hierarchy.cpp
     android/snapshot/Quickboot.cpp
@@ -596,6 +601,7 @@ set(android-emu-min
     android/snapshot/RamSnapshotTesting.cpp
     android/snapshot/Saver.cpp
     android/snapshot/Snapshot.cpp
+    android/snapshot/SnapshotProfile.cpp
     android/snapshot/Snapshotter.cpp
     android/snapshot/TextureLoader.cpp
     android/snapshot/TextureSaver.cpp
@@ -758,6 +764,7 @@ set(android-emu_unittests_common
     android/base/async/AsyncSocketServer_unittest.cpp
     # bug: 153381599: disabled until flakiness is addressed
     android/base/async/CallbackRegistry_unittest.cpp
+    android/base/async/PostedCallbackQueue_unittest.cpp
     android/base/async/RecurrentTask_unittest.cpp
     android/base/async/ScopedSocketWatch_unittest.cpp
     android/base/async/SubscriberList_unittest.cpp
@@ -765,6 +772,7 @@ set(android-emu_unittests_common
     android/base/containers/CircularBuffer_unittest.cpp
     android/base/containers/EntityManager_unittest.cpp
     android/base/containers/Lookup_unittest.cpp
+    android/base/containers/MpscQueue_unittest.cpp
     android/base/containers/SmallVector_unittest.cpp
     android/base/containers/StaticMap_unittest.cpp
     android/base/EintrWrapper_unittest.cpp
@@ -779,6 +787,7 @@ set(android-emu_unittests_common
     android/base/files/Stream_unittest.cpp
     android/base/files/StreamSerializing_unittest.cpp
     android/base/FunctionView_unittest.cpp
+    android/base/HdrHistogram_unittest.cpp
     android/base/IOVector_unittest.cpp
     android/base/JsonWriter_unittest.cpp
     android/base/Log_unittest.cpp
@@ -825,6 +834,7 @@ set(android-emu_unittests_common
     android/base/threads/ParallelTask_unittest.cpp
     android/base/threads/Thread_unittest.cpp
     android/base/threads/ThreadStore_unittest.cpp
+    android/base/Tracing_unittest.cpp
     android/base/TypeTraits_unittest.cpp
     android/base/Uri_unittest.cpp
     android/base/Uuid_unittest.cpp
@@ -902,6 +912,7 @@ set(android-emu_unittests_common
     android/opengl/EmuglBackendList_unittest.cpp
     android/opengl/EmuglBackendScanner_unittest.cpp
     android/opengl/emugl_config_unittest.cpp
+    android/opengl/FrameHub_unittest.cpp
     android/opengl/GpuFrameBridge_unittest.cpp
     android/opengl/gpuinfo_unittest.cpp
     android/physics/AmbientEnvironment_unittest.cpp
@@ -911,9 +922,12 @@ set(android-emu_unittests_common
     android/proxy/ProxyUtils_unittest.cpp
     android/qt/qt_path_unittest.cpp
     android/qt/qt_setup_unittest.cpp
+    android/shaper_unittest.cpp
+    android/snapshot/PageScan_unittest.cpp
     android/snapshot/RamLoader_unittest.cpp
     android/snapshot/RamSaver_unittest.cpp
     android/snapshot/RamSnapshot_unittest.cpp
+    android/snapshot/SnapshotProfile_unittest.cpp
     android/snapshot/Snapshot_unittest.cpp
     android/telephony/gsm_unittest.cpp
     android/telephony/modem_unittest.cpp
@@ -988,6 +1002,21 @@ target_link_libraries(
   android-emu_unittests PRIVATE android-emu android-mock-vm-operations gtest
                                 gmock gtest_main)
 
+# Add the snapshot benchmark
+android_add_executable(
+  TARGET android-emu-snapshot_benchmark NODISTRIBUTE
+  SRC # cmake-format: sortable
+      android/snapshot/PageScan_benchmark.cpp)
+target_link_libraries(android-emu-snapshot_benchmark PRIVATE android-emu
+                                                             emulator-gbench)
+
+# Add the camera format conversion benchmark
+android_add_executable(
+  TARGET android-emu-camera_benchmark NODISTRIBUTE
+  SRC # cmake-format: sortable
+      android/camera/CameraFormatConverters_benchmark.cpp)
+target_link_libraries(android-emu-camera_benchmark PRIVATE android-emu
+                                                           emulator-gbench)
 
 android_add_executable(
   NODISTRIBUTE TARGET studio_discovery_tester
@@ -13,12 +13,14 @@ set(ANDROID_LIBUI_HEADLESS_SRC_FILES
     android/mp4/SensorLocationEventProvider.cpp
     android/mp4/VideoMetadataProvider.cpp
     android/recording/audio/AudioProducer.cpp
+    android/recording/codecs/audio/AudioStreamEncoder.cpp
     android/recording/codecs/audio/VorbisCodec.cpp
     android/recording/codecs/video/VP9Codec.cpp
     android/recording/FfmpegRecorder.cpp
     android/recording/Frame.cpp
     android/recording/GifConverter.cpp
     android/recording/screen-recorder.cpp
+    android/recording/video/FrameConverter.cpp
     android/recording/video/GuestReadbackWorker.cpp
     android/recording/video/player/Clock.cpp
     android/recording/video/player/FrameQueue.cpp
@@ -59,12 +61,14 @@ set(ANDROID_LIBUI_SRC_FILES
     android/mp4/SensorLocationEventProvider.cpp
     android/mp4/VideoMetadataProvider.cpp
     android/recording/audio/AudioProducer.cpp
+    android/recording/codecs/audio/AudioStreamEncoder.cpp
     android/recording/codecs/audio/VorbisCodec.cpp
     android/recording/codecs/video/VP9Codec.cpp
     android/recording/FfmpegRecorder.cpp
     android/recording/Frame.cpp
     android/recording/GifConverter.cpp
     android/recording/screen-recorder.cpp
+    android/recording/video/FrameConverter.cpp
     android/recording/video/GuestReadbackWorker.cpp
     android/recording/video/player/Clock.cpp
     android/recording/video/player/FrameQueue.cpp
@@ -399,9 +403,14 @@ android_add_test(
       android/mp4/SensorLocationEventProvider_test.cpp
       android/mp4/VideoMetadataProvider_test.cpp
       android/recording/FfmpegRecorder.cpp
+      android/recording/codecs/audio/AudioStreamEncoder.cpp
+      android/recording/test/AudioStreamEncoder_unittest.cpp
       android/recording/test/DummyAudioProducer.cpp
       android/recording/test/DummyVideoProducer.cpp
       android/recording/test/FfmpegRecorder_unittest.cpp
+      android/recording/test/FrameConverter_unittest.cpp
+      android/recording/test/SharedFrameRing_unittest.cpp
+      android/recording/video/FrameConverter.cpp
       android/skin/keycode-buffer_unittest.cpp
       android/skin/keycode_unittest.cpp
       android/skin/qt/native-keyboard-event-handler_unittest.cpp
@@ -0,0 +1,185 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/HdrHistogram.h"
+
+#include "android/base/ArraySize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace android {
+namespace base {
+
+static int highestBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// The rank of the sample at |percentile| among |total| ones, from 1.
+static uint64_t percentileRank(double percentile, uint64_t total) {
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    const auto rank =
+            static_cast<uint64_t>(std::ceil(percentile / 100.0 * total));
+    return std::max<uint64_t>(rank, 1);
+}
+
+HdrHistogram::HdrHistogram() {
+    reset();
+}
+
+// static
+size_t HdrHistogram::bucketIndex(uint64_t value) {
+    if (value < 2 * kSubBuckets) {
+        return static_cast<size_t>(value);
+    }
+    const int shift = highestBit(value) - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + (value >> shift) - kSubBuckets;
+}
+
+// static
+uint64_t HdrHistogram::bucketLowest(size_t index) {
+    if (index < 2 * kSubBuckets) {
+        return index;
+    }
+    const int shift = static_cast<int>(index / kSubBuckets) - 1;
+    return (uint64_t(index % kSubBuckets) + kSubBuckets) << shift;
+}
+
+// static
+uint64_t HdrHistogram::bucketHighest(size_t index) {
+    if (index < 2 * kSubBuckets) {
+        return index;
+    }
+    const int shift = static_cast<int>(index / kSubBuckets) - 1;
+    return bucketLowest(index) + ((uint64_t(1) << shift) - 1);
+}
+
+void HdrHistogram::record(uint64_t value) {
+    mCounts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = mMin.load(std::memory_order_relaxed);
+    while (value < current &&
+           !mMin.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+    }
+    current = mMax.load(std::memory_order_relaxed);
+    while (value > current &&
+           !mMax.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t HdrHistogram::count() const {
+    return mCount.load(std::memory_order_relaxed);
+}
+
+uint64_t HdrHistogram::min() const {
+    const uint64_t value = mMin.load(std::memory_order_relaxed);
+    return value == std::numeric_limits<uint64_t>::max() ? 0 : value;
+}
+
+uint64_t HdrHistogram::max() const {
+    return mMax.load(std::memory_order_relaxed);
+}
+
+double HdrHistogram::mean() const {
+    const uint64_t samples = count();
+    return samples ? double(mSum.load(std::memory_order_relaxed)) / samples
+                   : 0;
+}
+
+uint64_t HdrHistogram::valueAtPercentile(double percentile) const {
+    std::array<uint64_t, kBucketCount> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        counts[i] = mCounts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (!total) {
+        return 0;
+    }
+
+    const uint64_t rank = percentileRank(percentile, total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucketHighest(i), max());
+        }
+    }
+    return max();
+}
+
+HdrHistogram::Summary HdrHistogram::summary() const {
+    Summary result;
+    std::array<uint64_t, kBucketCount> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        counts[i] = mCounts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (!total) {
+        return result;
+    }
+
+    result.count = total;
+    result.min = min();
+    result.max = max();
+    result.mean = mean();
+
+    struct Target {
+        uint64_t rank;
+        uint64_t* value;
+    };
+    const Target targets[] = {
+            {percentileRank(50, total), &result.p50},
+            {percentileRank(90, total), &result.p90},
+            {percentileRank(99, total), &result.p99},
+            {percentileRank(99.9, total), &result.p999},
+    };
+    size_t next = 0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size() && next < arraySize(targets); ++i) {
+        seen += counts[i];
+        while (next < arraySize(targets) && seen >= targets[next].rank) {
+            *targets[next].value = std::min(bucketHighest(i), result.max);
+            ++next;
+        }
+    }
+    return result;
+}
+
+void HdrHistogram::reset() {
+    for (auto& bucket : mCounts) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mSum.store(0, std::memory_order_relaxed);
+    mMin.store(std::numeric_limits<uint64_t>::max(),
+               std::memory_order_relaxed);
+    mMax.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace base
+}  // namespace android
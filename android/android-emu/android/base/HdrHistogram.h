@@ -0,0 +1,89 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace android {
+namespace base {
+
+// A histogram of unsigned values, such as latencies in nanoseconds, in the
+// manner of HdrHistogram: each power of two is split in kSubBuckets buckets
+// of the same width, so that a value is known within 1/kSubBuckets of itself
+// whatever its magnitude, with a fixed amount of memory.
+//
+// record() is lock-free and can be called from any number of threads.
+// Readers may run at the same time: they see each sample either entirely
+// or not at all in the bucket counts, which is what the percentiles are
+// computed from.
+class HdrHistogram {
+    DISALLOW_COPY_ASSIGN_AND_MOVE(HdrHistogram);
+
+public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    // Values below 2 * kSubBuckets have a bucket each, then every power of
+    // two up to 2^63 gets kSubBuckets of them.
+    static constexpr int kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    // The percentiles the summaries report.
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+        double mean = 0;
+        uint64_t p50 = 0;
+        uint64_t p90 = 0;
+        uint64_t p99 = 0;
+        uint64_t p999 = 0;
+    };
+
+    HdrHistogram();
+
+    void record(uint64_t value);
+
+    // Number of samples, and the extremes, 0 while there are none.
+    uint64_t count() const;
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+
+    // Returns the highest value of the bucket holding the sample at
+    // |percentile| (in [0, 100]), bounded by max(); 0 without samples.
+    uint64_t valueAtPercentile(double percentile) const;
+
+    // Same as the above for the percentiles of Summary, in a single pass.
+    Summary summary() const;
+
+    // Drops all the samples. Samples recorded at the same time may be
+    // partially kept.
+    void reset();
+
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketLowest(size_t index);
+    static uint64_t bucketHighest(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> mCounts;
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMin;
+    std::atomic<uint64_t> mMax;
+};
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,153 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/HdrHistogram.h"
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace base {
+
+// The relative error allowed by the buckets.
+static void expectNear(uint64_t expected, uint64_t actual) {
+    EXPECT_GE(actual, expected);
+    EXPECT_LE(actual, expected + expected / HdrHistogram::kSubBuckets);
+}
+
+TEST(HdrHistogram, Empty) {
+    HdrHistogram h;
+    EXPECT_EQ(0U, h.count());
+    EXPECT_EQ(0U, h.min());
+    EXPECT_EQ(0U, h.max());
+    EXPECT_EQ(0, h.mean());
+    EXPECT_EQ(0U, h.valueAtPercentile(50));
+
+    const auto summary = h.summary();
+    EXPECT_EQ(0U, summary.count);
+    EXPECT_EQ(0U, summary.p999);
+}
+
+TEST(HdrHistogram, Buckets) {
+    EXPECT_EQ(0U, HdrHistogram::bucketIndex(0));
+    EXPECT_EQ(63U, HdrHistogram::bucketIndex(63));
+    EXPECT_EQ(64U, HdrHistogram::bucketIndex(64));
+    EXPECT_EQ(64U, HdrHistogram::bucketIndex(65));
+    EXPECT_EQ(size_t(HdrHistogram::kBucketCount - 1),
+              HdrHistogram::bucketIndex(std::numeric_limits<uint64_t>::max()));
+    EXPECT_EQ(std::numeric_limits<uint64_t>::max(),
+              HdrHistogram::bucketHighest(HdrHistogram::kBucketCount - 1));
+
+    // Buckets follow each other, and are at most 1/kSubBuckets as wide as
+    // the values they hold.
+    for (size_t i = 1; i < HdrHistogram::kBucketCount; ++i) {
+        EXPECT_EQ(HdrHistogram::bucketHighest(i - 1) + 1,
+                  HdrHistogram::bucketLowest(i));
+        const uint64_t lowest = HdrHistogram::bucketLowest(i);
+        const uint64_t highest = HdrHistogram::bucketHighest(i);
+        EXPECT_LE(highest - lowest, lowest / HdrHistogram::kSubBuckets);
+        EXPECT_EQ(i, HdrHistogram::bucketIndex(lowest));
+        EXPECT_EQ(i, HdrHistogram::bucketIndex(highest));
+    }
+}
+
+TEST(HdrHistogram, SmallValuesAreExact) {
+    HdrHistogram h;
+    for (uint64_t i = 0; i < 64; ++i) {
+        h.record(i);
+    }
+    EXPECT_EQ(64U, h.count());
+    EXPECT_EQ(0U, h.min());
+    EXPECT_EQ(63U, h.max());
+    EXPECT_DOUBLE_EQ(31.5, h.mean());
+    EXPECT_EQ(0U, h.valueAtPercentile(0));
+    EXPECT_EQ(31U, h.valueAtPercentile(50));
+    EXPECT_EQ(63U, h.valueAtPercentile(100));
+}
+
+TEST(HdrHistogram, Percentiles) {
+    HdrHistogram h;
+    for (uint64_t i = 1; i <= 100000; ++i) {
+        h.record(i * 10);
+    }
+    EXPECT_EQ(10U, h.min());
+    EXPECT_EQ(1000000U, h.max());
+    EXPECT_DOUBLE_EQ(500005, h.mean());
+
+    expectNear(500000, h.valueAtPercentile(50));
+    expectNear(900000, h.valueAtPercentile(90));
+    expectNear(990000, h.valueAtPercentile(99));
+    expectNear(999000, h.valueAtPercentile(99.9));
+    EXPECT_EQ(1000000U, h.valueAtPercentile(100));
+
+    const auto summary = h.summary();
+    EXPECT_EQ(100000U, summary.count);
+    EXPECT_EQ(h.valueAtPercentile(50), summary.p50);
+    EXPECT_EQ(h.valueAtPercentile(90), summary.p90);
+    EXPECT_EQ(h.valueAtPercentile(99), summary.p99);
+    EXPECT_EQ(h.valueAtPercentile(99.9), summary.p999);
+}
+
+TEST(HdrHistogram, Tail) {
+    // The average hides the stalls, the percentiles don't.
+    HdrHistogram h;
+    for (int i = 0; i < 9980; ++i) {
+        h.record(100);
+    }
+    for (int i = 0; i < 20; ++i) {
+        h.record(50000000);
+    }
+    const auto summary = h.summary();
+    expectNear(100, summary.p50);
+    expectNear(100, summary.p99);
+    expectNear(50000000, summary.p999);
+    EXPECT_EQ(50000000U, summary.max);
+}
+
+TEST(HdrHistogram, Reset) {
+    HdrHistogram h;
+    h.record(1000);
+    h.reset();
+    EXPECT_EQ(0U, h.count());
+    EXPECT_EQ(0U, h.max());
+    EXPECT_EQ(0U, h.valueAtPercentile(100));
+    h.record(5);
+    EXPECT_EQ(5U, h.min());
+}
+
+TEST(HdrHistogram, ConcurrentRecord) {
+    static constexpr int kThreads = 4;
+    static constexpr uint64_t kSamples = 100000;
+
+    HdrHistogram h;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&h, t] {
+            for (uint64_t i = 1; i <= kSamples; ++i) {
+                h.record(i + t);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(kThreads * kSamples, h.count());
+    EXPECT_EQ(1U, h.min());
+    EXPECT_EQ(kSamples + kThreads - 1, h.max());
+    EXPECT_EQ(kThreads * kSamples, h.summary().count);
+}
+
+}  // namespace base
+}  // namespace android
@@ -35,7 +35,7 @@ JsonWriter::JsonWriter(const std::string& outputPath) {
 
 JsonWriter::~JsonWriter() {
     flush();
-    if (mNeedClose) fclose((FILE*)mFp);
+    if (mNeedClose && mFp) fclose((FILE*)mFp);
 }
 
 std::string JsonWriter::contents() const {
@@ -43,7 +43,7 @@ std::string JsonWriter::contents() const {
 }
 
 void JsonWriter::flush() {
-    if (mFlushed == mContents.size()) return;
+    if (mFlushed == mContents.size() || !mFp) return;
 
     fwrite(mContents.data() + mFlushed,
            mContents.size() - mFlushed,
@@ -207,6 +207,14 @@ JsonWriter& JsonWriter::value(long val) {
     return *this;
 }
 
+JsonWriter& JsonWriter::value(long long val) {
+    insertComma();
+    std::stringstream ss;
+    ss << val;
+    onValue(ss.str());
+    return *this;
+}
+
 JsonWriter& JsonWriter::value(float val) {
     insertComma();
     std::stringstream ss;
@@ -25,6 +25,9 @@ public:
     JsonWriter(const std::string& outputPath);
     ~JsonWriter();
 
+    // False if the output file could not be opened.
+    bool isOpen() const { return mFp != nullptr; }
+
     std::string contents() const;
 
     void flush();
@@ -47,6 +50,7 @@ public:
     JsonWriter& value(const std::string& string);
     JsonWriter& value(int val);
     JsonWriter& value(long val);
+    JsonWriter& value(long long val);
     JsonWriter& value(float val);
     JsonWriter& value(double val);
     JsonWriter& valueBool(bool val); // thx operator bool
@@ -0,0 +1,94 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/LatencyTracker.h"
+
+#include "android/base/StringFormat.h"
+#include "android/base/memory/LazyInstance.h"
+
+namespace android {
+namespace base {
+
+static LazyInstance<LatencyTracker> sGlobal;
+
+LatencyTracker::LatencyTracker() = default;
+
+// static
+LatencyTracker* LatencyTracker::get() {
+    return sGlobal.ptr();
+}
+
+// static
+const char* LatencyTracker::name(Area area) {
+    switch (area) {
+        case Area::MainLoopIteration:
+            return "MainLoopIteration";
+        case Area::BqlHold:
+            return "BqlHold";
+        case Area::VcpuExit:
+            return "VcpuExit";
+        case Area::RenderDecode:
+            return "RenderDecode";
+        case Area::FramePost:
+            return "FramePost";
+        case Area::LooperCallback:
+            return "LooperCallback";
+        case Area::Count:
+            break;
+    }
+    return "Unknown";
+}
+
+void LatencyTracker::addPendingCallbacks(int64_t delta) {
+    const int64_t pending =
+            mPendingCallbacks.fetch_add(delta, std::memory_order_relaxed) +
+            delta;
+    int64_t max = mMaxPendingCallbacks.load(std::memory_order_relaxed);
+    while (pending > max && !mMaxPendingCallbacks.compare_exchange_weak(
+                                    max, pending, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyTracker::pendingCallbacks() const {
+    return uint64_t(mPendingCallbacks.load(std::memory_order_relaxed));
+}
+
+uint64_t LatencyTracker::maxPendingCallbacks() const {
+    return uint64_t(mMaxPendingCallbacks.load(std::memory_order_relaxed));
+}
+
+std::string LatencyTracker::printUsage() const {
+    std::string result;
+    for (int i = 0; i < int(Area::Count); ++i) {
+        const auto summary = mAreas[i].summary();
+        if (!summary.count) {
+            continue;
+        }
+        StringAppendFormat(&result,
+                           "%s: %llu samples, mean %.1f us, p50/p90/p99/p99.9"
+                           "/max %.1f/%.1f/%.1f/%.1f/%.1f us\n",
+                           name(Area(i)), (unsigned long long)summary.count,
+                           summary.mean / 1000, summary.p50 / 1000.0,
+                           summary.p90 / 1000.0, summary.p99 / 1000.0,
+                           summary.p999 / 1000.0, summary.max / 1000.0);
+        if (Area(i) == Area::LooperCallback) {
+            StringAppendFormat(&result,
+                               "%s: %llu pending callbacks, max %llu\n",
+                               name(Area(i)),
+                               (unsigned long long)pendingCallbacks(),
+                               (unsigned long long)maxPendingCallbacks());
+        }
+    }
+    return result;
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,72 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+#include "android/base/HdrHistogram.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace android {
+namespace base {
+
+// Latency histograms of the threads that decide how responsive the guest
+// is, filled for the whole run of the emulator. The distributions, their
+// tail in particular, are reported by PerfStatReporter and the gRPC status.
+class LatencyTracker {
+    DISALLOW_COPY_ASSIGN_AND_MOVE(LatencyTracker);
+
+public:
+    enum class Area {
+        MainLoopIteration,  // busy part of an iteration of the main loop
+        BqlHold,            // hold of the big QEMU lock, by any thread
+        VcpuExit,           // handling of an exit of a vCPU
+        RenderDecode,       // decoding of a guest command buffer
+        FramePost,          // interval between two posted frames
+        LooperCallback,     // delay between posting a callback and its run
+        Count,
+    };
+
+    LatencyTracker();
+    static LatencyTracker* get();
+
+    // |ns| is in nanoseconds, the unit of all the histograms.
+    void record(Area area, uint64_t ns) { mAreas[int(area)].record(ns); }
+
+    const HdrHistogram& histogram(Area area) const {
+        return mAreas[int(area)];
+    }
+
+    static const char* name(Area area);
+
+    // Callbacks posted to the loopers that did not run yet: the queues the
+    // LooperCallback delays are spent in. |delta| is the number of callbacks
+    // posted, or minus the number run.
+    void addPendingCallbacks(int64_t delta);
+    uint64_t pendingCallbacks() const;
+    // The most there ever were at once.
+    uint64_t maxPendingCallbacks() const;
+
+    // One line per area with samples: count, mean and percentiles, in us.
+    std::string printUsage() const;
+
+private:
+    std::array<HdrHistogram, int(Area::Count)> mAreas;
+    std::atomic<int64_t> mPendingCallbacks{0};
+    std::atomic<int64_t> mMaxPendingCallbacks{0};
+};
+
+}  // namespace base
+}  // namespace android
@@ -15,13 +15,22 @@
 #include "android/base/Tracing.h"
 
 #include "android/base/system/System.h"
+#include "android/base/files/PathUtils.h"
 #include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
 #include "android/base/threads/Thread.h"
 #include "android/base/threads/ThreadStore.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <stdio.h>
+
 namespace android {
 namespace base {
 
@@ -239,6 +248,441 @@ bool shouldEnableTracing() {
     return sTraceConfig->enabled();
 }
 
+// Trace capture //////////////////////////////////////////////////////////////
+
+enum class TraceEventType : uint32_t {
+    Begin,     // beginTrace()
+    End,       // endTrace()
+    Complete,  // A scoped trace, |value| is the duration.
+    Counter,   // traceCounter()
+};
+
+struct TraceEvent {
+    uint64_t tsUs;
+    int64_t value;
+    uint32_t nameId;
+    TraceEventType type;
+};
+
+// The events of a single thread. Only the owning thread appends, the
+// exporter reads.
+class ThreadTraceBuffer {
+public:
+    ThreadTraceBuffer(unsigned long tid, size_t capacity)
+        : mTid(tid), mEvents(capacity) {}
+
+    void append(TraceEventType type,
+                uint32_t nameId,
+                uint64_t tsUs,
+                int64_t value) {
+        const uint64_t head = mHead.load(std::memory_order_relaxed);
+        mEvents[head & (mEvents.size() - 1)] = {tsUs, value, nameId, type};
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    // Copies out the events that are still in the ring, oldest first.
+    std::vector<TraceEvent> events() const {
+        const uint64_t size = mEvents.size();
+        const uint64_t head = mHead.load(std::memory_order_acquire);
+        uint64_t first = head > size ? head - size : 0;
+        std::vector<TraceEvent> result;
+        result.reserve(head - first);
+        for (uint64_t i = first; i < head; ++i) {
+            result.push_back(mEvents[i & (size - 1)]);
+        }
+
+        // The owner keeps going if the capture is still active, drop what it
+        // overwrote while we were copying.
+        const uint64_t now = mHead.load(std::memory_order_acquire);
+        if (now - first > size) {
+            const uint64_t lost = std::min<uint64_t>(now - first - size,
+                                                     result.size());
+            result.erase(result.begin(), result.begin() + lost);
+        }
+        return result;
+    }
+
+    unsigned long tid() const { return mTid; }
+
+private:
+    const unsigned long mTid;
+    std::vector<TraceEvent> mEvents;
+    std::atomic<uint64_t> mHead{0};
+};
+
+// Names are interned per capture. Guest names come and go (atrace reuses
+// its buffers), so the tables are keyed by contents and bounded.
+static constexpr size_t kMaxTraceNames = 1 << 16;
+static constexpr size_t kMaxThreadTraceNames = 1024;
+// What the names past kMaxTraceNames are exported as.
+static constexpr uint32_t kOverflowNameId = 0;
+static const char kOverflowName[] = "(too many names)";
+
+struct ThreadTraceState {
+    std::shared_ptr<ThreadTraceBuffer> buffer;
+    uint32_t generation = 0;
+    // A cache of the capture's name ids, reset with the buffer.
+    std::unordered_map<std::string, uint32_t> nameIds;
+};
+
+static std::atomic<bool> sCaptureActive{false};
+
+class TraceCapture {
+public:
+    bool start(size_t eventsPerThread) {
+        AutoLock lock(mLock);
+        if (sCaptureActive.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        // The ring indices rely on a power of 2.
+        size_t capacity = 1;
+        while (capacity < eventsPerThread) {
+            capacity <<= 1;
+        }
+        mEventsPerThread = capacity;
+        mBuffers.clear();
+        mNames.assign(1, kOverflowName);
+        mNameIds.clear();
+        mGeneration.fetch_add(1, std::memory_order_release);
+        sCaptureActive.store(true, std::memory_order_release);
+        return true;
+    }
+
+    void stop() {
+        AutoLock lock(mLock);
+        sCaptureActive.store(false, std::memory_order_release);
+    }
+
+    void record(TraceEventType type,
+                const char* name,
+                uint64_t tsUs,
+                int64_t value) {
+        ThreadTraceState* state = mThreadState.get();
+        if (!state) {
+            state = new ThreadTraceState();
+            mThreadState.set(state);
+        }
+
+        const uint32_t generation =
+                mGeneration.load(std::memory_order_acquire);
+        if (state->generation != generation) {
+            AutoLock lock(mLock);
+            state->buffer = std::make_shared<ThreadTraceBuffer>(
+                    getCurrentThreadId(), mEventsPerThread);
+            state->generation = generation;
+            state->nameIds.clear();
+            mBuffers.push_back(state->buffer);
+        }
+
+        uint32_t nameId = kOverflowNameId;
+        if (name) {
+            std::string key(name);
+            auto it = state->nameIds.find(key);
+            if (it != state->nameIds.end()) {
+                nameId = it->second;
+            } else {
+                nameId = intern(key);
+                if (state->nameIds.size() >= kMaxThreadTraceNames) {
+                    state->nameIds.clear();
+                }
+                state->nameIds.emplace(std::move(key), nameId);
+            }
+        }
+        state->buffer->append(type, nameId, tsUs, value);
+    }
+
+    std::string exportTo(TraceFormat format) {
+        std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+        std::vector<std::string> names;
+        {
+            AutoLock lock(mLock);
+            buffers = mBuffers;
+            names = mNames;
+        }
+
+        if (format == TraceFormat::ChromeJson) {
+            return toChromeJson(buffers, names);
+        }
+        return toPerfetto(buffers, names);
+    }
+
+private:
+    uint32_t intern(const std::string& name) {
+        AutoLock lock(mLock);
+        auto it = mNameIds.find(name);
+        if (it != mNameIds.end()) {
+            return it->second;
+        }
+        if (mNames.size() >= kMaxTraceNames) {
+            return kOverflowNameId;
+        }
+        const uint32_t id = mNames.size();
+        mNames.push_back(name);
+        mNameIds.emplace(name, id);
+        return id;
+    }
+
+    static std::string jsonEscape(const std::string& str) {
+        std::string result;
+        for (char c : str) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                result += buf;
+            } else {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    static std::string toChromeJson(
+            const std::vector<std::shared_ptr<ThreadTraceBuffer>>& buffers,
+            const std::vector<std::string>& names) {
+        const auto pid = System::get()->getCurrentProcessId();
+        std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        char buf[256];
+        for (const auto& buffer : buffers) {
+            for (const auto& event : buffer->events()) {
+                const std::string name =
+                        event.type == TraceEventType::End
+                                ? std::string()
+                                : jsonEscape(names[event.nameId]);
+                switch (event.type) {
+                    case TraceEventType::Begin:
+                        snprintf(buf, sizeof(buf),
+                                 "\"ph\":\"B\",\"ts\":%" PRIu64, event.tsUs);
+                        break;
+                    case TraceEventType::End:
+                        snprintf(buf, sizeof(buf),
+                                 "\"ph\":\"E\",\"ts\":%" PRIu64, event.tsUs);
+                        break;
+                    case TraceEventType::Complete:
+                        snprintf(buf, sizeof(buf),
+                                 "\"ph\":\"X\",\"ts\":%" PRIu64
+                                 ",\"dur\":%" PRId64,
+                                 event.tsUs, event.value);
+                        break;
+                    case TraceEventType::Counter:
+                        snprintf(buf, sizeof(buf),
+                                 "\"ph\":\"C\",\"ts\":%" PRIu64
+                                 ",\"args\":{\"value\":%" PRId64 "}",
+                                 event.tsUs, event.value);
+                        break;
+                }
+                json += first ? "\n" : ",\n";
+                first = false;
+                json += "{\"name\":\"" + name + "\",";
+                json += buf;
+                snprintf(buf, sizeof(buf), ",\"pid\":%d,\"tid\":%lu}",
+                         static_cast<int>(pid), buffer->tid());
+                json += buf;
+            }
+        }
+        json += "\n]}\n";
+        return json;
+    }
+
+    // Just enough of a protobuf encoder to write Perfetto traces.
+    class ProtoWriter {
+    public:
+        void varint(uint32_t field, uint64_t value) {
+            rawVarint(field << 3);
+            rawVarint(value);
+        }
+
+        void bytes(uint32_t field, const std::string& value) {
+            rawVarint((field << 3) | 2);
+            rawVarint(value.size());
+            mData += value;
+        }
+
+        void message(uint32_t field, const ProtoWriter& msg) {
+            bytes(field, msg.mData);
+        }
+
+        const std::string& data() const { return mData; }
+
+    private:
+        void rawVarint(uint64_t value) {
+            while (value >= 0x80) {
+                mData += static_cast<char>((value & 0x7f) | 0x80);
+                value >>= 7;
+            }
+            mData += static_cast<char>(value);
+        }
+
+        std::string mData;
+    };
+
+    static std::string toPerfetto(
+            const std::vector<std::shared_ptr<ThreadTraceBuffer>>& buffers,
+            const std::vector<std::string>& names) {
+        // Field numbers from perfetto/trace/trace_packet.proto and friends.
+        enum : uint32_t {
+            kTracePacket = 1,
+            kTimestamp = 8,
+            kSequenceId = 10,
+            kTrackEvent = 11,
+            kTrackDescriptor = 60,
+            kEventType = 9,
+            kEventTrackUuid = 11,
+            kEventName = 23,
+            kEventCounterValue = 30,
+            kTrackUuid = 1,
+            kTrackName = 2,
+            kTrackThread = 4,
+            kTrackCounter = 8,
+            kThreadPid = 1,
+            kThreadTid = 2,
+            kSliceBegin = 1,
+            kSliceEnd = 2,
+            kCounter = 4,
+        };
+        static constexpr uint32_t kSequence = 1;
+        static constexpr uint64_t kCounterTrackBit = 1ULL << 63;
+
+        const auto pid = System::get()->getCurrentProcessId();
+        ProtoWriter trace;
+
+        // Counters get a track each, shared by all threads.
+        std::vector<bool> counterTracks(names.size(), false);
+        const std::string kNoName;
+
+        struct Slice {
+            uint64_t tsUs;
+            uint64_t orderKey;  // Orders slice edges that share a timestamp.
+            ProtoWriter packet;
+        };
+
+        for (const auto& buffer : buffers) {
+            const uint64_t threadTrack = buffer->tid();
+            ProtoWriter thread;
+            thread.varint(kThreadPid, pid);
+            thread.varint(kThreadTid, buffer->tid());
+            ProtoWriter descriptor;
+            descriptor.varint(kTrackUuid, threadTrack);
+            descriptor.message(kTrackThread, thread);
+            ProtoWriter packet;
+            packet.message(kTrackDescriptor, descriptor);
+            trace.message(kTracePacket, packet);
+
+            auto makeEvent = [&](uint64_t tsUs, uint32_t type, uint64_t track,
+                                 const std::string* name) {
+                ProtoWriter event;
+                event.varint(kEventType, type);
+                event.varint(kEventTrackUuid, track);
+                if (name) {
+                    event.bytes(kEventName, *name);
+                }
+                ProtoWriter packet;
+                packet.varint(kTimestamp, tsUs * 1000);
+                packet.varint(kSequenceId, kSequence);
+                packet.message(kTrackEvent, event);
+                return packet;
+            };
+
+            // Scoped traces are recorded when they end, turn them into
+            // begin/end pairs in timestamp order. At the same timestamp ends
+            // go before begins, outer slices begin first and end last.
+            std::vector<Slice> slices;
+            for (const auto& event : buffer->events()) {
+                const std::string& name = event.type == TraceEventType::End
+                                                  ? kNoName
+                                                  : names[event.nameId];
+                switch (event.type) {
+                    case TraceEventType::Begin:
+                        slices.push_back({event.tsUs, 1ULL << 62,
+                                          makeEvent(event.tsUs, kSliceBegin,
+                                                    threadTrack, &name)});
+                        break;
+                    case TraceEventType::End:
+                        slices.push_back({event.tsUs, 0,
+                                          makeEvent(event.tsUs, kSliceEnd,
+                                                    threadTrack, nullptr)});
+                        break;
+                    case TraceEventType::Complete: {
+                        const uint64_t endUs = event.tsUs + event.value;
+                        slices.push_back({event.tsUs, ~endUs,
+                                          makeEvent(event.tsUs, kSliceBegin,
+                                                    threadTrack, &name)});
+                        // An empty slice has to end right after it began.
+                        slices.push_back({endUs,
+                                          endUs == event.tsUs
+                                                  ? ~endUs
+                                                  : ~event.tsUs >> 2,
+                                          makeEvent(endUs, kSliceEnd,
+                                                    threadTrack, nullptr)});
+                        break;
+                    }
+                    case TraceEventType::Counter: {
+                        const uint64_t counterTrack =
+                                kCounterTrackBit | event.nameId;
+                        if (!counterTracks[event.nameId]) {
+                            counterTracks[event.nameId] = true;
+                            ProtoWriter counter;
+                            counter.varint(kTrackUuid, counterTrack);
+                            counter.bytes(kTrackName, name);
+                            counter.bytes(kTrackCounter, std::string());
+                            ProtoWriter packet;
+                            packet.message(kTrackDescriptor, counter);
+                            trace.message(kTracePacket, packet);
+                        }
+                        ProtoWriter counterEvent;
+                        counterEvent.varint(kEventType, kCounter);
+                        counterEvent.varint(kEventTrackUuid, counterTrack);
+                        counterEvent.varint(kEventCounterValue, event.value);
+                        ProtoWriter packet;
+                        packet.varint(kTimestamp, event.tsUs * 1000);
+                        packet.varint(kSequenceId, kSequence);
+                        packet.message(kTrackEvent, counterEvent);
+                        slices.push_back({event.tsUs, ~0ULL, packet});
+                        break;
+                    }
+                }
+            }
+
+            std::stable_sort(slices.begin(), slices.end(),
+                             [](const Slice& a, const Slice& b) {
+                                 if (a.tsUs != b.tsUs) {
+                                     return a.tsUs < b.tsUs;
+                                 }
+                                 return a.orderKey < b.orderKey;
+                             });
+            for (const auto& slice : slices) {
+                trace.message(kTracePacket, slice.packet);
+            }
+        }
+        return trace.data();
+    }
+
+    std::atomic<uint32_t> mGeneration{0};
+    ThreadStore<ThreadTraceState> mThreadState;
+
+    Lock mLock;
+    size_t mEventsPerThread = kDefaultTraceEventsPerThread;
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> mBuffers;
+    std::vector<std::string> mNames;
+    std::unordered_map<std::string, uint32_t> mNameIds;
+};
+
+static LazyInstance<TraceCapture> sTraceCapture = LAZY_INSTANCE_INIT;
+
+static bool captureActive() {
+    return sCaptureActive.load(std::memory_order_relaxed);
+}
+
+static void captureRecord(TraceEventType type,
+                          const char* name,
+                          uint64_t tsUs,
+                          int64_t value = 0) {
+    sTraceCapture->record(type, name, tsUs, value);
+}
+
 #ifdef __cplusplus
 #   define CC_LIKELY( exp )    (__builtin_expect( !!(exp), true ))
 #   define CC_UNLIKELY( exp )  (__builtin_expect( !!(exp), false ))
@@ -251,48 +695,108 @@ void ScopedTrace::beginTraceImpl(const char* name) {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_begin(name);
     }
+    if (CC_UNLIKELY(captureActive())) {
+        captureBeginUs_ = System::getSystemTimeUs();
+    }
 }
 
-void ScopedTrace::endTraceImpl(const char*) {
+void ScopedTrace::endTraceImpl(const char* name) {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_end();
     }
+    // Scopes that were already open when the capture started are dropped.
+    if (CC_UNLIKELY(captureActive() && captureBeginUs_)) {
+        captureRecord(TraceEventType::Complete, name, captureBeginUs_,
+                      System::getSystemTimeUs() - captureBeginUs_);
+    }
 }
 
 void beginTrace(const char* name) {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_begin(name);
     }
+    if (CC_UNLIKELY(captureActive())) {
+        captureRecord(TraceEventType::Begin, name, System::getSystemTimeUs());
+    }
 }
 
 void endTrace() {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_end();
     }
+    if (CC_UNLIKELY(captureActive())) {
+        captureRecord(TraceEventType::End, nullptr, System::getSystemTimeUs());
+    }
 }
 
 void ScopedThresholdTrace::beginTraceImpl(const char* name, uint64_t thresholdUs) {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_begin(name, thresholdUs);
     }
+    if (CC_UNLIKELY(captureActive())) {
+        captureBeginUs_ = System::getSystemTimeUs();
+    }
 }
 
-void ScopedThresholdTrace::endTraceImpl(const char*) {
+void ScopedThresholdTrace::endTraceImpl(const char* name) {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_end();
     }
+    if (CC_UNLIKELY(captureActive() && captureBeginUs_)) {
+        captureRecord(TraceEventType::Complete, name, captureBeginUs_,
+                      System::getSystemTimeUs() - captureBeginUs_);
+    }
 }
 
 void beginThresholdTrace(const char* name, uint64_t thresholdUs) {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_begin(name, thresholdUs);
     }
+    if (CC_UNLIKELY(captureActive())) {
+        captureRecord(TraceEventType::Begin, name, System::getSystemTimeUs());
+    }
 }
 
 void endThresholdTrace() {
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_end();
     }
+    if (CC_UNLIKELY(captureActive())) {
+        captureRecord(TraceEventType::End, nullptr, System::getSystemTimeUs());
+    }
+}
+
+void traceCounter(const char* name, int64_t value) {
+    if (CC_UNLIKELY(captureActive())) {
+        captureRecord(TraceEventType::Counter, name, System::getSystemTimeUs(),
+                      value);
+    }
+}
+
+bool startTraceCapture(size_t eventsPerThread) {
+    return sTraceCapture->start(eventsPerThread);
+}
+
+void stopTraceCapture() {
+    sTraceCapture->stop();
+}
+
+bool isTraceCaptureActive() {
+    return captureActive();
+}
+
+std::string exportTraceCapture(TraceFormat format) {
+    return sTraceCapture->exportTo(format);
+}
+
+bool exportTraceCapture(const std::string& path, TraceFormat format) {
+    std::ofstream out(PathUtils::asUnicodePath(path).c_str(),
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out << exportTraceCapture(format);
+    return static_cast<bool>(out.flush());
 }
 
 } // namespace base
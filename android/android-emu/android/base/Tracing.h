@@ -15,15 +15,24 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
+
+#include <string>
 
 // Library to perform tracing. Talks to platform-specific
 // tracing libraries.
+//
+// Setting ANDROID_EMU_TRACING=1 prints every trace to stdout as it happens.
+// For anything else, use a trace capture (see startTraceCapture() below),
+// which records the traces of all threads in memory at a low cost, and
+// writes them out as a timeline that can be loaded in chrome://tracing or
+// https://ui.perfetto.dev.
 namespace android {
 namespace base {
 
 class ScopedTrace {
 public:
-    ScopedTrace(const char* name) {
+    ScopedTrace(const char* name) : name_(name) {
         beginTraceImpl(name);
     }
 
@@ -34,6 +43,7 @@ private:
     void beginTraceImpl(const char* name);
     void endTraceImpl(const char* name);
     const char* const name_ = nullptr;
+    uint64_t captureBeginUs_ = 0;  // Set if a capture saw the begin.
 };
 
 bool shouldEnableTracing();
@@ -42,7 +52,8 @@ void endTrace();
 
 class ScopedThresholdTrace {
 public:
-    ScopedThresholdTrace(const char* name, uint64_t thresholdUs = 1000) {
+    ScopedThresholdTrace(const char* name, uint64_t thresholdUs = 1000)
+        : name_(name) {
         beginTraceImpl(name, thresholdUs);
     }
 
@@ -53,11 +64,45 @@ private:
     void beginTraceImpl(const char* name, uint64_t thresholdUs);
     void endTraceImpl(const char* name);
     const char* const name_ = nullptr;
+    uint64_t captureBeginUs_ = 0;  // Set if a capture saw the begin.
 };
 
 void beginThresholdTrace(const char* name, uint64_t thresholdUs = 1000);
 void endThresholdTrace();
 
+// Records the current |value| of the counter |name|, only if a trace capture
+// is active.
+void traceCounter(const char* name, int64_t value);
+
+// Trace capture.
+//
+// While a capture is active every thread that traces appends binary events
+// to its own ring buffer, which holds the last |eventsPerThread| events of
+// that thread. Names are interned, so recording an event does not copy any
+// strings, and only takes a lock the first time a thread or a name shows up.
+static constexpr size_t kDefaultTraceEventsPerThread = 64 * 1024;
+
+enum class TraceFormat {
+    ChromeJson,  // The Trace Event Format used by chrome://tracing.
+    Perfetto,    // A Perfetto protobuf trace.
+};
+
+// Starts a new capture, dropping the events of a previous capture. Returns
+// false if a capture is already running.
+bool startTraceCapture(size_t eventsPerThread = kDefaultTraceEventsPerThread);
+
+// Stops recording events, the events stay around for exportTraceCapture().
+void stopTraceCapture();
+
+bool isTraceCaptureActive();
+
+// Writes the events of the last capture to |path|. Returns false if the file
+// could not be written.
+bool exportTraceCapture(const std::string& path, TraceFormat format);
+
+// Same as above, but returns the serialized trace.
+std::string exportTraceCapture(TraceFormat format);
+
 } // namespace base
 } // namespace android
 
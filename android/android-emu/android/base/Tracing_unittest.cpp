@@ -0,0 +1,183 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "android/base/Tracing.h"
+
+#include "android/base/threads/FunctorThread.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string>
+
+namespace android {
+namespace base {
+
+static int countOf(const std::string& haystack, const std::string& needle) {
+    int count = 0;
+    for (size_t pos = haystack.find(needle); pos != std::string::npos;
+         pos = haystack.find(needle, pos + needle.size())) {
+        ++count;
+    }
+    return count;
+}
+
+class TracingTest : public ::testing::Test {
+protected:
+    void TearDown() override { stopTraceCapture(); }
+};
+
+TEST_F(TracingTest, NothingRecordedWithoutCapture) {
+    ASSERT_TRUE(startTraceCapture());
+    stopTraceCapture();
+    { AEMU_SCOPED_TRACE("not-captured"); }
+    EXPECT_EQ(0, countOf(exportTraceCapture(TraceFormat::ChromeJson),
+                         "not-captured"));
+}
+
+TEST_F(TracingTest, OnlyOneCapture) {
+    EXPECT_FALSE(isTraceCaptureActive());
+    EXPECT_TRUE(startTraceCapture());
+    EXPECT_TRUE(isTraceCaptureActive());
+    EXPECT_FALSE(startTraceCapture());
+    stopTraceCapture();
+    EXPECT_FALSE(isTraceCaptureActive());
+}
+
+TEST_F(TracingTest, ChromeJson) {
+    ASSERT_TRUE(startTraceCapture());
+    {
+        AEMU_SCOPED_TRACE("outer");
+        beginTrace("manual");
+        endTrace();
+        traceCounter("counter", 42);
+    }
+    stopTraceCapture();
+
+    const std::string json = exportTraceCapture(TraceFormat::ChromeJson);
+    EXPECT_EQ(0u, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    EXPECT_EQ(1, countOf(json, "{\"name\":\"outer\",\"ph\":\"X\""));
+    EXPECT_EQ(1, countOf(json, "{\"name\":\"manual\",\"ph\":\"B\""));
+    EXPECT_EQ(1, countOf(json, "\"ph\":\"E\""));
+    EXPECT_EQ(1, countOf(json, "\"ph\":\"C\""));
+    EXPECT_EQ(1, countOf(json, "\"args\":{\"value\":42}"));
+}
+
+TEST_F(TracingTest, EscapesNames) {
+    ASSERT_TRUE(startTraceCapture());
+    { AEMU_SCOPED_TRACE("a\"b\\c"); }
+    stopTraceCapture();
+    EXPECT_EQ(1, countOf(exportTraceCapture(TraceFormat::ChromeJson),
+                         "\"a\\\"b\\\\c\""));
+}
+
+TEST_F(TracingTest, KeepsMostRecentEvents) {
+    ASSERT_TRUE(startTraceCapture(4));
+    traceCounter("old", 1);
+    for (int i = 0; i < 4; i++) {
+        traceCounter("new", i);
+    }
+    stopTraceCapture();
+
+    const std::string json = exportTraceCapture(TraceFormat::ChromeJson);
+    EXPECT_EQ(0, countOf(json, "\"old\""));
+    EXPECT_EQ(4, countOf(json, "\"new\""));
+}
+
+TEST_F(TracingTest, RestartDropsOldEvents) {
+    ASSERT_TRUE(startTraceCapture());
+    traceCounter("first", 1);
+    stopTraceCapture();
+    ASSERT_TRUE(startTraceCapture());
+    traceCounter("second", 1);
+    stopTraceCapture();
+
+    const std::string json = exportTraceCapture(TraceFormat::ChromeJson);
+    EXPECT_EQ(0, countOf(json, "\"first\""));
+    EXPECT_EQ(1, countOf(json, "\"second\""));
+}
+
+TEST_F(TracingTest, NamesAreCopied) {
+    // Guest names come from buffers that get reused.
+    char name[16];
+    ASSERT_TRUE(startTraceCapture());
+    snprintf(name, sizeof(name), "guest-one");
+    traceCounter(name, 1);
+    snprintf(name, sizeof(name), "guest-two");
+    traceCounter(name, 2);
+    traceCounter(name, 3);
+    stopTraceCapture();
+
+    const std::string json = exportTraceCapture(TraceFormat::ChromeJson);
+    EXPECT_EQ(1, countOf(json, "\"guest-one\""));
+    EXPECT_EQ(2, countOf(json, "\"guest-two\""));
+}
+
+TEST_F(TracingTest, TooManyNames) {
+    static constexpr int kNames = 70000;
+    ASSERT_TRUE(startTraceCapture(kNames));
+    for (int i = 0; i < kNames; i++) {
+        traceCounter(("name-" + std::to_string(i)).c_str(), i);
+    }
+    stopTraceCapture();
+
+    // The names past the limit share one, the events are all there.
+    const std::string json = exportTraceCapture(TraceFormat::ChromeJson);
+    EXPECT_EQ(1, countOf(json, "\"name-0\""));
+    EXPECT_EQ(0, countOf(json, "\"name-69999\""));
+    EXPECT_EQ(kNames, countOf(json, "\"ph\":\"C\""));
+    EXPECT_LT(0, countOf(json, "\"(too many names)\""));
+}
+
+TEST_F(TracingTest, EventsPerThread) {
+    static constexpr int kThreads = 4;
+    static constexpr int kEvents = 100;
+    ASSERT_TRUE(startTraceCapture());
+    std::vector<std::unique_ptr<FunctorThread>> threads;
+    for (int i = 0; i < kThreads; i++) {
+        threads.emplace_back(new FunctorThread([] {
+            for (int j = 0; j < kEvents; j++) {
+                AEMU_SCOPED_TRACE("worker");
+            }
+            return 0;
+        }));
+        threads.back()->start();
+    }
+    for (auto& thread : threads) {
+        thread->wait();
+    }
+    stopTraceCapture();
+
+    // The events outlive the threads that recorded them.
+    EXPECT_EQ(kThreads * kEvents,
+              countOf(exportTraceCapture(TraceFormat::ChromeJson),
+                      "\"worker\""));
+}
+
+TEST_F(TracingTest, Perfetto) {
+    ASSERT_TRUE(startTraceCapture());
+    { AEMU_SCOPED_TRACE("perfetto-slice"); }
+    traceCounter("perfetto-counter", 7);
+    stopTraceCapture();
+
+    const std::string trace = exportTraceCapture(TraceFormat::Perfetto);
+    ASSERT_FALSE(trace.empty());
+    // Every top level field is a Trace.packet.
+    EXPECT_EQ(0x0a, trace[0]);
+    EXPECT_EQ(1, countOf(trace, "perfetto-slice"));
+    // The counter name lives in its track descriptor.
+    EXPECT_EQ(1, countOf(trace, "perfetto-counter"));
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,96 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+#include "android/base/LatencyTracker.h"
+#include "android/base/containers/MpscQueue.h"
+#include "android/base/system/System.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace android {
+namespace base {
+
+// PostedCallbackQueue holds the callbacks posted to a looper from any
+// thread until the looper thread runs them, in batches:
+//
+//      // any thread
+//      if (queue.post(std::move(callback))) {
+//          wakeLooper();
+//      }
+//
+//      // looper thread, once woken up
+//      if (queue.runPending()) {
+//          wakeLooper();
+//      }
+//
+// Only the post that finds the queue empty asks for a wake up, so that a
+// burst of posts costs a single one. The delay between the post and the
+// run of each callback goes to the LooperCallback histogram of
+// LatencyTracker, and the callbacks waiting to run to its pending count.
+class PostedCallbackQueue {
+    DISALLOW_COPY_AND_ASSIGN(PostedCallbackQueue);
+
+public:
+    using Callback = std::function<void()>;
+
+    PostedCallbackQueue() = default;
+
+    // Callbacks that never ran are dropped.
+    ~PostedCallbackQueue() {
+        LatencyTracker::get()->addPendingCallbacks(
+                -int64_t(mCallbacks.size()));
+    }
+
+    // Queues |callback|. Returns true if the caller has to wake the looper.
+    bool post(Callback&& callback) {
+        // Counted before it can run, the count never goes below 0.
+        LatencyTracker::get()->addPendingCallbacks(1);
+        return mCallbacks.push({std::move(callback),
+                                System::get()->getHighResTimeUs()}) == 0;
+    }
+
+    // Runs the callbacks queued before the call, not the ones they post, so
+    // that busy producers can't starve the looper. Returns true if the
+    // looper has to run again: callbacks were posted meanwhile, or a post
+    // was still in progress and won't ask for a wake up itself.
+    bool runPending() {
+        size_t count = mCallbacks.size();
+        Pending pending;
+        while (count-- > 0 && mCallbacks.tryPop(&pending)) {
+            LatencyTracker::get()->addPendingCallbacks(-1);
+            const int64_t delayUs = std::max<int64_t>(
+                    0, int64_t(System::get()->getHighResTimeUs() -
+                               pending.postTimeUs));
+            LatencyTracker::get()->record(LatencyTracker::Area::LooperCallback,
+                                          uint64_t(delayUs) * 1000);
+            pending.callback();
+        }
+        return mCallbacks.size() > 0;
+    }
+
+    size_t size() const { return mCallbacks.size(); }
+
+private:
+    struct Pending {
+        Callback callback;
+        System::WallDuration postTimeUs;
+    };
+
+    MpscQueue<Pending> mCallbacks;
+};
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,135 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/PostedCallbackQueue.h"
+
+#include "android/base/testing/TestSystem.h"
+#include "android/base/threads/FunctorThread.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace base {
+
+using Area = LatencyTracker::Area;
+
+static uint64_t callbackSamples() {
+    return LatencyTracker::get()->histogram(Area::LooperCallback)
+            .summary()
+            .count;
+}
+
+TEST(PostedCallbackQueue, OnlyFirstPostWakes) {
+    PostedCallbackQueue queue;
+    std::vector<int> order;
+    EXPECT_TRUE(queue.post([&order]() { order.push_back(1); }));
+    EXPECT_FALSE(queue.post([&order]() { order.push_back(2); }));
+    EXPECT_FALSE(queue.post([&order]() { order.push_back(3); }));
+
+    EXPECT_FALSE(queue.runPending());
+    EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+
+    // Empty again: the next post wakes the looper up.
+    EXPECT_TRUE(queue.post([]() {}));
+    EXPECT_FALSE(queue.runPending());
+}
+
+TEST(PostedCallbackQueue, CallbacksPostedWhileRunningWaitForNextRun) {
+    PostedCallbackQueue queue;
+    int runs = 0;
+    queue.post([&queue, &runs]() {
+        ++runs;
+        queue.post([&runs]() { ++runs; });
+    });
+
+    EXPECT_TRUE(queue.runPending());
+    EXPECT_EQ(1, runs);
+    EXPECT_FALSE(queue.runPending());
+    EXPECT_EQ(2, runs);
+}
+
+TEST(PostedCallbackQueue, RecordsDelay) {
+    TestSystem system("/progdir", System::kProgramBitness);
+    PostedCallbackQueue queue;
+    const auto samples = callbackSamples();
+
+    system.setUnixTimeUs(1000);
+    queue.post([]() {});
+    queue.post([]() {});
+    system.setUnixTimeUs(3000);
+    EXPECT_FALSE(queue.runPending());
+
+    const auto summary =
+            LatencyTracker::get()->histogram(Area::LooperCallback).summary();
+    EXPECT_EQ(samples + 2, summary.count);
+    // 2 ms, within the accuracy of the histogram.
+    EXPECT_NEAR(2000000.0, double(summary.max), 2000000.0 * 0.05);
+}
+
+TEST(PostedCallbackQueue, CountsPending) {
+    const auto pending = LatencyTracker::get()->pendingCallbacks();
+    {
+        PostedCallbackQueue queue;
+        queue.post([]() {});
+        queue.post([]() {});
+        EXPECT_EQ(pending + 2, LatencyTracker::get()->pendingCallbacks());
+        EXPECT_LE(pending + 2, LatencyTracker::get()->maxPendingCallbacks());
+
+        EXPECT_FALSE(queue.runPending());
+        EXPECT_EQ(pending, LatencyTracker::get()->pendingCallbacks());
+
+        // Dropped with the queue.
+        queue.post([]() {});
+    }
+    EXPECT_EQ(pending, LatencyTracker::get()->pendingCallbacks());
+}
+
+TEST(PostedCallbackQueue, ManyProducers) {
+    PostedCallbackQueue queue;
+    const auto samples = callbackSamples();
+    const auto pending = LatencyTracker::get()->pendingCallbacks();
+    constexpr int kThreads = 4;
+    constexpr int kPerThread = 1000;
+    std::atomic<int> wakes{0};
+    int runs = 0;
+
+    std::vector<std::unique_ptr<FunctorThread>> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back(new FunctorThread([&]() {
+            for (int j = 0; j < kPerThread; ++j) {
+                if (queue.post([&runs]() { ++runs; })) {
+                    wakes.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            return 0;
+        }));
+        threads.back()->start();
+    }
+    while (runs < kThreads * kPerThread) {
+        queue.runPending();
+    }
+    for (auto& thread : threads) {
+        thread->wait();
+    }
+
+    EXPECT_FALSE(queue.runPending());
+    EXPECT_EQ(kThreads * kPerThread, runs);
+    EXPECT_GE(wakes.load(), 1);
+    EXPECT_EQ(samples + kThreads * kPerThread, callbackSamples());
+    EXPECT_EQ(pending, LatencyTracker::get()->pendingCallbacks());
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,136 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+
+#include <atomic>
+#include <utility>
+
+#include <stddef.h>
+
+namespace android {
+namespace base {
+
+// MpscQueue<T> is an unbounded FIFO queue that can be pushed to from any
+// number of threads without taking a lock, and popped from by a single
+// consumer thread (Dmitry Vyukov's intrusive MPSC node queue).
+//
+// push() returns the number of items that were in the queue before the new
+// one. A producer that sees 0 is responsible for waking the consumer, so
+// that a burst of pushes results in a single wake up:
+//
+//      if (queue.push(std::move(item)) == 0) {
+//          wakeConsumer();
+//      }
+//
+//      // consumer thread
+//      T item;
+//      while (queue.tryPop(&item)) {
+//          process(item);
+//      }
+//      if (queue.size() > 0) {
+//          wakeConsumer();  // see NOTE below.
+//      }
+//
+// NOTE: tryPop() can fail while size() is not 0, if a producer was
+// preempted in the middle of push(). The consumer must then make sure it
+// runs again later, as that producer won't wake it up.
+template <class T>
+class MpscQueue {
+    DISALLOW_COPY_AND_ASSIGN(MpscQueue);
+
+public:
+    MpscQueue() : mHead(&mStub), mTail(&mStub) {}
+
+    ~MpscQueue() {
+        T item;
+        while (tryPop(&item)) {
+        }
+    }
+
+    // Appends |value| to the queue. Can be called from any thread.
+    // Returns the number of items in the queue before this call.
+    size_t push(T&& value) {
+        Node* node = new Node(std::move(value));
+        const size_t prevSize = mSize.fetch_add(1, std::memory_order_acq_rel);
+        Node* prev = mHead.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+        return prevSize;
+    }
+
+    size_t push(const T& value) { return push(T(value)); }
+
+    // Removes the first item from the queue and moves it into |*value|.
+    // Returns false if the queue is empty, or if the next item is not fully
+    // published yet. Must only be called from the consumer thread.
+    bool tryPop(T* value) {
+        Node* tail = mTail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &mStub) {
+            if (!next) {
+                return false;
+            }
+            // Skip the stub node.
+            mTail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            mTail = next;
+            return consume(tail, value);
+        }
+        if (tail != mHead.load(std::memory_order_acquire)) {
+            // A producer is in the middle of push().
+            return false;
+        }
+        // |tail| is the last node: push the stub behind it so it can be
+        // unlinked without racing producers.
+        mStub.next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = mHead.exchange(&mStub, std::memory_order_acq_rel);
+        prev->next.store(&mStub, std::memory_order_release);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            mTail = next;
+            return consume(tail, value);
+        }
+        return false;
+    }
+
+    // Returns the number of items pushed but not popped yet. This is only
+    // a snapshot when producers are active.
+    size_t size() const { return mSize.load(std::memory_order_acquire); }
+
+private:
+    struct Node {
+        Node() = default;
+        explicit Node(T&& v) : value(std::move(v)) {}
+
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    bool consume(Node* node, T* value) {
+        *value = std::move(node->value);
+        delete node;
+        mSize.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    Node mStub;
+    std::atomic<Node*> mHead;  // Producers push here.
+    Node* mTail;               // Consumer pops from here.
+    std::atomic<size_t> mSize{0};
+};
+
+}  // namespace base
+}  // namespace android
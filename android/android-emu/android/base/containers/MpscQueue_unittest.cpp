@@ -0,0 +1,121 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/containers/MpscQueue.h"
+
+#include "android/base/threads/FunctorThread.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace base {
+
+TEST(MpscQueue, Empty) {
+    MpscQueue<int> q;
+    int value = 0;
+    EXPECT_EQ(0U, q.size());
+    EXPECT_FALSE(q.tryPop(&value));
+}
+
+TEST(MpscQueue, PushReturnsPreviousSize) {
+    MpscQueue<int> q;
+    EXPECT_EQ(0U, q.push(1));
+    EXPECT_EQ(1U, q.push(2));
+    EXPECT_EQ(2U, q.push(3));
+    EXPECT_EQ(3U, q.size());
+}
+
+TEST(MpscQueue, Fifo) {
+    MpscQueue<std::string> q;
+    q.push("one");
+    q.push("two");
+    q.push("three");
+
+    std::string value;
+    EXPECT_TRUE(q.tryPop(&value));
+    EXPECT_EQ("one", value);
+    EXPECT_TRUE(q.tryPop(&value));
+    EXPECT_EQ("two", value);
+
+    // Interleave pushes and pops, going through the empty state.
+    q.push("four");
+    EXPECT_TRUE(q.tryPop(&value));
+    EXPECT_EQ("three", value);
+    EXPECT_TRUE(q.tryPop(&value));
+    EXPECT_EQ("four", value);
+    EXPECT_FALSE(q.tryPop(&value));
+    EXPECT_EQ(0U, q.size());
+
+    EXPECT_EQ(0U, q.push("five"));
+    EXPECT_TRUE(q.tryPop(&value));
+    EXPECT_EQ("five", value);
+}
+
+TEST(MpscQueue, MoveOnly) {
+    MpscQueue<std::unique_ptr<int>> q;
+    q.push(std::unique_ptr<int>(new int(42)));
+    std::unique_ptr<int> value;
+    EXPECT_TRUE(q.tryPop(&value));
+    ASSERT_TRUE(value);
+    EXPECT_EQ(42, *value);
+}
+
+TEST(MpscQueue, DestroyNonEmpty) {
+    // Must not leak, checked by ASAN builds.
+    MpscQueue<std::unique_ptr<int>> q;
+    q.push(std::unique_ptr<int>(new int(1)));
+    q.push(std::unique_ptr<int>(new int(2)));
+}
+
+TEST(MpscQueue, MultipleProducers) {
+    static constexpr int kProducers = 4;
+    static constexpr int kItemsPerProducer = 10000;
+
+    MpscQueue<int> q;
+    std::vector<std::unique_ptr<FunctorThread>> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back(new FunctorThread([&q, p]() {
+            for (int i = 0; i < kItemsPerProducer; ++i) {
+                q.push(p * kItemsPerProducer + i);
+            }
+            return 0;
+        }));
+        producers.back()->start();
+    }
+
+    // Items from a single producer must come out in order.
+    std::vector<int> last(kProducers, -1);
+    int received = 0;
+    while (received < kProducers * kItemsPerProducer) {
+        int value;
+        if (!q.tryPop(&value)) {
+            continue;
+        }
+        const int producer = value / kItemsPerProducer;
+        EXPECT_LT(last[producer], value);
+        last[producer] = value;
+        ++received;
+    }
+
+    for (auto& thread : producers) {
+        thread->wait();
+    }
+    int value;
+    EXPECT_FALSE(q.tryPop(&value));
+    EXPECT_EQ(0U, q.size());
+}
+
+}  // namespace base
+}  // namespace android
@@ -851,6 +851,23 @@ public:
         }
         fin.close();
 
+        // Summed up over the mappings since Linux 4.14.
+        fin.open("/proc/self/smaps_rollup");
+        if (fin.good()) {
+            while (std::getline(fin, line)) {
+                if (sscanf(line.c_str(), "Shared_Clean:%lu", &size) == 1 ||
+                    sscanf(line.c_str(), "Shared_Dirty:%lu", &size) == 1) {
+                    res.resident_shared += size * 1024;
+                } else if (sscanf(line.c_str(), "Private_Clean:%lu", &size) ==
+                                   1 ||
+                           sscanf(line.c_str(), "Private_Dirty:%lu", &size) ==
+                                   1) {
+                    res.resident_private += size * 1024;
+                }
+            }
+            fin.close();
+        }
+
         fin.open("/proc/meminfo");
         if (!fin.good()) {
             return res;
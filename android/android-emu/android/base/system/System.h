@@ -165,6 +165,10 @@ public:
         uint64_t total_phys_memory;
         uint64_t avail_phys_memory;
         uint64_t total_page_file;
+        // The part of |resident| in pages mapped by other processes too, and
+        // the rest. Linux only.
+        uint64_t resident_shared;
+        uint64_t resident_private;
     };
     virtual MemUsage getMemUsage() const = 0;
 
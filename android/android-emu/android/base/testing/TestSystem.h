@@ -161,6 +161,8 @@ public:
         res.virt_max = 4294967295ULL * 8;
         res.total_phys_memory = 4294967295ULL * 16;
         res.total_page_file = 4294967295ULL * 32;
+        res.resident_shared = 4294967295ULL / 2;
+        res.resident_private = 4294967295ULL / 2;
         return res;
     }
 
@@ -0,0 +1,126 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Measures camera frame conversions from the formats host webcams and the
+// virtual scene produce into the formats the guest asks for. The arguments
+// are an index into kSourceFormats and one into kResolutions.
+
+#include "android/camera/camera-format-converters.h"
+
+#include <random>
+#include <stdlib.h>
+#include <vector>
+
+#include "benchmark/benchmark_api.h"
+
+static constexpr uint32_t kSourceFormats[] = {
+        V4L2_PIX_FMT_RGB32,  V4L2_PIX_FMT_BGR32, V4L2_PIX_FMT_RGB24,
+        V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21,  V4L2_PIX_FMT_YUYV,
+        V4L2_PIX_FMT_UYVY,   V4L2_PIX_FMT_SGRBG8, V4L2_PIX_FMT_SGRBG10,
+};
+
+static constexpr struct {
+    int width;
+    int height;
+} kResolutions[] = {{640, 480}, {1280, 720}, {1920, 1080}};
+
+static void formatsAndResolutions(benchmark::internal::Benchmark* b) {
+    for (size_t f = 0; f < sizeof(kSourceFormats) / sizeof(*kSourceFormats);
+         ++f) {
+        for (size_t r = 0; r < sizeof(kResolutions) / sizeof(*kResolutions);
+             ++r) {
+            b->ArgPair(int(f), int(r));
+        }
+    }
+}
+
+#define FORMAT_BENCHMARK(x) BENCHMARK(x)->Apply(formatsAndResolutions)
+
+// Converts frames of the benchmark's source format and resolution into
+// framebuffers of |dest_format|, |scale| times smaller.
+static void convertFrames(benchmark::State& state,
+                          uint32_t dest_format,
+                          int scale,
+                          bool slow) {
+    const uint32_t src_format = kSourceFormats[state.range_x()];
+    const int width = kResolutions[state.range_y()].width;
+    const int height = kResolutions[state.range_y()].height;
+
+    size_t src_size = 0;
+    size_t dest_size = 0;
+    calculate_framebuffer_size(src_format, width, height, &src_size);
+    calculate_framebuffer_size(dest_format, width / scale, height / scale,
+                               &dest_size);
+
+    std::vector<uint8_t> src(src_size);
+    std::mt19937 gen(42);
+    for (auto& b : src) {
+        b = uint8_t(gen());
+    }
+    std::vector<uint8_t> dest(dest_size);
+
+    ClientFrameBuffer framebuffer = {};
+    framebuffer.pixel_format = dest_format;
+    framebuffer.framebuffer = dest.data();
+    framebuffer.width = width / scale;
+    framebuffer.height = height / scale;
+
+    uint8_t* staging = nullptr;
+    size_t staging_size = 0;
+    ClientFrame frame = {};
+    frame.framebuffers = &framebuffer;
+    frame.framebuffers_count = 1;
+    frame.staging_framebuffer = &staging;
+    frame.staging_framebuffer_size = &staging_size;
+
+    while (state.KeepRunning()) {
+        if (slow) {
+            convert_frame_slow(src.data(), src_format, src.size(), width,
+                               height, &framebuffer, 1, 1.0f, 1.0f, 1.0f,
+                               1.0f);
+        } else {
+            convert_frame(src.data(), src_format, src.size(), width, height,
+                          &frame, 1.0f, 1.0f, 1.0f, 1.0f);
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * src.size());
+    free(staging);
+}
+
+void BM_ConvertToNV21(benchmark::State& state) {
+    convertFrames(state, V4L2_PIX_FMT_NV21, 1, false);
+}
+
+void BM_ConvertToYV12(benchmark::State& state) {
+    convertFrames(state, V4L2_PIX_FMT_YVU420, 1, false);
+}
+
+void BM_ConvertToRGB32(benchmark::State& state) {
+    convertFrames(state, V4L2_PIX_FMT_RGB32, 1, false);
+}
+
+// The preview stream of a camera app is usually smaller than the capture.
+void BM_ConvertAndScaleToNV21(benchmark::State& state) {
+    convertFrames(state, V4L2_PIX_FMT_NV21, 2, false);
+}
+
+// The per-pixel converters used when white balance is in effect.
+void BM_ConvertToNV21Slow(benchmark::State& state) {
+    convertFrames(state, V4L2_PIX_FMT_NV21, 1, true);
+}
+
+FORMAT_BENCHMARK(BM_ConvertToNV21);
+FORMAT_BENCHMARK(BM_ConvertToYV12);
+FORMAT_BENCHMARK(BM_ConvertToRGB32);
+FORMAT_BENCHMARK(BM_ConvertAndScaleToNV21);
+FORMAT_BENCHMARK(BM_ConvertToNV21Slow);
+
+BENCHMARK_MAIN();
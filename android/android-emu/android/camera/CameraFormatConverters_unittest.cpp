@@ -13,6 +13,8 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+#include <string.h>
 #include <vector>
 
 // An arbitrary color that's easily recognizable in hex and different for each
@@ -53,8 +55,8 @@ static constexpr uint32_t kSupportedSourceFormats[] = {
         // Aliases for V4L2_PIX_FMT_YUYV.
         V4L2_PIX_FMT_YUY2, V4L2_PIX_FMT_YUNV, V4L2_PIX_FMT_V422,
 
-        // Exclude bayer formats, they are not available in the fast-path so
-        // they don't need comparative testing.
+        // Bayer formats are tested separately below, convert_frame_slow cannot
+        // generate them.
 };
 
 // A list of supported output formats, taken from camera-service.c's
@@ -493,3 +495,217 @@ TEST_P(FrameModifiers, ExpComp) {
 INSTANTIATE_TEST_CASE_P(CameraFormatConverters,
                         FrameModifiers,
                         testing::Values(1.0f, 0.0f, 0.5f, -1.0f, 2.0f));
+
+
+// Bayer formats, with the bits per color and the colors of a 2x2 block.
+static constexpr struct {
+    uint32_t format;
+    int bits;
+    const char* order;
+} kBayerFormats[] = {
+        {V4L2_PIX_FMT_SBGGR8, 8, "BGGR"},   {V4L2_PIX_FMT_SGBRG8, 8, "GBRG"},
+        {V4L2_PIX_FMT_SGRBG8, 8, "GRBG"},   {V4L2_PIX_FMT_SRGGB8, 8, "RGGB"},
+        {V4L2_PIX_FMT_SBGGR10, 10, "BGGR"}, {V4L2_PIX_FMT_SGBRG10, 10, "GBRG"},
+        {V4L2_PIX_FMT_SGRBG10, 10, "GRBG"}, {V4L2_PIX_FMT_SRGGB10, 10, "RGGB"},
+        {V4L2_PIX_FMT_SBGGR12, 12, "BGGR"}, {V4L2_PIX_FMT_SGBRG12, 12, "GBRG"},
+        {V4L2_PIX_FMT_SGRBG12, 12, "GRBG"}, {V4L2_PIX_FMT_SRGGB12, 12, "RGGB"},
+};
+
+// Generate a bayer framebuffer. With |uniform| every site holds kRed, kGreen
+// or kBlue according to its color, otherwise the values are random.
+static std::vector<uint8_t> generateBayerFramebuffer(uint32_t format,
+                                                     int bits,
+                                                     const char* order,
+                                                     int width,
+                                                     int height,
+                                                     bool uniform) {
+    std::vector<uint8_t> bayer(bufferSize(format, width, height));
+    std::mt19937 gen(format);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int value = gen() & ((1 << bits) - 1);
+            if (uniform) {
+                const char color = order[((y & 1) << 1) | (x & 1)];
+                value = (color == 'R' ? kRed : color == 'G' ? kGreen : kBlue)
+                        << (bits - 8);
+            }
+            const int i = y * width + x;
+            if (bits == 8) {
+                bayer[i] = uint8_t(value);
+            } else {
+                const uint16_t sample = uint16_t(value);
+                memcpy(&bayer[i * 2], &sample, sizeof(sample));
+            }
+        }
+    }
+    return bayer;
+}
+
+static std::vector<uint8_t> convertBayer(const std::vector<uint8_t>& bayer,
+                                         uint32_t src_format,
+                                         uint32_t dest_format,
+                                         int width,
+                                         int height,
+                                         bool slow) {
+    std::vector<uint8_t> dest(bufferSize(dest_format, width, height));
+    ClientFrameBuffer framebuffer = {};
+    framebuffer.pixel_format = dest_format;
+    framebuffer.framebuffer = dest.data();
+    framebuffer.width = width;
+    framebuffer.height = height;
+
+    if (slow) {
+        EXPECT_EQ(0, convert_frame_slow(bayer.data(), src_format, bayer.size(),
+                                        width, height, &framebuffer, 1,
+                                        kDefaultColorScale, kDefaultColorScale,
+                                        kDefaultColorScale, kDefaultExpComp));
+        return dest;
+    }
+
+    uint8_t* stagingFramebuffer = nullptr;
+    size_t stagingFramebufferSize = 0;
+    ClientFrame resultFrame = {};
+    resultFrame.framebuffers = &framebuffer;
+    resultFrame.framebuffers_count = 1;
+    resultFrame.staging_framebuffer = &stagingFramebuffer;
+    resultFrame.staging_framebuffer_size = &stagingFramebufferSize;
+    EXPECT_EQ(0, convert_frame_fast(bayer.data(), src_format, bayer.size(),
+                                    width, height, &resultFrame,
+                                    kDefaultExpComp));
+    free(stagingFramebuffer);
+    return dest;
+}
+
+// The fast path demosaics bayer frames exactly like the slow path does.
+TEST(CameraFormatConverters, BayerToRgbMatchesSlowPath) {
+    for (const auto& bayerFormat : kBayerFormats) {
+        for (const auto size : {std::make_pair(32, 24), std::make_pair(17, 9),
+                                std::make_pair(2, 2)}) {
+            SCOPED_TRACE(testing::Message()
+                         << "source=" << bayerFormat.order << bayerFormat.bits
+                         << " " << size.first << "x" << size.second);
+            std::vector<uint8_t> bayer = generateBayerFramebuffer(
+                    bayerFormat.format, bayerFormat.bits, bayerFormat.order,
+                    size.first, size.second, false);
+
+            for (uint32_t dest_format :
+                 {V4L2_PIX_FMT_BGR32, V4L2_PIX_FMT_RGB32,
+                  V4L2_PIX_FMT_ARGB32, V4L2_PIX_FMT_RGB24,
+                  V4L2_PIX_FMT_BGR24}) {
+                SCOPED_TRACE(testing::Message()
+                             << "dest=" << fourccToString(dest_format));
+                // The slow path pads 24 bit lines of odd widths.
+                const bool is24 = dest_format == V4L2_PIX_FMT_RGB24 ||
+                                  dest_format == V4L2_PIX_FMT_BGR24;
+                if (is24 && (size.first & 1)) {
+                    continue;
+                }
+                compareSumOfSquaredDifferences(
+                        convertBayer(bayer, bayerFormat.format, dest_format,
+                                     size.first, size.second, true),
+                        convertBayer(bayer, bayerFormat.format, dest_format,
+                                     size.first, size.second, false),
+                        kDifferenceSq);
+            }
+        }
+    }
+}
+
+TEST(CameraFormatConverters, BayerToYuv) {
+    constexpr int kWidth = 16;
+    constexpr int kHeight = 8;
+
+    for (const auto& bayerFormat : kBayerFormats) {
+        std::vector<uint8_t> bayer = generateBayerFramebuffer(
+                bayerFormat.format, bayerFormat.bits, bayerFormat.order,
+                kWidth, kHeight, true);
+
+        for (uint32_t dest_format : kSupportedDestinationFormats) {
+            SCOPED_TRACE(testing::Message()
+                         << "source=" << bayerFormat.order << bayerFormat.bits
+                         << " dest=" << fourccToString(dest_format));
+
+            compareSumOfSquaredDifferences(
+                    convertBayer(bayer, bayerFormat.format, dest_format,
+                                 kWidth, kHeight, true),
+                    convertBayer(bayer, bayerFormat.format, dest_format,
+                                 kWidth, kHeight, false),
+                    kDifferenceSq);
+        }
+    }
+}
+
+// Framebuffers of one frame may take different routes through the fast path,
+// and share the staging framebuffer.
+TEST(CameraFormatConverters, MultipleFramebuffers) {
+    constexpr int kWidth = 32;
+    constexpr int kHeight = 16;
+
+    for (uint32_t src_format : {V4L2_PIX_FMT_RGB32, V4L2_PIX_FMT_YUV420,
+                                V4L2_PIX_FMT_SGRBG10}) {
+        SCOPED_TRACE(testing::Message()
+                     << "source=" << fourccToString(src_format));
+        std::vector<uint8_t> src =
+                src_format == V4L2_PIX_FMT_SGRBG10
+                        ? generateBayerFramebuffer(src_format, 10, "GRBG",
+                                                   kWidth, kHeight, true)
+                        : generateFramebuffer(src_format, kWidth, kHeight,
+                                              kAlpha, kRed, kGreen, kBlue);
+
+        const struct {
+            uint32_t format;
+            int width;
+            int height;
+        } kDests[] = {
+                {V4L2_PIX_FMT_NV21, kWidth, kHeight},
+                {V4L2_PIX_FMT_YVU420, kWidth / 2, kHeight / 2},
+                {V4L2_PIX_FMT_RGB24, kWidth, kHeight},
+                {V4L2_PIX_FMT_YUV420, kWidth, kHeight},
+        };
+
+        std::vector<std::vector<uint8_t>> dests;
+        std::vector<ClientFrameBuffer> framebuffers;
+        for (const auto& d : kDests) {
+            dests.emplace_back(bufferSize(d.format, d.width, d.height));
+        }
+        for (size_t i = 0; i < dests.size(); ++i) {
+            ClientFrameBuffer framebuffer = {};
+            framebuffer.pixel_format = kDests[i].format;
+            framebuffer.framebuffer = dests[i].data();
+            framebuffer.width = kDests[i].width;
+            framebuffer.height = kDests[i].height;
+            framebuffers.push_back(framebuffer);
+        }
+
+        uint8_t* stagingFramebuffer = nullptr;
+        size_t stagingFramebufferSize = 0;
+        ClientFrame resultFrame = {};
+        resultFrame.framebuffers = framebuffers.data();
+        resultFrame.framebuffers_count = int(framebuffers.size());
+        resultFrame.staging_framebuffer = &stagingFramebuffer;
+        resultFrame.staging_framebuffer_size = &stagingFramebufferSize;
+        EXPECT_EQ(0, convert_frame_fast(src.data(), src_format, src.size(),
+                                        kWidth, kHeight, &resultFrame,
+                                        kDefaultExpComp));
+        free(stagingFramebuffer);
+
+        // Each one must come out as if it was converted on its own.
+        for (size_t i = 0; i < dests.size(); ++i) {
+            SCOPED_TRACE(testing::Message()
+                         << "dest=" << fourccToString(kDests[i].format));
+            std::vector<uint8_t> alone(dests[i].size());
+            ClientFrameBuffer framebuffer = framebuffers[i];
+            framebuffer.framebuffer = alone.data();
+
+            stagingFramebuffer = nullptr;
+            stagingFramebufferSize = 0;
+            resultFrame.framebuffers = &framebuffer;
+            resultFrame.framebuffers_count = 1;
+            EXPECT_EQ(0, convert_frame_fast(src.data(), src_format, src.size(),
+                                            kWidth, kHeight, &resultFrame,
+                                            kDefaultExpComp));
+            free(stagingFramebuffer);
+            EXPECT_EQ(alone, dests[i]);
+        }
+    }
+}
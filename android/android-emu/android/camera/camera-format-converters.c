@@ -288,9 +288,9 @@ _change_exposure_RGB_i(int* r, int* g, int* b, float exp_comp)
     uint8_t y, u, v;
     R8G8B8ToYUV(*r, *g, *b, &y, &u, &v);
     y = _change_exposure(y, exp_comp);
-    *r = YUV2RO(y,u,v);
-    *g = YUV2GO(y,u,v);
-    *b = YUV2BO(y,u,v);
+    *r = YUV2R(y,u,v);
+    *g = YUV2G(y,u,v);
+    *b = YUV2B(y,u,v);
 }
 
 /* Computes the pixel value after adjusting the white balance to the current
@@ -1045,6 +1045,22 @@ _get_bayerRGB(const BayerDesc* desc,
     }
 }
 
+/* Scales colors calculated for a 10-bit or 12-bit bayer framebuffer down to the
+ * 8-bit range.
+ * Param:
+ *  desc - Bayer framebuffer descriptor.
+ *  red, green, blue - Colors to scale in place.
+ */
+static __inline__ void
+_bayer_to_8bit(const BayerDesc* desc, int* red, int* green, int* blue)
+{
+    if (desc->mask == kBayer10) {
+        *red >>= 2; *green >>= 2; *blue >>= 2;
+    } else if (desc->mask == kBayer12) {
+        *red >>= 4; *green >>= 4; *blue >>= 4;
+    }
+}
+
 /********************************************************************************
  * Generic YUV/RGB/BAYER converters
  *******************************************************************************/
@@ -1226,11 +1242,7 @@ BAYERToRGB(const BayerDesc* bayer_fmt,
         for (x = 0; x < width; x++) {
             int r, g, b;
             _get_bayerRGB(bayer_fmt, bayer, x, y, width, height, &r, &g, &b);
-            if (bayer_fmt->mask == kBayer10) {
-                r >>= 2; g >>= 2; b >>= 2;
-            } else if (bayer_fmt->mask == kBayer12) {
-                r >>= 4; g >>= 4; b >>= 4;
-            }
+            _bayer_to_8bit(bayer_fmt, &r, &g, &b);
             _change_white_balance_RGB(&r, &g, &b, r_scale, g_scale, b_scale);
             _change_exposure_RGB_i(&r, &g, &b, exp_comp);
             rgb = rgb_fmt->save_rgb(rgb, r, g, b);
@@ -1268,10 +1280,12 @@ BAYERToYUV(const BayerDesc* bayer_fmt,
                                pY += Y_next_pair, pU += UV_inc, pV += UV_inc) {
             int r, g, b;
             _get_bayerRGB(bayer_fmt, bayer, x, y, width, height, &r, &g, &b);
+            _bayer_to_8bit(bayer_fmt, &r, &g, &b);
             _change_white_balance_RGB(&r, &g, &b, r_scale, g_scale, b_scale);
             _change_exposure_RGB_i(&r, &g, &b, exp_comp);
             R8G8B8ToYUV(r, g, b, pY, pU, pV);
             _get_bayerRGB(bayer_fmt, bayer, x + 1, y, width, height, &r, &g, &b);
+            _bayer_to_8bit(bayer_fmt, &r, &g, &b);
             _change_white_balance_RGB(&r, &g, &b, r_scale, g_scale, b_scale);
             _change_exposure_RGB_i(&r, &g, &b, exp_comp);
             pY[Y_Inc] = RGB2Y(r, g, b);
@@ -1687,7 +1701,8 @@ static const PIXFormat* get_pixel_format_descriptor(uint32_t pixel_format) {
  */
 static bool valid_libyuv_pixformat(const PIXFormat* desc) {
     // Bayer formats are not supported, and RGB656 has the opposite byte order,
-    // so libyuv cannot be used to convert it.
+    // so libyuv cannot be used to convert it. Bayer sources are demosaiced
+    // before libyuv sees them, see libyuv_supported.
     // libyuv does not support YYUV, YVYU, VYUY and YYVU format conversion
     return (desc->format_sel != PIX_FMT_BAYER &&
             desc->fourcc_type != V4L2_PIX_FMT_RGB565 &&
@@ -1709,8 +1724,10 @@ static bool valid_libyuv_pixformat(const PIXFormat* desc) {
  */
 static bool libyuv_supported(const PIXFormat* src_desc,
                              ClientFrame* result_frame) {
-    // Use libyuv if all of the formats are valid.
-    bool valid_format = valid_libyuv_pixformat(src_desc);
+    // Use libyuv if all of the formats are valid. Bayer sources are turned into
+    // ARGB with bayer_to_argb first.
+    bool valid_format = src_desc->format_sel == PIX_FMT_BAYER ||
+                        valid_libyuv_pixformat(src_desc);
 
     int i;
     for (i = 0; i < result_frame->framebuffers_count; ++i) {
@@ -1926,29 +1943,140 @@ bool resize_staging(ClientFrame* result_frame, size_t required) {
     return true;
 }
 
+/* Get the planes of an aligned YUV420 or YVU420 framebuffer.
+ * Param:
+ *  |frame| - Beginning of the framebuffer.
+ *  |pixel_format| - V4L2_PIX_FMT_YUV420 or V4L2_PIX_FMT_YVU420.
+ *  |info| - Layout of the framebuffer, from get_yuv_info.
+ *  |y|, |u|, |v| - Upon return contain the beginning of each plane.
+ */
+static void get_i420_planes(uint8_t* frame,
+                            uint32_t pixel_format,
+                            YUVInfo info,
+                            uint8_t** y,
+                            uint8_t** u,
+                            uint8_t** v) {
+    *y = frame;
+    if (pixel_format == V4L2_PIX_FMT_YVU420) {
+        *v = frame + info.y_size;
+        *u = *v + info.u_or_v_size;
+    } else {
+        *u = frame + info.y_size;
+        *v = *u + info.u_or_v_size;
+    }
+}
+
+/* Reads a pixel of a bayer framebuffer line, see _get_bayer_color. */
+static __inline__ int
+_get_bayer_line_color(const BayerDesc* desc, const uint8_t* line, int x)
+{
+    if (desc->mask == kBayer8) {
+        return line[x];
+    } else {
+#ifndef HOST_WORDS_BIGENDIAN
+        return *((const int16_t*)line + x) & desc->mask;
+#else
+        return (((uint16_t)line[x * 2 + 1] << 8) | line[x * 2]) & desc->mask;
+#endif  /* !HOST_WORDS_BIGENDIAN */
+    }
+}
+
+/* Demosaic a bayer frame into libyuv's ARGB (B, G, R, A in memory), so that the
+ * libyuv kernels can take it from there. The interpolation is the one of
+ * _get_bayerRGB, but pixels away from the borders read their neighbours
+ * straight from the adjacent lines instead of going through the generic
+ * per-pixel helpers.
+ * Param:
+ *  |desc| - Bayer framebuffer descriptor.
+ *  |bayer| - Bayer framebuffer.
+ *  |argb| - ARGB framebuffer of |width| x |height| pixels, |argb_stride| bytes
+ *      per line.
+ */
+static void bayer_to_argb(const BayerDesc* desc,
+                          const void* bayer,
+                          uint8_t* argb,
+                          int argb_stride,
+                          int width,
+                          int height) {
+    const int line_size = width * (desc->mask == kBayer8 ? 1 : 2);
+    int x, y;
+    for (y = 0; y < height; y++) {
+        const uint8_t* line = (const uint8_t*)bayer + y * line_size;
+        const bool border_line = (y == 0 || y == height - 1);
+        /* Border lines never read these. */
+        const uint8_t* above = border_line ? line : line - line_size;
+        const uint8_t* below = border_line ? line : line + line_size;
+        /* Colors of the even and odd pixels in this line. */
+        const char even_color = _get_bayer_color_sel(desc, 0, y);
+        const char odd_color = _get_bayer_color_sel(desc, 1, y);
+        uint8_t* out = argb + y * argb_stride;
+
+        for (x = 0; x < width; x++, out += 4) {
+            const char pixel_color = (x & 1) ? odd_color : even_color;
+            int r, g, b;
+            if (border_line || x == 0 || x == width - 1) {
+                _get_bayerRGB(desc, bayer, x, y, width, height, &r, &g, &b);
+            } else if (pixel_color == 'G') {
+                const int hor = (_get_bayer_line_color(desc, line, x - 1) +
+                                 _get_bayer_line_color(desc, line, x + 1)) / 2;
+                const int vert = (_get_bayer_line_color(desc, above, x) +
+                                  _get_bayer_line_color(desc, below, x)) / 2;
+                const char next_pixel_color = (x & 1) ? even_color : odd_color;
+                g = _get_bayer_line_color(desc, line, x);
+                if (next_pixel_color == 'R') {
+                    r = hor;
+                    b = vert;
+                } else {
+                    r = vert;
+                    b = hor;
+                }
+            } else {
+                const int cross = (_get_bayer_line_color(desc, line, x - 1) +
+                                   _get_bayer_line_color(desc, line, x + 1) +
+                                   _get_bayer_line_color(desc, above, x) +
+                                   _get_bayer_line_color(desc, below, x)) / 4;
+                const int diag = (_get_bayer_line_color(desc, above, x - 1) +
+                                  _get_bayer_line_color(desc, above, x + 1) +
+                                  _get_bayer_line_color(desc, below, x - 1) +
+                                  _get_bayer_line_color(desc, below, x + 1)) / 4;
+                g = cross;
+                if (pixel_color == 'R') {
+                    r = _get_bayer_line_color(desc, line, x);
+                    b = diag;
+                } else {
+                    b = _get_bayer_line_color(desc, line, x);
+                    r = diag;
+                }
+            }
+            _bayer_to_8bit(desc, &r, &g, &b);
+            out[0] = b;
+            out[1] = g;
+            out[2] = r;
+            out[3] = 0xFF;
+        }
+    }
+}
+
 int convert_to_i420(const void* src_frame,
                     uint32_t pixel_format,
                     size_t framebuffer_size,
                     int width,
                     int height,
                     YUVInfo info,
-                    ClientFrame* result_frame) {
-    const size_t staging_size = info.y_size + 2 * info.u_or_v_size;
-
-    uint8_t* y_staging = *result_frame->staging_framebuffer;
-    uint8_t* u_staging = y_staging + info.y_size;
-    uint8_t* v_staging = u_staging + info.u_or_v_size;
-
+                    uint8_t* dst_y,
+                    uint8_t* dst_u,
+                    uint8_t* dst_v) {
     int result = 0;
-    if (pixel_format == V4L2_PIX_FMT_YUV420) {
-        memcpy(y_staging, src_frame, staging_size);
-    } else if (pixel_format == V4L2_PIX_FMT_YVU420) {
-        // YVU420 is 16-byte aligned, but there is no way to specify alignment
-        // with ConvertToI420; manually convert it to YUV420 (swapping U and V)
-        // with libyuv's I420Copy.
-        const uint8_t* src_y = src_frame;
-        const uint8_t* src_v = src_y + info.y_size;
-        const uint8_t* src_u = src_v + info.u_or_v_size;
+    if (pixel_format == V4L2_PIX_FMT_YUV420 ||
+        pixel_format == V4L2_PIX_FMT_YVU420) {
+        // YUV420 and YVU420 are 16-byte aligned, but there is no way to specify
+        // alignment with ConvertToI420; manually copy the planes (swapping U
+        // and V for YVU420) with libyuv's I420Copy.
+        uint8_t* src_y;
+        uint8_t* src_u;
+        uint8_t* src_v;
+        get_i420_planes((uint8_t*)src_frame, pixel_format, info, &src_y, &src_u,
+                        &src_v);
 
         result = I420Copy(src_y,               // src_y
                           info.y_stride,       // src_stride_y
@@ -1956,11 +2084,11 @@ int convert_to_i420(const void* src_frame,
                           info.u_or_v_stride,  // src_stride_u
                           src_v,               // src_v
                           info.u_or_v_stride,  // src_stride_v
-                          y_staging,           // dst_y
+                          dst_y,               // dst_y
                           info.y_stride,       // dst_stride_y
-                          u_staging,           // dst_u
+                          dst_u,               // dst_u
                           info.u_or_v_stride,  // dst_stride_u
-                          v_staging,           // dst_v
+                          dst_v,               // dst_v
                           info.u_or_v_stride,  // dst_stride_v
                           width,               // width
                           height);             // height
@@ -1969,11 +2097,11 @@ int convert_to_i420(const void* src_frame,
 
         result = ConvertToI420(src_frame,           // src_frame
                                framebuffer_size,    // src_size
-                               y_staging,           // dst_y
+                               dst_y,               // dst_y
                                info.y_stride,       // dst_stride_y
-                               u_staging,           // dst_u
+                               dst_u,               // dst_u
                                info.u_or_v_stride,  // dst_stride_u
-                               v_staging,           // dst_v
+                               dst_v,               // dst_v
                                info.u_or_v_stride,  // dst_stride_v
                                0,                   // crop_x
                                0,                   // crop_y
@@ -1994,6 +2122,169 @@ int convert_to_i420(const void* src_frame,
     return 0;
 }
 
+/* Get whether a V4L2 pixel format is one of the 32 bit RGB formats. */
+static bool is_rgb32(uint32_t pixel_format) {
+    return pixel_format == V4L2_PIX_FMT_ARGB32 ||
+           pixel_format == V4L2_PIX_FMT_RGB32 ||
+           pixel_format == V4L2_PIX_FMT_BGR32;
+}
+
+/* Convert a libyuv ARGB frame to an RGB framebuffer.
+ * Param:
+ *  |argb| - ARGB frame, tightly packed.
+ *  |dest| - Destination framebuffer, tightly packed.
+ *  |dest_format| - V4L2 pixel format of |dest|, an RGB format other than
+ *      RGB565.
+ * Return:
+ *  Zero on success, or a libyuv error.
+ */
+static int argb_to_rgb(const uint8_t* argb,
+                       int width,
+                       int height,
+                       uint8_t* dest,
+                       uint32_t dest_format) {
+    const int argb_stride = width * 4;
+    switch (dest_format) {
+        case V4L2_PIX_FMT_BGR32:
+            return ARGBCopy(argb, argb_stride, dest, width * 4, width, height);
+        case V4L2_PIX_FMT_RGB32:
+            return ARGBToABGR(argb, argb_stride, dest, width * 4, width,
+                              height);
+        case V4L2_PIX_FMT_ARGB32:
+            return ARGBToBGRA(argb, argb_stride, dest, width * 4, width,
+                              height);
+        case V4L2_PIX_FMT_RGB24:
+            // libyuv's RAW is R, G, B in memory.
+            return ARGBToRAW(argb, argb_stride, dest, width * 3, width, height);
+        case V4L2_PIX_FMT_BGR24:
+            return ARGBToRGB24(argb, argb_stride, dest, width * 3, width,
+                               height);
+    }
+    return -1;
+}
+
+/* Convert a frame into a framebuffer of the same size with a single libyuv
+ * kernel, without the I420 staging copy, if there is one for the pair of
+ * formats. This is only valid without exposure compensation.
+ * Param:
+ *  |src_frame| - Source frame, |pixel_format| is a valid libyuv format.
+ *  |src_has_alpha| - Whether the source has an alpha channel of its own.
+ *  |framebuffer| - Destination framebuffer.
+ *  |result| - Upon return contains zero on success, or a libyuv error.
+ * Return:
+ *  True if the frame was converted, false if it has to go through I420.
+ */
+static bool convert_direct(const void* src_frame,
+                           uint32_t pixel_format,
+                           size_t framebuffer_size,
+                           bool src_has_alpha,
+                           int width,
+                           int height,
+                           ClientFrameBuffer* framebuffer,
+                           int* result) {
+    const uint8_t* src = src_frame;
+    uint8_t* dest = framebuffer->framebuffer;
+    const uint32_t src_format = pixel_format_to_libyuv(pixel_format);
+    const uint32_t dest_format = pixel_format_to_libyuv(framebuffer->pixel_format);
+
+    switch (dest_format) {
+        case V4L2_PIX_FMT_YUV420:
+        case V4L2_PIX_FMT_YVU420:
+            // convert_to_i420 writes these in place already.
+            return false;
+    }
+
+    // Planar sources are the I420 picture ConvertFromI420 starts from.
+    if (src_format == V4L2_PIX_FMT_YUV420 ||
+        src_format == V4L2_PIX_FMT_YVU420) {
+        const YUVInfo info = get_yuv_info(width, height);
+        uint8_t* src_y;
+        uint8_t* src_u;
+        uint8_t* src_v;
+        get_i420_planes((uint8_t*)src, src_format, info, &src_y, &src_u,
+                        &src_v);
+        *result = ConvertFromI420(src_y,               // y
+                                  info.y_stride,       // y_stride
+                                  src_u,               // u
+                                  info.u_or_v_stride,  // u_stride
+                                  src_v,               // v
+                                  info.u_or_v_stride,  // v_stride
+                                  dest,                // dst_sample
+                                  0,                   // dst_sample_stride
+                                  width,               // width
+                                  height,              // height
+                                  dest_format);        // format
+        return true;
+    }
+
+    switch (dest_format) {
+        case V4L2_PIX_FMT_NV12:
+        case V4L2_PIX_FMT_NV21: {
+            const bool nv21 = dest_format == V4L2_PIX_FMT_NV21;
+            uint8_t* dest_uv = dest + width * height;
+            if (src_format == dest_format) {
+                // Both framebuffers share the layout, so the possibly
+                // overlapping UV lines of odd widths copy over as they are.
+                CopyPlane(src, width, dest, width, width, height);
+                CopyPlane(src + width * height, width, dest_uv, width,
+                          align(width, 2), (height + 1) / 2);
+                *result = 0;
+            } else if (src_format == FOURCC_ARGB) {
+                *result = nv21 ? ARGBToNV21(src, width * 4, dest, width,
+                                            dest_uv, width, width, height)
+                               : ARGBToNV12(src, width * 4, dest, width,
+                                            dest_uv, width, width, height);
+            } else if (!nv21 && src_format == V4L2_PIX_FMT_YUYV) {
+                *result = YUY2ToNV12(src, width * 2, dest, width, dest_uv,
+                                     width, width, height);
+            } else if (!nv21 && src_format == V4L2_PIX_FMT_UYVY) {
+                *result = UYVYToNV12(src, width * 2, dest, width, dest_uv,
+                                     width, width, height);
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        case FOURCC_ARGB:
+        case FOURCC_ABGR:
+        case FOURCC_BGRA:
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_BGR24: {
+            // Unlike the slow path, libyuv keeps the alpha of the source, so
+            // the destination would not be opaque. Leave these pairs to I420.
+            if (src_has_alpha && is_rgb32(framebuffer->pixel_format)) {
+                return false;
+            }
+
+            // A single pass needs one side to be libyuv's ARGB; converting
+            // through an ARGB copy is slower than going through I420.
+            if (src_format == FOURCC_ARGB) {
+                *result = argb_to_rgb(src, width, height, dest,
+                                      framebuffer->pixel_format);
+            } else if (dest_format == FOURCC_ARGB) {
+                *result = ConvertToARGB(src,               // src_frame
+                                        framebuffer_size,  // src_size
+                                        dest,              // dst_argb
+                                        width * 4,         // dst_stride_argb
+                                        0,                 // crop_x
+                                        0,                 // crop_y
+                                        width,             // src_width
+                                        height,            // src_height
+                                        width,             // crop_width
+                                        height,            // crop_height
+                                        kRotate0,          // rotation
+                                        src_format);       // format
+            } else {
+                return false;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
 int convert_frame_fast(const void* src_frame,
                        uint32_t pixel_format,
                        size_t framebuffer_size,
@@ -2001,42 +2292,108 @@ int convert_frame_fast(const void* src_frame,
                        int src_height,
                        ClientFrame* result_frame,
                        float exp_comp) {
+    const PIXFormat* src_desc = get_pixel_format_descriptor(pixel_format);
+    if (src_desc == NULL) {
+        return -1;
+    }
+    const bool src_has_alpha = src_desc->format_sel == PIX_FMT_RGB &&
+                               src_desc->bits_per_pixel == 32;
+
+    // Bayer frames are demosaiced once, into libyuv's ARGB at the beginning of
+    // the staging framebuffer, which then stands in for the source frame.
+    const bool is_bayer = src_desc->format_sel == PIX_FMT_BAYER;
+    const size_t argb_size =
+            is_bayer ? (size_t)src_width * src_height * 4 : 0;
+    if (is_bayer) {
+        if (!resize_staging(result_frame, argb_size)) {
+            D("%s: Failed to resize the camera staging buffer", __FUNCTION__);
+            return -1;
+        }
+        bayer_to_argb(src_desc->desc.bayer_desc, src_frame,
+                      *result_frame->staging_framebuffer, src_width * 4,
+                      src_width, src_height);
+        pixel_format = V4L2_PIX_FMT_BGR32;
+        framebuffer_size = argb_size;
+    }
+
     int n;
     for (n = 0; n < result_frame->framebuffers_count; ++n) {
-        int result_width = result_frame->framebuffers[n].width;
-        int result_height = result_frame->framebuffers[n].height;
+        ClientFrameBuffer* framebuffer = &result_frame->framebuffers[n];
+        const uint32_t dest_pixel_format = framebuffer->pixel_format;
+        int result_width = framebuffer->width;
+        int result_height = framebuffer->height;
         const bool has_resize =
             (src_width != result_width || src_height != result_height);
+        const bool is_direct = !has_resize && exp_comp == 1.0f;
+        // I420 and YV12 framebuffers hold the final I420 picture themselves,
+        // other formats are converted from a staged copy of it.
+        const bool dest_is_i420 = dest_pixel_format == V4L2_PIX_FMT_YUV420 ||
+                                  dest_pixel_format == V4L2_PIX_FMT_YVU420;
         YUVInfo src_info = get_yuv_info(src_width, src_height);
         YUVInfo result_info = get_yuv_info(result_width, result_height);
-        size_t src_size = src_info.y_size + 2 * src_info.u_or_v_size;
+        const size_t src_size = src_info.y_size + 2 * src_info.u_or_v_size;
         const size_t result_size =
             result_info.y_size + 2 * result_info.u_or_v_size;
         const size_t required_staging_size =
-            src_size + (has_resize ? result_size : 0);
+            (has_resize || !dest_is_i420 ? src_size : 0) +
+            (has_resize && !dest_is_i420 ? result_size : 0);
 
-        if (!resize_staging(result_frame, required_staging_size)) {
+        if (!resize_staging(result_frame, argb_size + required_staging_size)) {
             D("%s: Failed to resize the camera staging buffer", __FUNCTION__);
             return -1;
         }
 
+        uint8_t* staging = *result_frame->staging_framebuffer + argb_size;
+        const void* src =
+                is_bayer ? *result_frame->staging_framebuffer : src_frame;
+        uint8_t* dest = framebuffer->framebuffer;
+        int result = 0;
+
+        if (is_direct &&
+            convert_direct(src, pixel_format, framebuffer_size, src_has_alpha,
+                           src_width, src_height, framebuffer, &result)) {
+            if (result != 0) {
+                W("%s: Could not convert frame from %.4s to %.4s %dx%d, error "
+                  "%d",
+                  __FUNCTION__, (const char*)(&pixel_format),
+                  (const char*)(&dest_pixel_format), result_width,
+                  result_height, result);
+                return -1;
+            }
+            continue;
+        }
+
         // Convert to I420, the intermediate format required for libyuv.
-        int result = convert_to_i420(src_frame, pixel_format, framebuffer_size,
-                                     src_width, src_height, src_info, result_frame);
+        uint8_t* src_y;
+        uint8_t* src_u;
+        uint8_t* src_v;
+        if (has_resize || !dest_is_i420) {
+            get_i420_planes(staging, V4L2_PIX_FMT_YUV420, src_info, &src_y,
+                            &src_u, &src_v);
+        } else {
+            get_i420_planes(dest, dest_pixel_format, src_info, &src_y, &src_u,
+                            &src_v);
+        }
+        result = convert_to_i420(src, pixel_format, framebuffer_size,
+                                 src_width, src_height, src_info, src_y, src_u,
+                                 src_v);
         if (result != 0) {
             W("%s: Failed to convert the camera frame", __FUNCTION__);
             return result;
         }
 
-        uint8_t* src_y = *result_frame->staging_framebuffer;
-        uint8_t* src_u = src_y + src_info.y_size;
-        uint8_t* src_v = src_u + src_info.u_or_v_size;
-
         // If there is a resize, resize to the destination size.
         if (has_resize) {
-            uint8_t* dest_y = *result_frame->staging_framebuffer + src_size;
-            uint8_t* dest_u = dest_y + result_info.y_size;
-            uint8_t* dest_v = dest_u + result_info.u_or_v_size;
+            uint8_t* dest_y;
+            uint8_t* dest_u;
+            uint8_t* dest_v;
+            if (dest_is_i420) {
+                get_i420_planes(dest, dest_pixel_format, result_info, &dest_y,
+                                &dest_u, &dest_v);
+            } else {
+                get_i420_planes(staging + src_size, V4L2_PIX_FMT_YUV420,
+                                result_info, &dest_y, &dest_u, &dest_v);
+            }
 
             result = I420Scale(src_y,                      // src_y
                                src_info.y_stride,          // src_stride_y
@@ -2065,7 +2422,6 @@ int convert_frame_fast(const void* src_frame,
             src_u = dest_u;
             src_v = dest_v;
             src_info = result_info;
-            src_size = result_size;
         }
 
         // Apply exposure compensation.
@@ -2080,49 +2436,24 @@ int convert_frame_fast(const void* src_frame,
             }
         }
 
-        // Convert to the target framebuffer formats.
-        void* dest = result_frame->framebuffers[n].framebuffer;
-        const uint32_t dest_format = pixel_format_to_libyuv(
-                result_frame->framebuffers[n].pixel_format);
-
-        if (dest_format == V4L2_PIX_FMT_YUV420) {
-            memcpy(dest, src_y, src_size);
-        } else if (dest_format == V4L2_PIX_FMT_YVU420) {
-            // YVU420 is 16-byte aligned, but there is no way to specify u and v
-            // with ConvertFromI420; manually convert it to YUV420 (swapping U
-            // and V) with libyuv's I420Copy.
-            uint8_t* dest_y = dest;
-            uint8_t* dest_v = dest_y + src_info.y_size;
-            uint8_t* dest_u = dest_v + src_info.u_or_v_size;
-
-            result = I420Copy(src_y,                   // src_y
-                              src_info.y_stride,       // src_stride_y
-                              src_u,                   // src_u
-                              src_info.u_or_v_stride,  // src_stride_u
-                              src_v,                   // src_v
-                              src_info.u_or_v_stride,  // src_stride_v
-                              dest_y,                  // dst_y
-                              src_info.y_stride,       // dst_stride_y
-                              dest_u,                  // dst_u
-                              src_info.u_or_v_stride,  // dst_stride_u
-                              dest_v,                  // dst_v
-                              src_info.u_or_v_stride,  // dst_stride_v
-                              result_width,            // width
-                              result_height);          // height
-        } else {
-            result = ConvertFromI420(src_y,                   // y
-                                     src_info.y_stride,       // y_stride
-                                     src_u,                   // u
-                                     src_info.u_or_v_stride,  // u_stride
-                                     src_v,                   // v
-                                     src_info.u_or_v_stride,  // v_stride
-                                     dest,                    // dst_sample
-                                     0,              // dst_sample_stride
-                                     result_width,   // width
-                                     result_height,  // height
-                                     dest_format);   // format
+        if (dest_is_i420) {
+            continue;
         }
 
+        // Convert to the target framebuffer formats.
+        const uint32_t dest_format = pixel_format_to_libyuv(dest_pixel_format);
+        result = ConvertFromI420(src_y,                   // y
+                                 src_info.y_stride,       // y_stride
+                                 src_u,                   // u
+                                 src_info.u_or_v_stride,  // u_stride
+                                 src_v,                   // v
+                                 src_info.u_or_v_stride,  // v_stride
+                                 dest,                    // dst_sample
+                                 0,                       // dst_sample_stride
+                                 result_width,            // width
+                                 result_height,           // height
+                                 dest_format);            // format
+
         if (result != 0) {
             // Failed to convert with libyuv, fallback to original method for
             // this one frame.
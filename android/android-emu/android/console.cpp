@@ -29,6 +29,7 @@
 #include "android/avd/BugreportInfo.h"
 #include "android/avd/info.h"
 #include "android/base/StringView.h"
+#include "android/base/Tracing.h"
 #include "android/base/misc/StringUtils.h"
 #include "android/cmdline-option.h"
 #include "android/console_auth.h"
@@ -3721,6 +3722,78 @@ static const CommandDefRec screenrecord_commands[] = {
 
         {NULL, NULL, NULL, NULL, NULL, NULL}};
 
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                    T R A C E   C O M M A N D S                                  ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static int do_trace_start(ControlClient client, char* args) {
+    size_t events = android::base::kDefaultTraceEventsPerThread;
+    if (args) {
+        char* end;
+        long value = strtol(args, &end, 10);
+        if (*end != '\0' || value <= 0) {
+            control_write(client,
+                          "KO: <events> must be a positive number, see "
+                          "'help trace start'\r\n");
+            return -1;
+        }
+        events = value;
+    }
+
+    if (!android::base::startTraceCapture(events)) {
+        control_write(client, "KO: A trace capture is already running.\r\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int do_trace_stop(ControlClient client, char* args) {
+    if (!args) {
+        control_write(client,
+                      "KO: missing <file> argument, see 'help trace stop'\r\n");
+        return -1;
+    }
+    if (!android::base::isTraceCaptureActive()) {
+        control_write(client, "KO: No trace capture has been started.\r\n");
+        return -1;
+    }
+
+    android::base::stopTraceCapture();
+    const auto format = android::base::endsWith(args, ".json")
+                                ? android::base::TraceFormat::ChromeJson
+                                : android::base::TraceFormat::Perfetto;
+    if (!android::base::exportTraceCapture(args, format)) {
+        control_write(client, "KO: Could not write the trace to %s\r\n", args);
+        return -1;
+    }
+    return 0;
+}
+
+static const CommandDefRec trace_commands[] = {
+        {"start", "start a trace capture",
+         "'trace start [events]' starts recording the emulator's trace "
+         "events\r\n"
+         "(vCPU exits, render thread work, snapshot workers, ...) in "
+         "memory.\r\n"
+         "Only the last <events> events of every thread are kept, the "
+         "default is 65536.\r\n",
+         NULL, do_trace_start, NULL},
+
+        {"stop", "stop the trace capture and save it",
+         "'trace stop <file>' stops the running capture and writes it to "
+         "<file>.\r\n"
+         "Files ending in .json get the Chrome JSON format "
+         "(chrome://tracing),\r\n"
+         "anything else gets the Perfetto protobuf format "
+         "(ui.perfetto.dev).\r\n",
+         NULL, do_trace_stop, NULL},
+
+        {NULL, NULL, NULL, NULL, NULL, NULL}};
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -4147,6 +4220,12 @@ extern const CommandDefRec main_commands[] = {
         {"screenrecord", "Records the emulator's display", NULL, NULL, NULL,
          screenrecord_commands},
 
+        {"trace", "capture a performance trace",
+         "allows you to record the emulator's trace events and save them "
+         "for\r\n"
+         "chrome://tracing or the Perfetto UI\r\n",
+         NULL, NULL, trace_commands},
+
         {"fold", "fold the device", NULL, NULL, do_fold, NULL},
 
         {"unfold", "unfold the device", NULL, NULL, do_unfold, NULL},
@@ -17,6 +17,7 @@
 #include "android/base/memory/LazyInstance.h"
 #include "android/base/Optional.h"
 #include "android/base/StringFormat.h"
+#include "android/base/Tracing.h"
 #include "android/base/files/MemStream.h"
 #include "android/base/synchronization/Lock.h"
 #include "android/base/threads/ThreadStore.h"
@@ -366,6 +367,37 @@ public:
     }
 
 private:
+    // Wakes for the same pipe are merged into one command, so a chatty pipe
+    // woken many times between two main loop iterations is signalled only
+    // once, and the whole set is delivered to the guest with a single IRQ.
+    // Pipes don't depend on each other's wakes, so they may complete in any
+    // order.
+    virtual void performDeviceOperations(const PendingList& ops) override {
+        PendingList merged;
+        merged.reserve(ops.size());
+        for (const auto& op : ops) {
+            auto it = std::find_if(merged.begin(), merged.end(),
+                                   [&op](const PipeWakeCommand& cmd) {
+                                       return cmd.hwPipe == op.hwPipe;
+                                   });
+            if (it == merged.end()) {
+                merged.push_back(op);
+            } else {
+                it->wakeFlags |= op.wakeFlags;
+            }
+        }
+
+        if (sPipeHwFuncs->beginWakeBatch) {
+            sPipeHwFuncs->beginWakeBatch();
+        }
+        for (const auto& op : merged) {
+            performDeviceOperation(op);
+        }
+        if (sPipeHwFuncs->endWakeBatch) {
+            sPipeHwFuncs->endWakeBatch();
+        }
+    }
+
     virtual void performDeviceOperation(const PipeWakeCommand& wake_cmd) {
         void* hwPipe = wake_cmd.hwPipe;
         int flags = wake_cmd.wakeFlags;
@@ -786,6 +818,7 @@ unsigned android_pipe_guest_poll(void* internalPipe) {
 int android_pipe_guest_recv(void* internalPipe,
                             AndroidPipeBuffer* buffers,
                             int numBuffers) {
+    AEMU_SCOPED_TRACE("android_pipe_guest_recv");
     CHECK_VM_STATE_LOCK();
     auto pipe = static_cast<AndroidPipe*>(internalPipe);
     // Note that pipe may be deleted during this call, so it's not safe to
@@ -796,6 +829,7 @@ int android_pipe_guest_recv(void* internalPipe,
 int android_pipe_guest_send(void* internalPipe,
                             const AndroidPipeBuffer* buffers,
                             int numBuffers) {
+    AEMU_SCOPED_TRACE("android_pipe_guest_send");
     CHECK_VM_STATE_LOCK();
     auto pipe = static_cast<AndroidPipe*>(internalPipe);
     // Note that pipe may be deleted during this call, so it's not safe to
@@ -112,6 +112,15 @@ protected:
     // the method that actually touches the virtual device.
     virtual void performDeviceOperation(const T& op) = 0;
 
+    // Called from the main loop with all operations that were deferred
+    // since the last timer event. Derived classes can override this to
+    // merge or reorder them; the default performs them one by one.
+    virtual void performDeviceOperations(const PendingList& ops) {
+        for (const auto& op : ops) {
+            performDeviceOperation(op);
+        }
+    }
+
     // queueDeviceOperation: If the VM lock is currently held,
     // we are OK to actually perform device operations.
     // Otherwise, we need to add the request to a pending
@@ -159,9 +168,7 @@ protected:
 private:
     void onTimerEvent() {
         AutoLock lock(mLock);
-        for (const auto& elt : mPending) {
-            performDeviceOperation(elt);
-        }
+        performDeviceOperations(mPending);
         mPending.clear();
     }
 
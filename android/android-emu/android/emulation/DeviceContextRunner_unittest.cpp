@@ -184,6 +184,55 @@ TEST(DeviceContextRunner, multiRequestsNeedWait) {
     resetTestDevice();
 }
 
+// A runner that sees all deferred operations at once and records how many
+// batches it was handed, in addition to forwarding each request.
+class BatchingTestDeviceContextRunner :
+    public DeviceContextRunner<DeviceContextRunnerTestOp> {
+public:
+    void signal(const DeviceContextRunnerTestOp& op) {
+        queueDeviceOperation(op);
+    }
+    int batches = 0;
+private:
+    void performDeviceOperations(const PendingList& ops) override {
+        ++batches;
+        DeviceContextRunner::performDeviceOperations(ops);
+    }
+    void performDeviceOperation(const DeviceContextRunnerTestOp& op) override {
+        getTestDevice()->requests.push_back(op.request_code);
+    }
+};
+
+TEST(DeviceContextRunner, multiRequestsNeedWaitBatched) {
+    resetTestDevice();
+
+    std::unique_ptr<Looper> testLooper(Looper::create());
+
+    TestVmLock testLock;
+
+    BatchingTestDeviceContextRunner testRunner;
+    testRunner.init(&testLock, testLooper.get());
+
+    for (size_t i = 0; i < kNumRequests; i++) {
+        testRunner.signal({ .request_code = (int)i });
+    }
+
+    testLock.lock();
+    testLooper->run();
+    testLock.unlock();
+
+    EXPECT_EQ(1, testRunner.batches);
+    EXPECT_EQ(kNumRequests, getTestDevice()->requests.size());
+
+    const std::vector<int>& results =
+        getTestDevice()->requests;
+    for (size_t i = 0; i < kNumRequests; i++) {
+        EXPECT_EQ((int)i, results[i]);
+    }
+
+    resetTestDevice();
+}
+
 } // namespace
 
 } // namespace android
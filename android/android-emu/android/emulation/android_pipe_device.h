@@ -186,6 +186,10 @@ typedef struct AndroidPipeHwFuncs {
     // Lookup functions for pipe instances and ids.
     int (*getPipeId)(void* hwpipe);
     void* (*lookupPipeById)(int id);
+    // Optional: bracket a group of signalWake()/closeFromHost() calls so the
+    // device can notify the guest once for all of them. Can be NULL.
+    void (*beginWakeBatch)(void);
+    void (*endWakeBatch)(void);
 } AndroidPipeHwFuncs;
 
 // Utility functions to look up pipe instances and ids.
@@ -16,18 +16,24 @@
 
 #include "android/base/Log.h"
 #include "android/base/files/PathUtils.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
 #include "android/base/system/System.h"
 #include "android/emulation/control/display_agent.h"
 #include "android/emulation/control/window_agent.h"
 #include "observation.pb.h"
 #include "android/emulator-window.h"
 #include "android/loadpng.h"
+#include "android/opengl/FrameHub.h"
 #include "android/opengles.h"
 #include "android/utils/string.h"
 
+#include <libyuv.h>
 #include <png.h>
+#include <zlib.h>
 #include <fstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 
 namespace android {
@@ -53,97 +59,380 @@ bool captureScreenshot(android::base::StringView outputDirectoryPath,
     }
 }
 
-Image takeScreenshot(
-        ImageFormat desiredFormat,
-        SkinRotation rotation,
-        emugl::Renderer* renderer,
-        std::function<void(int* w,
-                           int* h,
-                           int* lineSize,
-                           int* bytesPerPixel,
-                           uint8_t** frameBufferData)> getFrameBuffer,
-        int displayId,
-        int desiredWidth,
-        int desiredHeight
-        ) {
+namespace {
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+
+using FrameBufferGetter = std::function<void(int* w,
+                                             int* h,
+                                             int* lineSize,
+                                             int* bytesPerPixel,
+                                             uint8_t** frameBufferData)>;
+
+// Staging buffers for pixels that cannot be written straight into the output
+// of a screenshot, e.g. the ones that get PNG encoded. They are kept around
+// so a stream of screenshots does not allocate a whole frame every time.
+class ScratchBuffers {
+public:
+    std::vector<uint8_t> acquire() {
+        AutoLock lock(mLock);
+        if (mFree.empty()) {
+            return {};
+        }
+        std::vector<uint8_t> buffer = std::move(mFree.back());
+        mFree.pop_back();
+        return buffer;
+    }
+
+    void release(std::vector<uint8_t>&& buffer) {
+        AutoLock lock(mLock);
+        if (mFree.size() < kMaxFree) {
+            mFree.push_back(std::move(buffer));
+        }
+    }
+
+private:
+    static constexpr size_t kMaxFree = 2;
+
+    Lock mLock;
+    std::vector<std::vector<uint8_t>> mFree;
+};
+
+LazyInstance<ScratchBuffers> sScratchBuffers = LAZY_INSTANCE_INIT;
+
+// A scratch buffer that goes back to the pool when it goes out of scope.
+class ScopedScratch {
+public:
+    ScopedScratch() : mBuffer(sScratchBuffers->acquire()) {}
+    ~ScopedScratch() { sScratchBuffers->release(std::move(mBuffer)); }
+
+    std::vector<uint8_t>* get() { return &mBuffer; }
+
+private:
+    std::vector<uint8_t> mBuffer;
+};
+
+template <class Buffer>
+uint8_t* resizeBuffer(Buffer* buffer, size_t size) {
+    buffer->resize(size);
+    return size ? reinterpret_cast<uint8_t*>(&(*buffer)[0]) : nullptr;
+}
+
+// Reads RGBA pixels from |renderer| into |buffer|. The buffer is used as is
+// when it is large enough, otherwise it is resized to what the renderer asks
+// for. Returns nullptr if there was nothing to capture.
+template <class Buffer>
+uint8_t* readRenderer(emugl::Renderer* renderer,
+                      Buffer* buffer,
+                      unsigned int* width,
+                      unsigned int* height,
+                      int displayId,
+                      int desiredWidth,
+                      int desiredHeight,
+                      SkinRotation rotation) {
+    size_t size = buffer->size();
+    uint8_t* pixels = resizeBuffer(buffer, size);
+    // The display can change its size between two attempts.
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        if (renderer->getScreenshot(4, width, height, pixels, &size, displayId,
+                                    desiredWidth, desiredHeight, rotation)) {
+            return resizeBuffer(buffer, size);
+        }
+        if (size == 0) {
+            break;
+        }
+        pixels = resizeBuffer(buffer, size);
+    }
+    *width = 0;
+    *height = 0;
+    return nullptr;
+}
+
+// Expands RGB565 to RGB888 a row at a time, so the intermediate ARGB row
+// libyuv needs stays in the cache.
+void convertRgb565ToRgb888(const uint8_t* src,
+                           int srcStride,
+                           uint8_t* dst,
+                           int width,
+                           int height) {
+    std::vector<uint8_t> argb(width * 4);
+    for (int y = 0; y < height; ++y) {
+        libyuv::RGB565ToARGB(src + y * srcStride, srcStride, argb.data(),
+                             width * 4, width, 1);
+        // libyuv's ARGB is B, G, R, A in memory and RAW is R, G, B.
+        libyuv::ARGBToRAW(argb.data(), width * 4, dst + y * width * 3,
+                          width * 3, width, 1);
+    }
+}
+
+template <class Buffer>
+bool encodePng(Buffer* out,
+               const uint8_t* pixels,
+               unsigned int nChannels,
+               unsigned int width,
+               unsigned int height,
+               SkinRotation rotation,
+               PngCompression compression) {
+    out->clear();
+    // Screen content compresses well, this is enough for most images.
+    out->reserve(size_t(width) * height * nChannels / 4);
+
+    png_structp p = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
+                                            NULL, NULL);
+    png_infop pi = png_create_info_struct(p);
+    png_set_write_fn(
+            p, out,
+            [](png_structp png_ptr, png_bytep data, png_size_t length) {
+                Buffer* buffer =
+                        reinterpret_cast<Buffer*>(png_get_io_ptr(png_ptr));
+                buffer->insert(buffer->end(), &data[0], &data[length]);
+            },
+            [](png_structp png_ptr) {});
+    if (compression == PngCompression::Fast) {
+        // Sub is the cheapest filter that still helps on UI content, and
+        // saves libpng trying all filters on every row.
+        png_set_compression_level(p, Z_BEST_SPEED);
+        png_set_filter(p, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+    }
+    bool written = write_png_user_function(p, pi, nChannels, width, height,
+                                           rotation,
+                                           const_cast<uint8_t*>(pixels));
+    png_destroy_write_struct(&p, &pi);
+    return written;
+}
+
+template <class Buffer>
+Image takeScreenshotInto(Buffer* out,
+                         ImageFormat desiredFormat,
+                         SkinRotation rotation,
+                         emugl::Renderer* renderer,
+                         const FrameBufferGetter& getFrameBuffer,
+                         int displayId,
+                         int desiredWidth,
+                         int desiredHeight,
+                         PngCompression compression) {
+    const Image failed(0, 0, 0, ImageFormat::RGB888);
+    const bool encode = desiredFormat == ImageFormat::PNG;
     unsigned int nChannels = 4;
-    unsigned int width;
-    unsigned int height;
+    unsigned int width = 0;
+    unsigned int height = 0;
     ImageFormat outputFormat = ImageFormat::RGBA8888;
-    std::vector<unsigned char> pixelBuffer;
+    const uint8_t* pixels = nullptr;
+
+    // Pixels that still have to be encoded or converted are staged in the
+    // scratch buffer, the others are written straight into |out|.
+    ScopedScratch scratch;
     if (renderer) {
-        renderer->getScreenshot(nChannels, &width, &height, pixelBuffer, displayId,
-                                desiredWidth, desiredHeight, rotation);
+        if (encode || desiredFormat == ImageFormat::RGB888) {
+            pixels = readRenderer(renderer, scratch.get(), &width, &height,
+                                  displayId, desiredWidth, desiredHeight,
+                                  rotation);
+        } else {
+            pixels = readRenderer(renderer, out, &width, &height, displayId,
+                                  desiredWidth, desiredHeight, rotation);
+        }
+        if (!pixels) {
+            return failed;
+        }
+        // already rotated through rendering
+        rotation = SKIN_ROTATION_0;
     } else {
-        unsigned char* pixels = nullptr;
+        uint8_t* frameBuffer = nullptr;
+        int w = 0;
+        int h = 0;
         int bpp = 4;
         int lineSize = 0;
-        getFrameBuffer((int*)&width, (int*)&height, &lineSize, &bpp, &pixels);
-        if (bpp < 1 || bpp > 4) {
+        getFrameBuffer(&w, &h, &lineSize, &bpp, &frameBuffer);
+        if (bpp < 1 || bpp > 4 || w <= 0 || h <= 0 || !frameBuffer) {
             // unknown pixel buffer format
-            return Image(0, 0, 0, ImageFormat::RGB888, {});
+            return failed;
         }
+        width = w;
+        height = h;
         // -gpu guest usually gives us bpp=2
         // bpp=2 infers we are using rgb565
         // convert it to rgb888
         nChannels = bpp == 2 ? 3 : bpp;
-        outputFormat = ImageFormat::RGB888;
-        // Need to handle padding if lineSize != width * nChannels
-        if ((lineSize != 0 && lineSize != width * nChannels) || bpp == 2) {
-            pixelBuffer.resize(width * height * nChannels);
-            unsigned char* src = pixels;
-            unsigned char* dst = pixelBuffer.data();
-            for (int h = 0; h < height; h++) {
-                if (bpp != 2) {
-                    memcpy(dst, src, width * nChannels);
-                    dst += width * nChannels;
-                } else {
-                    // rgb565, need convertion
-                    for (int w = 0; w < width; w++) {
-                        unsigned char r = src[w * 2 + 1] >> 3;
-                        unsigned char g =
-                                (src[w * 2 + 1] & 7) << 3 | src[w * 2] >> 5;
-                        unsigned char b = src[w * 2] & 63;
-                        r = r << 3 | r >> 2;
-                        g = g << 2 | g >> 4;
-                        b = b << 3 | b >> 2;
-                        *(dst++) = r;
-                        *(dst++) = g;
-                        *(dst++) = b;
-                    }
-                }
-                src += lineSize;
-            }
-            pixels = pixelBuffer.data();
+        outputFormat =
+                nChannels == 4 ? ImageFormat::RGBA8888 : ImageFormat::RGB888;
+        if (lineSize <= 0) {
+            lineSize = w * bpp;
+        }
+        const int rowSize = w * nChannels;
+        const bool stage = encode || (desiredFormat == ImageFormat::RGB888 &&
+                                      nChannels == 4);
+        if (stage && bpp != 2 && lineSize == rowSize) {
+            // Tightly packed, encode or convert the framebuffer itself.
+            pixels = frameBuffer;
         } else {
-            // Just copy the pixels to our buffer.
-            pixelBuffer.insert(pixelBuffer.end(), &pixels[0], &pixels[width * height * nChannels]);
+            uint8_t* dst = stage ? resizeBuffer(scratch.get(), rowSize * h)
+                                 : resizeBuffer(out, rowSize * h);
+            if (bpp == 2) {
+                convertRgb565ToRgb888(frameBuffer, lineSize, dst, w, h);
+            } else {
+                // Need to handle padding if lineSize != width * nChannels
+                libyuv::CopyPlane(frameBuffer, lineSize, dst, rowSize, rowSize,
+                                  h);
+            }
+            pixels = dst;
         }
     }
-    // We only convert png at this time..
-    if (desiredFormat == ImageFormat::PNG) {
-        std::vector<uint8_t> pngData;
-        png_structp p = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
-                                                NULL, NULL);
-        png_infop pi = png_create_info_struct(p);
-        png_set_write_fn(
-                p, &pngData,
-                [](png_structp png_ptr, png_bytep data, png_size_t length) {
-                    std::vector<uint8_t>* vec =
-                            reinterpret_cast<std::vector<uint8_t>*>(
-                                    png_get_io_ptr(png_ptr));
-                    vec->insert(vec->end(), &data[0], &data[length]);
-                },
-                [](png_structp png_ptr) {});
-        // already rotated through rendering
-        rotation = renderer ? SKIN_ROTATION_0 : rotation;
-        write_png_user_function(p, pi, nChannels, width,
-                                height, rotation,
-                                pixelBuffer.data());
-        png_destroy_write_struct(&p, &pi);
-        return Image((uint16_t)width, (uint16_t)height, nChannels, ImageFormat::PNG, pngData);
-    }
-    return Image((uint16_t)width, (uint16_t)height, nChannels, outputFormat, pixelBuffer);
+
+    if (encode) {
+        if (!encodePng(out, pixels, nChannels, width, height, rotation,
+                       compression)) {
+            return failed;
+        }
+        return Image((uint16_t)width, (uint16_t)height, nChannels,
+                     ImageFormat::PNG);
+    }
+    if (desiredFormat == ImageFormat::RGB888 && nChannels == 4) {
+        // libyuv's ARGB to RGB24 keeps the first three bytes of every pixel,
+        // so it turns RGBA into RGB as well.
+        uint8_t* dst = resizeBuffer(out, size_t(width) * height * 3);
+        libyuv::ARGBToRGB24(pixels, width * 4, dst, width * 3, width, height);
+        return Image((uint16_t)width, (uint16_t)height, 3,
+                     ImageFormat::RGB888);
+    }
+    return Image((uint16_t)width, (uint16_t)height, nChannels, outputFormat);
+}
+
+// Converts |frame| the way the renderer does a screenshot: scaled to
+// |desiredWidth| x |desiredHeight|, then rotated clockwise.
+template <class Buffer>
+Image takeScreenshotFromFrame(Buffer* out,
+                              ImageFormat desiredFormat,
+                              SkinRotation rotation,
+                              const android::opengl::SharedFrame& frame,
+                              int desiredWidth,
+                              int desiredHeight,
+                              PngCompression compression) {
+    int width = desiredWidth > 0 ? desiredWidth : frame.width();
+    int height = desiredHeight > 0 ? desiredHeight : frame.height();
+    const uint8_t* pixels = frame.pixels();
+
+    ScopedScratch scaled;
+    if (width != frame.width() || height != frame.height()) {
+        uint8_t* dst = resizeBuffer(scaled.get(), size_t(width) * height * 4);
+        libyuv::ARGBScale(pixels, frame.width() * 4, frame.width(),
+                          frame.height(), dst, width * 4, width, height,
+                          libyuv::kFilterBilinear);
+        pixels = dst;
+    }
+
+    ScopedScratch rotated;
+    if (rotation != SKIN_ROTATION_0) {
+        static const libyuv::RotationMode kModes[] = {
+                libyuv::kRotate0, libyuv::kRotate90, libyuv::kRotate180,
+                libyuv::kRotate270};
+        const bool swap =
+                rotation == SKIN_ROTATION_90 || rotation == SKIN_ROTATION_270;
+        const int rotatedWidth = swap ? height : width;
+        uint8_t* dst = resizeBuffer(rotated.get(), size_t(width) * height * 4);
+        libyuv::ARGBRotate(pixels, width * 4, dst, rotatedWidth * 4, width,
+                           height, kModes[rotation]);
+        pixels = dst;
+        if (swap) {
+            std::swap(width, height);
+        }
+    }
+
+    // The frame is B, G, R, A in memory, screenshots are R, G, B(, A).
+    if (desiredFormat == ImageFormat::RGB888) {
+        uint8_t* dst = resizeBuffer(out, size_t(width) * height * 3);
+        libyuv::ARGBToRAW(pixels, width * 4, dst, width * 3, width, height);
+        return Image((uint16_t)width, (uint16_t)height, 3,
+                     ImageFormat::RGB888);
+    }
+    if (desiredFormat != ImageFormat::PNG) {
+        uint8_t* dst = resizeBuffer(out, size_t(width) * height * 4);
+        libyuv::ARGBToABGR(pixels, width * 4, dst, width * 4, width, height);
+        return Image((uint16_t)width, (uint16_t)height, 4,
+                     ImageFormat::RGBA8888);
+    }
+
+    // The PNG is encoded from R, G, B, A pixels staged on the side.
+    ScopedScratch rgba;
+    uint8_t* dst = resizeBuffer(rgba.get(), size_t(width) * height * 4);
+    libyuv::ARGBToABGR(pixels, width * 4, dst, width * 4, width, height);
+    if (!encodePng(out, dst, 4, width, height, SKIN_ROTATION_0, compression)) {
+        return Image(0, 0, 0, ImageFormat::RGB888);
+    }
+    return Image((uint16_t)width, (uint16_t)height, 4, ImageFormat::PNG);
+}
+
+}  // namespace
+
+Image takeScreenshot(std::string* out,
+                     ImageFormat desiredFormat,
+                     SkinRotation rotation,
+                     const android::opengl::SharedFrame& frame,
+                     int desiredWidth,
+                     int desiredHeight,
+                     PngCompression compression) {
+    return takeScreenshotFromFrame(out, desiredFormat, rotation, frame,
+                                   desiredWidth, desiredHeight, compression);
+}
+
+Image takeScreenshot(
+        std::string* out,
+        ImageFormat desiredFormat,
+        SkinRotation rotation,
+        emugl::Renderer* renderer,
+        std::function<void(int* w,
+                           int* h,
+                           int* lineSize,
+                           int* bytesPerPixel,
+                           uint8_t** frameBufferData)> getFrameBuffer,
+        int displayId,
+        int desiredWidth,
+        int desiredHeight,
+        PngCompression compression) {
+    return takeScreenshotInto(out, desiredFormat, rotation, renderer,
+                              getFrameBuffer, displayId, desiredWidth,
+                              desiredHeight, compression);
+}
+
+Image takeScreenshot(
+        std::vector<uint8_t>* out,
+        ImageFormat desiredFormat,
+        SkinRotation rotation,
+        emugl::Renderer* renderer,
+        std::function<void(int* w,
+                           int* h,
+                           int* lineSize,
+                           int* bytesPerPixel,
+                           uint8_t** frameBufferData)> getFrameBuffer,
+        int displayId,
+        int desiredWidth,
+        int desiredHeight,
+        PngCompression compression) {
+    return takeScreenshotInto(out, desiredFormat, rotation, renderer,
+                              getFrameBuffer, displayId, desiredWidth,
+                              desiredHeight, compression);
+}
+
+Image takeScreenshot(
+        ImageFormat desiredFormat,
+        SkinRotation rotation,
+        emugl::Renderer* renderer,
+        std::function<void(int* w,
+                           int* h,
+                           int* lineSize,
+                           int* bytesPerPixel,
+                           uint8_t** frameBufferData)> getFrameBuffer,
+        int displayId,
+        int desiredWidth,
+        int desiredHeight
+        ) {
+    std::vector<uint8_t> pixels;
+    Image img = takeScreenshotInto(&pixels, desiredFormat, rotation, renderer,
+                                   getFrameBuffer, displayId, desiredWidth,
+                                   desiredHeight, PngCompression::Default);
+    return Image(img.getWidth(), img.getHeight(), img.getChannels(),
+                 img.getImageFormat(), std::move(pixels));
 }
 
 bool captureScreenshot(
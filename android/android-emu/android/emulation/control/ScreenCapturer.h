@@ -15,6 +15,7 @@
 #pragma once
 
 #include <functional>
+#include <string>
 #include <vector>
 
 #include "android/base/StringView.h"
@@ -25,12 +26,30 @@ class Renderer;
 }
 
 namespace android {
+namespace opengl {
+class SharedFrame;
+}  // namespace opengl
+
 namespace emulation {
 
 enum class ImageFormat { PNG, RAW, RGB888, RGBA8888 };
 
+// Trade-off between size and encoding time of PNG screenshots.
+enum class PngCompression {
+    // zlib's default level and adaptive row filters, for files that are kept.
+    Default,
+    // The fastest zlib level and only the Sub row filter. Encodes several
+    // times faster for somewhat larger images, for screenshots that are
+    // streamed to a client.
+    Fast,
+};
+
 class Image {
 public:
+    // An image whose pixels were written somewhere else.
+    Image(uint16_t w, uint16_t h, uint8_t channels, ImageFormat format)
+        : m_Width(w), m_Height(h), m_NChannels(channels), m_Format(format) {}
+
     Image(uint16_t w,
           uint16_t h,
           uint8_t channels,
@@ -74,6 +93,52 @@ Image takeScreenshot(
         int desiredHeight = 0
         );
 
+// Same as above, but writes the image (pixels or PNG data) into |out|,
+// replacing its contents, and returns an Image without pixels describing it.
+// Nothing is copied once the image is in |out|, and its storage is reused,
+// so a caller can keep one buffer for a series of screenshots or hand in the
+// string of a protobuf message. A failed capture has a width of 0.
+Image takeScreenshot(
+        std::string* out,
+        ImageFormat desiredFormat,
+        SkinRotation rotation,
+        emugl::Renderer* renderer,
+        std::function<void(int* w,
+                           int* h,
+                           int* lineSize,
+                           int* bytesPerPixel,
+                           uint8_t** frameBufferData)> getFrameBuffer,
+        int displayId = 0,
+        int desiredWidth = 0,
+        int desiredHeight = 0,
+        PngCompression compression = PngCompression::Default);
+Image takeScreenshot(
+        std::vector<uint8_t>* out,
+        ImageFormat desiredFormat,
+        SkinRotation rotation,
+        emugl::Renderer* renderer,
+        std::function<void(int* w,
+                           int* h,
+                           int* lineSize,
+                           int* bytesPerPixel,
+                           uint8_t** frameBufferData)> getFrameBuffer,
+        int displayId = 0,
+        int desiredWidth = 0,
+        int desiredHeight = 0,
+        PngCompression compression = PngCompression::Default);
+
+// Same as above, but takes the screenshot from a frame handed out by the
+// FrameHub of a display instead of reading one back from the renderer.
+// Scaling and rotation happen on the CPU, with the same results as the
+// renderer would produce.
+Image takeScreenshot(std::string* out,
+                     ImageFormat desiredFormat,
+                     SkinRotation rotation,
+                     const android::opengl::SharedFrame& frame,
+                     int desiredWidth = 0,
+                     int desiredHeight = 0,
+                     PngCompression compression = PngCompression::Default);
+
 bool captureScreenshot(android::base::StringView outputDirectoryPath,
                        std::string* outputFilepath = NULL,
                        uint32_t displayId = 0);
@@ -23,6 +23,7 @@
 #include "android/base/testing/TestTempDir.h"
 #include "observation.pb.h"
 #include "android/loadpng.h"
+#include "android/opengl/FrameHub.h"
 
 #include <cstdio>
 #include <fstream>
@@ -37,6 +38,7 @@ using android::emulation::captureScreenshot;
 using android::emulation::takeScreenshot;
 using android::emulation::ImageFormat;
 using android::emulation::Image;
+using android::emulation::PngCompression;
 using ::testing::Gt;
 
 extern "C" EmulatorWindow* emulator_window_get(void) {
@@ -202,25 +204,37 @@ public:
         return false;
     }
     void fillGLESUsages(android_studio::EmulatorGLESUsages*) { }
-    void getScreenshot(unsigned int nChannels, unsigned int* width,
-        unsigned int* height, std::vector<unsigned char>& pixels,
+    bool getScreenshot(unsigned int nChannels, unsigned int* width,
+        unsigned int* height, uint8_t* pixels, size_t* cPixels,
         int displayId, int desiredWidth, int desiredHeight,
         SkinRotation desiredRotation) {
-        if (mHasValidScreenshot) {
-            if (desiredWidth == 0 && desiredHeight == 0) {
-                *width = kWidth;
-                *height = kHeight;
-                pixels.assign(*width * *height * nChannels, 0);
-            } else {
-                *width = desiredWidth;
-                *height = desiredHeight;
-                pixels.assign(*width * *height * nChannels, 0);
-            }
-        } else {
+        if (!mHasValidScreenshot) {
             *width = 0;
             *height = 0;
-            pixels.resize(0);
+            *cPixels = 0;
+            return false;
+        }
+        if (desiredWidth == 0 && desiredHeight == 0) {
+            *width = kWidth;
+            *height = kHeight;
+        } else {
+            *width = desiredWidth;
+            *height = desiredHeight;
+        }
+        const size_t needed = *width * *height * nChannels;
+        if (*cPixels < needed) {
+            *cPixels = needed;
+            return false;
+        }
+        *cPixels = needed;
+        for (size_t i = 0; i < needed; i++) {
+            pixels[i] = pixelByte(i);
         }
+        return true;
+    }
+    // The byte at |offset| of a screenshot.
+    static uint8_t pixelByte(size_t offset) {
+        return offset * 7 % 251;
     }
     void snapshotOperationCallback(
             android::snapshot::Snapshotter::Operation op,
@@ -437,3 +451,131 @@ TEST_F(ScreenCapturerTest, scaleSuccess) {
     EXPECT_TRUE(image.getWidth() == 600);
     EXPECT_TRUE(image.getHeight() == 800);
 }
+
+TEST_F(ScreenCapturerTest, rendererIntoString) {
+    MockRenderer renderer(true);
+    std::string out = "previous screenshot";
+
+    Image image = takeScreenshot(&out, ImageFormat::RGBA8888, SKIN_ROTATION_0,
+                                 &renderer, nullptr, 0, 6, 4);
+    EXPECT_EQ(6, image.getWidth());
+    EXPECT_EQ(4, image.getHeight());
+    EXPECT_EQ(4, image.getChannels());
+    EXPECT_EQ(ImageFormat::RGBA8888, image.getImageFormat());
+    ASSERT_EQ(6 * 4 * 4, out.size());
+    for (size_t i = 0; i < out.size(); i++) {
+        EXPECT_EQ(MockRenderer::pixelByte(i), (uint8_t)out[i]) << i;
+    }
+}
+
+TEST_F(ScreenCapturerTest, rendererRgb888DropsAlpha) {
+    MockRenderer renderer(true);
+    std::vector<uint8_t> out;
+
+    Image image = takeScreenshot(&out, ImageFormat::RGB888, SKIN_ROTATION_0,
+                                 &renderer, nullptr, 0, 5, 3);
+    EXPECT_EQ(3, image.getChannels());
+    EXPECT_EQ(ImageFormat::RGB888, image.getImageFormat());
+    ASSERT_EQ(5 * 3 * 3, out.size());
+    for (size_t i = 0; i < 5 * 3; i++) {
+        for (size_t c = 0; c < 3; c++) {
+            EXPECT_EQ(MockRenderer::pixelByte(i * 4 + c), out[i * 3 + c])
+                    << "pixel " << i << " channel " << c;
+        }
+    }
+}
+
+TEST_F(ScreenCapturerTest, getFrameBufferRgb565Values) {
+    // White, red, green, blue and a gray that needs the low bits filled in.
+    static uint16_t rgb565[] = {0xffff, 0xf800, 0x07e0, 0x001f, 0x8410};
+    const uint8_t expected[] = {255, 255, 255,  255, 0, 0,  0, 255, 0,
+                                0, 0, 255,      132, 130, 132};
+    std::vector<uint8_t> out;
+
+    Image image = takeScreenshot(
+            &out, ImageFormat::RAW, SKIN_ROTATION_0, nullptr,
+            [](int* w, int* h, int* lineSize, int* bytesPerPixel,
+               uint8_t** frameBufferData) {
+                *w = 5;
+                *h = 1;
+                *bytesPerPixel = 2;
+                *frameBufferData = reinterpret_cast<uint8_t*>(rgb565);
+            });
+    EXPECT_EQ(3, image.getChannels());
+    EXPECT_EQ(ImageFormat::RGB888, image.getImageFormat());
+    EXPECT_EQ(std::vector<uint8_t>(expected, expected + sizeof(expected)),
+              out);
+}
+
+TEST_F(ScreenCapturerTest, getFrameBufferPaddedLines) {
+    static uint8_t padded[] = {1, 2, 3, 4,  5, 6, 7, 8,  0, 0,
+                               9, 10, 11, 12,  13, 14, 15, 16,  0, 0};
+    const uint8_t expected[] = {1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15};
+    std::vector<uint8_t> out;
+
+    Image image = takeScreenshot(
+            &out, ImageFormat::RGB888, SKIN_ROTATION_0, nullptr,
+            [](int* w, int* h, int* lineSize, int* bytesPerPixel,
+               uint8_t** frameBufferData) {
+                *w = 2;
+                *h = 2;
+                *lineSize = 10;
+                *bytesPerPixel = 4;
+                *frameBufferData = padded;
+            });
+    EXPECT_EQ(2, image.getWidth());
+    EXPECT_EQ(3, image.getChannels());
+    EXPECT_EQ(std::vector<uint8_t>(expected, expected + sizeof(expected)),
+              out);
+}
+
+TEST_F(ScreenCapturerTest, fastPngScreenShotRotations) {
+    const SkinRotation rotations[] = {SKIN_ROTATION_0, SKIN_ROTATION_90,
+                                      SKIN_ROTATION_180, SKIN_ROTATION_270};
+
+    std::string screenShot = PathUtils::join(mScreenshotPath, "fast_png.png");
+    std::string png;
+    for (SkinRotation rotation : rotations) {
+        Image img = takeScreenshot(&png, ImageFormat::PNG, rotation, nullptr,
+                                   framebuffer4Pixels, 0, 0, 0,
+                                   PngCompression::Fast);
+        EXPECT_EQ(ImageFormat::PNG, img.getImageFormat());
+
+        std::ofstream ofile(screenShot,
+                            std::ofstream::binary | std::ofstream::trunc);
+        ofile.write(png.data(), png.size());
+        ofile.close();
+        uint8_t* pixels =
+                (uint8_t*)loadScreenshot(screenShot.c_str(), 2, 2);
+
+        verifyframebuffer4Pixels(rotation, pixels);
+        free(pixels);
+    }
+}
+
+TEST_F(ScreenCapturerTest, sharedFrameRotation90) {
+    // B, G, R, A pixels of a 2x2 frame: top left, top right, bottom left,
+    // bottom right.
+    static const uint8_t bgra[] = {1, 2, 3, 4,     5, 6, 7, 8,
+                                   9, 10, 11, 12,  13, 14, 15, 16};
+    // Turned clockwise and in R, G, B, A.
+    const uint8_t expected[] = {11, 10, 9, 12,  3, 2, 1, 4,
+                                15, 14, 13, 16, 7, 6, 5, 8};
+    android::opengl::FrameHub hub;
+    android::opengl::SharedFramePtr frame;
+    hub.subscribe([&frame](const android::opengl::SharedFramePtr& f) {
+        frame = f;
+    });
+    hub.post(2, 2, [](void* pixels, size_t size) {
+        memcpy(pixels, bgra, size);
+    });
+    ASSERT_TRUE(frame);
+
+    std::string out;
+    Image image = takeScreenshot(&out, ImageFormat::RGBA8888,
+                                 SKIN_ROTATION_90, *frame);
+    EXPECT_EQ(2, image.getWidth());
+    EXPECT_EQ(2, image.getHeight());
+    EXPECT_EQ(ImageFormat::RGBA8888, image.getImageFormat());
+    EXPECT_EQ(std::string(expected, expected + sizeof(expected)), out);
+}
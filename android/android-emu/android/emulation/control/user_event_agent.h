@@ -43,9 +43,11 @@ typedef struct QAndroidUserEventAgent {
     // counterclockwise rotation.
     void (*sendRotaryEvent)(int delta);
 
-    // Send generic input events.
+    // Send generic input events. sendGenericEvents() keeps the events in
+    // order and returns the number of them that had to be dropped because
+    // the device queue was full.
     void (*sendGenericEvent)(SkinGenericEventCode events);
-    void (*sendGenericEvents)(SkinGenericEventCode* events, int count);
+    int (*sendGenericEvents)(SkinGenericEventCode* events, int count);
 
     // notify the emulator that new user event is available
     void (*onNewUserEvent)(void);
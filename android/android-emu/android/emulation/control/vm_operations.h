@@ -61,6 +61,8 @@ typedef struct {
     void (*onEnd)(void* opaque, const char* name, int res);
     void (*onQuickFail)(void* opaque, const char* name, int res);
     bool (*isCanceled)(void* opaque, const char* name);
+    // Optional, marks the start of the next stage of the operation.
+    void (*onPhase)(void* opaque, const char* name);
 } SnapshotCallbackSet;
 
 typedef enum {
@@ -206,6 +208,18 @@ typedef struct QAndroidVmOperations {
     struct HostmemEntry (*hostmemGetInfo)(uint64_t id);
     EmuRunState (*getRunState)();
 
+    // Dirty page tracking of the guest RAM, used to save a loaded snapshot
+    // again without looking at the pages the guest did not touch.
+    // startDirtyPageTracking() forgets about any earlier writes, and returns
+    // false if the hypervisor cannot track them.
+    bool (*startDirtyPageTracking)(void);
+    void (*stopDirtyPageTracking)(void);
+
+    // Sets the bits of |bitmap| for the 4KB pages of the RAM block at
+    // |ramOffset| that the guest wrote to since the tracking started.
+    // Returns false if that is unknown.
+    bool (*getDirtyPages)(int64_t ramOffset, int64_t size, uint64_t* bitmap);
+
 } QAndroidVmOperations;
 
 // gQAndroidVmOperations is defined in .cpp depending on the target it used for,
@@ -60,3 +60,10 @@ FEATURE_CONTROL_ITEM(CarAssistButton)
 FEATURE_CONTROL_ITEM(NoDelayCloseColorBuffer)
 FEATURE_CONTROL_ITEM(NoDeviceFrame)
 FEATURE_CONTROL_ITEM(VirtioGpuNativeSync)
+FEATURE_CONTROL_ITEM(TcgTbCache)
+FEATURE_CONTROL_ITEM(SlirpThread)
+FEATURE_CONTROL_ITEM(SlirpOffload)
+FEATURE_CONTROL_ITEM(SlirpDnsCache)
+FEATURE_CONTROL_ITEM(SnapshotSharedRam)
+FEATURE_CONTROL_ITEM(LatencyHistograms)
+FEATURE_CONTROL_ITEM(SnapshotDirtyPageTracking)
@@ -16,6 +16,7 @@
 
 #include <stdio.h>                                // for stderr
 #include <atomic>                                 // for atomic_bool
+#include <utility>                                // for move
 
 #include "android/base/Log.h"                     // for LogMessage, DCHECK
 #include "android/base/async/CallbackRegistry.h"  // for CallbackRegistry
@@ -185,11 +186,9 @@ void* gpu_frame_get_record_frame(uint32_t displayId) {
     }
 }
 
-void gpu_register_shared_memory_callback(FrameAvailableCallback frameAvailable,
-                                         void* opaque) {
-    sReceiverState->registerCallback(frameAvailable, opaque);
-    // TODO: need sync with grpc for multi display, put default 0 so far
-    gpu_frame_set_record_mode(true, 0);
+// Asks for the last frame to be posted again, so new listeners do not have
+// to wait for the screen to change.
+static void request_repost() {
     bool expected = false;
     if (sRequestPost.compare_exchange_strong(expected, true)) {
         android_getVirtioGpuOps()->repost();
@@ -197,14 +196,39 @@ void gpu_register_shared_memory_callback(FrameAvailableCallback frameAvailable,
     }
 }
 
+void gpu_register_shared_memory_callback(FrameAvailableCallback frameAvailable,
+                                         void* opaque) {
+    sReceiverState->registerCallback(frameAvailable, opaque);
+    // TODO: need sync with grpc for multi display, put default 0 so far
+    gpu_frame_set_record_mode(true, 0);
+    request_repost();
+}
+
 void gpu_unregister_shared_memory_callback(void* opaque) {
     sReceiverState->unregisterCallback(opaque);
     gpu_frame_set_record_mode(false, 0);
-    bool expected = false;
-    if (sRequestPost.compare_exchange_strong(expected, true)) {
-        android_getVirtioGpuOps()->repost();
-        sRequestPost.store(false);
+    request_repost();
+}
+
+int gpu_frame_subscribe(uint32_t displayId,
+                        android::opengl::FrameHub::Callback callback,
+                        int maxFps) {
+    if (displayId >= MultiDisplay::s_maxNumMultiDisplay) {
+        return -1;
+    }
+    gpu_frame_set_record_mode(true, displayId);
+    int subscription = sBridge[displayId]->getFrameHub()->subscribe(
+            std::move(callback), maxFps);
+    request_repost();
+    return subscription;
+}
+
+void gpu_frame_unsubscribe(uint32_t displayId, int subscription) {
+    if (subscription < 0 || displayId >= MultiDisplay::s_maxNumMultiDisplay) {
+        return;
     }
+    sBridge[displayId]->getFrameHub()->unsubscribe(subscription);
+    gpu_frame_set_record_mode(false, displayId);
 }
 
 void gpu_initialize_recorders() {
@@ -14,9 +14,10 @@
 
 #pragma once
 
-#include <stdint.h>                  // for uint32_t
+#include <stdint.h>                   // for uint32_t
 
-#include "android/utils/compiler.h"  // for ANDROID_BEGIN_HEADER, ANDROID_EN...
+#include "android/opengl/FrameHub.h"  // for FrameHub
+#include "android/utils/compiler.h"   // for ANDROID_BEGIN_HEADER, ANDROID_EN...
 
 ANDROID_BEGIN_HEADER
 
@@ -48,3 +49,13 @@ void gpu_initialize_recorders();
 void gpu_emulator_shutdown();
 
 ANDROID_END_HEADER
+
+// Delivers the frames of |displayId| to |callback|, at most |maxFps| of them
+// per second (0 for all). The frames are read back once for all subscribers
+// of a display, see FrameHub. Turns on recording mode for the display until
+// the returned subscription is passed to gpu_frame_unsubscribe(). Returns -1
+// if the display does not exist.
+int gpu_frame_subscribe(uint32_t displayId,
+                        android::opengl::FrameHub::Callback callback,
+                        int maxFps = 0);
+void gpu_frame_unsubscribe(uint32_t displayId, int subscription);
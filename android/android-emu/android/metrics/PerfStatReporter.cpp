@@ -16,6 +16,7 @@
 
 #include "android/CommonReportedInfo.h"
 #include "android/base/CpuUsage.h"
+#include "android/base/LatencyTracker.h"
 #include "android/base/files/StdioStream.h"
 #include "android/cmdline-option.h"
 #include "android/globals.h"
@@ -28,6 +29,8 @@
 #include "android/utils/debug.h"
 #include "android/utils/file_io.h"
 
+#include <cmath>
+
 #define  D(...)  do {  if (VERBOSE_CHECK(memory)) dprint(__VA_ARGS__); } while (0)
 
 // Report PerfStats metrics in 1 minute but only once.
@@ -40,6 +43,7 @@ namespace metrics {
 
 using android::base::CpuTime;
 using android::base::CpuUsage;
+using android::base::LatencyTracker;
 using android::base::Lock;
 using android::base::StdioStream;
 using android::base::System;
@@ -121,6 +125,7 @@ void PerfStatReporter::fillProto(android_studio::EmulatorPerformanceStats* perfS
 
 static void fillProtoMemUsage(android_studio::EmulatorPerformanceStats* stats_out);
 static void fillProtoCpuUsage(android_studio::EmulatorPerformanceStats* stats_out);
+static void fillProtoLatencies(android_studio::EmulatorPerformanceStats* stats_out);
 
 void PerfStatReporter::dump() {
     if (mWriter != nullptr) {
@@ -147,6 +152,7 @@ void PerfStatReporter::refreshPerfStats() {
 
     fillProtoMemUsage(mCurrPerfStats.get());
     fillProtoCpuUsage(mCurrPerfStats.get());
+    fillProtoLatencies(mCurrPerfStats.get());
 }
 
 static void fillProtoMemUsage(android_studio::EmulatorPerformanceStats* stats_out) {
@@ -159,16 +165,21 @@ static void fillProtoMemUsage(android_studio::EmulatorPerformanceStats* stats_ou
     memUsageProto->set_virtual_memory_max(rawMemUsage.virt_max);
     memUsageProto->set_total_phys_memory(rawMemUsage.total_phys_memory);
     memUsageProto->set_total_page_file(rawMemUsage.total_page_file);
+    memUsageProto->set_resident_memory_shared(rawMemUsage.resident_shared);
+    memUsageProto->set_resident_memory_private(rawMemUsage.resident_private);
     if (android_hw->hw_ramSize) {
         memUsageProto->set_total_guest_memory(android_hw->hw_ramSize * 1024 * 1024);
     }
     D("MemoryReport: uptime: %" PRIu64 ", Res/ResMax/Virt/VirtMax: "
-      "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
+      "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+      ", ResShared/ResPrivate: %" PRIu64 " %" PRIu64,
       stats_out->process_uptime_us(),
       rawMemUsage.resident,
       rawMemUsage.resident_max,
       rawMemUsage.virt,
-      rawMemUsage.virt_max);
+      rawMemUsage.virt_max,
+      rawMemUsage.resident_shared,
+      rawMemUsage.resident_private);
 }
 
 static void fillProtoCpuUsage(android_studio::EmulatorPerformanceStats* stats_out) {
@@ -194,6 +205,54 @@ static void fillProtoCpuUsage(android_studio::EmulatorPerformanceStats* stats_ou
         });
 }
 
+// One estimator per latency histogram with samples, its buckets at the
+// percentiles of HdrHistogram::Summary, in microseconds.
+static void fillProtoLatencies(android_studio::EmulatorPerformanceStats* stats_out) {
+    using Area = LatencyTracker::Area;
+    using Estimator = android_studio::EmulatorPercentileEstimator;
+    static const struct {
+        Area area;
+        Estimator::EmulatorPerformanceMetric metric;
+    } kMetrics[] = {
+        {Area::MainLoopIteration, Estimator::MAIN_LOOP_ITERATION_TIME_US},
+        {Area::BqlHold, Estimator::BQL_HOLD_TIME_US},
+        {Area::VcpuExit, Estimator::VCPU_EXIT_HANDLING_TIME_US},
+        {Area::RenderDecode, Estimator::RENDER_THREAD_DECODE_TIME_US},
+        {Area::FramePost, Estimator::FRAME_POST_INTERVAL_US},
+        {Area::LooperCallback, Estimator::LOOPER_CALLBACK_DELAY_US},
+    };
+
+    const LatencyTracker* tracker = LatencyTracker::get();
+    for (const auto& entry : kMetrics) {
+        const auto summary = tracker->histogram(entry.area).summary();
+        if (!summary.count) {
+            continue;
+        }
+        const std::pair<double, uint64_t> points[] = {
+            {0, summary.min},
+            {50, summary.p50},
+            {90, summary.p90},
+            {99, summary.p99},
+            {99.9, summary.p999},
+            {100, summary.max},
+        };
+        auto estimator = stats_out->add_estimator();
+        estimator->set_metric(entry.metric);
+        auto percentiles = estimator->mutable_estimator();
+        for (const auto& point : points) {
+            auto bucket = percentiles->add_bucket();
+            bucket->set_target_percentile(point.first);
+            bucket->set_value(point.second / 1000.0);
+            bucket->set_count(static_cast<uint64_t>(
+                    std::ceil(point.first / 100 * summary.count)));
+        }
+    }
+    if (tracker->maxPendingCallbacks()) {
+        stats_out->set_max_pending_looper_callbacks(
+                tracker->maxPendingCallbacks());
+    }
+}
+
 }  // namespace metrics
 }  // namespace android
 
@@ -0,0 +1,185 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/FrameHub.h"
+
+#include <algorithm>                     // for remove_if
+#include <utility>                       // for move
+
+#include "android/base/system/System.h"  // for System
+
+#include <libyuv.h>                      // for ARGBToI420
+
+namespace android {
+namespace opengl {
+
+using android::base::AutoLock;
+using android::base::Lock;
+using android::base::System;
+
+// Keeps the pixel buffers of released frames, so a stream of frames of the
+// same size does not allocate (and fault in) a new buffer for every one.
+class FrameHub::Pool {
+public:
+    std::vector<uint8_t> take(size_t size) {
+        std::vector<uint8_t> buffer;
+        {
+            AutoLock lock(mLock);
+            if (!mFree.empty()) {
+                buffer = std::move(mFree.back());
+                mFree.pop_back();
+            }
+        }
+        buffer.resize(size);
+        return buffer;
+    }
+
+    void give(std::vector<uint8_t>&& buffer) {
+        AutoLock lock(mLock);
+        if (mFree.size() < kMaxFree) {
+            mFree.push_back(std::move(buffer));
+        }
+    }
+
+private:
+    // A subscriber holding on to a frame while the next one is being
+    // published, plus one in flight.
+    static constexpr size_t kMaxFree = 3;
+
+    Lock mLock;
+    std::vector<std::vector<uint8_t>> mFree;
+};
+
+SharedFrame::SharedFrame(int width,
+                         int height,
+                         uint64_t number,
+                         int64_t timestampUs)
+    : mWidth(width),
+      mHeight(height),
+      mNumber(number),
+      mTimestampUs(timestampUs) {}
+
+size_t SharedFrame::i420Size() const {
+    const size_t chroma = size_t((mWidth + 1) / 2) * ((mHeight + 1) / 2);
+    return size_t(mWidth) * mHeight + 2 * chroma;
+}
+
+const uint8_t* SharedFrame::i420() const {
+    std::call_once(mI420Once, [this]() {
+        mI420.resize(i420Size());
+        const int chromaWidth = (mWidth + 1) / 2;
+        uint8_t* y = mI420.data();
+        uint8_t* u = y + mWidth * mHeight;
+        uint8_t* v = u + chromaWidth * ((mHeight + 1) / 2);
+        libyuv::ARGBToI420(pixels(), mWidth * 4, y, mWidth, u, chromaWidth, v,
+                           chromaWidth, mWidth, mHeight);
+    });
+    return mI420.data();
+}
+
+FrameHub::FrameHub() : mPool(std::make_shared<Pool>()) {}
+
+FrameHub::~FrameHub() = default;
+
+int FrameHub::subscribe(Callback callback, int maxFps) {
+    AutoLock lock(mLock);
+    const int id = mNextId++;
+    mSubscribers.push_back(
+            {id, std::move(callback), maxFps > 0 ? 1000000 / maxFps : 0, 0});
+    return id;
+}
+
+void FrameHub::unsubscribe(int id) {
+    {
+        AutoLock lock(mLock);
+        mSubscribers.erase(std::remove_if(mSubscribers.begin(),
+                                          mSubscribers.end(),
+                                          [id](const Subscriber& s) {
+                                              return s.id == id;
+                                          }),
+                           mSubscribers.end());
+    }
+    // Wait for a delivery that might still be calling it.
+    AutoLock delivery(mDeliveryLock);
+}
+
+bool FrameHub::hasSubscribers() const {
+    AutoLock lock(mLock);
+    return !mSubscribers.empty();
+}
+
+uint64_t FrameHub::postedFrames() const {
+    AutoLock lock(mLock);
+    return mPosted;
+}
+
+SharedFramePtr FrameHub::lastFrame() const {
+    AutoLock lock(mLock);
+    return mLastFrame;
+}
+
+bool FrameHub::post(int width, int height, const ReadPixels& read) {
+    AutoLock delivery(mDeliveryLock);
+    const int64_t now = System::get()->getHighResTimeUs();
+    std::vector<Callback> due;
+    uint64_t number;
+    {
+        AutoLock lock(mLock);
+        number = ++mPosted;
+        for (auto& subscriber : mSubscribers) {
+            // Frames arrive with some jitter, take one that is a little
+            // early rather than skip it and wait for the next one.
+            if (now < subscriber.nextDueUs - subscriber.intervalUs / 8) {
+                continue;
+            }
+            // Keep the cadence of the subscriber, unless it fell behind by
+            // more than a frame (e.g. the guest stopped posting).
+            subscriber.nextDueUs =
+                    now - subscriber.nextDueUs < subscriber.intervalUs
+                            ? subscriber.nextDueUs + subscriber.intervalUs
+                            : now + subscriber.intervalUs;
+            due.push_back(subscriber.callback);
+        }
+    }
+    if (due.empty() || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    // The last reference to a frame can go away on any thread, and after
+    // the hub is gone.
+    std::weak_ptr<Pool> pool = mPool;
+    std::shared_ptr<SharedFrame> frame(
+            new SharedFrame(width, height, number, now),
+            [pool](SharedFrame* frame) {
+                if (auto alive = pool.lock()) {
+                    alive->give(std::move(frame->mPixels));
+                }
+                delete frame;
+            });
+    frame->mPixels = mPool->take(size_t(width) * height * 4);
+    read(frame->mPixels.data(), frame->mPixels.size());
+
+    SharedFramePtr published = std::move(frame);
+    {
+        AutoLock lock(mLock);
+        mLastFrame = published;
+    }
+    for (const auto& callback : due) {
+        callback(published);
+    }
+    return true;
+}
+
+}  // namespace opengl
+}  // namespace android
@@ -0,0 +1,132 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>                             // for size_t
+#include <stdint.h>                             // for uint8_t, int64_t
+#include <functional>                           // for function
+#include <memory>                               // for shared_ptr
+#include <mutex>                                // for once_flag
+#include <vector>                               // for vector
+
+#include "android/base/synchronization/Lock.h"  // for Lock
+
+namespace android {
+namespace opengl {
+
+class FrameHub;
+
+// A frame of a display, as read back from the renderer. Frames are immutable
+// once published and shared between all the subscribers of a hub, hold on to
+// the pointer for as long as the pixels are needed.
+class SharedFrame {
+public:
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    // Frames are numbered in the order they were posted by the guest,
+    // numbers skipped by a subscriber were dropped for it.
+    uint64_t number() const { return mNumber; }
+    // When the frame was read back, in System::getHighResTimeUs() time.
+    int64_t timestampUs() const { return mTimestampUs; }
+
+    // Tightly packed pixels, B, G, R, A in memory (libyuv's ARGB).
+    const uint8_t* pixels() const { return mPixels.data(); }
+    size_t size() const { return mPixels.size(); }
+
+    // The frame in I420, the Y, U and V planes one after the other. It is
+    // converted by the first caller and shared with the others.
+    const uint8_t* i420() const;
+    size_t i420Size() const;
+
+private:
+    friend class FrameHub;
+
+    SharedFrame(int width, int height, uint64_t number, int64_t timestampUs);
+
+    int mWidth;
+    int mHeight;
+    uint64_t mNumber;
+    int64_t mTimestampUs;
+    std::vector<uint8_t> mPixels;
+
+    mutable std::once_flag mI420Once;
+    mutable std::vector<uint8_t> mI420;
+};
+
+using SharedFramePtr = std::shared_ptr<const SharedFrame>;
+
+// Fans the frames of one display out to any number of subscribers, such as
+// the screen recorder, the WebRTC frame sharer and gRPC screenshot streams.
+//
+// Every posted frame is read back at most once, and only if a subscriber
+// wants it: each subscriber can ask for a maximum frame rate, and frames
+// that come in faster than that are not delivered to it. A frame nobody
+// wants is not read back at all.
+//
+// Subscribers are called on the thread that posts the frames (usually the
+// render thread), they should take a reference to the frame and return; the
+// work on the pixels belongs on a thread of their own.
+class FrameHub {
+public:
+    using Callback = std::function<void(const SharedFramePtr& frame)>;
+    // Reads the posted frame into |pixels|, which holds |size| bytes.
+    using ReadPixels = std::function<void(void* pixels, size_t size)>;
+
+    FrameHub();
+    ~FrameHub();
+
+    // Delivers the frames to |callback|, at most |maxFps| of them per second
+    // (0 for all of them). Returns an id for unsubscribe().
+    int subscribe(Callback callback, int maxFps = 0);
+    void unsubscribe(int id);
+    bool hasSubscribers() const;
+
+    // Called for every frame posted to the display. Reads it with |read| if
+    // a subscriber is due a frame and hands it out. Returns false if the
+    // frame was not read.
+    bool post(int width, int height, const ReadPixels& read);
+
+    // Number of frames posted so far.
+    uint64_t postedFrames() const;
+
+    // The last frame that was read, or null. It can be older than the last
+    // frame that was posted.
+    SharedFramePtr lastFrame() const;
+
+private:
+    struct Subscriber {
+        int id;
+        Callback callback;
+        int64_t intervalUs;
+        int64_t nextDueUs;
+    };
+
+    class Pool;
+
+    mutable base::Lock mLock;
+    // Held while the callbacks run, so none of them is running once
+    // unsubscribe() returns. Callbacks must not unsubscribe themselves.
+    base::Lock mDeliveryLock;
+    std::vector<Subscriber> mSubscribers;
+    int mNextId = 0;
+    uint64_t mPosted = 0;
+    SharedFramePtr mLastFrame;
+    // Pixel buffers of frames that are gone, outlives the hub if frames do.
+    std::shared_ptr<Pool> mPool;
+};
+
+}  // namespace opengl
+}  // namespace android
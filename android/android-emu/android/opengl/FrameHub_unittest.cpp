@@ -0,0 +1,164 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/opengl/FrameHub.h"
+
+#include "android/base/testing/TestSystem.h"
+
+#include <gtest/gtest.h>
+
+#include <libyuv.h>
+#include <string.h>
+#include <vector>
+
+namespace android {
+namespace opengl {
+
+using android::base::System;
+using android::base::TestSystem;
+
+class FrameHubTest : public ::testing::Test {
+protected:
+    // Posts a frame filled with |value|, returns whether it was read.
+    bool post(int width = 4, int height = 2, uint8_t value = 0x42) {
+        return mHub.post(width, height, [this, value](void* pixels, size_t size) {
+            ++mReads;
+            memset(pixels, value, size);
+        });
+    }
+
+    void advanceUs(int64_t us) {
+        mNowUs += us;
+        mTestSystem.setUnixTimeUs(mNowUs);
+    }
+
+    TestSystem mTestSystem{"/", System::kProgramBitness};
+    int64_t mNowUs = 1000000;
+    FrameHub mHub;
+    int mReads = 0;
+};
+
+TEST_F(FrameHubTest, noReadWithoutSubscribers) {
+    EXPECT_FALSE(post());
+    EXPECT_EQ(0, mReads);
+    EXPECT_EQ(1u, mHub.postedFrames());
+    EXPECT_FALSE(mHub.lastFrame());
+}
+
+TEST_F(FrameHubTest, oneReadForAllSubscribers) {
+    SharedFramePtr first;
+    SharedFramePtr second;
+    mHub.subscribe([&first](const SharedFramePtr& frame) { first = frame; });
+    mHub.subscribe([&second](const SharedFramePtr& frame) { second = frame; });
+
+    EXPECT_TRUE(post(4, 2, 0x42));
+    EXPECT_EQ(1, mReads);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(first, mHub.lastFrame());
+    EXPECT_EQ(4, first->width());
+    EXPECT_EQ(2, first->height());
+    EXPECT_EQ(1u, first->number());
+    ASSERT_EQ(4u * 2 * 4, first->size());
+    for (size_t i = 0; i < first->size(); ++i) {
+        EXPECT_EQ(0x42, first->pixels()[i]);
+    }
+}
+
+TEST_F(FrameHubTest, decimatesPerSubscriber) {
+    mTestSystem.setUnixTimeUs(mNowUs);
+    int all = 0;
+    int half = 0;
+    mHub.subscribe([&all](const SharedFramePtr&) { ++all; });
+    mHub.subscribe([&half](const SharedFramePtr&) { ++half; }, 30);
+
+    // A second of 60 fps, with some jitter.
+    for (int i = 0; i < 60; ++i) {
+        advanceUs(i % 2 ? 16000 : 17333);
+        post();
+    }
+    EXPECT_EQ(60, all);
+    EXPECT_EQ(30, half);
+    EXPECT_EQ(60, mReads);
+}
+
+TEST_F(FrameHubTest, skipsReadWhenNobodyIsDue) {
+    mTestSystem.setUnixTimeUs(mNowUs);
+    int delivered = 0;
+    mHub.subscribe([&delivered](const SharedFramePtr&) { ++delivered; }, 10);
+
+    for (int i = 0; i < 60; ++i) {
+        advanceUs(16667);
+        post();
+    }
+    EXPECT_EQ(10, delivered);
+    EXPECT_EQ(10, mReads);
+    // The last frame read is not the last one posted.
+    EXPECT_LT(mHub.lastFrame()->number(), mHub.postedFrames());
+}
+
+TEST_F(FrameHubTest, unsubscribeStopsDelivery) {
+    int delivered = 0;
+    int id = mHub.subscribe([&delivered](const SharedFramePtr&) {
+        ++delivered;
+    });
+    post();
+    mHub.unsubscribe(id);
+    EXPECT_FALSE(mHub.hasSubscribers());
+    EXPECT_FALSE(post());
+    EXPECT_EQ(1, delivered);
+}
+
+TEST_F(FrameHubTest, framesOutliveTheHub) {
+    SharedFramePtr kept;
+    {
+        FrameHub hub;
+        hub.subscribe([&kept](const SharedFramePtr& frame) { kept = frame; });
+        hub.post(2, 2, [](void* pixels, size_t size) {
+            memset(pixels, 7, size);
+        });
+    }
+    ASSERT_TRUE(kept);
+    EXPECT_EQ(7, kept->pixels()[15]);
+}
+
+TEST_F(FrameHubTest, i420IsConvertedOnce) {
+    SharedFramePtr frame;
+    mHub.subscribe([&frame](const SharedFramePtr& f) { frame = f; });
+    const int width = 6;
+    const int height = 3;
+    std::vector<uint8_t> argb(width * height * 4);
+    for (size_t i = 0; i < argb.size(); ++i) {
+        argb[i] = i * 13;
+    }
+    mHub.post(width, height, [&argb](void* pixels, size_t size) {
+        memcpy(pixels, argb.data(), size);
+    });
+    ASSERT_TRUE(frame);
+
+    std::vector<uint8_t> expected(width * height + 2 * 3 * 2);
+    uint8_t* y = expected.data();
+    uint8_t* u = y + width * height;
+    uint8_t* v = u + 3 * 2;
+    libyuv::ARGBToI420(argb.data(), width * 4, y, width, u, 3, v, 3, width,
+                       height);
+
+    ASSERT_EQ(expected.size(), frame->i420Size());
+    const uint8_t* i420 = frame->i420();
+    EXPECT_EQ(i420, frame->i420());
+    EXPECT_EQ(expected, std::vector<uint8_t>(i420, i420 + frame->i420Size()));
+}
+
+}  // namespace opengl
+}  // namespace android
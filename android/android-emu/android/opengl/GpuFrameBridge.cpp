@@ -146,9 +146,11 @@ public:
     virtual void* getRecordFrameAsync() override {
         if (mRecFrameUpdated.exchange(false)) {
             AutoLock lock(mRecLock);
-            mReadPixelsFunc(mRecFrame->pixels,
-                            mRecFrame->width * mRecFrame->height * 4,
-                            mDisplayId);
+            if (!copyFromHub()) {
+                mReadPixelsFunc(mRecFrame->pixels,
+                                mRecFrame->width * mRecFrame->height * 4,
+                                mDisplayId);
+            }
             mRecFrame->isValid = true;
         }
         return mRecFrame && mRecFrame->isValid ? mRecFrame->pixels : nullptr;
@@ -177,6 +179,21 @@ public:
         mReceiverOpaque = opaque;
     }
 
+    FrameHub* getFrameHub() override { return &mHub; }
+
+    // Copies the last posted frame into the recording frame if the hub has
+    // already read it back.
+    bool copyFromHub() {
+        SharedFramePtr frame = mHub.lastFrame();
+        if (!frame || frame->number() != mHub.postedFrames() ||
+            frame->width() != mRecFrame->width ||
+            frame->height() != mRecFrame->height) {
+            return false;
+        }
+        memcpy(mRecFrame->pixels, frame->pixels(), frame->size());
+        return true;
+    }
+
     void postFrame(int width, int height, const void* pixels, bool copy) {
         {
             AutoLock lock(mRecLock);
@@ -191,6 +208,13 @@ public:
             }
         }
         mRecFrameUpdated.store(true, std::memory_order_release);
+        mHub.post(width, height, [=](void* dst, size_t size) {
+            if (copy) {
+                memcpy(dst, pixels, size);
+            } else {
+                mReadPixelsFunc(dst, size, mDisplayId);
+            }
+        });
         if (mReceiver) {
             mReceiver(mReceiverOpaque);
             AutoLock delay(mDelayLock);
@@ -227,6 +251,7 @@ private:
     Frame* mRecFrame;
     Frame* mRecTmpFrame;
     std::atomic_bool mRecFrameUpdated;
+    FrameHub mHub;
     ReadPixelsFunc mReadPixelsFunc = 0;
     uint32_t mDisplayId = 0;
     FlushReadPixelPipeline mFlushPixelPipeline = 0;
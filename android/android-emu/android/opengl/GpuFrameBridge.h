@@ -16,6 +16,7 @@
 
 #include <cstdint>
 #include "android/base/async/Looper.h"
+#include "android/opengl/FrameHub.h"
 
 class Looper;
 namespace android {
@@ -30,7 +31,8 @@ namespace opengl {
 // Usage is the following:
 // 1) Create a new GpuFrameBridge instance.
 // 2) Register the FrameAvailableCallback if needed.
-// 3) Call getRecordFrame or getRecordFrameAsync to receive frame.
+// 3) Call getRecordFrame or getRecordFrameAsync to receive frame, or
+//    subscribe to the frames of its FrameHub.
 class GpuFrameBridge {
 public:
     // Create a new GpuFrameBridge instance.
@@ -69,6 +71,10 @@ public:
 
     virtual void setLooper(android::base::Looper* aLooper) = 0;
 
+    // The hub that hands the posted frames out to its subscribers. Frames
+    // are read back once for the hub and the recording frame together.
+    virtual FrameHub* getFrameHub() = 0;
+
 protected:
     GpuFrameBridge() {}
     GpuFrameBridge(const GpuFrameBridge& other);
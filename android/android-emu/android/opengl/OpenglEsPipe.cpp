@@ -52,6 +52,7 @@ using emugl::RenderChannelPtr;
 using ChannelState = emugl::RenderChannel::State;
 using IoResult = emugl::RenderChannel::IoResult;
 using android::base::Stopwatch;
+using android::snapshot::ScopedSnapshotPhase;
 using android::snapshot::Snapshotter;
 
 #define OPENGL_SAVE_VERSION 1
@@ -102,6 +103,7 @@ public:
             }
             int version = stream->getBe32();
             (void)version;
+            ScopedSnapshotPhase phase(Snapshotter::get().profile(), "renderer");
             renderer->load(stream, Snapshotter::get().loader().textureLoader());
 #ifdef SNAPSHOT_PROFILE
             printf("OpenglEs preload time: %lld ms\n",
@@ -124,6 +126,8 @@ public:
             mSaveMeter.restartUs();
 #endif
             if (const auto& renderer = android_getOpenglesRenderer()) {
+                ScopedSnapshotPhase phase(Snapshotter::get().profile(),
+                                          "renderer");
                 renderer->pauseAllPreSave();
                 stream->putByte(1);
                 stream->putBe32(OPENGL_SAVE_VERSION);
@@ -202,7 +206,13 @@ public:
             unsigned int width;
             unsigned int height;
             std::vector<unsigned char> pixels;
-            renderer.getScreenshot(nChannels, &width, &height, pixels);
+            size_t cPixels = 0;
+            while (!renderer.getScreenshot(nChannels, &width, &height,
+                                           pixels.data(), &cPixels) &&
+                   cPixels > pixels.size()) {
+                pixels.resize(cPixels);
+            }
+            pixels.resize(cPixels);
 #if SNAPSHOT_PROFILE > 1
             printf("Screenshot load texture time %lld ms\n",
                    (long long)(sw.elapsedUs() / 1000));
@@ -14,6 +14,7 @@
 
 #include "android/base/CpuUsage.h"
 #include "android/base/GLObjectCounter.h"
+#include "android/base/LatencyTracker.h"
 #include "android/base/files/PathUtils.h"
 #include "android/base/files/Stream.h"
 #include "android/base/memory/MemoryTracker.h"
@@ -247,6 +248,11 @@ android_startOpenglesRenderer(int width, int height, bool guestPhoneApi, int gue
     sRenderLib->setWindowOps(*window_agent, *multi_display_agent);
     sRenderLib->setUsageTracker(android::base::CpuUsage::get(),
                                 android::base::MemoryTracker::get());
+    sRenderLib->setLatencyTracker(
+            android::featurecontrol::isEnabled(
+                    android::featurecontrol::LatencyHistograms)
+                    ? android::base::LatencyTracker::get()
+                    : nullptr);
 
     sRenderer = sRenderLib->initRenderer(width, height, sRendererUsesSubWindow, sEgl2egl);
 
@@ -41,6 +41,7 @@
 #include "android/recording/Frame.h"            // for Frame, AVFormat, getV...
 #include "android/recording/Producer.h"         // for Producer
 #include "android/recording/codecs/Codec.h"     // for Codec, CodecParams
+#include "android/recording/video/FrameConverter.h"  // for FrameConverter
 #include "android/utils/debug.h"                // for VERBOSE_record, VERBO...
 
 extern "C" {
@@ -75,6 +76,7 @@ struct SwsContext;
 #include <string.h>                             // for memcpy
 #include <cstdint>                              // for uint8_t
 #include <functional>                           // for __base
+#include <memory>                               // for unique_ptr
 #include <string>                               // for string, basic_string
 #include <utility>                              // for move
 #include <vector>                               // for vector
@@ -98,6 +100,9 @@ struct VideoOutputStream {
     AVScopedPtr<AVFrame> frame;
     AVScopedPtr<AVFrame> tmpFrame;
     AVScopedPtr<SwsContext> swsCtx;
+    // Converts the frames when the encoder takes I420, sws_scale() does it
+    // otherwise.
+    std::unique_ptr<FrameConverter> converter;
 
     uint64_t frameCount = 0;
     uint64_t writeFrameCount = 0;
@@ -742,16 +747,29 @@ bool FfmpegRecorderImpl::encodeVideoFrame(const Frame* frame) {
 
     VideoOutputStream* ost = &mVideoStream;
 
-    const int linesize[1] = {getVideoFormatSize(frame->format.videoFormat) *
-                             mFbWidth};
+    const auto format = frame->format.videoFormat;
+    AVCodecContext* c = ost->codecCtx.get();
+    if (!ost->converter && c->pix_fmt == AV_PIX_FMT_YUV420P &&
+        FrameConverter::isSupported(format)) {
+        ost->converter.reset(new FrameConverter(mFbWidth, mFbHeight, format,
+                                                c->width, c->height));
+        VLOG(record) << "Converting frames in "
+                     << ost->converter->slices() << " slices";
+    }
 
-    // To test the speed of sws_scale()
+    // To test the speed of the conversion
     auto startUs = android::base::System::get()->getHighResTimeUs();
-    auto data = frame->dataVec.data();
-    sws_scale(ost->swsCtx.get(), (const uint8_t* const*)&data, linesize, 0,
-              mFbHeight, ost->frame->data, ost->frame->linesize);
+    if (ost->converter) {
+        ost->converter->convert(frame->dataVec.data(), ost->frame->data,
+                                ost->frame->linesize);
+    } else {
+        const int linesize[1] = {getVideoFormatSize(format) * mFbWidth};
+        auto data = frame->dataVec.data();
+        sws_scale(ost->swsCtx.get(), (const uint8_t* const*)&data, linesize,
+                  0, mFbHeight, ost->frame->data, ost->frame->linesize);
+    }
     VLOG(record)
-            << "Time to sws_scale: ["
+            << "Time to convert the frame: ["
             << (long long)(android::base::System::get()->getHighResTimeUs() -
                            startUs) /
                        1000
@@ -989,6 +1007,7 @@ void FfmpegRecorderImpl::closeVideoContext() {
     mVideoStream.frame.reset();
     mVideoStream.tmpFrame.reset();
     mVideoStream.swsCtx.reset();
+    mVideoStream.converter.reset();
 }
 
 // static
@@ -0,0 +1,230 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/recording/codecs/audio/AudioStreamEncoder.h"
+
+#include <algorithm>                   // for min
+
+extern "C" {
+#include <libavutil/channel_layout.h>  // for AV_CH_LAYOUT_STEREO, AV_CH_LA...
+#include <libavutil/opt.h>             // for av_opt_set_int, av_opt_set_sam...
+#include <libavutil/rational.h>        // for AVRational
+}
+
+#include "android/base/Log.h"          // for LOG, LogMessage, LogStream
+
+namespace android {
+namespace recording {
+
+// Size of a single signed 16 bit sample.
+static constexpr int kBytesPerSample = 2;
+
+AudioStreamEncoder::AudioStreamEncoder(int channels) : mChannels(channels) {}
+
+AudioStreamEncoder::~AudioStreamEncoder() {}
+
+// static
+std::unique_ptr<AudioStreamEncoder> AudioStreamEncoder::create(
+        AVCodecID codecId,
+        int sampleRate,
+        int channels,
+        uint32_t bitrate) {
+    av_register_all();
+    AVCodec* codec = avcodec_find_encoder(codecId);
+    if (!codec) {
+        LOG(WARNING) << "No encoder available for "
+                     << avcodec_get_name(codecId);
+        return nullptr;
+    }
+
+    std::unique_ptr<AudioStreamEncoder> encoder(
+            new AudioStreamEncoder(channels));
+    if (!encoder->open(codec, sampleRate, bitrate)) {
+        return nullptr;
+    }
+    return encoder;
+}
+
+bool AudioStreamEncoder::open(AVCodec* codec,
+                              int sampleRate,
+                              uint32_t bitrate) {
+    AVCodecContext* c = avcodec_alloc_context3(codec);
+    if (!c) {
+        LOG(ERROR) << "avcodec_alloc_context3 failed [codec="
+                   << avcodec_get_name(codec->id) << "]";
+        return false;
+    }
+    mCodecCtx = makeAVScopedPtr(c);
+
+    c->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0]
+                                       : AV_SAMPLE_FMT_FLTP;
+    c->bit_rate = bitrate;
+    c->sample_rate = sampleRate;
+    if (codec->supported_samplerates) {
+        c->sample_rate = codec->supported_samplerates[0];
+        for (int i = 0; codec->supported_samplerates[i]; i++) {
+            if (codec->supported_samplerates[i] == sampleRate) {
+                c->sample_rate = sampleRate;
+                break;
+            }
+        }
+    }
+    c->channel_layout =
+            mChannels == 1 ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO;
+    c->channels = av_get_channel_layout_nb_channels(c->channel_layout);
+    c->time_base = (AVRational){1, c->sample_rate};
+
+    // There is no container, so the decoder has to get the headers out of
+    // band.
+    c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (codec->capabilities & CODEC_CAP_EXPERIMENTAL) {
+        c->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+    }
+
+    int ret = avcodec_open2(c, codec, nullptr);
+    if (ret < 0) {
+        LOG(ERROR) << "Could not open audio codec (error code " << ret << ")";
+        return false;
+    }
+
+    if (c->frame_size <= 0) {
+        // Variable frame size codecs, 20ms worth of samples.
+        c->frame_size = c->sample_rate / 50;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        LOG(ERROR) << "Error allocating an audio frame";
+        return false;
+    }
+    mFrame = makeAVScopedPtr(frame);
+    frame->format = c->sample_fmt;
+    frame->channel_layout = c->channel_layout;
+    frame->sample_rate = c->sample_rate;
+    frame->nb_samples = c->frame_size;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        LOG(ERROR) << "Error allocating an audio buffer";
+        return false;
+    }
+
+    SwrContext* swrCtx = swr_alloc();
+    if (!swrCtx) {
+        LOG(ERROR) << "Could not allocate resampler context";
+        return false;
+    }
+    mSwrCtx = makeAVScopedPtr(swrCtx);
+    av_opt_set_int(swrCtx, "in_channel_count", c->channels, 0);
+    av_opt_set_int(swrCtx, "in_sample_rate", c->sample_rate, 0);
+    av_opt_set_sample_fmt(swrCtx, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+    av_opt_set_int(swrCtx, "out_channel_count", c->channels, 0);
+    av_opt_set_int(swrCtx, "out_sample_rate", c->sample_rate, 0);
+    av_opt_set_sample_fmt(swrCtx, "out_sample_fmt", c->sample_fmt, 0);
+    if (swr_init(swrCtx) < 0) {
+        LOG(ERROR) << "Failed to initialize the resampling context";
+        return false;
+    }
+
+    mPending.reserve(c->frame_size * mChannels * kBytesPerSample);
+    return true;
+}
+
+int AudioStreamEncoder::sampleRate() const {
+    return mCodecCtx->sample_rate;
+}
+
+int AudioStreamEncoder::frameSize() const {
+    return mCodecCtx->frame_size;
+}
+
+std::string AudioStreamEncoder::codecConfig() const {
+    if (!mCodecCtx->extradata) {
+        return {};
+    }
+    return std::string(reinterpret_cast<const char*>(mCodecCtx->extradata),
+                       mCodecCtx->extradata_size);
+}
+
+bool AudioStreamEncoder::encode(const uint8_t* pcm,
+                                size_t size,
+                                std::vector<std::string>* packets) {
+    const size_t frameBytes = frameSize() * mChannels * kBytesPerSample;
+
+    // Top up a partial frame from the previous call first.
+    if (!mPending.empty()) {
+        size_t needed = std::min(frameBytes - mPending.size(), size);
+        mPending.insert(mPending.end(), pcm, pcm + needed);
+        pcm += needed;
+        size -= needed;
+        if (mPending.size() < frameBytes) {
+            return true;
+        }
+        if (!encodeFrame(mPending.data(), packets)) {
+            return false;
+        }
+        mPending.clear();
+    }
+
+    // Encode straight out of the input as long as we have full frames.
+    for (; size >= frameBytes; pcm += frameBytes, size -= frameBytes) {
+        if (!encodeFrame(pcm, packets)) {
+            return false;
+        }
+    }
+
+    mPending.assign(pcm, pcm + size);
+    return true;
+}
+
+bool AudioStreamEncoder::encodeFrame(const uint8_t* pcm,
+                                     std::vector<std::string>* packets) {
+    AVCodecContext* c = mCodecCtx.get();
+    AVFrame* frame = mFrame.get();
+
+    // The encoder may still reference the previous frame.
+    int ret = av_frame_make_writable(frame);
+    if (ret < 0) {
+        return false;
+    }
+
+    const uint8_t* in[] = {pcm};
+    ret = swr_convert(mSwrCtx.get(), frame->data, c->frame_size, in,
+                      c->frame_size);
+    if (ret < 0) {
+        LOG(ERROR) << "Error while converting";
+        return false;
+    }
+    frame->pts = mPts;
+    mPts += c->frame_size;
+
+    AVPacket pkt;
+    int gotPacket;
+    av_init_packet(&pkt);
+    pkt.data = nullptr;  // data and size must be 0
+    pkt.size = 0;
+    ret = avcodec_encode_audio2(c, &pkt, frame, &gotPacket);
+    if (ret < 0) {
+        LOG(ERROR) << "Error encoding audio frame (error code " << ret << ")";
+        return false;
+    }
+
+    if (gotPacket) {
+        packets->emplace_back(reinterpret_cast<const char*>(pkt.data),
+                              pkt.size);
+        av_packet_unref(&pkt);
+    }
+    return true;
+}
+
+}  // namespace recording
+}  // namespace android
@@ -0,0 +1,90 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+//  Encodes a live stream of audio samples into codec packets, without a
+//  container around them.
+//
+
+#pragma once
+
+#include <stddef.h>                          // for size_t
+#include <stdint.h>                          // for uint8_t, uint32_t, int64_t
+#include <memory>                            // for unique_ptr
+#include <string>                            // for string
+#include <vector>                            // for vector
+
+#include "android/recording/AVScopedPtr.h"  // for AVScopedPtr
+
+extern "C" {
+#include <libavcodec/avcodec.h>              // for AVCodecID, AVCodecContext
+#include <libavutil/frame.h>                 // for AVFrame
+#include "libswresample/swresample.h"        // for SwrContext
+}
+
+namespace android {
+namespace recording {
+
+// An AudioStreamEncoder turns interleaved signed 16 bit samples into encoded
+// packets, for example to send audio over the network with a fraction of the
+// bandwidth raw PCM would need. Every packet can be handed to a decoder
+// as is, the decoder needs to be configured with codecConfig() first.
+//
+// The encoder buffers incoming samples until it has a full codec frame, so
+// the input can be chopped up in any way.
+class AudioStreamEncoder {
+public:
+    ~AudioStreamEncoder();
+
+    // Creates an encoder for the given codec, or nullptr if ffmpeg does not
+    // come with that encoder, or it cannot be configured. The encoder can
+    // pick a different sample rate than |sampleRate| if the codec does not
+    // support it, the samples fed to encode() must be in sampleRate().
+    static std::unique_ptr<AudioStreamEncoder> create(AVCodecID codecId,
+                                                      int sampleRate,
+                                                      int channels,
+                                                      uint32_t bitrate);
+
+    // The sample rate the samples fed to encode() must have.
+    int sampleRate() const;
+
+    // Number of samples (per channel) the codec consumes at once.
+    int frameSize() const;
+
+    // Codec specific data a decoder needs, can be empty.
+    std::string codecConfig() const;
+
+    // Encodes |size| bytes of interleaved signed 16 bit samples. Every packet
+    // that comes out of the encoder is appended to |packets|. Returns false
+    // on encoding errors.
+    bool encode(const uint8_t* pcm,
+                size_t size,
+                std::vector<std::string>* packets);
+
+private:
+    explicit AudioStreamEncoder(int channels);
+
+    bool open(AVCodec* codec, int sampleRate, uint32_t bitrate);
+    bool encodeFrame(const uint8_t* pcm, std::vector<std::string>* packets);
+
+    const int mChannels;
+    AVScopedPtr<AVCodecContext> mCodecCtx;
+    AVScopedPtr<AVFrame> mFrame;
+    AVScopedPtr<SwrContext> mSwrCtx;
+    std::vector<uint8_t> mPending;  // Samples that do not fill a frame yet.
+    int64_t mPts = 0;
+};
+
+}  // namespace recording
+}  // namespace android
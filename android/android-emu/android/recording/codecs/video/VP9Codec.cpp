@@ -12,14 +12,14 @@
 #include "android/recording/codecs/video/VP9Codec.h"
 
 #include <stddef.h>                      // for NULL
-#include <algorithm>                     // for min
+#include <algorithm>                     // for min, max
 #include <utility>                       // for move
 
 #include "android/base/Log.h"            // for LOG, LogMessage, LogStream
 #include "android/base/system/System.h"  // for System
 
 extern "C" {
-#include <libavutil/dict.h>              // for av_dict_set, av_dict_free
+#include <libavutil/dict.h>              // for av_dict_set, av_dict_set_int
 #include <libavutil/rational.h>          // for AVRational
 #include <libswscale/swscale.h>          // for sws_getContext, SWS_BICUBIC
 struct SwsContext;
@@ -31,6 +31,28 @@ struct SwsContext;
 namespace android {
 namespace recording {
 
+// libvpx does not make VP9 tiles narrower than this.
+static constexpr int kMinTileWidth = 256;
+static constexpr int kMaxEncoderThreads = 16;
+
+// One thread per core, as long as the picture is wide enough to give each of
+// them a column of tiles.
+static int encoderThreads(uint32_t width) {
+    const int cores = android::base::System::get()->getCpuCoreCount();
+    const int tiles = std::max<int>(1, width / kMinTileWidth);
+    return std::max(1, std::min({cores, tiles, kMaxEncoderThreads}));
+}
+
+// The tile-columns option is the log2 of the number of tile columns.
+static int tileColumnsLog2(uint32_t width, int threads) {
+    int log2 = 0;
+    while ((2 << log2) <= threads &&
+           (2 << log2) * kMinTileWidth <= int(width)) {
+        ++log2;
+    }
+    return log2;
+}
+
 VP9Codec::VP9Codec(CodecParams&& p,
                                uint32_t fbWidth,
                                uint32_t fbHeight,
@@ -52,8 +74,7 @@ bool VP9Codec::configAndOpenEncoder(const AVFormatContext* oc,
     c->bit_rate = mParams.bitrate;
     c->width = mParams.width;
     c->height = mParams.height;
-    c->thread_count =
-            std::min(8, android::base::System::get()->getCpuCoreCount() * 2);
+    c->thread_count = encoderThreads(mParams.width);
 
     // If you use a .WEBM container, the stream time base will automatically get changed
     // to a millisecond time base. Even so, let's explicitly set it anyways just in case
@@ -80,6 +101,12 @@ bool VP9Codec::configAndOpenEncoder(const AVFormatContext* oc,
     AVDictionary* opts = nullptr;
     av_dict_set(&opts, "deadline", "realtime", 0);
     av_dict_set(&opts, "cpu-used", "8", 0);
+    // Without tiles and row based multithreading libvpx keeps encoding a
+    // frame on a single thread, whatever the thread count is.
+    av_dict_set_int(&opts, "tile-columns",
+                    tileColumnsLog2(mParams.width, c->thread_count), 0);
+    av_dict_set_int(&opts, "row-mt", 1, 0);
+    av_dict_set_int(&opts, "frame-parallel", 0, 0);
 
     // Open the codec
     int ret = avcodec_open2(c, mCodec, &opts);
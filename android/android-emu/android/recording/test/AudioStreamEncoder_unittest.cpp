@@ -0,0 +1,152 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/recording/codecs/audio/AudioStreamEncoder.h"
+
+#include <gtest/gtest.h>                     // for Test, EXPECT_EQ, ASSERT...
+#include <math.h>                            // for sin, M_PI
+#include <string.h>                          // for memcpy
+#include <algorithm>                         // for min
+#include <string>                            // for string
+#include <vector>                            // for vector
+
+#include "android/recording/AVScopedPtr.h"  // for makeAVScopedPtr
+
+extern "C" {
+#include <libavcodec/avcodec.h>              // for AVCodecContext, AVPacket
+#include <libavutil/mem.h>                   // for av_mallocz
+}
+
+using namespace android::recording;
+
+static constexpr int kSampleRate = 48000;
+static constexpr int kChannels = 2;
+static constexpr uint32_t kBitrate = 64000;
+
+// |seconds| of a 440Hz tone, interleaved signed 16 bit stereo.
+static std::vector<uint8_t> makeTone(int sampleRate, double seconds) {
+    const int frames = int(sampleRate * seconds);
+    std::vector<uint8_t> pcm(frames * kChannels * sizeof(int16_t));
+    auto samples = reinterpret_cast<int16_t*>(pcm.data());
+    for (int i = 0; i < frames; ++i) {
+        const auto value =
+                int16_t(8000 * sin(2 * M_PI * 440 * i / sampleRate));
+        for (int c = 0; c < kChannels; ++c) {
+            samples[i * kChannels + c] = value;
+        }
+    }
+    return pcm;
+}
+
+// Decodes |packets| as a client would, returns the number of samples (per
+// channel) that came out, or -1 on errors.
+static int decode(AVCodecID codecId,
+                  const std::string& codecConfig,
+                  const std::vector<std::string>& packets) {
+    AVCodec* codec = avcodec_find_decoder(codecId);
+    if (!codec) {
+        return -1;
+    }
+    AVScopedPtr<AVCodecContext> ctx =
+            makeAVScopedPtr(avcodec_alloc_context3(codec));
+    ctx->sample_rate = kSampleRate;
+    ctx->channels = kChannels;
+    ctx->extradata = static_cast<uint8_t*>(av_mallocz(
+            codecConfig.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+    memcpy(ctx->extradata, codecConfig.data(), codecConfig.size());
+    ctx->extradata_size = codecConfig.size();
+    if (avcodec_open2(ctx.get(), codec, nullptr) < 0) {
+        return -1;
+    }
+
+    AVScopedPtr<AVFrame> frame = makeAVScopedPtr(av_frame_alloc());
+    int samples = 0;
+    for (const auto& data : packets) {
+        // The decoder reads past the end of the packet.
+        std::string padded = data;
+        padded.resize(data.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+
+        AVPacket pkt;
+        av_init_packet(&pkt);
+        pkt.data = reinterpret_cast<uint8_t*>(&padded[0]);
+        pkt.size = data.size();
+        int gotFrame = 0;
+        if (avcodec_decode_audio4(ctx.get(), frame.get(), &gotFrame, &pkt) <
+            0) {
+            return -1;
+        }
+        if (gotFrame) {
+            samples += frame->nb_samples;
+        }
+    }
+    return samples;
+}
+
+TEST(AudioStreamEncoder, noEncoder) {
+    EXPECT_EQ(nullptr, AudioStreamEncoder::create(AV_CODEC_ID_NONE,
+                                                  kSampleRate, kChannels,
+                                                  kBitrate));
+}
+
+TEST(AudioStreamEncoder, vorbisPacketsDecode) {
+    auto encoder = AudioStreamEncoder::create(AV_CODEC_ID_VORBIS, kSampleRate,
+                                              kChannels, kBitrate);
+    ASSERT_NE(nullptr, encoder);
+    EXPECT_EQ(kSampleRate, encoder->sampleRate());
+    EXPECT_GT(encoder->frameSize(), 0);
+    // Vorbis has no in-band headers, clients can't decode without them.
+    const std::string config = encoder->codecConfig();
+    EXPECT_FALSE(config.empty());
+
+    const auto pcm = makeTone(encoder->sampleRate(), 1);
+    std::vector<std::string> packets;
+    ASSERT_TRUE(encoder->encode(pcm.data(), pcm.size(), &packets));
+    ASSERT_FALSE(packets.empty());
+
+    size_t encodedBytes = 0;
+    for (const auto& packet : packets) {
+        EXPECT_FALSE(packet.empty());
+        encodedBytes += packet.size();
+    }
+    // A fraction of the raw samples.
+    EXPECT_LT(encodedBytes, pcm.size() / 4);
+
+    // The encoder keeps some samples back, but most of the second is there.
+    const int decoded = decode(AV_CODEC_ID_VORBIS, config, packets);
+    EXPECT_GT(decoded, encoder->sampleRate() / 2);
+    EXPECT_LE(decoded, encoder->sampleRate());
+}
+
+TEST(AudioStreamEncoder, inputCanBeChoppedUp) {
+    auto whole = AudioStreamEncoder::create(AV_CODEC_ID_VORBIS, kSampleRate,
+                                            kChannels, kBitrate);
+    auto chopped = AudioStreamEncoder::create(AV_CODEC_ID_VORBIS, kSampleRate,
+                                              kChannels, kBitrate);
+    ASSERT_NE(nullptr, whole);
+    ASSERT_NE(nullptr, chopped);
+
+    const auto pcm = makeTone(whole->sampleRate(), 0.5);
+    std::vector<std::string> wholePackets;
+    ASSERT_TRUE(whole->encode(pcm.data(), pcm.size(), &wholePackets));
+
+    // Chunks that split frames, and even samples.
+    static constexpr size_t kChunks[] = {1, 7, 1000, 4099};
+    std::vector<std::string> choppedPackets;
+    for (size_t pos = 0, i = 0; pos < pcm.size(); ++i) {
+        const size_t chunk = std::min(kChunks[i % 4], pcm.size() - pos);
+        ASSERT_TRUE(chopped->encode(pcm.data() + pos, chunk, &choppedPackets));
+        pos += chunk;
+    }
+    EXPECT_EQ(wholePackets, choppedPackets);
+}
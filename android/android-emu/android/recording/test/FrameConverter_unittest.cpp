@@ -0,0 +1,142 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/recording/video/FrameConverter.h"
+
+#include <gtest/gtest.h>  // for Test, EXPECT_EQ, TEST
+#include <random>         // for mt19937
+#include <vector>         // for vector
+
+#include <libyuv.h>       // for ABGRToI420, ARGBToI420, RGB565ToI420
+
+using namespace android::recording;
+
+namespace {
+
+// An I420 picture in a single buffer.
+struct Picture {
+    Picture(int width, int height)
+        : width(width),
+          height(height),
+          data(width * height + 2 * chromaWidth() * chromaHeight()) {}
+
+    int chromaWidth() const { return (width + 1) / 2; }
+    int chromaHeight() const { return (height + 1) / 2; }
+
+    void planes(uint8_t* out[3], int stride[3]) {
+        out[0] = data.data();
+        out[1] = out[0] + width * height;
+        out[2] = out[1] + chromaWidth() * chromaHeight();
+        stride[0] = width;
+        stride[1] = stride[2] = chromaWidth();
+    }
+
+    int width;
+    int height;
+    std::vector<uint8_t> data;
+};
+
+std::vector<uint8_t> randomFrame(int width, int height, VideoFormat format) {
+    std::vector<uint8_t> frame(width * height * getVideoFormatSize(format));
+    std::mt19937 gen(width * height);
+    for (auto& b : frame) {
+        b = uint8_t(gen());
+    }
+    return frame;
+}
+
+Picture convert(const std::vector<uint8_t>& frame,
+                int srcWidth,
+                int srcHeight,
+                VideoFormat format,
+                int dstWidth,
+                int dstHeight,
+                int threads) {
+    FrameConverter converter(srcWidth, srcHeight, format, dstWidth, dstHeight,
+                             threads);
+    Picture pic(dstWidth, dstHeight);
+    uint8_t* planes[3];
+    int stride[3];
+    pic.planes(planes, stride);
+    converter.convert(frame.data(), planes, stride);
+    return pic;
+}
+
+}  // namespace
+
+TEST(FrameConverter, slicesAreSplitEvenly) {
+    EXPECT_EQ(1, FrameConverter(640, 64, VideoFormat::RGBA8888, 640, 64, 4)
+                         .slices());
+    EXPECT_EQ(4, FrameConverter(1280, 720, VideoFormat::RGBA8888, 1280, 720, 4)
+                         .slices());
+}
+
+TEST(FrameConverter, matchesLibyuv) {
+    const int width = 720;
+    const int height = 1281;  // Odd, the last slice ends on half a chroma row.
+    for (auto format : {VideoFormat::RGBA8888, VideoFormat::BGRA8888,
+                        VideoFormat::RGB565}) {
+        auto frame = randomFrame(width, height, format);
+        auto parallel = convert(frame, width, height, format, width, height, 4);
+
+        Picture expected(width, height);
+        uint8_t* planes[3];
+        int stride[3];
+        expected.planes(planes, stride);
+        const int srcStride = width * getVideoFormatSize(format);
+        switch (format) {
+            case VideoFormat::RGBA8888:
+                libyuv::ABGRToI420(frame.data(), srcStride, planes[0],
+                                   stride[0], planes[1], stride[1], planes[2],
+                                   stride[2], width, height);
+                break;
+            case VideoFormat::BGRA8888:
+                libyuv::ARGBToI420(frame.data(), srcStride, planes[0],
+                                   stride[0], planes[1], stride[1], planes[2],
+                                   stride[2], width, height);
+                break;
+            default:
+                libyuv::RGB565ToI420(frame.data(), srcStride, planes[0],
+                                     stride[0], planes[1], stride[1],
+                                     planes[2], stride[2], width, height);
+                break;
+        }
+        EXPECT_EQ(expected.data, parallel.data)
+                << "format " << static_cast<int>(format);
+    }
+}
+
+TEST(FrameConverter, scaledSlicesMatchSingleSlice) {
+    for (auto format : {VideoFormat::RGBA8888, VideoFormat::RGB565}) {
+        auto frame = randomFrame(1440, 2560, format);
+        auto single = convert(frame, 1440, 2560, format, 720, 1280, 1);
+        auto parallel = convert(frame, 1440, 2560, format, 720, 1280, 6);
+        EXPECT_EQ(single.data, parallel.data)
+                << "format " << static_cast<int>(format);
+    }
+}
+
+TEST(FrameConverter, convertsRepeatedly) {
+    auto frame = randomFrame(640, 480, VideoFormat::BGRA8888);
+    FrameConverter converter(640, 480, VideoFormat::BGRA8888, 320, 240, 3);
+    Picture first(320, 240);
+    Picture second(320, 240);
+    uint8_t* planes[3];
+    int stride[3];
+    first.planes(planes, stride);
+    converter.convert(frame.data(), planes, stride);
+    second.planes(planes, stride);
+    converter.convert(frame.data(), planes, stride);
+    EXPECT_EQ(first.data, second.data);
+}
@@ -0,0 +1,208 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/recording/video/SharedFrameRing.h"
+
+#include <gtest/gtest.h>  // for Test, EXPECT_EQ, TEST
+#include <atomic>         // for atomic
+#include <string.h>       // for memset
+#include <thread>         // for thread
+#include <vector>         // for vector
+
+using namespace android::recording;
+
+namespace {
+
+const uint32_t kWidth = 6;
+const uint32_t kHeight = 3;
+
+// A region both sides of the ring see, as if it were shared memory.
+class Region {
+public:
+    Region()
+        : mData((SharedFrameRing::regionSize(kWidth, kHeight) + 63) / 64) {}
+
+    void* get() { return mData.data(); }
+    size_t size() const { return mData.size() * 64; }
+
+private:
+    struct alignas(64) Line {
+        uint8_t bytes[64];
+    };
+    std::vector<Line> mData;
+};
+
+// Publishes a frame filled with |value|.
+void publish(SharedFrameRing* ring, uint8_t value) {
+    uint8_t* dst = ring->beginWrite();
+    const auto size =
+            SharedFrameRing::frameSize(ring->format(), kWidth, kHeight);
+    memset(dst, value, size);
+    ring->publish(ring->format(), size, value);
+}
+
+}  // namespace
+
+TEST(SharedFrameRing, frameSizes) {
+    EXPECT_EQ(6u * 3 + 2 * 3 * 2,
+              SharedFrameRing::frameSize(SharedFrameFormat::I420, 6, 3));
+    EXPECT_EQ(6u * 3 + 2 * 3 * 2,
+              SharedFrameRing::frameSize(SharedFrameFormat::NV12, 6, 3));
+    EXPECT_EQ(6u * 3 * 4,
+              SharedFrameRing::frameSize(SharedFrameFormat::RGBA, 6, 3));
+}
+
+TEST(SharedFrameRing, attachNeedsAProducer) {
+    Region region;
+    memset(region.get(), 0, region.size());
+    EXPECT_EQ(nullptr, SharedFrameRing::attach(region.get(), region.size()));
+
+    auto ring = SharedFrameRing::create(region.get(), kWidth, kHeight, 30);
+    EXPECT_EQ(ring, SharedFrameRing::attach(region.get(), region.size()));
+    EXPECT_EQ(kWidth, ring->width());
+    EXPECT_EQ(kHeight, ring->height());
+    EXPECT_EQ(30u, ring->fps());
+    EXPECT_EQ(SharedFrameFormat::I420, ring->format());
+}
+
+TEST(SharedFrameRing, consumerTakesTheLatestFrame) {
+    Region region;
+    auto producer = SharedFrameRing::create(region.get(), kWidth, kHeight, 30);
+    auto consumer = SharedFrameRing::attach(region.get(), region.size());
+
+    EXPECT_EQ(nullptr, consumer->acquire());
+    publish(producer, 1);
+    publish(producer, 2);
+
+    auto slot = consumer->acquire();
+    ASSERT_NE(nullptr, slot);
+    EXPECT_EQ(2u, slot->seq);
+    EXPECT_EQ(2u, slot->tsUs);
+    EXPECT_EQ(2, consumer->pixels(slot)[0]);
+
+    EXPECT_EQ(nullptr, consumer->acquire());
+    // Frame 1 was replaced before the consumer got to it.
+    EXPECT_EQ(1u, producer->late());
+}
+
+TEST(SharedFrameRing, latestFrameGetsThroughASlowConsumer) {
+    Region region;
+    auto producer = SharedFrameRing::create(region.get(), kWidth, kHeight, 30);
+    auto consumer = SharedFrameRing::attach(region.get(), region.size());
+
+    publish(producer, 1);
+    auto slot = consumer->acquire();
+    ASSERT_NE(nullptr, slot);
+    EXPECT_EQ(1u, slot->seq);
+
+    // The consumer keeps reading frame 1 while many more are published: none
+    // of them touches its slot, and the last one is the next it gets.
+    for (uint8_t i = 2; i <= 10; ++i) {
+        publish(producer, i);
+        EXPECT_EQ(1u, slot->seq);
+        EXPECT_EQ(1, consumer->pixels(slot)[0]);
+    }
+    EXPECT_EQ(8u, producer->late());
+
+    slot = consumer->acquire();
+    ASSERT_NE(nullptr, slot);
+    EXPECT_EQ(10u, slot->seq);
+    EXPECT_EQ(10, consumer->pixels(slot)[0]);
+    EXPECT_EQ(nullptr, consumer->acquire());
+
+    publish(producer, 11);
+    slot = consumer->acquire();
+    ASSERT_NE(nullptr, slot);
+    EXPECT_EQ(11u, slot->seq);
+    EXPECT_EQ(8u, producer->late());
+}
+
+TEST(SharedFrameRing, producerSeesWhatTheConsumerTook) {
+    Region region;
+    auto producer = SharedFrameRing::create(region.get(), kWidth, kHeight, 30);
+    auto consumer = SharedFrameRing::attach(region.get(), region.size());
+
+    EXPECT_EQ(0u, producer->consumed());
+    EXPECT_TRUE(producer->canWrite());
+    publish(producer, 1);
+    // Another frame would replace frame 1 before it was seen.
+    EXPECT_FALSE(producer->canWrite());
+
+    ASSERT_NE(nullptr, consumer->acquire());
+    EXPECT_EQ(1u, producer->consumed());
+    EXPECT_TRUE(producer->canWrite());
+
+    publish(producer, 2);
+    publish(producer, 3);
+    EXPECT_EQ(1u, producer->consumed());
+    ASSERT_NE(nullptr, consumer->acquire());
+    EXPECT_EQ(3u, producer->consumed());
+    EXPECT_TRUE(producer->canWrite());
+    EXPECT_EQ(1u, producer->late());
+}
+
+TEST(SharedFrameRing, consumerPicksTheFormat) {
+    Region region;
+    auto producer = SharedFrameRing::create(region.get(), kWidth, kHeight, 30);
+    auto consumer = SharedFrameRing::attach(region.get(), region.size());
+
+    consumer->setFormat(SharedFrameFormat::RGBA);
+    EXPECT_EQ(SharedFrameFormat::RGBA, producer->format());
+    publish(producer, 7);
+
+    auto slot = consumer->acquire();
+    ASSERT_NE(nullptr, slot);
+    EXPECT_EQ(uint32_t(SharedFrameFormat::RGBA), slot->format);
+    EXPECT_EQ(kWidth * kHeight * 4, slot->size);
+    EXPECT_EQ(7, consumer->pixels(slot)[slot->size - 1]);
+}
+
+TEST(SharedFrameRing, framesAreNotOverwrittenWhileRead) {
+    Region region;
+    auto producer = SharedFrameRing::create(region.get(), kWidth, kHeight, 30);
+    auto consumer = SharedFrameRing::attach(region.get(), region.size());
+    const int kFrames = 20000;
+
+    std::atomic<bool> done{false};
+    std::thread writer([producer, &done]() {
+        for (int i = 1; i <= kFrames; ++i) {
+            publish(producer, uint8_t(i));
+        }
+        done = true;
+    });
+
+    uint64_t last = 0;
+    int torn = 0;
+    int taken = 0;
+    for (;;) {
+        const bool finished = done;
+        auto slot = consumer->acquire();
+        if (slot) {
+            const uint8_t* pixels = consumer->pixels(slot);
+            for (uint32_t i = 1; i < slot->size; ++i) {
+                torn += pixels[i] != pixels[0];
+            }
+            EXPECT_GT(slot->seq, last);
+            last = slot->seq;
+            taken++;
+        } else if (finished) {
+            break;
+        }
+    }
+    writer.join();
+    EXPECT_EQ(0, torn);
+    // Whatever the consumer missed, it ends with the last frame.
+    EXPECT_EQ(uint64_t(kFrames), last);
+    EXPECT_EQ(uint64_t(kFrames), taken + producer->late());
+}
@@ -0,0 +1,200 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/recording/video/FrameConverter.h"
+
+#include <algorithm>                     // for min, max
+#include <utility>                       // for move
+
+#include "android/base/system/System.h"  // for System
+
+#include <libyuv.h>                      // for ARGBScaleClip, ARGBToI420
+
+namespace android {
+namespace recording {
+
+using android::base::AutoLock;
+using android::base::System;
+
+// Slices smaller than this cost more in synchronization than they save.
+static constexpr int kMinSliceRows = 64;
+static constexpr int kMaxThreads = 8;
+
+static int bytesPerPixel(VideoFormat format) {
+    return format == VideoFormat::RGB565 ? 2 : 4;
+}
+
+// Converts |height| rows of 32 bit pixels in the byte order of |format| to
+// I420. RGB565 has been expanded to libyuv's ARGB (B, G, R, A in memory).
+static void toI420(VideoFormat format,
+                   const uint8_t* src,
+                   int srcStride,
+                   uint8_t* const dst[3],
+                   const int dstStride[3],
+                   int width,
+                   int height) {
+    if (format == VideoFormat::RGBA8888) {
+        libyuv::ABGRToI420(src, srcStride, dst[0], dstStride[0], dst[1],
+                           dstStride[1], dst[2], dstStride[2], width, height);
+    } else {
+        libyuv::ARGBToI420(src, srcStride, dst[0], dstStride[0], dst[1],
+                           dstStride[1], dst[2], dstStride[2], width, height);
+    }
+}
+
+FrameConverter::FrameConverter(int srcWidth,
+                               int srcHeight,
+                               VideoFormat srcFormat,
+                               int dstWidth,
+                               int dstHeight,
+                               int threads)
+    : mSrcWidth(srcWidth),
+      mSrcHeight(srcHeight),
+      mSrcFormat(srcFormat),
+      mDstWidth(dstWidth),
+      mDstHeight(dstHeight),
+      mScale(srcWidth != dstWidth || srcHeight != dstHeight) {
+    if (threads < 1) {
+        threads = std::min(kMaxThreads, System::get()->getCpuCoreCount());
+    }
+    mSlices = std::max(1, std::min(threads, mDstHeight / kMinSliceRows));
+
+    if (mScale) {
+        if (mSrcFormat == VideoFormat::RGB565) {
+            mArgb.resize(size_t(mSrcWidth) * mSrcHeight * 4);
+        }
+        mScaled.resize(size_t(mDstWidth) * mDstHeight * 4);
+    }
+
+    // The calling thread converts a slice as well.
+    if (mSlices > 1) {
+        mWorkers.emplace(mSlices - 1, [](Task&& task) { task(); });
+        if (!mWorkers->start()) {
+            mWorkers.clear();
+            mSlices = 1;
+        }
+    }
+}
+
+FrameConverter::~FrameConverter() {
+    mWorkers.clear();
+}
+
+// static
+bool FrameConverter::isSupported(VideoFormat format) {
+    switch (format) {
+        case VideoFormat::RGB565:
+        case VideoFormat::RGBA8888:
+        case VideoFormat::BGRA8888:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void FrameConverter::forEachSlice(int rows,
+                                  const std::function<void(int, int)>& work) {
+    // Keep every slice but the last one at an even number of rows, so the
+    // chroma rows of a slice do not overlap with its neighbours.
+    const int sliceRows = ((rows + mSlices - 1) / mSlices + 1) & ~1;
+    if (mSlices == 1 || sliceRows >= rows) {
+        work(0, rows);
+        return;
+    }
+
+    int y = sliceRows;
+    {
+        AutoLock lock(mLock);
+        mPending = (rows - y + sliceRows - 1) / sliceRows;
+    }
+    for (; y < rows; y += sliceRows) {
+        const int height = std::min(sliceRows, rows - y);
+        mWorkers->enqueue([this, &work, y, height]() {
+            work(y, height);
+            AutoLock lock(mLock);
+            if (--mPending == 0) {
+                mCv.signalAndUnlock(&lock);
+            }
+        });
+    }
+
+    work(0, sliceRows);
+
+    AutoLock lock(mLock);
+    mCv.wait(&lock, [this]() { return mPending == 0; });
+}
+
+void FrameConverter::convert(const uint8_t* src,
+                             uint8_t* const dst[3],
+                             const int dstStride[3]) {
+    if (!mScale) {
+        forEachSlice(mDstHeight, [&](int y, int height) {
+            convertSlice(src, dst, dstStride, y, height);
+        });
+        return;
+    }
+
+    if (mSrcFormat == VideoFormat::RGB565) {
+        // Every destination slice is scaled from the whole picture, so
+        // expand all of it first.
+        const int srcStride = mSrcWidth * 2;
+        const int argbStride = mSrcWidth * 4;
+        forEachSlice(mSrcHeight, [&](int y, int height) {
+            libyuv::RGB565ToARGB(src + y * srcStride, srcStride,
+                                 mArgb.data() + y * argbStride, argbStride,
+                                 mSrcWidth, height);
+        });
+        src = mArgb.data();
+    }
+
+    forEachSlice(mDstHeight, [&](int y, int height) {
+        convertSlice(src, dst, dstStride, y, height);
+    });
+}
+
+void FrameConverter::convertSlice(const uint8_t* src,
+                                  uint8_t* const dst[3],
+                                  const int dstStride[3],
+                                  int y,
+                                  int height) {
+    uint8_t* const planes[3] = {dst[0] + y * dstStride[0],
+                                dst[1] + y / 2 * dstStride[1],
+                                dst[2] + y / 2 * dstStride[2]};
+
+    if (!mScale) {
+        const int srcStride = mSrcWidth * bytesPerPixel(mSrcFormat);
+        const uint8_t* rows = src + y * srcStride;
+        if (mSrcFormat == VideoFormat::RGB565) {
+            libyuv::RGB565ToI420(rows, srcStride, planes[0], dstStride[0],
+                                 planes[1], dstStride[1], planes[2],
+                                 dstStride[2], mDstWidth, height);
+        } else {
+            toI420(mSrcFormat, rows, srcStride, planes, dstStride, mDstWidth,
+                   height);
+        }
+        return;
+    }
+
+    // Scale the rows of this slice out of the whole (32 bit) source picture;
+    // the filter only cares about the pixel size, not the channel order.
+    const int scaledStride = mDstWidth * 4;
+    libyuv::ARGBScaleClip(src, mSrcWidth * 4, mSrcWidth, mSrcHeight,
+                          mScaled.data(), scaledStride, mDstWidth, mDstHeight,
+                          0, y, mDstWidth, height, libyuv::kFilterBilinear);
+    toI420(mSrcFormat, mScaled.data() + y * scaledStride, scaledStride, planes,
+           dstStride, mDstWidth, height);
+}
+
+}  // namespace recording
+}  // namespace android
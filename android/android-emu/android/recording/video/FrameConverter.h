@@ -0,0 +1,93 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>                                   // for uint8_t
+#include <functional>                                 // for function
+#include <vector>                                     // for vector
+
+#include "android/base/Optional.h"                    // for Optional
+#include "android/base/synchronization/ConditionVariable.h"  // for Condit...
+#include "android/base/synchronization/Lock.h"        // for Lock
+#include "android/base/threads/ThreadPool.h"          // for ThreadPool
+#include "android/recording/Frame.h"                  // for VideoFormat
+
+namespace android {
+namespace recording {
+
+// Converts the packed RGB frames coming out of the guest into (scaled) I420
+// pictures for the video encoder.
+//
+// The picture is cut into horizontal slices that are scaled and converted on
+// a pool of threads with libyuv, so a large display does not keep a single
+// core busy for most of the frame interval. The calling thread converts one
+// of the slices itself, and convert() returns once the whole picture is done.
+class FrameConverter {
+public:
+    // |threads| < 1 picks a number based on the host cores and the height of
+    // the picture.
+    FrameConverter(int srcWidth,
+                   int srcHeight,
+                   VideoFormat srcFormat,
+                   int dstWidth,
+                   int dstHeight,
+                   int threads = 0);
+    ~FrameConverter();
+
+    // Whether frames in |format| can be converted.
+    static bool isSupported(VideoFormat format);
+
+    // Converts a tightly packed frame at |src| into the Y, U and V planes of
+    // |dst|, with the given line sizes.
+    void convert(const uint8_t* src,
+                 uint8_t* const dst[3],
+                 const int dstStride[3]);
+
+    // Number of slices a picture is cut into.
+    int slices() const { return mSlices; }
+
+private:
+    using Task = std::function<void()>;
+
+    // Runs |work| for slices of |rows| rows, the slices start on even rows.
+    void forEachSlice(int rows, const std::function<void(int, int)>& work);
+
+    void convertSlice(const uint8_t* src,
+                      uint8_t* const dst[3],
+                      const int dstStride[3],
+                      int y,
+                      int height);
+
+    const int mSrcWidth;
+    const int mSrcHeight;
+    const VideoFormat mSrcFormat;
+    const int mDstWidth;
+    const int mDstHeight;
+    const bool mScale;
+    int mSlices = 1;
+
+    // RGB565 frames are expanded to 32 bits before scaling.
+    std::vector<uint8_t> mArgb;
+    // The scaled 32 bit picture, before the conversion to I420.
+    std::vector<uint8_t> mScaled;
+
+    base::Optional<base::ThreadPool<Task>> mWorkers;
+    base::Lock mLock;
+    base::ConditionVariable mCv;
+    int mPending = 0;
+};
+
+}  // namespace recording
+}  // namespace android
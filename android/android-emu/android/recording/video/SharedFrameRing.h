@@ -0,0 +1,215 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint32_t, uint64_t
+#include <atomic>    // for atomic
+#include <new>       // for placement new
+
+namespace android {
+namespace recording {
+
+// Pixel formats the frames can be shared in.
+enum class SharedFrameFormat : uint32_t {
+    I420 = 0,  // Y plane, then the U and V planes at half resolution.
+    NV12 = 1,  // Y plane, then interleaved U, V at half resolution.
+    RGBA = 2,  // R, G, B, A bytes.
+};
+
+// The layout of a shared memory region that carries the frames of a display
+// from the emulator (the producer) to another process (the consumer), such as
+// the WebRTC video bridge. Both sides map the region and use this header in
+// place, it is followed by kSlots frame slots.
+//
+// The slots work as a triple buffer: at any time one of them is being written
+// by the producer, one holds the latest published frame and one is being read
+// by the consumer. Publishing swaps the written slot with the latest one, and
+// taking a frame swaps the latest slot with the one that was read, so the
+// consumer always gets the latest frame without it changing under its feet.
+//
+// The consumer records the sequence number of the frame it took. While the
+// latest frame is still unread the producer has no slot to spare: it should
+// skip the frames that come in meanwhile (see canWrite()) rather than spend
+// the conversion on a frame that would only replace one nobody has seen.
+//
+// The consumer picks the pixel format, the producer converts to it.
+//
+// There is a single producer and a single consumer.
+class SharedFrameRing {
+public:
+    static constexpr uint32_t kMagic = 0x52465645;  // "EVFR"
+    static constexpr uint32_t kVersion = 3;
+    static constexpr uint32_t kSlots = 3;
+
+    struct Slot {
+        uint64_t seq;     // Sequence number of the frame in the slot.
+        uint64_t tsUs;    // When the frame was read back, monotonic.
+        uint32_t format;  // A SharedFrameFormat.
+        uint32_t size;    // Bytes of pixels in the slot.
+    };
+
+    static size_t frameSize(SharedFrameFormat format,
+                            uint32_t width,
+                            uint32_t height) {
+        if (format == SharedFrameFormat::RGBA) {
+            return size_t(width) * height * 4;
+        }
+        return size_t(width) * height +
+               2 * size_t((width + 1) / 2) * ((height + 1) / 2);
+    }
+
+    // Size of a region for frames of |width| x |height|.
+    static size_t regionSize(uint32_t width, uint32_t height) {
+        return sizeof(SharedFrameRing) + kSlots * slotSize(width, height);
+    }
+
+    // Formats a ring at |region|, which holds regionSize() bytes, for the
+    // producer.
+    static SharedFrameRing* create(void* region,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint32_t fps) {
+        return new (region) SharedFrameRing(width, height, fps);
+    }
+
+    // The ring at |region| of |size| bytes for the consumer, or null if it
+    // has not been created by a producer of this version.
+    static SharedFrameRing* attach(void* region, size_t size) {
+        auto ring = static_cast<SharedFrameRing*>(region);
+        if (size < sizeof(SharedFrameRing) || ring->mMagic != kMagic ||
+            ring->mVersion != kVersion) {
+            return nullptr;
+        }
+        return ring;
+    }
+
+    uint32_t width() const { return mWidth; }
+    uint32_t height() const { return mHeight; }
+    uint32_t fps() const { return mFps; }
+
+    // The format the consumer wants the frames in.
+    SharedFrameFormat format() const {
+        auto format = mFormat.load(std::memory_order_relaxed);
+        return format <= uint32_t(SharedFrameFormat::RGBA)
+                       ? SharedFrameFormat(format)
+                       : SharedFrameFormat::I420;
+    }
+    void setFormat(SharedFrameFormat format) {
+        mFormat.store(uint32_t(format), std::memory_order_relaxed);
+    }
+
+    // Sequence number of the last published frame, 0 if there is none.
+    uint64_t published() const {
+        return mPublished.load(std::memory_order_acquire);
+    }
+
+    // Sequence number of the last frame the consumer took, 0 if there is
+    // none.
+    uint64_t consumed() const {
+        return mConsumed.load(std::memory_order_acquire);
+    }
+
+    // Published frames that were replaced by a newer one before the consumer
+    // got to them.
+    uint64_t late() const { return mLate.load(std::memory_order_relaxed); }
+
+    // Producer: whether the consumer took the last published frame, so that
+    // a new one would not replace a frame it has not seen.
+    bool canWrite() const { return consumed() == published(); }
+
+    // Producer: the pixels of the slot for the next frame. Write the frame
+    // and publish() it.
+    uint8_t* beginWrite() { return pixels(mBack); }
+
+    void publish(SharedFrameFormat format, uint32_t size, uint64_t tsUs) {
+        const uint64_t seq = mPublished.load(std::memory_order_relaxed) + 1;
+        Slot& slot = mSlots[mBack];
+        slot.seq = seq;
+        slot.tsUs = tsUs;
+        slot.format = uint32_t(format);
+        slot.size = size;
+        const uint32_t previous =
+                mLatest.exchange(mBack | kFresh, std::memory_order_acq_rel);
+        if (previous & kFresh) {
+            mLate.fetch_add(1, std::memory_order_relaxed);
+        }
+        mBack = previous & kIndexMask;
+        mPublished.store(seq, std::memory_order_release);
+    }
+
+    // Consumer: the latest frame if it was published since the last call, or
+    // null. The frame stays untouched until the next call.
+    const Slot* acquire() {
+        if (!(mLatest.load(std::memory_order_relaxed) & kFresh)) {
+            return nullptr;
+        }
+        mFront = mLatest.exchange(mFront, std::memory_order_acq_rel) &
+                 kIndexMask;
+        mConsumed.store(mSlots[mFront].seq, std::memory_order_release);
+        return &mSlots[mFront];
+    }
+
+    const uint8_t* pixels(const Slot* slot) const {
+        return pixels(slot - mSlots);
+    }
+
+private:
+    // Set in mLatest when its slot holds a frame the consumer has not taken.
+    static constexpr uint32_t kFresh = 0x80000000;
+    static constexpr uint32_t kIndexMask = kFresh - 1;
+
+    SharedFrameRing(uint32_t width, uint32_t height, uint32_t fps)
+        : mWidth(width),
+          mHeight(height),
+          mFps(fps),
+          mSlotSize(slotSize(width, height)) {}
+
+    // Large enough for a frame in any format, in whole cache lines.
+    static size_t slotSize(uint32_t width, uint32_t height) {
+        return (frameSize(SharedFrameFormat::RGBA, width, height) + 63) &
+               ~size_t(63);
+    }
+
+    uint8_t* pixels(size_t index) const {
+        return const_cast<uint8_t*>(
+                reinterpret_cast<const uint8_t*>(this + 1) +
+                index * mSlotSize);
+    }
+
+    uint32_t mMagic = kMagic;
+    uint32_t mVersion = kVersion;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mFps;
+    std::atomic<uint32_t> mFormat{uint32_t(SharedFrameFormat::I420)};
+    uint64_t mSlotSize;
+    // Owned by the producer.
+    std::atomic<uint64_t> mPublished{0};
+    std::atomic<uint64_t> mLate{0};
+    uint32_t mBack = 0;
+    // Swapped by both sides: the slot of the latest frame, and kFresh.
+    alignas(64) std::atomic<uint32_t> mLatest{1};
+    // Owned by the consumer.
+    alignas(64) uint32_t mFront = 2;
+    std::atomic<uint64_t> mConsumed{0};
+    Slot mSlots[kSlots] = {};
+};
+
+static_assert(sizeof(SharedFrameRing) % 64 == 0,
+              "Slots must start on a cache line");
+
+}  // namespace recording
+}  // namespace android
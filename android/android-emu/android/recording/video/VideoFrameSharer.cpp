@@ -14,16 +14,17 @@
 
 #include "android/recording/video/VideoFrameSharer.h"
 
+#include <inttypes.h>                          // for PRIu64
 #include <string.h>                            // for memcpy, size_t
 #include <sys/types.h>                         // for mode_t
-#include <functional>                          // for _1, _2, _3
 
 #include "android/base/Log.h"                  // for LogStream, LOG, LogMes...
 #include "android/base/StringView.h"           // for StringView
 #include "android/base/memory/SharedMemory.h"  // for SharedMemory, StringView
 #include "android/base/system/System.h"        // for System
-#include "android/gpu_frame.h"                 // for gpu_set_shared_memory_...
-#include "android/recording/Producer.h"        // for Producer
+#include "android/gpu_frame.h"                 // for gpu_frame_subscribe
+
+#include <libyuv.h>                            // for ARGBToNV12, ARGBToABGR
 
 
 #if DEBUG >= 2
@@ -35,17 +36,13 @@
 namespace android {
 namespace recording {
 
-using std::placeholders::_1;
-using std::placeholders::_2;
-using std::placeholders::_3;
-
 VideoFrameSharer::VideoFrameSharer(uint32_t fbWidth,
                                    uint32_t fbHeight,
                                    const std::string& handle)
-    : mVideo({fbWidth, fbHeight, 60}),
+    : mWidth(fbWidth),
+      mHeight(fbHeight),
       mHandle(handle),
-      mPixelBufferSize(getPixelBytes(mVideo)),
-      mMemory(handle, sizeof(mVideo) + getPixelBytes(mVideo)) {}
+      mMemory(handle, SharedFrameRing::regionSize(fbWidth, fbHeight)) {}
 
 VideoFrameSharer::~VideoFrameSharer() {
     stop();
@@ -53,8 +50,8 @@ VideoFrameSharer::~VideoFrameSharer() {
 }
 bool VideoFrameSharer::initialize() {
     // Prepare the shared memory with some basic info.
-    const mode_t user_read_only = 0600;
-    int err = mMemory.create(user_read_only);
+    const mode_t user_read_write = 0600;
+    int err = mMemory.create(user_read_write);
     if (err != 0) {
         LOG(ERROR) << "Unable to open shared memory of size: " << mMemory.size()
                    << ", due to " << -err;
@@ -71,40 +68,134 @@ bool VideoFrameSharer::initialize() {
         return false;
     }
 
-    memcpy(mMemory.get(), &mVideo, sizeof(mVideo));
-    mReadPixels = android_getReadPixelsFunc();
+    mRing = SharedFrameRing::create(mMemory.get(), mWidth, mHeight, mFps);
     LOG(INFO) << "Initialized handle: " << mHandle;
     return true;
 }
 
-void VideoFrameSharer::frameCallbackForwarder(void* opaque) {
-    VideoFrameSharer* pThis = reinterpret_cast<VideoFrameSharer*>(opaque);
-    pThis->frameAvailable();
-}
-
 void VideoFrameSharer::start() {
-    gpu_register_shared_memory_callback(&VideoFrameSharer::frameCallbackForwarder, this);
+    if (mSubscription >= 0) {
+        return;
+    }
+    mStopping = false;
+    mConvertThread.reset(
+            new base::FunctorThread([this]() { convertFrames(); }));
+    mConvertThread->start();
+
+    // The frames are read back once for all the observers of the display,
+    // and no more often than the target frame rate.
+    // TODO: enable displayId > 0
+    mSubscription = gpu_frame_subscribe(
+            0,
+            [this](const opengl::SharedFramePtr& frame) {
+                frameAvailable(frame);
+            },
+            mFps);
 }
 
 void VideoFrameSharer::stop() {
-    gpu_unregister_shared_memory_callback(this);
+    if (mSubscription < 0) {
+        return;
+    }
+    gpu_frame_unsubscribe(0, mSubscription);
+    mSubscription = -1;
+    {
+        base::AutoLock lock(mLock);
+        mStopping = true;
+        mPending.reset();
+        mFrameCv.signal();
+    }
+    mConvertThread->wait();
+    DD("Shared %" PRIu64 " frames, dropped: %" PRIu64 ", late: %" PRIu64,
+       mRing->published(), droppedFrames(), mRing->late());
 }
 
-void VideoFrameSharer::frameAvailable() {
-    VideoInfo* info = (VideoInfo*)mMemory.get();
-    uint8_t* bPixels = (uint8_t*)mMemory.get() + sizeof(mVideo);
-    // TODO: enable displayId > 0
-    mReadPixels(bPixels, mPixelBufferSize, 0);
+uint64_t VideoFrameSharer::droppedFrames() const {
+    base::AutoLock lock(mLock);
+    return mDropped;
+}
+
+uint64_t VideoFrameSharer::lateFrames() const {
+    return mRing ? mRing->late() : 0;
+}
+
+// Called on the render thread, which must not wait for the conversion: the
+// frame is handed to the conversion thread, replacing one it did not get to.
+void VideoFrameSharer::frameAvailable(const opengl::SharedFramePtr& frame) {
+    if (!mRing || frame->width() != int(mWidth) ||
+        frame->height() != int(mHeight)) {
+        DD("Dropping frame of %dx%d", frame->width(), frame->height());
+        return;
+    }
 
-    // Update frame information.
-    info->frameNumber++;
-    info->tsUs = base::System::get()->getUnixTimeUs();
-    DD("Marshall, frame: %d, ts: %d", info->frameNumber, info->tsUs);
+    base::AutoLock lock(mLock);
+    if (mPending) {
+        DD("Replacing unconverted frame: %" PRIu64, mPending->number());
+        mDropped++;
+    }
+    mPending = frame;
+    mFrameCv.signal();
 }
 
-size_t VideoFrameSharer::getPixelBytes(VideoInfo info) {
-    // ARGB8888 = 4 bytes per pixel.
-    return info.width * info.height * 4;
+// While the other process has not taken the last shared frame there is no
+// slot to convert into: the frame is held back, and dropped if a newer one
+// arrives before a slot frees up.
+void VideoFrameSharer::convertFrames() {
+    const base::System::Duration retryUs = 1000000 / mFps;
+    opengl::SharedFramePtr frame;
+    for (;;) {
+        {
+            base::AutoLock lock(mLock);
+            if (frame) {
+                mFrameCv.timedWait(
+                        &mLock,
+                        base::System::get()->getUnixTimeUs() + retryUs);
+            } else {
+                mFrameCv.wait(&lock,
+                              [this]() { return mStopping || mPending; });
+            }
+            if (mStopping) {
+                return;
+            }
+            if (mPending) {
+                if (frame) {
+                    DD("Dropping unshared frame: %" PRIu64, frame->number());
+                    mDropped++;
+                }
+                frame = std::move(mPending);
+                mPending.reset();
+            }
+        }
+        if (mRing->canWrite()) {
+            convert(*frame);
+            frame.reset();
+        }
+    }
+}
+
+void VideoFrameSharer::convert(const opengl::SharedFrame& frame) {
+    uint8_t* dst = mRing->beginWrite();
+    const auto format = mRing->format();
+    const int chromaWidth = (mWidth + 1) / 2;
+    uint8_t* uv = dst + mWidth * mHeight;
+    switch (format) {
+        case SharedFrameFormat::I420:
+            // Shared with the other subscribers that want I420.
+            memcpy(dst, frame.i420(), frame.i420Size());
+            break;
+        case SharedFrameFormat::NV12:
+            libyuv::ARGBToNV12(frame.pixels(), mWidth * 4, dst, mWidth, uv,
+                               chromaWidth * 2, mWidth, mHeight);
+            break;
+        case SharedFrameFormat::RGBA:
+            libyuv::ARGBToABGR(frame.pixels(), mWidth * 4, dst, mWidth * 4,
+                               mWidth, mHeight);
+            break;
+    }
+    mRing->publish(format,
+                   SharedFrameRing::frameSize(format, mWidth, mHeight),
+                   frame.timestampUs());
+    DD("Marshall, frame: %" PRIu64, mRing->published());
 }
 
 }  // namespace recording
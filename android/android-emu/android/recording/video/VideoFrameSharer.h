@@ -14,50 +14,31 @@
 
 #pragma once
 
-#include <stddef.h>                            // for size_t
-#include <stdint.h>                            // for uint32_t, uint64_t
-#include <memory>                              // for unique_ptr
-#include <string>                              // for string, basic_string
+#include <stdint.h>                                   // for uint32_t, uint64_t
+#include <memory>                                     // for unique_ptr
+#include <string>                                     // for string
 
-#include "android/base/memory/SharedMemory.h"  // for SharedMemory
-#include "android/opengles.h"                  // for ReadPixelsFunc
+#include "android/base/memory/SharedMemory.h"         // for SharedMemory
+#include "android/base/synchronization/ConditionVariable.h"  // for Conditio...
+#include "android/base/synchronization/Lock.h"        // for Lock
+#include "android/base/threads/FunctorThread.h"       // for FunctorThread
+#include "android/opengl/FrameHub.h"                  // for SharedFrame
+#include "android/recording/video/SharedFrameRing.h"  // for SharedFrameRing
 
 namespace android {
 namespace recording {
-class Producer;
 
-// A class that produces video frames in the YUV-I420 pixel format.
-// It has the luma "luminance" plane Y first, then the U chroma plane and last
-// the V chroma plane.
+// Shares the frames of the display with another process, such as the WebRTC
+// video bridge, through a SharedFrameRing in shared memory. It produces AT
+// MOST "fps" frames per second.
 //
-// The two chroma planes (blue and red projections) are sub-sampled in both the
-// horizontal and vertical dimensions by a factor of 2. That is to say, for a
-// 2x2 square of pixels, there are 4 Y samples but only 1 U sample and 1 V
-// sample.
-//
-// This format requires 4*8+8+8=48 bits for 4 pixels, so its depth is 12 bits
-// per pixel.
-//
-// The VideoFrameSharer will listen to frame events from the Producer and
-// convert the incoming video format to I420 and copy it to the shared memory
-// location. It will produce AT MOST "fps" frames per second.
-//
-// Note, that the existing frame will be overwritten, this can cause encoder
-// artifacts. See https://en.wikipedia.org/wiki/Screen_tearing for background
-// information on vsync issues. Vsync is tracked in b/77969099.
-//
-// The process on the other side can feed this data to the WebRTC system that
-// will take care of the actual encoding and serialization of the video frames.
+// The frames are converted into the format the other process asks for (I420,
+// NV12 or RGBA) straight into the write slot of the ring, on a thread of the
+// sharer rather than the render thread that reads the frames back. When the
+// conversion or the other process falls behind, only the latest frame is
+// converted.
 class VideoFrameSharer {
 public:
-    struct VideoInfo {
-        uint32_t width;
-        uint32_t height;
-        uint32_t fps;          // Target framerate.
-        uint32_t frameNumber;  // Frames are ordered
-        uint64_t tsUs;         // Timestamp when this frame was received.
-    };
-
     VideoFrameSharer(uint32_t fbWidth,
                      uint32_t fbHeight,
                      const std::string& handle);
@@ -67,17 +48,32 @@ public:
     void start();
     void stop();
 
+    // Frames not shared because a newer one arrived before they could be
+    // converted, or before the other process took the previous one.
+    uint64_t droppedFrames() const;
+    // Frames shared but replaced before the other process took them.
+    uint64_t lateFrames() const;
+
 private:
-    static void frameCallbackForwarder(void* opaque);
-    void frameAvailable();
-    static size_t getPixelBytes(VideoInfo info);
+    void frameAvailable(const opengl::SharedFramePtr& frame);
+    void convertFrames();
+    void convert(const opengl::SharedFrame& frame);
 
-    VideoInfo mVideo = {0};
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mFps = 60;  // Target framerate.
     std::string mHandle;
     base::SharedMemory mMemory;
-    ReadPixelsFunc mReadPixels;
-    std::unique_ptr<Producer> mVideoProducer;
-    size_t mPixelBufferSize;
+    SharedFrameRing* mRing = nullptr;
+    int mSubscription = -1;
+
+    // The frame waiting for the conversion thread.
+    mutable base::Lock mLock;
+    base::ConditionVariable mFrameCv;
+    opengl::SharedFramePtr mPending;
+    bool mStopping = false;
+    uint64_t mDropped = 0;
+    std::unique_ptr<base::FunctorThread> mConvertThread;
 };
 }  // namespace recording
 }  // namespace android
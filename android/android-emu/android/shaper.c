@@ -47,76 +47,171 @@ _packet_is_internal( const uint8_t*  data, size_t  size )
 }
 
 /* here's how we implement network shaping. we want to limit the network
- * rate to a given constant MAX_RATE expressed as bits/second. this means
- * that it takes 1/MAX_RATE seconds to send a single bit, and count*8/MAX_RATE
- * seconds to send 'count' bytes.
+ * rate to a given constant MAX_RATE expressed as bits/second.
  *
- * we're going to implement a scheme where, when we send a packet of
- * 'count' bytes, no other packet will go through in the same direction for
- * at least 'count*8/MAX_RATE' seconds. any successive packet that is "sent"
- * in this interval is placed in a queue, associated to a timer
+ * each shaper has a token bucket that fills at MAX_RATE/8 bytes per second,
+ * up to SHAPER_BURST_MS worth of traffic. a packet goes through as soon as
+ * the bucket isn't empty, and takes its size out of it, which may leave the
+ * bucket in debt. packets sent while it is empty wait in a FIFO queue,
+ * which a single timer drains when the debt has been paid back: all the
+ * packets the bucket can afford are sent at once, instead of one timer
+ * per packet.
  *
  * there are different (queue/timer/rate) values for the input and output
  * direction of the user vlan.
  */
-typedef struct QueuedPacketRec_ {
-    Duration                   expiration;
-    struct QueuedPacketRec_*   next;
-    size_t                     size;
-    void*                      opaque;
-    void*                      data;
-} QueuedPacketRec, *QueuedPacket;
+#define  SHAPER_BURST_MS     5
 
+/* the payloads copied by a shaper come from fixed-size chunks that are
+ * recycled through a free list, so a busy link doesn't malloc() each
+ * packet. larger packets get a buffer of their own.
+ */
+#define  SHAPER_CHUNK_SIZE       2048
+#define  SHAPER_POOL_MAX_CHUNKS  256
+#define  SHAPER_RING_MIN         64
+
+typedef union PacketChunkRec_ {
+    union PacketChunkRec_*  next;
+    uint8_t                 data[SHAPER_CHUNK_SIZE];
+} PacketChunkRec, *PacketChunk;
+
+typedef struct {
+    PacketChunk   free_chunks;
+    int           num_free;
+} PacketPool;
+
+static void*
+packet_pool_alloc( PacketPool*  pool, size_t  size )
+{
+    PacketChunk  chunk;
 
-static QueuedPacket
-queued_packet_create( const void*   data,
-                      size_t        size,
-                      void*         opaque,
-                      int           do_copy )
-{
-    QueuedPacket   packet;
-    size_t         packet_size = sizeof(*packet);
-
-    if (do_copy)
-        packet_size += size;
-
-    packet = malloc(packet_size);
-    packet->next       = NULL;
-    packet->expiration = 0;
-    packet->size       = (size_t)size;
-    packet->opaque     = opaque;
-
-    if (do_copy) {
-        packet->data = (void*)(packet+1);
-        memcpy( (char*)packet->data, (char*)data, packet->size );
+    if (size > SHAPER_CHUNK_SIZE)
+        return malloc(size);
+
+    chunk = pool->free_chunks;
+    if (chunk) {
+        pool->free_chunks = chunk->next;
+        pool->num_free--;
     } else {
-        packet->data = (void*)data;
+        chunk = malloc(sizeof(*chunk));
     }
-    return packet;
+    return chunk->data;
 }
 
 static void
-queued_packet_free( QueuedPacket  packet )
+packet_pool_free( PacketPool*  pool, void*  data, size_t  size )
 {
-    if (packet) {
-        free( packet );
+    PacketChunk  chunk = (PacketChunk)data;
+
+    if (size > SHAPER_CHUNK_SIZE || pool->num_free >= SHAPER_POOL_MAX_CHUNKS) {
+        free(data);
+        return;
     }
+    chunk->next = pool->free_chunks;
+    pool->free_chunks = chunk;
+    pool->num_free++;
 }
 
+static void
+packet_pool_done( PacketPool*  pool )
+{
+    while (pool->free_chunks) {
+        PacketChunk  chunk = pool->free_chunks;
+        pool->free_chunks = chunk->next;
+        free(chunk);
+    }
+    pool->num_free = 0;
+}
+
+typedef struct {
+    size_t    size;
+    void*     opaque;
+    void*     data;   /* from the pool if the shaper copies packets */
+} QueuedPacketRec, *QueuedPacket;
+
 typedef struct NetShaperRec_ {
-    QueuedPacket   packets;   /* list of queued packets, ordered by expiration date */
+    QueuedPacket   packets;   /* ring of queued packets, in sending order */
+    unsigned       ring_size; /* a power of 2 */
+    unsigned       head;
     int            num_packets;
     int            active;    /* is this shaper active ? */
-    Duration       block_until;
-    double         max_rate;  /* max rate expressed in bytes/second */
-    double         inv_rate;  /* inverse of max rate                */
+    double         max_rate;  /* max rate expressed in bits/second */
+    double         byte_rate; /* bytes per clock unit                */
+    double         tokens;    /* bytes that can be sent now, or debt */
+    double         burst;     /* max tokens                          */
+    Duration       last_fill;
+    Duration       timer_deadline;  /* DURATION_INFINITE if not armed */
     LoopTimer*     timer;     /* timer */
+    PacketPool     pool;
 
     int                do_copy;
     NetShaperSendFunc  send_func;
 
 } NetShaperRec;
 
+static QueuedPacket
+netshaper_queue_tail( NetShaper  shaper )
+{
+    if (shaper->num_packets == (int)shaper->ring_size) {
+        unsigned      new_size = shaper->ring_size ? 2*shaper->ring_size
+                                                   : SHAPER_RING_MIN;
+        QueuedPacket  packets  = malloc(new_size * sizeof(*packets));
+        int           nn;
+
+        for (nn = 0; nn < shaper->num_packets; nn++) {
+            packets[nn] = shaper->packets[(shaper->head + nn) &
+                                          (shaper->ring_size - 1)];
+        }
+        free(shaper->packets);
+        shaper->packets   = packets;
+        shaper->ring_size = new_size;
+        shaper->head      = 0;
+    }
+    return &shaper->packets[(shaper->head + shaper->num_packets++) &
+                            (shaper->ring_size - 1)];
+}
+
+static QueuedPacket
+netshaper_queue_head( NetShaper  shaper )
+{
+    return shaper->num_packets ? &shaper->packets[shaper->head] : NULL;
+}
+
+/* removes the head packet after it has been sent or dropped */
+static void
+netshaper_queue_pop( NetShaper  shaper )
+{
+    QueuedPacket  packet = &shaper->packets[shaper->head];
+
+    if (shaper->do_copy)
+        packet_pool_free(&shaper->pool, packet->data, packet->size);
+
+    shaper->head = (shaper->head + 1) & (shaper->ring_size - 1);
+    shaper->num_packets--;
+}
+
+static void
+netshaper_refill( NetShaper  shaper, Duration  now )
+{
+    if (now > shaper->last_fill) {
+        shaper->tokens += (now - shaper->last_fill) * shaper->byte_rate;
+        if (shaper->tokens > shaper->burst)
+            shaper->tokens = shaper->burst;
+    }
+    shaper->last_fill = now;
+}
+
+static void
+netshaper_arm( NetShaper  shaper, Duration  now )
+{
+    /* when the debt will have been paid back */
+    Duration  deadline = now + (Duration)(-shaper->tokens / shaper->byte_rate) + 1;
+
+    if (deadline != shaper->timer_deadline) {
+        shaper->timer_deadline = deadline;
+        loopTimer_startAbsolute(shaper->timer, deadline);
+    }
+}
 
 void
 netshaper_destroy( NetShaper  shaper )
@@ -124,12 +219,11 @@ netshaper_destroy( NetShaper  shaper )
     if (shaper) {
         shaper->active = 0;
 
-        while (shaper->packets) {
-            QueuedPacket  packet = shaper->packets;
-            shaper->packets = packet->next;
-            packet->next    = NULL;
-            queued_packet_free(packet);
-        }
+        while (shaper->num_packets)
+            netshaper_queue_pop(shaper);
+
+        free(shaper->packets);
+        packet_pool_done(&shaper->pool);
 
         loopTimer_stop(shaper->timer);
         loopTimer_free(shaper->timer);
@@ -144,30 +238,26 @@ netshaper_expires(void* opaque, LoopTimer* unused)
 {
     NetShaper shaper = (NetShaper)opaque;
     QueuedPacket  packet;
+    Duration      now;
 
     if (opaque == NULL) {
         crashhandler_die("netshaper_expires() with opaque==NULL");
     }
 
-    while ((packet = shaper->packets) != NULL) {
-       Duration now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
-
-       if (packet->expiration > now)
-           break;
+    shaper->timer_deadline = DURATION_INFINITE;
+    now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
+    netshaper_refill(shaper, now);
 
-       shaper->packets = packet->next;
-       shaper->send_func( packet->data, packet->size, packet->opaque );
-       queued_packet_free(packet);
-       shaper->num_packets--;
-   }
+    while ((packet = netshaper_queue_head(shaper)) != NULL &&
+           shaper->tokens >= 0) {
+        shaper->tokens -= packet->size;
+        shaper->send_func( packet->data, packet->size, packet->opaque );
+        netshaper_queue_pop(shaper);
+    }
 
-   /* reprogram timer if needed */
-   if (shaper->packets) {
-       shaper->block_until = shaper->packets->expiration;
-       loopTimer_startAbsolute(shaper->timer, shaper->block_until);
-   } else {
-       shaper->block_until = -1;
-   }
+    /* reprogram timer if needed */
+    if (shaper->num_packets)
+        netshaper_arm(shaper, now);
 }
 
 
@@ -175,18 +265,15 @@ NetShaper
 netshaper_create( int                do_copy,
                   NetShaperSendFunc  send_func )
 {
-    NetShaper  shaper = malloc(sizeof(*shaper));
+    NetShaper  shaper = calloc(1, sizeof(*shaper));
 
     shaper->active = 0;
-    shaper->packets = NULL;
-    shaper->num_packets = 0;
     shaper->timer = loopTimer_newWithClock(
             looper_getForThread(), netshaper_expires, shaper, SHAPER_CLOCK);
+    shaper->timer_deadline = DURATION_INFINITE;
+    shaper->do_copy   = do_copy;
     shaper->send_func = send_func;
     shaper->max_rate  = 1e6;
-    shaper->inv_rate  = 0.;
-
-    shaper->block_until = -1; /* magic value, means to not block */
 
     return shaper;
 }
@@ -195,26 +282,30 @@ void
 netshaper_set_rate( NetShaper  shaper,
                     double     rate )
 {
+    QueuedPacket  packet;
+
     if (!shaper) return;
 
     /* send all current packets when changing the rate */
-    while (shaper->packets) {
-        QueuedPacket  packet = shaper->packets;
-        shaper->packets = packet->next;
+    while ((packet = netshaper_queue_head(shaper)) != NULL) {
         shaper->send_func(packet->data, packet->size, packet->opaque);
-        free(packet);
-        shaper->num_packets = 0;
+        netshaper_queue_pop(shaper);
     }
+    loopTimer_stop(shaper->timer);
+    shaper->timer_deadline = DURATION_INFINITE;
 
     shaper->max_rate = rate;
     if (rate > 1.) {
-        shaper->inv_rate = (8.*SHAPER_CLOCK_UNIT)/rate;  /* our clock time is in ms */
-        shaper->active   = 1;                            /* for the real-time clock */
+        shaper->byte_rate = rate/(8.*SHAPER_CLOCK_UNIT);  /* our clock time is in ms */
+        shaper->burst     = shaper->byte_rate*SHAPER_BURST_MS;
+        shaper->active    = 1;                            /* for the real-time clock */
     } else {
         shaper->active = 0;
     }
 
-    shaper->block_until = -1;
+    /* the next packet goes through right away */
+    shaper->tokens    = 0.;
+    shaper->last_fill = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
 }
 
 void
@@ -223,50 +314,40 @@ netshaper_send_aux( NetShaper  shaper,
                     size_t     size,
                     void*      opaque )
 {
-    Duration now;
+    Duration      now;
+    QueuedPacket  packet;
 
     if (!shaper->active || _packet_is_internal(data, size)) {
         shaper->send_func( data, size, opaque );
         return;
     }
 
-    now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
-    if (now >= shaper->block_until) {
-        shaper->send_func( data, size, opaque );
-        shaper->block_until = now + size*shaper->inv_rate;
-        //fprintf(stderr, "NETSHAPER: block for %.2fms\n", (shaper->block_until - now)*1.0 );
-        return;
+    /* keep the packets in order behind the ones already waiting, the timer
+     * will send them */
+    if (!shaper->num_packets) {
+        now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
+        netshaper_refill(shaper, now);
+        if (shaper->tokens >= 0) {
+            shaper->tokens -= size;
+            shaper->send_func( data, size, opaque );
+            return;
+        }
+    } else {
+        now = 0;
     }
 
-    /* create new packet, add it to the queue */
-    {
-        QueuedPacket   packet;
-
-        packet = queued_packet_create( data, size, opaque, shaper->do_copy );
-
-        packet->expiration = shaper->block_until;
-
-        {
-            QueuedPacket  *pnode, node;
-
-            pnode = &shaper->packets;
-            for (;;) {
-                node = *pnode;
-                if (node == NULL || node->expiration > packet->expiration )
-                    break;
-                pnode = &node->next;
-            }
-            packet->next = *pnode;
-            *pnode       = packet;
-
-            if (packet == shaper->packets) {
-                loopTimer_startAbsolute(shaper->timer, packet->expiration);
-            }
-        }
-        shaper->num_packets += 1;
+    packet = netshaper_queue_tail(shaper);
+    packet->size   = size;
+    packet->opaque = opaque;
+    if (shaper->do_copy) {
+        packet->data = packet_pool_alloc(&shaper->pool, size);
+        memcpy(packet->data, data, size);
+    } else {
+        packet->data = data;
     }
-    shaper->block_until += size*shaper->inv_rate;
-    //fprintf(stderr, "NETSHAPER: block2 for %.2fms\n", (shaper->block_until - now)*1.0 );
+
+    if (shaper->num_packets == 1)
+        netshaper_arm(shaper, now);
 }
 
 void
@@ -281,16 +362,15 @@ netshaper_send( NetShaper  shaper,
 int
 netshaper_can_send( NetShaper  shaper )
 {
-    Duration now;
-
-    if (!shaper->active || shaper->block_until < 0)
+    if (!shaper->active)
         return 1;
 
-    if (shaper->packets)
+    if (shaper->num_packets)
         return 0;
 
-    now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
-    return (now >= shaper->block_until);
+    netshaper_refill(shaper,
+                     looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK));
+    return (shaper->tokens >= 0);
 }
 
 
@@ -303,13 +383,17 @@ netshaper_can_send( NetShaper  shaper )
  */
 typedef struct SessionRec_ {
     Duration              expiration;
-    struct SessionRec_*   next;
+    struct SessionRec_*   next;       /* in its hash bucket */
+    struct SessionRec_*   wheel_next; /* in its timing wheel slot */
+    struct SessionRec_**  wheel_pprev;
     unsigned              src_ip;
     unsigned              dst_ip;
     unsigned short        src_port;
     unsigned short        dst_port;
     uint8_t               protocol;
-    QueuedPacket          packet;
+    size_t                packet_size;
+    void*                 packet_opaque;
+    void*                 packet;
 
 } SessionRec, *Session;
 
@@ -322,10 +406,7 @@ static void
 session_free( Session  session )
 {
     if (session) {
-        if (session->packet) {
-            queued_packet_free(session->packet);
-            session->packet = NULL;
-        }
+        free( session->packet );
         free( session );
     }
 }
@@ -395,11 +476,147 @@ _packet_SYN_flags( const void*  _data, size_t   size, Session  info )
 }
 
 
+/* the delayed sessions are kept in a hierarchical timing wheel with a
+ * slot per millisecond for the next WHEEL0_SLOTS ms, and a slot per
+ * WHEEL0_SLOTS ms after that. when the first level wraps around, the next
+ * slot of the second level is spread over it. adding or removing a session
+ * is O(1), and expiring them only looks at the slots that came due.
+ */
+#define  WHEEL0_BITS    8
+#define  WHEEL1_BITS    6
+#define  WHEEL0_SLOTS   (1 << WHEEL0_BITS)
+#define  WHEEL1_SLOTS   (1 << WHEEL1_BITS)
+#define  WHEEL0_MASK    (WHEEL0_SLOTS - 1)
+#define  WHEEL1_MASK    (WHEEL1_SLOTS - 1)
+#define  WHEEL_SPAN     ((Duration)WHEEL0_SLOTS << WHEEL1_BITS)
+
+typedef struct {
+    Duration   now;          /* next millisecond to expire */
+    int        count;
+    Session    slots0[WHEEL0_SLOTS];
+    Session    slots1[WHEEL1_SLOTS];
+} TimerWheel;
+
+static void
+wheel_insert( TimerWheel*  wheel, Session  session )
+{
+    Duration   expiration = session->expiration;
+    Duration   delta;
+    Session*   slot;
+
+    if (expiration < wheel->now)
+        expiration = wheel->now;
+
+    delta = expiration - wheel->now;
+    if (delta < WHEEL0_SLOTS) {
+        slot = &wheel->slots0[expiration & WHEEL0_MASK];
+    } else {
+        /* too far: park it in the last slot, it will be placed again
+         * when that slot is spread over the first level */
+        if (delta >= WHEEL_SPAN)
+            expiration = wheel->now + WHEEL_SPAN - 1;
+        slot = &wheel->slots1[(expiration >> WHEEL0_BITS) & WHEEL1_MASK];
+    }
+
+    session->wheel_next  = *slot;
+    session->wheel_pprev = slot;
+    if (*slot)
+        (*slot)->wheel_pprev = &session->wheel_next;
+    *slot = session;
+    wheel->count++;
+}
+
+static void
+wheel_remove( TimerWheel*  wheel, Session  session )
+{
+    if (session->wheel_pprev == NULL)
+        return;
+
+    *session->wheel_pprev = session->wheel_next;
+    if (session->wheel_next)
+        session->wheel_next->wheel_pprev = session->wheel_pprev;
+    session->wheel_next  = NULL;
+    session->wheel_pprev = NULL;
+    wheel->count--;
+}
+
+/* calls 'func' for each session that expires up to 'now', after taking it
+ * out of the wheel */
+static void
+wheel_advance( TimerWheel*  wheel, Duration  now,
+               void (*func)(void* opaque, Session session), void*  opaque )
+{
+    if (wheel->count == 0) {
+        if (now >= wheel->now)
+            wheel->now = now + 1;
+        return;
+    }
+
+    while (wheel->now <= now) {
+        Session  session;
+
+        if ((wheel->now & WHEEL0_MASK) == 0) {
+            Session*  slot = &wheel->slots1[(wheel->now >> WHEEL0_BITS) &
+                                            WHEEL1_MASK];
+            while ((session = *slot) != NULL) {
+                wheel_remove(wheel, session);
+                wheel_insert(wheel, session);
+            }
+        }
+
+        while ((session = wheel->slots0[wheel->now & WHEEL0_MASK]) != NULL) {
+            wheel_remove(wheel, session);
+            func(opaque, session);
+        }
+
+        wheel->now++;
+        if (wheel->count == 0) {
+            if (now >= wheel->now)
+                wheel->now = now + 1;
+            break;
+        }
+    }
+}
+
+/* returns the time by which wheel_advance() must be called again, or
+ * DURATION_INFINITE if the wheel is empty */
+static Duration
+wheel_next_deadline( TimerWheel*  wheel )
+{
+    Duration  deadline = DURATION_INFINITE;
+    Duration  first, when;
+
+    if (wheel->count == 0)
+        return deadline;
+
+    for (when = wheel->now; when < wheel->now + WHEEL0_SLOTS; when++) {
+        if (wheel->slots0[when & WHEEL0_MASK]) {
+            deadline = when;
+            break;
+        }
+    }
+
+    /* sessions of the second level only move when their slot comes up */
+    first = (wheel->now + WHEEL0_MASK) >> WHEEL0_BITS;
+    for (when = first; when < first + WHEEL1_SLOTS; when++) {
+        if (wheel->slots1[when & WHEEL1_MASK]) {
+            if ((when << WHEEL0_BITS) < deadline)
+                deadline = when << WHEEL0_BITS;
+            break;
+        }
+    }
+    return deadline;
+}
+
+
 typedef struct NetDelayRec_
 {
-    Session     sessions;
+    Session*    buckets;     /* hash table of sessions, by 5-tuple */
+    unsigned    num_buckets; /* a power of 2 */
     int         num_sessions;
+    TimerWheel  wheel;       /* of the sessions with a delayed packet */
     LoopTimer*  timer;
+    Duration    timer_deadline;
     int         active;
     int         min_ms;
     int         max_ms;
@@ -408,11 +625,24 @@ typedef struct NetDelayRec_
 
 } NetDelayRec;
 
+#define  NETDELAY_MIN_BUCKETS   64
+
+static unsigned
+session_hash( Session  info )
+{
+    uint32_t  h = info->src_ip * 0x9e3779b1u;
+
+    h ^= info->dst_ip * 0x85ebca77u;
+    h ^= ((uint32_t)info->src_port << 16 | info->dst_port) * 0xc2b2ae3du;
+    h ^= info->protocol;
+    return h ^ (h >> 15);
+}
 
 static Session*
 netdelay_lookup_session( NetDelay  delay, Session  info )
 {
-    Session*  pnode = &delay->sessions;
+    Session*  pnode = &delay->buckets[session_hash(info) &
+                                      (delay->num_buckets - 1)];
     Session   node;
 
     for (;;) {
@@ -432,56 +662,104 @@ netdelay_lookup_session( NetDelay  delay, Session  info )
     return pnode;
 }
 
+static void
+netdelay_grow( NetDelay  delay )
+{
+    unsigned   old_count = delay->num_buckets;
+    Session*   old       = delay->buckets;
+    unsigned   nn;
+
+    delay->num_buckets = 2*old_count;
+    delay->buckets     = calloc(delay->num_buckets, sizeof(*delay->buckets));
+
+    for (nn = 0; nn < old_count; nn++) {
+        while (old[nn]) {
+            Session   session = old[nn];
+            Session*  bucket  = &delay->buckets[session_hash(session) &
+                                                (delay->num_buckets - 1)];
+            old[nn] = session->next;
+            session->next = *bucket;
+            *bucket = session;
+        }
+    }
+    free(old);
+}
 
-
-/* called by the delay's timer on expiration */
+/* removes all sessions, sending their delayed packet first if 'flush' */
 static void
-netdelay_expires(void* opaque, LoopTimer* unused)
+netdelay_clear( NetDelay  delay, int  flush )
 {
-    NetDelay delay = (NetDelay)opaque;
-    Session  session;
-    Duration now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
-    int      rearm = 0;
-    Duration rearm_time = 0;
-
-    for (session = delay->sessions; session != NULL; session = session->next)
-    {
-        QueuedPacket  packet = session->packet;
-
-        if (packet == NULL)
-            continue;
-
-        if (session->expiration <= now) {
-            /* send the SYN packet now */
-                    //fprintf(stderr, "NetDelay:RST: sending creation for %s\n", session_to_string(session) );
-            delay->send_func( packet->data, packet->size, packet->opaque );
-            session->packet = NULL;
-            queued_packet_free( packet );
-        } else {
-            if (!rearm) {
-                rearm      = 1;
-                rearm_time = session->expiration;
+    unsigned  nn;
+
+    for (nn = 0; nn < delay->num_buckets; nn++) {
+        while (delay->buckets[nn]) {
+            Session  session = delay->buckets[nn];
+            delay->buckets[nn] = session->next;
+            wheel_remove(&delay->wheel, session);
+            if (flush && session->packet) {
+                delay->send_func( session->packet, session->packet_size,
+                                  session->packet_opaque );
             }
-            else if ( session->expiration < rearm_time )
-                rearm_time = session->expiration;
+            session_free(session);
+            delay->num_sessions--;
         }
     }
+}
+
+static void
+netdelay_send_session( void*  opaque, Session  session )
+{
+    NetDelay  delay = (NetDelay)opaque;
+
+    /* send the SYN packet now */
+            //fprintf(stderr, "NetDelay:RST: sending creation for %s\n", session_to_string(session) );
+    delay->send_func( session->packet, session->packet_size,
+                      session->packet_opaque );
+    free(session->packet);
+    session->packet = NULL;
+}
 
-    if (rearm) {
-        loopTimer_startAbsolute(delay->timer, rearm_time);
+static void
+netdelay_update( NetDelay  delay, Duration  now )
+{
+    Duration  deadline;
+
+    wheel_advance(&delay->wheel, now, netdelay_send_session, delay);
+
+    deadline = wheel_next_deadline(&delay->wheel);
+    if (deadline != delay->timer_deadline) {
+        delay->timer_deadline = deadline;
+        if (deadline == DURATION_INFINITE)
+            loopTimer_stop(delay->timer);
+        else
+            loopTimer_startAbsolute(delay->timer, deadline);
     }
 }
 
+/* called by the delay's timer on expiration */
+static void
+netdelay_expires(void* opaque, LoopTimer* unused)
+{
+    NetDelay delay = (NetDelay)opaque;
+
+    delay->timer_deadline = DURATION_INFINITE;
+    netdelay_update(delay,
+                    looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK));
+}
+
 
 NetDelay
 netdelay_create( NetShaperSendFunc  send_func )
 {
-    NetDelay  delay = malloc(sizeof(*delay));
+    NetDelay  delay = calloc(1, sizeof(*delay));
 
-    delay->sessions     = NULL;
+    delay->num_buckets  = NETDELAY_MIN_BUCKETS;
+    delay->buckets      = calloc(delay->num_buckets, sizeof(*delay->buckets));
     delay->num_sessions = 0;
     delay->timer = loopTimer_newWithClock(
             looper_getForThread(), netdelay_expires, delay, SHAPER_CLOCK);
+    delay->timer_deadline = DURATION_INFINITE;
+    delay->wheel.now = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK);
     delay->active = 0;
     delay->min_ms = 0;
     delay->max_ms = 0;
@@ -496,17 +774,9 @@ void
 netdelay_set_latency( NetDelay  delay, int  min_ms, int  max_ms )
 {
     /* when changing the latency, accept all sessions */
-    while (delay->sessions) {
-        Session  session = delay->sessions;
-        delay->sessions = session->next;
-        session->next = NULL;
-        if (session->packet) {
-            QueuedPacket  packet = session->packet;
-            delay->send_func( packet->data, packet->size, packet->opaque );
-        }
-        session_free(session);
-        delay->num_sessions--;
-    }
+    netdelay_clear(delay, 1);
+    loopTimer_stop(delay->timer);
+    delay->timer_deadline = DURATION_INFINITE;
 
     delay->min_ms = min_ms;
     delay->max_ms = max_ms;
@@ -536,6 +806,7 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                 //fprintf(stderr, "NetDelay:RST: dropping %s\n", session_to_string(info) );
 
                 *lookup = session->next;
+                wheel_remove(&delay->wheel, session);
                 session_free( session );
                 delay->num_sessions -= 1;
             }
@@ -556,20 +827,27 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                 }
             } else {
                 /* establish a new session slightly in the future */
-                int   latency = delay->min_ms;
-                int   range   = delay->max_ms - delay->min_ms;
+                int       latency = delay->min_ms;
+                int       range   = delay->max_ms - delay->min_ms;
+                Duration  now     = looper_nowWithClock(looper_getForThread(),
+                                                        SHAPER_CLOCK);
 
                  if (range > 0)
                     latency += rand() % range;
 
+                if (delay->num_sessions >= (int)delay->num_buckets) {
+                    netdelay_grow(delay);
+                    lookup = netdelay_lookup_session( delay, info );
+                }
+
                     //fprintf(stderr, "NetDelay:RST: delay creation for %s\n", session_to_string(info) );
-                session = malloc( sizeof(*session) );
+                session = calloc( 1, sizeof(*session) );
 
-                session->next        = delay->sessions;
-                delay->sessions      = session;
+                session->next        = NULL;
+                *lookup              = session;
                 delay->num_sessions += 1;
 
-                session->expiration = looper_nowWithClock(looper_getForThread(), SHAPER_CLOCK) + latency;
+                session->expiration = now + latency;
 
                 session->src_ip   = info->src_ip;
                 session->dst_ip   = info->dst_ip;
@@ -577,9 +855,16 @@ netdelay_send_aux( NetDelay  delay, const void*  data, size_t  size, void* opaqu
                 session->dst_port = info->dst_port;
                 session->protocol = info->protocol;
 
-                session->packet = queued_packet_create( data, size, opaque, 1 );
+                session->packet        = malloc( size );
+                session->packet_size   = size;
+                session->packet_opaque = opaque;
+                memcpy( session->packet, data, size );
 
-                netdelay_expires(delay, delay->timer);
+                /* expire what is due so the wheel doesn't lag behind */
+                wheel_advance(&delay->wheel, now - 1,
+                              netdelay_send_session, delay);
+                wheel_insert(&delay->wheel, session);
+                netdelay_update(delay, now);
                 return;
             }
         }
@@ -593,12 +878,8 @@ void
 netdelay_destroy( NetDelay  delay )
 {
     if (delay) {
-        while (delay->sessions) {
-            Session  session = delay->sessions;
-            delay->sessions = session->next;
-            session_free(session);
-            delay->num_sessions -= 1;
-        }
+        netdelay_clear(delay, 0);
+        free(delay->buckets);
         loopTimer_stop(delay->timer);
         loopTimer_free(delay->timer);
         delay->timer = NULL;
@@ -0,0 +1,257 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/shaper.h"
+
+#include "android/base/async/ThreadLooper.h"
+#include "android/base/testing/TestLooper.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <string.h>
+
+using android::base::TestLooper;
+using android::base::ThreadLooper;
+
+namespace {
+
+// The shapers run on the realtime clock, give all clocks the same fake
+// time so that the test controls when their timers fire.
+class FakeClockLooper : public TestLooper {
+public:
+    Duration nowMs(ClockType clockType) override { return mNowMs; }
+    DurationNs nowNs(ClockType clockType) override {
+        return mNowMs * 1000000ULL;
+    }
+
+    void advance(Duration ms) {
+        for (; ms > 0; --ms) {
+            mNowMs++;
+            runOneIterationWithDeadlineMs(mNowMs);
+        }
+    }
+
+private:
+    Duration mNowMs = 1000;
+};
+
+struct Sent {
+    std::vector<uint8_t> data;
+    void* opaque;
+};
+
+std::vector<Sent> sSent;
+
+void recordPacket(void* data, size_t size, void* opaque) {
+    auto bytes = static_cast<uint8_t*>(data);
+    sSent.push_back({std::vector<uint8_t>(bytes, bytes + size), opaque});
+}
+
+enum { kTcpSyn = 0x02, kTcpRst = 0x04, kTcpAck = 0x10 };
+
+// An Ethernet frame with an IPv4/TCP packet from the guest to the outside,
+// tagged with |tag| after the headers.
+std::vector<uint8_t> makeFrame(size_t size,
+                               uint8_t tag,
+                               uint16_t srcPort = 40000,
+                               uint8_t tcpFlags = kTcpAck) {
+    std::vector<uint8_t> frame(std::max<size_t>(size, 64));
+    frame[12] = 0x08;  // IPv4
+    uint8_t* ip = &frame[14];
+    ip[0] = 0x45;
+    ip[8] = 64;  // TTL
+    ip[9] = 6;   // TCP
+    const uint8_t src[] = {10, 0, 2, 15};
+    const uint8_t dst[] = {8, 8, 8, 8};
+    memcpy(ip + 12, src, 4);
+    memcpy(ip + 16, dst, 4);
+    uint8_t* tcp = ip + 20;
+    tcp[0] = srcPort >> 8;
+    tcp[1] = srcPort & 0xff;
+    tcp[2] = 0;
+    tcp[3] = 80;
+    tcp[13] = tcpFlags;
+    tcp[20] = tag;
+    return frame;
+}
+
+uint8_t tagOf(const Sent& sent) {
+    return sent.data[14 + 20 + 20];
+}
+
+class ShaperTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ThreadLooper::setLooper(&mLooper);
+        sSent.clear();
+    }
+
+    void TearDown() override {
+        if (mShaper) {
+            netshaper_destroy(mShaper);
+        }
+        if (mDelay) {
+            netdelay_destroy(mDelay);
+        }
+        ThreadLooper::setLooper(nullptr);
+    }
+
+    void send(const std::vector<uint8_t>& frame) {
+        netshaper_send(mShaper, (void*)frame.data(), frame.size());
+    }
+
+    void delay(const std::vector<uint8_t>& frame) {
+        netdelay_send(mDelay, frame.data(), frame.size());
+    }
+
+    FakeClockLooper mLooper;
+    NetShaper mShaper = nullptr;
+    NetDelay mDelay = nullptr;
+};
+
+}  // namespace
+
+TEST_F(ShaperTest, InactivePassesThrough) {
+    mShaper = netshaper_create(1, recordPacket);
+    netshaper_set_rate(mShaper, 0);
+    for (int i = 0; i < 100; ++i) {
+        send(makeFrame(1500, i));
+    }
+    EXPECT_EQ(100U, sSent.size());
+    EXPECT_TRUE(netshaper_can_send(mShaper));
+}
+
+TEST_F(ShaperTest, LimitsRate) {
+    mShaper = netshaper_create(1, recordPacket);
+    // 1000 bytes per ms.
+    netshaper_set_rate(mShaper, 8e6);
+
+    for (int i = 0; i < 50; ++i) {
+        send(makeFrame(1000, i));
+    }
+    // The first one goes through, the others wait for their turn.
+    EXPECT_EQ(1U, sSent.size());
+    EXPECT_FALSE(netshaper_can_send(mShaper));
+
+    for (int ms = 1; ms <= 100 && sSent.size() < 50; ++ms) {
+        mLooper.advance(1);
+        EXPECT_LE(sSent.size(), static_cast<size_t>(ms + 1));
+    }
+    ASSERT_EQ(50U, sSent.size());
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_EQ(i, tagOf(sSent[i]));
+    }
+}
+
+TEST_F(ShaperTest, IdleLinkAllowsBurst) {
+    mShaper = netshaper_create(1, recordPacket);
+    netshaper_set_rate(mShaper, 8e6);
+
+    send(makeFrame(1000, 0));
+    mLooper.advance(100);
+    EXPECT_TRUE(netshaper_can_send(mShaper));
+
+    // A few ms worth of traffic, but no more, goes through at once.
+    for (int i = 1; i < 20; ++i) {
+        send(makeFrame(1000, i));
+    }
+    EXPECT_GT(sSent.size(), 2U);
+    EXPECT_LT(sSent.size(), 10U);
+}
+
+TEST_F(ShaperTest, SetRateFlushesQueue) {
+    mShaper = netshaper_create(1, recordPacket);
+    netshaper_set_rate(mShaper, 8e3);
+    for (int i = 0; i < 10; ++i) {
+        send(makeFrame(1000, i));
+    }
+    EXPECT_EQ(1U, sSent.size());
+    netshaper_set_rate(mShaper, 0);
+    EXPECT_EQ(10U, sSent.size());
+    mLooper.advance(10000);
+    EXPECT_EQ(10U, sSent.size());
+}
+
+TEST_F(ShaperTest, CopiesQueuedPackets) {
+    mShaper = netshaper_create(1, recordPacket);
+    netshaper_set_rate(mShaper, 8e6);
+    send(makeFrame(1000, 0));
+    {
+        // Larger than a pool chunk.
+        auto frame = makeFrame(9000, 1);
+        send(frame);
+        frame.assign(frame.size(), 0);
+    }
+    mLooper.advance(20);
+    ASSERT_EQ(2U, sSent.size());
+    EXPECT_EQ(1, tagOf(sSent[1]));
+    EXPECT_EQ(9000U, sSent[1].data.size());
+}
+
+TEST_F(ShaperTest, DelaysNewSessions) {
+    mDelay = netdelay_create(recordPacket);
+    netdelay_set_latency(mDelay, 100, 100);
+
+    delay(makeFrame(60, 1, 40000, kTcpSyn));
+    // A SYN sent again before the first one went out is swallowed.
+    delay(makeFrame(60, 2, 40000, kTcpSyn));
+    // Other sessions and packets aren't held back by it.
+    delay(makeFrame(60, 3, 40001, kTcpAck));
+    ASSERT_EQ(1U, sSent.size());
+    EXPECT_EQ(3, tagOf(sSent[0]));
+
+    mLooper.advance(99);
+    EXPECT_EQ(1U, sSent.size());
+    mLooper.advance(1);
+    ASSERT_EQ(2U, sSent.size());
+    EXPECT_EQ(1, tagOf(sSent[1]));
+
+    // The session is established now.
+    delay(makeFrame(60, 4, 40000, kTcpSyn));
+    EXPECT_EQ(3U, sSent.size());
+}
+
+TEST_F(ShaperTest, DelaysManySessions) {
+    mDelay = netdelay_create(recordPacket);
+    // Past both levels of the timing wheel.
+    const int kLatencies[] = {300, 20000};
+
+    for (int latency : kLatencies) {
+        sSent.clear();
+        netdelay_set_latency(mDelay, latency, latency);
+        for (int i = 0; i < 200; ++i) {
+            delay(makeFrame(60, i, 30000 + i, kTcpSyn));
+            mLooper.advance(1);
+        }
+        EXPECT_EQ(0U, sSent.size()) << latency;
+        mLooper.advance(latency - 200);
+        for (int i = 0; i < 200; ++i) {
+            ASSERT_EQ(static_cast<size_t>(i + 1), sSent.size()) << latency;
+            EXPECT_EQ(i, tagOf(sSent[i]));
+            mLooper.advance(1);
+        }
+    }
+}
+
+TEST_F(ShaperTest, ResetDropsDelayedSession) {
+    mDelay = netdelay_create(recordPacket);
+    netdelay_set_latency(mDelay, 100, 100);
+
+    delay(makeFrame(60, 1, 40000, kTcpSyn));
+    delay(makeFrame(60, 2, 40000, kTcpRst));
+    ASSERT_EQ(1U, sSent.size());
+    EXPECT_EQ(2, tagOf(sSent[0]));
+    mLooper.advance(1000);
+    EXPECT_EQ(1U, sSent.size());
+}
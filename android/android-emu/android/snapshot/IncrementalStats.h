@@ -40,6 +40,7 @@ public:
         TotalPages,
         SamePage,
         NotLoadedPage,
+        NotWrittenPage,
         StillZeroPage,
         SameHashPage,
         ChangedPage,
@@ -52,8 +53,8 @@ public:
 
     static constexpr char kActionFormat[] =
             "\tPages: total %llu\n"
-            "\t\tsame %llu [not loaded %llu; still empty %llu; "
-            "same hash %llu]\n"
+            "\t\tsame %llu [not loaded %llu; not written %llu; "
+            "still empty %llu; same hash %llu]\n"
             "\t\tnew  %llu [reused %llu, empty %llu, appended %llu]\n";
 
     enum class Time : int {
@@ -15,6 +15,7 @@
 #include "android/base/files/FileShareOpen.h"
 #include "android/base/files/PathUtils.h"
 #include "android/base/files/StdioStream.h"
+#include "android/featurecontrol/FeatureControl.h"
 #include "android/snapshot/TextureLoader.h"
 #include "android/utils/path.h"
 #include "android/utils/file_io.h"
@@ -62,6 +63,11 @@ Loader::Loader(const Snapshot& snapshot, int error)
         mRamLoader.emplace(StdioStream(ram, StdioStream::kOwner),
                            RamLoader::Flags::OnDemandAllowed,
                            emptyRamBlockStructure);
+        if (android::featurecontrol::isEnabled(
+                    android::featurecontrol::SnapshotSharedRam)) {
+            mRamLoader->setSharedImagePath(
+                    PathUtils::join(mSnapshot.dataDir(), kSharedRamFileName));
+        }
     }
     {
         const auto textures = android::base::fsopen(
@@ -17,6 +17,7 @@
 #include "android/snapshot/common.h"
 #include "android/snapshot/RamLoader.h"
 #include "android/snapshot/Snapshot.h"
+#include "android/snapshot/TextureLoader.h"
 
 namespace android {
 namespace snapshot {
@@ -33,6 +34,10 @@ public:
     bool hasRamLoader() const { return mRamLoader; }
     RamLoader& ramLoader() { return *mRamLoader; }
     ITextureLoaderPtr textureLoader() const;
+    TextureLoader::Stats textureStats() const {
+        return mTextureLoader ? mTextureLoader->stats()
+                              : TextureLoader::Stats{0, 0};
+    }
 
     OperationStatus status() const { return mStatus; }
     const Snapshot& snapshot() const { return mSnapshot; }
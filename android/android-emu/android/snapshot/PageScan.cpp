@@ -0,0 +1,478 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/PageScan.h"
+
+#include "MurmurHash3.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+#endif
+
+// The AVX kernels are compiled with function level target attributes, so the
+// rest of the emulator keeps running on hosts without them.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && \
+        !defined(_MSC_VER)
+#define PAGE_SCAN_AVX 1
+#define PAGE_SCAN_TARGET(x) __attribute__((target(x)))
+#else
+#define PAGE_SCAN_AVX 0
+#endif
+
+namespace android {
+namespace snapshot {
+
+// A group of pages hashed at once, with their results.
+static constexpr size_t kMaxLanes = 8;
+
+namespace {
+
+struct Kernel {
+    bool (*isZero)(const void* ptr, size_t size);
+    // Hashes |lanes| pages of |size| bytes, |size| is a multiple of 64.
+    void (*hashGroup)(const uint8_t* const* ptrs,
+                      size_t size,
+                      PageHash* const* hashes);
+    size_t lanes;
+};
+
+}  // namespace
+
+static bool isZeroGeneric(const void* buf, size_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(buf);
+    for (size_t i = 0; i < len; ++i) {
+        if (bytes[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef __x86_64__
+// Inspired by QEMU's bufferzero.c implementation, but simplified for the case
+// when checking the whole aligned memory page.
+static bool isZeroSse2(const void* buf, size_t len) {
+    buf = __builtin_assume_aligned(buf, 1024);
+    __m128i t = _mm_load_si128(static_cast<const __m128i*>(buf));
+    auto p = reinterpret_cast<__m128i*>(
+            (reinterpret_cast<intptr_t>(buf) + 5 * 16));
+    auto e =
+            reinterpret_cast<__m128i*>((reinterpret_cast<intptr_t>(buf) + len));
+    const __m128i zero = _mm_setzero_si128();
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    do {
+        __builtin_prefetch(p);
+        t = _mm_cmpeq_epi32(t, zero);
+        if (_mm_movemask_epi8(t) != 0xFFFF) {
+            return false;
+        }
+#ifdef _MSC_VER
+        t = _mm_or_si128(_mm_or_si128(p[-4], p[-3]), _mm_or_si128(p[-2], p[-1]));
+#else
+        t = p[-4] | p[-3] | p[-2] | p[-1];
+#endif
+        p += 4;
+    } while (p <= e);
+
+    /* Finish the aligned tail.  */
+#ifdef _WIN32
+    t = _mm_or_si128(t, e[-3]);
+    t = _mm_or_si128(t, e[-2]);
+    t = _mm_or_si128(t, e[-1]);
+#else
+    t |= e[-3];
+    t |= e[-2];
+    t |= e[-1];
+#endif
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(t, zero)) == 0xFFFF;
+}
+#endif  // __x86_64__
+
+#if PAGE_SCAN_AVX
+PAGE_SCAN_TARGET("avx2")
+static bool isZeroAvx2(const void* buf, size_t len) {
+    auto p = static_cast<const __m256i*>(buf);
+    const auto e = p + len / sizeof(__m256i);
+    // 128 bytes at a time, |len| is a multiple of 1KB.
+    for (; p < e; p += 4) {
+        __m256i t = _mm256_or_si256(
+                _mm256_or_si256(_mm256_load_si256(p), _mm256_load_si256(p + 1)),
+                _mm256_or_si256(_mm256_load_si256(p + 2),
+                                _mm256_load_si256(p + 3)));
+        if (!_mm256_testz_si256(t, t)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PAGE_SCAN_TARGET("avx512f")
+static bool isZeroAvx512(const void* buf, size_t len) {
+    auto p = static_cast<const __m512i*>(buf);
+    const auto e = p + len / sizeof(__m512i);
+    // 256 bytes at a time, |len| is a multiple of 1KB.
+    for (; p < e; p += 4) {
+        __m512i t = _mm512_or_si512(
+                _mm512_or_si512(_mm512_load_si512(p), _mm512_load_si512(p + 1)),
+                _mm512_or_si512(_mm512_load_si512(p + 2),
+                                _mm512_load_si512(p + 3)));
+        if (_mm512_test_epi64_mask(t, t)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif  // PAGE_SCAN_AVX
+
+#ifdef __aarch64__
+static bool isZeroNeon(const void* buf, size_t len) {
+    auto p = static_cast<const uint64_t*>(buf);
+    const auto e = p + len / sizeof(uint64_t);
+    // 64 bytes at a time, |len| is a multiple of 1KB.
+    for (; p < e; p += 8) {
+        uint64x2_t t = vorrq_u64(vorrq_u64(vld1q_u64(p), vld1q_u64(p + 2)),
+                                 vorrq_u64(vld1q_u64(p + 4), vld1q_u64(p + 6)));
+        if (vmaxvq_u32(vreinterpretq_u32_u64(t))) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif  // __aarch64__
+
+// MurmurHash3_x64_128, taken apart so a few independent streams can be
+// interleaved.
+static constexpr uint64_t kC1 = 0x87c37b91114253d5ULL;
+static constexpr uint64_t kC2 = 0x4cf5ad432745937fULL;
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline void murmurFinish(uint64_t h1,
+                                uint64_t h2,
+                                size_t size,
+                                PageHash* hash) {
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    const uint64_t out[2] = {h1, h2};
+    memcpy(hash->data(), out, sizeof(out));
+}
+
+static void hashGroupGeneric(const uint8_t* const* ptrs,
+                             size_t size,
+                             PageHash* const* hashes) {
+    MurmurHash3_x64_128(ptrs[0], int(size), 0, hashes[0]->data());
+}
+
+template <size_t N>
+static void hashGroupInterleaved(const uint8_t* const* ptrs,
+                                 size_t size,
+                                 PageHash* const* hashes) {
+    uint64_t h1[N] = {};
+    uint64_t h2[N] = {};
+    for (size_t offset = 0; offset < size; offset += 16) {
+        for (size_t j = 0; j < N; ++j) {
+            uint64_t k[2];
+            memcpy(k, ptrs[j] + offset, sizeof(k));
+
+            k[0] *= kC1;
+            k[0] = rotl64(k[0], 31);
+            k[0] *= kC2;
+            h1[j] ^= k[0];
+            h1[j] = rotl64(h1[j], 27);
+            h1[j] += h2[j];
+            h1[j] = h1[j] * 5 + 0x52dce729;
+
+            k[1] *= kC2;
+            k[1] = rotl64(k[1], 33);
+            k[1] *= kC1;
+            h2[j] ^= k[1];
+            h2[j] = rotl64(h2[j], 31);
+            h2[j] += h1[j];
+            h2[j] = h2[j] * 5 + 0x38495ab5;
+        }
+    }
+    for (size_t j = 0; j < N; ++j) {
+        murmurFinish(h1[j], h2[j], size, hashes[j]);
+    }
+}
+
+#if PAGE_SCAN_AVX
+// One MurmurHash3 block for each of eight streams, one per 64 bit lane.
+PAGE_SCAN_TARGET("avx512f,avx512dq")
+static inline void murmurBlockAvx512(__m512i k1,
+                                     __m512i k2,
+                                     __m512i* h1,
+                                     __m512i* h2) {
+    const __m512i c1 = _mm512_set1_epi64(kC1);
+    const __m512i c2 = _mm512_set1_epi64(kC2);
+
+    k1 = _mm512_mullo_epi64(k1, c1);
+    k1 = _mm512_rol_epi64(k1, 31);
+    k1 = _mm512_mullo_epi64(k1, c2);
+    *h1 = _mm512_xor_si512(*h1, k1);
+    *h1 = _mm512_rol_epi64(*h1, 27);
+    *h1 = _mm512_add_epi64(*h1, *h2);
+    *h1 = _mm512_add_epi64(_mm512_add_epi64(_mm512_slli_epi64(*h1, 2), *h1),
+                           _mm512_set1_epi64(0x52dce729));
+
+    k2 = _mm512_mullo_epi64(k2, c2);
+    k2 = _mm512_rol_epi64(k2, 33);
+    k2 = _mm512_mullo_epi64(k2, c1);
+    *h2 = _mm512_xor_si512(*h2, k2);
+    *h2 = _mm512_rol_epi64(*h2, 31);
+    *h2 = _mm512_add_epi64(*h2, *h1);
+    *h2 = _mm512_add_epi64(_mm512_add_epi64(_mm512_slli_epi64(*h2, 2), *h2),
+                           _mm512_set1_epi64(0x38495ab5));
+}
+
+// Hashes eight pages at once. Every round loads 64 bytes of each page and
+// transposes them, so that vector |i| holds the |i|th 64 bit word of all
+// the pages.
+PAGE_SCAN_TARGET("avx512f,avx512dq")
+static void hashGroupAvx512(const uint8_t* const* ptrs,
+                            size_t size,
+                            PageHash* const* hashes) {
+    // Element indices into the concatenation of two vectors.
+    const __m512i low = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    const __m512i high = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+    __m512i h1 = _mm512_setzero_si512();
+    __m512i h2 = _mm512_setzero_si512();
+
+    for (size_t offset = 0; offset + 64 <= size; offset += 64) {
+        __m512i r[8];
+        for (int j = 0; j < 8; ++j) {
+            r[j] = _mm512_loadu_si512(ptrs[j] + offset);
+        }
+
+        // a[2n]: even words of page 2n and 2n + 1, a[2n + 1]: odd words.
+        __m512i a[8];
+        for (int n = 0; n < 4; ++n) {
+            a[2 * n] = _mm512_unpacklo_epi64(r[2 * n], r[2 * n + 1]);
+            a[2 * n + 1] = _mm512_unpackhi_epi64(r[2 * n], r[2 * n + 1]);
+        }
+
+        // For pages 0-3 (g = 0) and 4-7 (g = 1):
+        // b[4g]: words 0 and 2, b[4g + 1]: 1 and 3, b[4g + 2]: 4 and 6,
+        // b[4g + 3]: 5 and 7.
+        __m512i b[8];
+        for (int g = 0; g < 2; ++g) {
+            const __m512i* in = a + 4 * g;
+            b[4 * g] = _mm512_permutex2var_epi64(in[0], low, in[2]);
+            b[4 * g + 1] = _mm512_permutex2var_epi64(in[1], low, in[3]);
+            b[4 * g + 2] = _mm512_permutex2var_epi64(in[0], high, in[2]);
+            b[4 * g + 3] = _mm512_permutex2var_epi64(in[1], high, in[3]);
+        }
+
+        __m512i w[8];
+        w[0] = _mm512_shuffle_i64x2(b[0], b[4], 0x44);
+        w[2] = _mm512_shuffle_i64x2(b[0], b[4], 0xee);
+        w[1] = _mm512_shuffle_i64x2(b[1], b[5], 0x44);
+        w[3] = _mm512_shuffle_i64x2(b[1], b[5], 0xee);
+        w[4] = _mm512_shuffle_i64x2(b[2], b[6], 0x44);
+        w[6] = _mm512_shuffle_i64x2(b[2], b[6], 0xee);
+        w[5] = _mm512_shuffle_i64x2(b[3], b[7], 0x44);
+        w[7] = _mm512_shuffle_i64x2(b[3], b[7], 0xee);
+
+        murmurBlockAvx512(w[0], w[1], &h1, &h2);
+        murmurBlockAvx512(w[2], w[3], &h1, &h2);
+        murmurBlockAvx512(w[4], w[5], &h1, &h2);
+        murmurBlockAvx512(w[6], w[7], &h1, &h2);
+    }
+
+    alignas(64) uint64_t out1[8];
+    alignas(64) uint64_t out2[8];
+    _mm512_store_si512(out1, h1);
+    _mm512_store_si512(out2, h2);
+    for (size_t j = 0; j < 8; ++j) {
+        murmurFinish(out1[j], out2[j], size, hashes[j]);
+    }
+}
+#endif  // PAGE_SCAN_AVX
+
+static const Kernel sKernels[] = {
+        // Generic
+        {isZeroGeneric, hashGroupGeneric, 1},
+#ifdef __x86_64__
+        // Sse2
+        {isZeroSse2, hashGroupInterleaved<4>, 4},
+#else
+        {nullptr, nullptr, 0},
+#endif
+#ifdef __aarch64__
+        // Neon
+        {isZeroNeon, hashGroupInterleaved<4>, 4},
+#else
+        {nullptr, nullptr, 0},
+#endif
+#if PAGE_SCAN_AVX
+        // Avx2
+        {isZeroAvx2, hashGroupInterleaved<4>, 4},
+        // Avx512
+        {isZeroAvx512, hashGroupAvx512, 8},
+#else
+        {nullptr, nullptr, 0},
+        {nullptr, nullptr, 0},
+#endif
+};
+
+bool pageScanKernelSupported(PageScanKernel kernel) {
+    if (!sKernels[int(kernel)].isZero) {
+        return false;
+    }
+#if PAGE_SCAN_AVX
+    switch (kernel) {
+        case PageScanKernel::Avx2:
+            return __builtin_cpu_supports("avx2");
+        case PageScanKernel::Avx512:
+            return __builtin_cpu_supports("avx512f") &&
+                   __builtin_cpu_supports("avx512dq");
+        default:
+            break;
+    }
+#endif
+    return true;
+}
+
+static PageScanKernel bestKernel() {
+    for (int i = int(PageScanKernel::Avx512); i > int(PageScanKernel::Generic);
+         --i) {
+        if (pageScanKernelSupported(PageScanKernel(i))) {
+            return PageScanKernel(i);
+        }
+    }
+    return PageScanKernel::Generic;
+}
+
+static std::atomic<int> sKernelIndex{-1};
+
+static const Kernel& kernel() {
+    int index = sKernelIndex.load(std::memory_order_relaxed);
+    if (index < 0) {
+        index = int(bestKernel());
+        sKernelIndex.store(index, std::memory_order_relaxed);
+    }
+    return sKernels[index];
+}
+
+PageScanKernel pageScanKernel() {
+    kernel();
+    return PageScanKernel(sKernelIndex.load(std::memory_order_relaxed));
+}
+
+bool setPageScanKernel(PageScanKernel kernel) {
+    if (!pageScanKernelSupported(kernel)) {
+        return false;
+    }
+    sKernelIndex.store(int(kernel), std::memory_order_relaxed);
+    return true;
+}
+
+bool isPageZeroed(const void* ptr, size_t size) {
+    assert((uintptr_t(ptr) & (1024 - 1)) == 0);  // page-aligned
+    assert(size >= 1024 && size % 1024 == 0);    // whole small pages
+    return kernel().isZero(ptr, size);
+}
+
+void hashPage(const void* ptr, size_t size, PageHash* hash) {
+    MurmurHash3_x64_128(ptr, int(size), 0, hash->data());
+}
+
+// Hashes the pages in |ptrs|, as many at a time as the kernel can.
+static void hashScattered(const Kernel& k,
+                          const uint8_t* const* ptrs,
+                          size_t size,
+                          PageHash* const* hashes,
+                          size_t count) {
+    size_t i = 0;
+    if (size % 64 == 0) {
+        for (; i + k.lanes <= count; i += k.lanes) {
+            k.hashGroup(ptrs + i, size, hashes + i);
+        }
+    }
+    for (; i < count; ++i) {
+        hashPage(ptrs[i], size, hashes[i]);
+    }
+}
+
+void hashPages(const uint8_t* pages,
+               size_t pageSize,
+               size_t count,
+               PageHash* hashes) {
+    const Kernel& k = kernel();
+    const uint8_t* ptrs[kMaxLanes];
+    PageHash* outs[kMaxLanes];
+    while (count > 0) {
+        const size_t n = std::min(count, kMaxLanes);
+        for (size_t j = 0; j < n; ++j) {
+            ptrs[j] = pages + j * pageSize;
+            outs[j] = hashes + j;
+        }
+        hashScattered(k, ptrs, pageSize, outs, n);
+        pages += n * pageSize;
+        hashes += n;
+        count -= n;
+    }
+}
+
+void scanPages(const uint8_t* pages,
+               size_t pageSize,
+               size_t count,
+               bool hash,
+               PageScanResult* results) {
+    const Kernel& k = kernel();
+    const uint8_t* ptrs[kMaxLanes];
+    PageHash* outs[kMaxLanes];
+    size_t pending = 0;
+    for (size_t i = 0; i < count; ++i, pages += pageSize) {
+        results[i].zero = k.isZero(pages, pageSize);
+        if (!hash || results[i].zero) {
+            continue;
+        }
+        // Hash while the start of the page is still in the cache.
+        ptrs[pending] = pages;
+        outs[pending] = &results[i].hash;
+        if (++pending == k.lanes) {
+            hashScattered(k, ptrs, pageSize, outs, pending);
+            pending = 0;
+        }
+    }
+    hashScattered(k, ptrs, pageSize, outs, pending);
+}
+
+}  // namespace snapshot
+}  // namespace android
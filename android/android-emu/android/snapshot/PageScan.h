@@ -0,0 +1,85 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+// The inner loop of every RAM snapshot save: find out which guest pages are
+// all zeroes, and hash the others so an incremental save can tell if they
+// changed.
+//
+// The zero check picks the widest vector unit the host has at runtime
+// (AVX-512, AVX2 or SSE2 on x86_64, NEON on aarch64). The hash is
+// MurmurHash3_x64_128 with a zero seed, bit for bit: the hashes are stored in
+// the snapshot index and compared against the next save. Batches of pages are
+// hashed several at a time instead: eight pages in the lanes of an AVX-512
+// vector, or four interleaved scalar streams, which hides the latency of the
+// multiplies a single MurmurHash3 stream is bound by.
+
+namespace android {
+namespace snapshot {
+
+using PageHash = std::array<char, 16>;
+
+struct PageScanResult {
+    bool zero;
+    PageHash hash;  // Only filled for nonzero pages.
+};
+
+// Returns true if |size| bytes at |ptr| are all zero. |ptr| has to be aligned
+// to 1KB and |size| a nonzero multiple of 1KB.
+bool isPageZeroed(const void* ptr, size_t size);
+
+// Hashes a single page, MurmurHash3_x64_128(ptr, size, 0, hash).
+void hashPage(const void* ptr, size_t size, PageHash* hash);
+
+// Hashes |count| contiguous pages of |pageSize| bytes starting at |pages|.
+void hashPages(const uint8_t* pages,
+               size_t pageSize,
+               size_t count,
+               PageHash* hashes);
+
+// Zero checks |count| contiguous pages of |pageSize| bytes starting at
+// |pages|, and if |hash| is set, hashes the ones that are not all zeroes.
+// Zero pages are read exactly once, a zero check of a page with data usually
+// stops within its first cache line, so a page is not pulled through the
+// cache twice.
+void scanPages(const uint8_t* pages,
+               size_t pageSize,
+               size_t count,
+               bool hash,
+               PageScanResult* results);
+
+// The implementations of the functions above, for tests and benchmarks. The
+// fastest one the host supports is picked by default.
+enum class PageScanKernel {
+    Generic,  // Byte by byte zero check, one page hashed at a time.
+    Sse2,
+    Neon,
+    Avx2,
+    Avx512,
+};
+
+// Whether |kernel| is compiled in, and the host can run it.
+bool pageScanKernelSupported(PageScanKernel kernel);
+
+// The kernel currently in use.
+PageScanKernel pageScanKernel();
+
+// Switches all page scans over to |kernel|, returns false if it is not
+// supported.
+bool setPageScanKernel(PageScanKernel kernel);
+
+}  // namespace snapshot
+}  // namespace android
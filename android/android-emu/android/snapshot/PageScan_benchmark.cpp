@@ -0,0 +1,107 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Compares the page scan kernels used by RAM snapshot saving. The argument
+// is the kernel (see PageScanKernel), the kernels the host does not support
+// are skipped.
+
+#include "android/snapshot/PageScan.h"
+
+#include "android/base/AlignedBuf.h"
+
+#include <random>
+#include <string.h>
+#include <vector>
+
+#include "benchmark/benchmark_api.h"
+
+using android::AlignedBuf;
+using android::snapshot::PageHash;
+using android::snapshot::PageScanKernel;
+using android::snapshot::PageScanResult;
+
+static constexpr size_t kPageSize = 4096;
+static constexpr size_t kNumPages = 1024;  // 4MB, a typical batch of RAM.
+
+#define KERNEL_BENCHMARK(x) BENCHMARK(x)->DenseRange(0, 4)
+
+// A RAM image where every |zeroEvery|th page is zero, the others are random.
+static AlignedBuf<uint8_t, 4096> makeRam(int zeroEvery) {
+    AlignedBuf<uint8_t, 4096> ram(kNumPages * kPageSize);
+    memset(ram.data(), 0, ram.size());
+    std::mt19937_64 gen(42);
+    for (size_t i = 0; i < kNumPages; ++i) {
+        if (zeroEvery && i % zeroEvery == 0) {
+            continue;
+        }
+        auto page = reinterpret_cast<uint64_t*>(ram.data() + i * kPageSize);
+        for (size_t j = 0; j < kPageSize / sizeof(uint64_t); ++j) {
+            page[j] = gen();
+        }
+    }
+    return ram;
+}
+
+static bool useKernel(benchmark::State& state) {
+    auto kernel = PageScanKernel(state.range_x());
+    if (!android::snapshot::setPageScanKernel(kernel)) {
+        state.SkipWithError("Kernel not supported");
+        return false;
+    }
+    return true;
+}
+
+void BM_IsPageZeroed(benchmark::State& state) {
+    if (!useKernel(state)) {
+        return;
+    }
+    auto ram = makeRam(1);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < kNumPages; ++i) {
+            benchmark::DoNotOptimize(android::snapshot::isPageZeroed(
+                    ram.data() + i * kPageSize, kPageSize));
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+}
+
+void BM_HashPages(benchmark::State& state) {
+    if (!useKernel(state)) {
+        return;
+    }
+    auto ram = makeRam(0);
+    std::vector<PageHash> hashes(kNumPages);
+    while (state.KeepRunning()) {
+        android::snapshot::hashPages(ram.data(), kPageSize, kNumPages,
+                                     hashes.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+}
+
+// The snapshot save case: a mix of zero pages and pages with data.
+void BM_ScanPages(benchmark::State& state) {
+    if (!useKernel(state)) {
+        return;
+    }
+    auto ram = makeRam(3);
+    std::vector<PageScanResult> results(kNumPages);
+    while (state.KeepRunning()) {
+        android::snapshot::scanPages(ram.data(), kPageSize, kNumPages, true,
+                                     results.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+}
+
+KERNEL_BENCHMARK(BM_IsPageZeroed);
+KERNEL_BENCHMARK(BM_HashPages);
+KERNEL_BENCHMARK(BM_ScanPages);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,160 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/PageScan.h"
+
+#include "android/base/AlignedBuf.h"
+
+#include "MurmurHash3.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string.h>
+#include <vector>
+
+using android::AlignedBuf;
+
+namespace android {
+namespace snapshot {
+
+static constexpr size_t kPageSize = 4096;
+static constexpr size_t kNumPages = 37;
+
+using PageBuffer = AlignedBuf<uint8_t, 4096>;
+
+// Runs every test against all the kernels the host supports.
+class PageScanTest : public ::testing::TestWithParam<PageScanKernel> {
+protected:
+    void SetUp() override {
+        mDefault = pageScanKernel();
+        if (!setPageScanKernel(GetParam())) {
+            mSkip = true;
+        }
+    }
+
+    void TearDown() override { setPageScanKernel(mDefault); }
+
+    // Fills every |step|th page with random data, the rest stays zero.
+    static PageBuffer makePages(int step) {
+        PageBuffer buf(kNumPages * kPageSize);
+        memset(buf.data(), 0, buf.size());
+        std::mt19937 gen(step);
+        for (size_t i = 0; i < kNumPages; i += step) {
+            for (size_t j = 0; j < kPageSize; ++j) {
+                buf[i * kPageSize + j] = uint8_t(gen());
+            }
+        }
+        return buf;
+    }
+
+    static PageHash murmur(const uint8_t* ptr, size_t size) {
+        PageHash hash;
+        MurmurHash3_x64_128(ptr, int(size), 0, hash.data());
+        return hash;
+    }
+
+    PageScanKernel mDefault;
+    bool mSkip = false;
+};
+
+TEST_P(PageScanTest, ZeroPage) {
+    if (mSkip) {
+        return;
+    }
+    PageBuffer buf(kPageSize);
+    memset(buf.data(), 0, buf.size());
+    EXPECT_TRUE(isPageZeroed(buf.data(), kPageSize));
+
+    // A single bit anywhere in the page counts.
+    for (size_t i = 0; i < kPageSize; i += 7) {
+        buf[i] = 0x10;
+        EXPECT_FALSE(isPageZeroed(buf.data(), kPageSize)) << "byte " << i;
+        buf[i] = 0;
+    }
+    buf[kPageSize - 1] = 1;
+    EXPECT_FALSE(isPageZeroed(buf.data(), kPageSize));
+}
+
+TEST_P(PageScanTest, SmallPages) {
+    if (mSkip) {
+        return;
+    }
+    PageBuffer buf(kPageSize);
+    memset(buf.data(), 0, buf.size());
+    buf[1024] = 1;
+    EXPECT_TRUE(isPageZeroed(buf.data(), 1024));
+    EXPECT_FALSE(isPageZeroed(buf.data(), 2048));
+}
+
+TEST_P(PageScanTest, HashPagesMatchesMurmur) {
+    if (mSkip) {
+        return;
+    }
+    PageBuffer buf = makePages(1);
+    std::vector<PageHash> hashes(kNumPages);
+    hashPages(buf.data(), kPageSize, kNumPages, hashes.data());
+    for (size_t i = 0; i < kNumPages; ++i) {
+        EXPECT_EQ(murmur(buf.data() + i * kPageSize, kPageSize), hashes[i])
+                << "page " << i;
+    }
+
+    PageHash hash;
+    hashPage(buf.data(), kPageSize, &hash);
+    EXPECT_EQ(hashes[0], hash);
+}
+
+TEST_P(PageScanTest, ScanPages) {
+    if (mSkip) {
+        return;
+    }
+    for (int step : {1, 2, 3, 9}) {
+        PageBuffer buf = makePages(step);
+        std::vector<PageScanResult> results(kNumPages);
+        scanPages(buf.data(), kPageSize, kNumPages, true, results.data());
+        for (size_t i = 0; i < kNumPages; ++i) {
+            const uint8_t* page = buf.data() + i * kPageSize;
+            ASSERT_EQ(i % step != 0, results[i].zero) << "page " << i;
+            if (!results[i].zero) {
+                EXPECT_EQ(murmur(page, kPageSize), results[i].hash)
+                        << "page " << i;
+            }
+        }
+    }
+}
+
+TEST_P(PageScanTest, ScanPagesWithoutHash) {
+    if (mSkip) {
+        return;
+    }
+    PageBuffer buf = makePages(2);
+    std::vector<PageScanResult> results(kNumPages);
+    for (auto& result : results) {
+        result.hash.fill(0);
+    }
+    scanPages(buf.data(), kPageSize, kNumPages, false, results.data());
+    const PageHash empty = {};
+    for (size_t i = 0; i < kNumPages; ++i) {
+        EXPECT_EQ(i % 2 != 0, results[i].zero);
+        EXPECT_EQ(empty, results[i].hash);
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(PageScan,
+                        PageScanTest,
+                        ::testing::Values(PageScanKernel::Generic,
+                                          PageScanKernel::Sse2,
+                                          PageScanKernel::Neon,
+                                          PageScanKernel::Avx2,
+                                          PageScanKernel::Avx512));
+
+}  // namespace snapshot
+}  // namespace android
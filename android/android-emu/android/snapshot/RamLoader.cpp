@@ -16,9 +16,12 @@
 #include "android/base/ContiguousRangeMapper.h"
 #include "android/base/EintrWrapper.h"
 #include "android/base/Profiler.h"
+#include "android/base/StringFormat.h"
 #include "android/base/Stopwatch.h"
+#include "android/base/Tracing.h"
 #include "android/base/files/MemStream.h"
 #include "android/base/files/PathUtils.h"
+#include "android/base/files/ScopedFd.h"
 #include "android/base/files/preadwrite.h"
 #include "android/base/memory/MemoryHints.h"
 #include "android/base/misc/StringUtils.h"
@@ -35,16 +38,33 @@
 #include <cassert>
 #include <memory>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using android::base::ContiguousRangeMapper;
 using android::base::MemoryHint;
 using android::base::MemStream;
 using android::base::PathUtils;
+using android::base::ScopedFd;
 using android::base::ScopedMemoryProfiler;
 using android::base::Stopwatch;
 
 namespace android {
 namespace snapshot {
 
+// The shared image holds the pages of the RAM blocks the way the guest sees
+// them, each block at an aligned offset after a header, so that they can be
+// mapped straight from it. Zero pages are left as holes.
+static constexpr uint32_t kSharedImageMagic = 0x52414d53;  // 'RAMS'
+static constexpr uint32_t kSharedImageVersion = 1;
+static constexpr int64_t kSharedImageAlignment = 64 * 1024;
+static constexpr int64_t kSharedImageHeaderSize = kSharedImageAlignment;
+static constexpr uint32_t kSharedImageMaxBlocks = 256;
+
 void RamLoader::FileIndex::clear() {
     decltype(pages)().swap(pages);
     decltype(blocks)().swap(blocks);
@@ -55,7 +75,9 @@ RamLoader::RamBlockStructure::~RamBlockStructure() {}
 RamLoader::RamLoader(base::StdioStream&& stream,
                      Flags flags,
                      const RamLoader::RamBlockStructure& blockStructure)
-    : mStream(std::move(stream)), mReaderThread([this]() { readerWorker(); }) {
+    : mStream(std::move(stream)),
+      mReaderThread([this]() { readerWorker(); }),
+      mSharedImageWriter([this]() { writeSharedImage(); }) {
     if (nonzero(flags & Flags::LoadIndexOnly)) {
         mIndexOnly = true;
         applyRamBlockStructure(blockStructure);
@@ -66,8 +88,12 @@ RamLoader::RamLoader(base::StdioStream&& stream,
 
     if (nonzero(flags & Flags::OnDemandAllowed) &&
         MemoryAccessWatch::isSupported()) {
-        mAccessWatch.emplace([this](void* ptr) { loadRamPage(ptr); },
-                             [this]() { return backgroundPageLoad(); });
+        mAccessWatch.emplace(
+                [this](void* ptr) {
+                    mPageFaults.fetch_add(1, std::memory_order_relaxed);
+                    loadRamPage(ptr);
+                },
+                [this]() { return backgroundPageLoad(); });
         if (mAccessWatch->valid()) {
             mOnDemandEnabled = true;
         } else {
@@ -79,6 +105,8 @@ RamLoader::RamLoader(base::StdioStream&& stream,
 }
 
 RamLoader::~RamLoader() {
+    mStopSharedImageWriter.store(true, std::memory_order_relaxed);
+    mSharedImageWriter.wait();
     if (mWasStarted) {
         interruptReading();
         mReaderThread.wait();
@@ -144,6 +172,12 @@ bool RamLoader::start(bool isQuickboot) {
         return false;
     }
 
+    const bool sharedImageMapped = !mSharedImagePath.empty() &&
+                                   mapSharedImage();
+    if (mHasError) {
+        return false;
+    }
+
     if (!mAccessWatch) {
         bool res = readAllPages();
         mEndTime = base::System::get()->getHighResTimeUs();
@@ -151,6 +185,9 @@ bool RamLoader::start(bool isQuickboot) {
         printf("Eager RAM load complete in %.03f ms\n",
                (mEndTime - mStartTime) / 1000.0);
 #endif
+        if (res && !mSharedImagePath.empty() && !sharedImageMapped) {
+            startSharedImageWriter();
+        }
         return res;
     }
 
@@ -161,9 +198,17 @@ bool RamLoader::start(bool isQuickboot) {
     mBackgroundPageIt = mIndex.pages.begin();
     mAccessWatch->doneRegistering();
     mReaderThread.start();
+    if (!mSharedImagePath.empty() && !sharedImageMapped) {
+        startSharedImageWriter();
+    }
     return true;
 }
 
+bool RamLoader::joinSharedImageWriter() {
+    mSharedImageWriter.wait();
+    return mSharedImageWritten;
+}
+
 void RamLoader::join() {
 #if SNAPSHOT_PROFILE > 1
     printf("Finishing background RAM load\n");
@@ -465,6 +510,11 @@ bool RamLoader::registerPageWatches() {
     uint8_t* startPtr = nullptr;
     uint64_t curSize = 0;
     for (const Page& page : mIndex.pages) {
+        // Mapped from the shared image.
+        if (page.state.load(std::memory_order_relaxed) ==
+            uint8_t(State::Filled)) {
+            continue;
+        }
         auto ptr = pagePtr(page);
         auto size = pageSize(page);
         if (ptr == startPtr + curSize) {
@@ -646,6 +696,7 @@ void RamLoader::loadRamPage(void* ptr) {
 }
 
 bool RamLoader::readDataFromDisk(Page* pagePtr, uint8_t* preallocatedBuffer) {
+    AEMU_SCOPED_TRACE("RamLoader::readDataFromDisk");
     Page& page = *pagePtr;
     if (page.sizeOnDisk == 0) {
         assert(page.state.load(std::memory_order_relaxed) >=
@@ -695,6 +746,8 @@ bool RamLoader::readDataFromDisk(Page* pagePtr, uint8_t* preallocatedBuffer) {
         mHasError = true;
         return false;
     }
+    mBytesRead.fetch_add(size, std::memory_order_relaxed);
+    mPagesRead.fetch_add(1, std::memory_order_relaxed);
 
     bool decompressorThreadPoolOwned = false;
 
@@ -723,6 +776,8 @@ bool RamLoader::readDataFromDisk(Page* pagePtr, uint8_t* preallocatedBuffer) {
                 return false;
             }
 
+            mPagesDecompressed.fetch_add(1, std::memory_order_relaxed);
+
             if (allocateBuffer && !preallocatedBuffer) {
                 delete[] buf;
             }
@@ -778,6 +833,7 @@ void RamLoader::fillPageData(Page* pagePtr) {
 }
 
 bool RamLoader::readAllPages() {
+    AEMU_SCOPED_TRACE("RamLoader::readAllPages");
 #if SNAPSHOT_PROFILE > 1
     auto startTime = base::System::get()->getHighResTimeUs();
 #endif
@@ -796,6 +852,11 @@ bool RamLoader::readAllPages() {
 #endif
 
     for (Page& page : mIndex.pages) {
+        if (page.state.load(std::memory_order_relaxed) ==
+            uint8_t(State::Filled)) {
+            // Mapped from the shared image.
+            continue;
+        }
         if (page.sizeOnDisk) {
             sortedPages.emplace_back(&page);
         } else if (!mIsQuickboot) {
@@ -843,6 +904,8 @@ void RamLoader::startDecompressor() {
             derror("Decompressing page %p failed", pagePtr(*page));
             mHasError = true;
             page->state.store(uint8_t(State::Error));
+        } else {
+            mPagesDecompressed.fetch_add(1, std::memory_order_relaxed);
         }
     });
     if (!mDecompressor->start()) {
@@ -850,5 +913,277 @@ void RamLoader::startDecompressor() {
     }
 }
 
+// Blocks backed by a file of their own share their pages through it already.
+static bool canShareBlock(const RamLoader::FileIndex::Block& block) {
+    return !block.ramBlock.readonly &&
+           !(block.ramBlock.flags & SNAPSHOT_RAM_MAPPED) &&
+           block.pagesBegin != block.pagesEnd;
+}
+
+#ifdef __linux__
+// Tells apart the versions of the RAM file, which saves rewrite in place.
+using RamFileKey = std::array<uint64_t, 5>;
+
+static bool ramFileKey(int fd, uint64_t indexPos, RamFileKey* key) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    *key = {uint64_t(st.st_size), indexPos, uint64_t(st.st_ino),
+            uint64_t(st.st_mtim.tv_sec), uint64_t(st.st_mtim.tv_nsec)};
+    return true;
+}
+
+// Whether the image could be mapped over the blocks: there must be some to
+// share, and MAP_FIXED needs each of them to cover whole host pages.
+bool RamLoader::sharedImageMappable() const {
+    const auto hostPageSize = uint64_t(sysconf(_SC_PAGESIZE));
+    bool anyShareable = false;
+    for (const auto& block : mIndex.blocks) {
+        if (!canShareBlock(block)) {
+            continue;
+        }
+        if ((uint64_t(block.ramBlock.hostPtr) |
+             uint64_t(block.ramBlock.totalSize)) &
+            (hostPageSize - 1)) {
+            return false;
+        }
+        anyShareable = true;
+    }
+    return anyShareable;
+}
+#endif
+
+bool RamLoader::mapSharedImage() {
+#ifdef __linux__
+    AEMU_SCOPED_TRACE("RamLoader::mapSharedImage");
+    if (!sharedImageMappable()) {
+        return false;
+    }
+
+    ScopedFd fd(HANDLE_EINTR(
+            open(mSharedImagePath.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (!fd.valid()) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) != 0) {
+        return false;
+    }
+    MemStream::Buffer buffer(kSharedImageHeaderSize);
+    if (HANDLE_EINTR(base::pread(fd.get(), buffer.data(), buffer.size(), 0)) !=
+        int64_t(buffer.size())) {
+        return false;
+    }
+    MemStream header(std::move(buffer));
+    if (header.getBe32() != kSharedImageMagic ||
+        header.getBe32() != kSharedImageVersion) {
+        return false;
+    }
+    RamFileKey key;
+    if (!ramFileKey(mStreamFd, mIndexPos, &key)) {
+        return false;
+    }
+    for (uint64_t value : key) {
+        if (header.getBe64() != value) {
+            VERBOSE_PRINT(snapshot, "Shared RAM image %s is out of date",
+                          mSharedImagePath.c_str());
+            return false;
+        }
+    }
+
+    // Check all the blocks before replacing any of them.
+    std::vector<int64_t> offsets(mIndex.blocks.size(), -1);
+    const auto blockCount = header.getBe32();
+    if (blockCount > kSharedImageMaxBlocks) {
+        return false;
+    }
+    for (uint32_t i = 0; i < blockCount; ++i) {
+        const auto id = header.getString();
+        const auto totalSize = int64_t(header.getBe64());
+        const auto pageSize = int32_t(header.getBe32());
+        const auto offset = int64_t(header.getBe64());
+        if ((offset % kSharedImageAlignment) ||
+            offset + totalSize > st.st_size) {
+            return false;
+        }
+        for (size_t b = 0; b < mIndex.blocks.size(); ++b) {
+            const auto& ramBlock = mIndex.blocks[b].ramBlock;
+            if (id == ramBlock.id && totalSize == ramBlock.totalSize &&
+                pageSize == ramBlock.pageSize) {
+                offsets[b] = offset;
+            }
+        }
+    }
+    for (size_t b = 0; b < mIndex.blocks.size(); ++b) {
+        if (canShareBlock(mIndex.blocks[b]) && offsets[b] < 0) {
+            return false;
+        }
+    }
+
+    for (size_t b = 0; b < mIndex.blocks.size(); ++b) {
+        auto& block = mIndex.blocks[b];
+        if (!canShareBlock(block)) {
+            continue;
+        }
+        if (mmap(block.ramBlock.hostPtr, size_t(block.ramBlock.totalSize),
+                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd.get(),
+                 offsets[b]) == MAP_FAILED) {
+            // The block may be gone already.
+            derror("Failed to map RAM block %s from %s: %s", block.ramBlock.id,
+                   mSharedImagePath.c_str(), strerror(errno));
+            mHasError = true;
+            return false;
+        }
+        for (auto it = block.pagesBegin; it != block.pagesEnd; ++it) {
+            it->state.store(uint8_t(State::Filled), std::memory_order_relaxed);
+        }
+        mSharedBytes += uint64_t(block.ramBlock.totalSize);
+    }
+    VERBOSE_PRINT(snapshot, "Mapped %llu bytes of RAM from %s",
+                  (unsigned long long)mSharedBytes, mSharedImagePath.c_str());
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RamLoader::startSharedImageWriter() {
+#ifdef __linux__
+    // An image that can't be mapped would only be written again next time.
+    if (!mWriteSharedImage || !sharedImageMappable()) {
+        return;
+    }
+    // The loading closes |mStream| when it's done.
+    mSharedImageRamFd = fcntl(mStreamFd, F_DUPFD_CLOEXEC, 0);
+    if (mSharedImageRamFd < 0) {
+        return;
+    }
+    if (!mSharedImageWriter.start()) {
+        close(mSharedImageRamFd);
+        mSharedImageRamFd = -1;
+    }
+#endif
+}
+
+void RamLoader::writeSharedImage() {
+#ifdef __linux__
+    AEMU_SCOPED_TRACE("RamLoader::writeSharedImage");
+    ScopedFd ramFd(mSharedImageRamFd);
+    mSharedImageRamFd = -1;
+
+    RamFileKey key;
+    if (!ramFileKey(ramFd.get(), mIndexPos, &key)) {
+        return;
+    }
+
+    MemStream header;
+    header.putBe32(kSharedImageMagic);
+    header.putBe32(kSharedImageVersion);
+    for (uint64_t value : key) {
+        header.putBe64(value);
+    }
+    header.putBe32(uint32_t(std::count_if(
+            mIndex.blocks.begin(), mIndex.blocks.end(), canShareBlock)));
+
+    std::vector<int64_t> offsets(mIndex.blocks.size(), -1);
+    std::vector<const Page*> sortedPages;
+    int64_t imageSize = kSharedImageHeaderSize;
+    for (size_t b = 0; b < mIndex.blocks.size(); ++b) {
+        const auto& block = mIndex.blocks[b];
+        if (!canShareBlock(block)) {
+            continue;
+        }
+        offsets[b] = imageSize;
+        header.putString(block.ramBlock.id);
+        header.putBe64(uint64_t(block.ramBlock.totalSize));
+        header.putBe32(uint32_t(block.ramBlock.pageSize));
+        header.putBe64(uint64_t(offsets[b]));
+        imageSize = offsets[b] + block.ramBlock.totalSize;
+        imageSize = (imageSize + kSharedImageAlignment - 1) &
+                    ~(kSharedImageAlignment - 1);
+        for (auto it = block.pagesBegin; it != block.pagesEnd; ++it) {
+            if (it->sizeOnDisk) {
+                sortedPages.push_back(&*it);
+            }
+        }
+    }
+    if (int64_t(header.buffer().size()) > kSharedImageHeaderSize) {
+        return;
+    }
+    std::sort(sortedPages.begin(), sortedPages.end(),
+              [](const Page* l, const Page* r) {
+                  return l->filePos < r->filePos;
+              });
+
+    const auto tmpPath = base::StringFormat(
+            "%s.tmp%d", mSharedImagePath, int(getpid()));
+    ScopedFd fd(HANDLE_EINTR(open(tmpPath.c_str(),
+                                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                  0644)));
+    if (!fd.valid()) {
+        return;
+    }
+
+    const bool compressedIndex =
+            nonzero(mIndex.flags & IndexFlags::CompressedPages);
+    std::vector<uint8_t> diskBuf;
+    std::vector<uint8_t> pageBuf;
+    bool ok = true;
+    for (const Page* page : sortedPages) {
+        if (mStopSharedImageWriter.load(std::memory_order_relaxed)) {
+            ok = false;
+            break;
+        }
+        const auto& block = mIndex.blocks[page->blockIndex];
+        const auto size = pageSize(*page);
+        const bool compressed =
+                compressedIndex &&
+                (mVersion == 1 || page->sizeOnDisk < kDefaultPageSize);
+        diskBuf.resize(page->sizeOnDisk);
+        if (HANDLE_EINTR(base::pread(ramFd.get(), diskBuf.data(),
+                                     diskBuf.size(),
+                                     int64_t(page->filePos))) !=
+            int64_t(diskBuf.size())) {
+            ok = false;
+            break;
+        }
+        const uint8_t* data = diskBuf.data();
+        if (compressed) {
+            pageBuf.resize(size);
+            if (!Decompressor::decompress(diskBuf.data(),
+                                          int32_t(diskBuf.size()),
+                                          pageBuf.data(), int32_t(size))) {
+                ok = false;
+                break;
+            }
+            data = pageBuf.data();
+        }
+        const auto pos = offsets[page->blockIndex] +
+                         int64_t(page - &*block.pagesBegin) * size;
+        if (HANDLE_EINTR(base::pwrite(fd.get(), data, size, pos)) !=
+            int64_t(size)) {
+            ok = false;
+            break;
+        }
+    }
+
+    // The header goes in last, once the pages are all there.
+    ok = ok && ftruncate(fd.get(), imageSize) == 0 &&
+         HANDLE_EINTR(base::pwrite(fd.get(), header.buffer().data(),
+                                   header.buffer().size(), 0)) ==
+                 int64_t(header.buffer().size()) &&
+         fdatasync(fd.get()) == 0;
+    fd.close();
+    if (!ok || rename(tmpPath.c_str(), mSharedImagePath.c_str()) != 0) {
+        path_delete_file(tmpPath.c_str());
+        return;
+    }
+    mSharedImageWritten = true;
+    VERBOSE_PRINT(snapshot, "Wrote shared RAM image %s",
+                  mSharedImagePath.c_str());
+#endif
+}
+
 }  // namespace snapshot
 }  // namespace android
@@ -26,6 +26,7 @@
 #include <array>
 #include <atomic>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -110,6 +111,33 @@ public:
     void acquireGapTracker(GapTracker::Ptr gaps) { mGaps = std::move(gaps); }
     GapTracker::Ptr releaseGapTracker() { return std::move(mGaps); }
 
+    // Fills |bitmap| with the pages of |block| that the guest wrote to since
+    // this snapshot was loaded, one bit per page. Returns false if the
+    // writes were not tracked.
+    using DirtyPagesQuery = std::function<bool(const RamBlock& block,
+                                               std::vector<uint64_t>* bitmap)>;
+    void setDirtyPagesQuery(DirtyPagesQuery query) {
+        mDirtyPagesQuery = std::move(query);
+    }
+    bool dirtyPages(const RamBlock& block,
+                    std::vector<uint64_t>* bitmap) const {
+        return mDirtyPagesQuery && mDirtyPagesQuery(block, bitmap);
+    }
+
+    // Backs the RAM blocks with private mappings of the page-aligned image
+    // of the snapshot at |path| instead of loading their pages, so that the
+    // emulators loading the same snapshot share the memory of the pages
+    // none of them wrote to. Linux only.
+    void setSharedImagePath(std::string path) {
+        mSharedImagePath = std::move(path);
+    }
+    // Without a valid image, writes one in the background for the next
+    // loads. Only worth it for snapshots that aren't saved over, as a new
+    // RAM file makes the image out of date.
+    void setWriteSharedImage(bool write) { mWriteSharedImage = write; }
+    // Waits for the image to be written; returns false if it wasn't.
+    bool joinSharedImageWriter();
+
     bool getDuration(base::System::Duration* duration) {
         if (mEndTime < mStartTime) {
             return false;
@@ -121,6 +149,25 @@ public:
         return true;
     }
 
+    // What the loading did so far; on-demand loading goes on in the
+    // background after start() returns.
+    struct Stats {
+        uint64_t bytesRead;
+        uint64_t pagesRead;
+        uint64_t pagesDecompressed;
+        // Guest accesses to pages that weren't loaded yet.
+        uint64_t pageFaults;
+        // Guest RAM mapped from the shared image rather than loaded.
+        uint64_t sharedBytes;
+    };
+    Stats stats() const {
+        return {mBytesRead.load(std::memory_order_relaxed),
+                mPagesRead.load(std::memory_order_relaxed),
+                mPagesDecompressed.load(std::memory_order_relaxed),
+                mPageFaults.load(std::memory_order_relaxed),
+                mSharedBytes};
+    }
+
     bool didSwitchFileBacking() const {
         return mLoadedFromFileBacking || mLoadedToFileBacking;
     }
@@ -152,6 +199,11 @@ private:
     bool readAllPages();
     void startDecompressor();
 
+    bool sharedImageMappable() const;
+    bool mapSharedImage();
+    void startSharedImageWriter();
+    void writeSharedImage();
+
     base::StdioStream mStream;
     int mStreamFd;  // An FD for the |mStream|'s underlying open file.
     bool mWasStarted = false;
@@ -170,6 +222,7 @@ private:
 
     FileIndex mIndex;
     GapTracker::Ptr mGaps;
+    DirtyPagesQuery mDirtyPagesQuery;
     uint64_t mDiskSize = 0;
     uint64_t mIndexPos = 0;
     int mVersion = 0;
@@ -177,6 +230,11 @@ private:
     base::System::Duration mStartTime = 0;
     base::System::Duration mEndTime = 0;
 
+    std::atomic<uint64_t> mBytesRead{0};
+    std::atomic<uint64_t> mPagesRead{0};
+    std::atomic<uint64_t> mPagesDecompressed{0};
+    std::atomic<uint64_t> mPageFaults{0};
+
     // Assumed to be a power of 2 for convenient
     // rounding and aligning
     uint64_t mPageSize = kDefaultPageSize;
@@ -199,6 +257,16 @@ private:
 
     // Whether we are currently lazy loading from a ram.img by mmap
     bool mLazyLoadingFromFileBacking = false;
+
+    std::string mSharedImagePath;
+    bool mWriteSharedImage = false;
+    uint64_t mSharedBytes = 0;
+    // Reads the pages from its own descriptor of the RAM file, as the
+    // loading may close |mStream| before it's done.
+    int mSharedImageRamFd = -1;
+    base::FunctorThread mSharedImageWriter;
+    std::atomic<bool> mStopSharedImageWriter{false};
+    bool mSharedImageWritten = false;
 };
 
 struct RamLoader::Page {
@@ -14,6 +14,7 @@
 #include "android/base/ContiguousRangeMapper.h"
 #include "android/base/Profiler.h"
 #include "android/base/Stopwatch.h"
+#include "android/base/Tracing.h"
 #include "android/base/EintrWrapper.h"
 #include "android/base/files/FileShareOpen.h"
 #include "android/base/files/MemStream.h"
@@ -23,11 +24,10 @@
 #include "android/base/misc/FileUtils.h"
 #include "android/base/system/System.h"
 #include "android/snapshot/MemoryWatch.h"
+#include "android/snapshot/PageScan.h"
 #include "android/snapshot/RamLoader.h"
 #include "android/utils/debug.h"
 
-#include "MurmurHash3.h"
-
 #include <algorithm>
 #include <cassert>
 #include <iterator>
@@ -53,6 +53,9 @@ using android::base::System;
 using StatAction = IncrementalStats::Action;
 using StatTime = IncrementalStats::Time;
 
+// Number of pages zero checked and hashed at once when saving.
+static constexpr int32_t kScanBatchPages = 64;
+
 void RamSaver::FileIndex::clear() {
     decltype(blocks)().swap(blocks);
 }
@@ -239,9 +242,44 @@ void RamSaver::savePage(int64_t blockOffset,
         int notLoadedPage = 0;
         int stillZero = 0;
         int sameHash = 0;
+        int notWritten = 0;
 
         mIncStats.countMultiple(StatAction::TotalPages, numPages);
 
+        // When the guest writes were tracked since the parent snapshot was
+        // loaded, the pages it did not touch still are exactly what the
+        // parent has on disk: reuse them without reading the page at all.
+        std::vector<uint64_t> dirtyPages;
+        const bool writesTracked =
+                mLoader && !mLoaderOnDemand &&
+                mLoader->dirtyPages(block.ramBlock, &dirtyPages) &&
+                dirtyPages.size() * 64 >= size_t(numPages);
+        auto notWrittenSinceLoad = [&](int32_t i) {
+            return writesTracked &&
+                   !(dirtyPages[size_t(i) / 64] & (1ULL << (i % 64))) &&
+                   block.pages[size_t(i)].loaderPage;
+        };
+
+        if (writesTracked) {
+            for (int32_t i = 0; i < numPages; ++i) {
+                auto& page = block.pages[size_t(i)];
+                page.loaderPage = mLoader->findPage(mLastBlockIndex,
+                                                    block.ramBlock.id, i);
+                if (!notWrittenSinceLoad(i)) {
+                    continue;
+                }
+                auto loaderPage = page.loaderPage;
+                ++notWritten;
+                page.same = true;
+                page.filePos = loaderPage->filePos;
+                page.sizeOnDisk = loaderPage->sizeOnDisk;
+                page.hashFilled = page.sizeOnDisk != 0;
+                if (page.hashFilled) {
+                    page.hash = loaderPage->hash;
+                }
+            }
+        }
+
         mIncStats.measure(StatTime::ZeroCheck, [&] {
 
             // Hint that we will access sequentially.
@@ -273,27 +311,56 @@ void RamSaver::savePage(int64_t blockOffset,
                 ScopedMemoryProfiler mem("zeroCheck");
 #endif
 
-                for (int32_t i = 0; i < numPages;
-                     ++i,
-                     zeroCheckPtr += (uintptr_t)block.ramBlock.pageSize) {
+                // Zero check and hash runs of pages in one pass, so every
+                // page is pulled into the cache once. With on-demand loading
+                // the pages that are not loaded yet keep the parent's hash,
+                // those are hashed separately below.
+                const bool hashNow = !mLoaderOnDemand;
+                PageScanResult scan[kScanBatchPages];
+
+                for (int32_t i = 0; i < numPages;) {
+                    if (notWrittenSinceLoad(i)) {
+                        ++i;
+                        continue;
+                    }
+                    int32_t count = 1;
+                    while (count < kScanBatchPages && i + count < numPages &&
+                           !notWrittenSinceLoad(i + count)) {
+                        ++count;
+                    }
 
-                    bool isZero = isBufferZeroed(zeroCheckPtr,
-                                                 block.ramBlock.pageSize);
+                    zeroCheckPtr = block.ramBlock.hostPtr +
+                                   int64_t(i) * block.ramBlock.pageSize;
+                    scanPages(zeroCheckPtr, block.ramBlock.pageSize, count,
+                              hashNow, scan);
+
+                    for (int32_t j = 0; j < count; ++j,
+                                 zeroCheckPtr +=
+                                 (uintptr_t)block.ramBlock.pageSize) {
+                        const bool isZero = scan[j].zero;
+
+                        auto& page = block.pages[size_t(i + j)];
+                        page.same = false;
+                        page.hashFilled = hashNow && !isZero;
+                        if (page.hashFilled) {
+                            page.hash = scan[j].hash;
+                        }
+                        page.filePos = 0;
+                        if (!writesTracked) {
+                            page.loaderPage = nullptr;
+                        }
 
-                    auto& page = block.pages[size_t(i)];
-                    page.same = false;
-                    page.hashFilled = false;
-                    page.filePos = 0;
-                    page.loaderPage = nullptr;
-
-                    // Don't branch for the isZero decision
-                    page.sizeOnDisk = kDefaultPageSize * !isZero;
-                    totalZero += isZero;
-
-                    // Decommit or free in chunks of 16 mb.
-                    if (page.sizeOnDisk == 0) {
-                        zeroPageDeleter.add((uintptr_t)zeroCheckPtr, block.ramBlock.pageSize);
+                        // Don't branch for the isZero decision
+                        page.sizeOnDisk = kDefaultPageSize * !isZero;
+                        totalZero += isZero;
+
+                        // Decommit or free in chunks of 16 mb.
+                        if (page.sizeOnDisk == 0) {
+                            zeroPageDeleter.add((uintptr_t)zeroCheckPtr,
+                                                block.ramBlock.pageSize);
+                        }
                     }
+                    i += count;
                 }
             }
 
@@ -327,7 +394,7 @@ void RamSaver::savePage(int64_t blockOffset,
                         }
                     }
 
-                } else {
+                } else if (!writesTracked) {
                     // Find all corresponding loader pages
                     for (int32_t i = 0; i < numPages; ++i) {
                         auto& page = block.pages[size_t(i)];
@@ -361,6 +428,9 @@ void RamSaver::savePage(int64_t blockOffset,
                 mIncStats.measure(StatTime::Hashing, [&] {
 
                 for (int32_t i = 0; i < numPages; ++i) {
+                    if (notWrittenSinceLoad(i)) {
+                        continue;
+                    }
                     auto& page = block.pages[size_t(i)];
                     auto loaderPage = page.loaderPage;
                     if (loaderPage && loaderPage->zeroed() && !page.sizeOnDisk) {
@@ -409,11 +479,13 @@ void RamSaver::savePage(int64_t blockOffset,
         // Record most stats right here.
         mIncStats.countMultiple(StatAction::SamePage, samePage);
         mIncStats.countMultiple(StatAction::NotLoadedPage, notLoadedPage);
+        mIncStats.countMultiple(StatAction::NotWrittenPage, notWritten);
         mIncStats.countMultiple(StatAction::ChangedPage, changedTotal);
         mIncStats.countMultiple(StatAction::StillZeroPage, stillZero);
         mIncStats.countMultiple(StatAction::NewZeroPage, totalZero - stillZero);
         mIncStats.countMultiple(StatAction::SameHashPage, sameHash);
-        mIncStats.countMultiple(StatAction::SamePage, sameHash + stillZero);
+        mIncStats.countMultiple(StatAction::SamePage,
+                                sameHash + stillZero + notWritten);
     }
 }
 
@@ -439,7 +511,7 @@ void RamSaver::cancel() {
 void RamSaver::calcHash(FileIndex::Block::Page& page,
                         const FileIndex::Block& block,
                         const void* ptr) {
-    MurmurHash3_x64_128(ptr, block.ramBlock.pageSize, 0, page.hash.data());
+    hashPage(ptr, size_t(block.ramBlock.pageSize), &page.hash);
     page.hashFilled = true;
 }
 
@@ -469,6 +541,7 @@ void RamSaver::passToSaveHandler(QueuedPageInfo&& pi) {
 }
 
 bool RamSaver::handlePageSave(QueuedPageInfo&& pi) {
+    AEMU_SCOPED_TRACE("RamSaver::handlePageSave");
 
     assert(pi.blockIndex != kStopMarkerIndex);
     FileIndex::Block& block = mIndex.blocks[size_t(pi.blockIndex)];
@@ -632,6 +705,7 @@ void RamSaver::writeIndex() {
 }
 
 void RamSaver::writePage(WriteInfo&& wi) {
+    AEMU_SCOPED_TRACE("RamSaver::writePage");
     int64_t nextStreamPos = mCurrentStreamPos;
 
     FileIndex::Block& block = mIndex.blocks[size_t(wi.blockIndex)];
@@ -90,7 +90,8 @@ void loadRamSingleBlock(const RamBlock& block,
 void incrementalSaveSingleBlock(const RamSaver::Flags flags,
                                 const RamBlock& blockToLoad,
                                 const RamBlock& blockToSave,
-                                android::base::StringView filename) {
+                                android::base::StringView filename,
+                                RamLoader::DirtyPagesQuery dirtyPages) {
     auto ram = android_fopen(c_str(filename), "rb");
 
     RamLoader::RamBlockStructure emptyRamBlockStructure = {};
@@ -102,6 +103,7 @@ void incrementalSaveSingleBlock(const RamSaver::Flags flags,
     ramLoader.registerBlock(blockToLoad);
 
     ramLoader.start(false);
+    ramLoader.setDirtyPagesQuery(std::move(dirtyPages));
 
     RamSaver s(filename, flags, &ramLoader, true);
 
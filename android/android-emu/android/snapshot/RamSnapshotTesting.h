@@ -36,10 +36,12 @@ void saveRamSingleBlock(const RamSaver::Flags flags,
 void loadRamSingleBlock(const RamBlock& block,
                         android::base::StringView filename);
 
-void incrementalSaveSingleBlock(const RamSaver::Flags flags,
-                                const RamBlock& blockToLoad,
-                                const RamBlock& blockToSave,
-                                android::base::StringView filename);
+void incrementalSaveSingleBlock(
+        const RamSaver::Flags flags,
+        const RamBlock& blockToLoad,
+        const RamBlock& blockToSave,
+        android::base::StringView filename,
+        RamLoader::DirtyPagesQuery dirtyPages = {});
 
 TestRamBuffer generateRandomRam(size_t numPages, float zeroPageChance, int seed = 0);
 
@@ -14,6 +14,7 @@
 #include "android/base/misc/FileUtils.h"
 #include "android/base/testing/TestTempDir.h"
 #include "android/snapshot/RamSnapshotTesting.h"
+#include "android/utils/file_io.h"
 
 #include <gtest/gtest.h>
 
@@ -21,6 +22,12 @@
 #include <random>
 #include <vector>
 
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 using android::AlignedBuf;
 using android::base::PathUtils;
 using android::base::StdioStream;
@@ -181,5 +188,160 @@ TEST_F(RamSnapshotTest, IncrementalSaveRandomMultiStep) {
     }
 }
 
+// Reports the pages that differ between |before| and |after| as written.
+static RamLoader::DirtyPagesQuery changedPages(const TestRamBuffer& before,
+                                               const TestRamBuffer& after) {
+    return [&before, &after](const RamBlock& block,
+                             std::vector<uint64_t>* bitmap) {
+        const size_t numPages = before.size() / kTestingPageSize;
+        bitmap->assign((numPages + 63) / 64, 0);
+        for (size_t i = 0; i < numPages; i++) {
+            if (memcmp(&before[i * kTestingPageSize],
+                       &after[i * kTestingPageSize],
+                       kTestingPageSize)) {
+                (*bitmap)[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+        return true;
+    };
+}
+
+TEST_F(RamSnapshotTest, IncrementalSaveDirtyPages) {
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+
+    const int numPages = 100;
+    const int numTrials = 10;
+    const float noChangeChance = 0.5;
+    const float zeroPageChance = 0.5;
+
+    for (int i = 0; i < numTrials; i++) {
+        auto ramToLoad = generateRandomRam(numPages, zeroPageChance, i);
+        auto ramToSave = ramToLoad;
+
+        auto blockForLoad =
+            makeRam("testRam", ramToLoad.data(), (int64_t)ramToLoad.size());
+
+        saveRamSingleBlock(RamSaver::Flags::Compress, blockForLoad, ramPath);
+
+        randomMutateRam(ramToSave, noChangeChance, zeroPageChance, i);
+
+        auto blockForSave =
+            makeRam("testRam", ramToSave.data(), (int64_t)ramToSave.size());
+
+        incrementalSaveSingleBlock(RamSaver::Flags::Compress,
+                                   blockForLoad,
+                                   blockForSave,
+                                   ramPath,
+                                   changedPages(ramToLoad, ramToSave));
+
+        TestRamBuffer testRamOut(numPages * kTestingPageSize);
+        auto blockForTestOutput =
+            makeRam("testRam", testRamOut.data(), (int64_t)testRamOut.size());
+
+        loadRamSingleBlock(blockForTestOutput, ramPath);
+
+        EXPECT_EQ(ramToSave, testRamOut);
+    }
+}
+
+TEST_F(RamSnapshotTest, IncrementalSaveSkipsPagesNotWritten) {
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+
+    const int numPages = 10;
+    auto ramToLoad = generateRandomRam(numPages, 0.0f);
+    auto ramToSave = ramToLoad;
+
+    auto blockForLoad =
+        makeRam("testRam", ramToLoad.data(), (int64_t)ramToLoad.size());
+
+    saveRamSingleBlock(RamSaver::Flags::None, blockForLoad, ramPath);
+
+    // Change two pages, but only report the first one: the saver must not
+    // look at the second one at all.
+    memset(ramToSave.data(), 0x1, kTestingPageSize);
+    memset(ramToSave.data() + kTestingPageSize, 0x2, kTestingPageSize);
+    auto expected = ramToLoad;
+    memset(expected.data(), 0x1, kTestingPageSize);
+
+    auto blockForSave =
+        makeRam("testRam", ramToSave.data(), (int64_t)ramToSave.size());
+
+    incrementalSaveSingleBlock(RamSaver::Flags::None,
+                               blockForLoad,
+                               blockForSave,
+                               ramPath,
+                               changedPages(ramToLoad, expected));
+
+    TestRamBuffer testRamOut(numPages * kTestingPageSize);
+    auto blockForTestOutput =
+        makeRam("testRam", testRamOut.data(), (int64_t)testRamOut.size());
+
+    loadRamSingleBlock(blockForTestOutput, ramPath);
+
+    EXPECT_EQ(expected, testRamOut);
+}
+
+#ifdef __linux__
+TEST_F(RamSnapshotTest, SharedImage) {
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+    std::string imagePath = mTempDir->makeSubPath("ram.shared");
+
+    const int numPages = 100;
+    const int64_t size = numPages * kTestingPageSize;
+    auto testRam = generateRandomRam(numPages, 0.5f);
+
+    saveRamSingleBlock(RamSaver::Flags::Compress,
+                       makeRam("testRam", testRam.data(), size), ramPath);
+
+    RamLoader::RamBlockStructure emptyRamBlockStructure = {};
+
+    // The first load writes the image.
+    {
+        TestRamBuffer testRamOut(size);
+        RamLoader ramLoader(
+                StdioStream(android_fopen(ramPath.c_str(), "rb"),
+                            StdioStream::kOwner),
+                RamLoader::Flags::None, emptyRamBlockStructure);
+        ramLoader.registerBlock(
+                makeRam("testRam", testRamOut.data(), size));
+        ramLoader.setSharedImagePath(imagePath);
+        ramLoader.setWriteSharedImage(true);
+        EXPECT_TRUE(ramLoader.start(false));
+        ramLoader.join();
+        EXPECT_TRUE(ramLoader.joinSharedImageWriter());
+        EXPECT_EQ(uint64_t(0), ramLoader.stats().sharedBytes);
+        EXPECT_EQ(testRam, testRamOut);
+    }
+
+    // The next ones map it, privately.
+    std::vector<uint8_t*> outs;
+    for (int i = 0; i < 2; i++) {
+        auto out = static_cast<uint8_t*>(
+                mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        ASSERT_NE(MAP_FAILED, out);
+        outs.push_back(out);
+
+        RamLoader ramLoader(
+                StdioStream(android_fopen(ramPath.c_str(), "rb"),
+                            StdioStream::kOwner),
+                RamLoader::Flags::None, emptyRamBlockStructure);
+        ramLoader.registerBlock(makeRam("testRam", out, size));
+        ramLoader.setSharedImagePath(imagePath);
+        EXPECT_TRUE(ramLoader.start(false));
+        ramLoader.join();
+        EXPECT_FALSE(ramLoader.joinSharedImageWriter());
+        EXPECT_EQ(uint64_t(size), ramLoader.stats().sharedBytes);
+        EXPECT_EQ(0, memcmp(testRam.data(), out, size));
+
+        memset(out, 0x1, size);
+    }
+
+    for (auto out : outs) {
+        munmap(out, size);
+    }
+}
+#endif
+
 }  // namespace snapshot
 }  // namespace android
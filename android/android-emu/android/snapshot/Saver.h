@@ -35,6 +35,7 @@ public:
           bool isRemapping);
     ~Saver();
 
+    bool hasRamSaver() const { return mRamSaver; }
     RamSaver& ramSaver() { return *mRamSaver; }
     ITextureSaverPtr textureSaver() const;
 
@@ -0,0 +1,151 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/SnapshotProfile.h"
+
+#include "android/base/JsonWriter.h"
+
+using android::base::JsonWriter;
+using android::base::StringView;
+using android::base::System;
+
+namespace android {
+namespace snapshot {
+
+SnapshotProfile::SnapshotProfile(StringView operation, StringView snapshot)
+    : mOperation(operation),
+      mSnapshot(snapshot),
+      mStartUs(System::get()->getHighResTimeUs()),
+      mStartCpuMs(processCpuMs()) {}
+
+System::Duration SnapshotProfile::processCpuMs() {
+    const auto times = System::get()->getProcessTimes();
+    return times.userMs + times.systemMs;
+}
+
+void SnapshotProfile::beginPhase(StringView name) {
+    if (mFinished) {
+        return;
+    }
+    Phase phase;
+    phase.name = name.str();
+    phase.depth = int(mOpenPhases.size());
+    // Keep the start times around until the phase ends.
+    phase.startUs = System::get()->getHighResTimeUs();
+    phase.wallUs = 0;
+    phase.cpuMs = processCpuMs();
+    mOpenPhases.push_back(mPhases.size());
+    mPhases.push_back(std::move(phase));
+}
+
+void SnapshotProfile::endPhase() {
+    if (mOpenPhases.empty()) {
+        return;
+    }
+    auto& phase = mPhases[mOpenPhases.back()];
+    mOpenPhases.pop_back();
+    const auto nowUs = System::get()->getHighResTimeUs();
+    phase.wallUs = nowUs - phase.startUs;
+    phase.startUs -= mStartUs;
+    phase.cpuMs = processCpuMs() - phase.cpuMs;
+}
+
+void SnapshotProfile::nextPhase(StringView name) {
+    endPhase();
+    beginPhase(name);
+}
+
+void SnapshotProfile::setCounter(StringView phase,
+                                 StringView counter,
+                                 uint64_t value) {
+    Phase* target = nullptr;
+    for (auto it = mPhases.rbegin(); it != mPhases.rend(); ++it) {
+        if (it->name == phase) {
+            target = &*it;
+            break;
+        }
+    }
+    if (!target) {
+        mPhases.push_back({phase.str(), 0, 0, 0, 0, {}});
+        target = &mPhases.back();
+    }
+    for (auto& entry : target->counters) {
+        if (entry.first == counter) {
+            entry.second = value;
+            return;
+        }
+    }
+    target->counters.emplace_back(counter.str(), value);
+}
+
+void SnapshotProfile::finish(bool succeeded) {
+    if (mFinished) {
+        return;
+    }
+    while (!mOpenPhases.empty()) {
+        endPhase();
+    }
+    mDurationUs = System::get()->getHighResTimeUs() - mStartUs;
+    mCpuMs = processCpuMs() - mStartCpuMs;
+    mSucceeded = succeeded;
+    mFinished = true;
+}
+
+const SnapshotProfile::Phase* SnapshotProfile::slowestPhase() const {
+    const Phase* slowest = nullptr;
+    for (const auto& phase : mPhases) {
+        if (phase.depth == 0 && (!slowest || phase.wallUs > slowest->wallUs)) {
+            slowest = &phase;
+        }
+    }
+    return slowest;
+}
+
+void SnapshotProfile::write(JsonWriter* writer) const {
+    writer->beginObject();
+    writer->name("operation").value(mOperation);
+    writer->name("snapshot").value(mSnapshot);
+    writer->name("succeeded").valueBool(mSucceeded);
+    writer->name("durationUs").value((long long)mDurationUs);
+    writer->name("cpuMs").value((long long)mCpuMs);
+    writer->name("budgetMs").value((long long)mBudgetMs);
+    writer->name("overBudget").valueBool(overBudget());
+    writer->name("phases").beginArray();
+    for (const auto& phase : mPhases) {
+        writer->beginObject();
+        writer->name("name").value(phase.name);
+        writer->name("depth").value(phase.depth);
+        writer->name("startUs").value((long long)phase.startUs);
+        writer->name("wallUs").value((long long)phase.wallUs);
+        writer->name("cpuMs").value((long long)phase.cpuMs);
+        writer->name("counters").beginObject();
+        for (const auto& counter : phase.counters) {
+            writer->name(counter.first).value((long long)counter.second);
+        }
+        writer->endObject();
+        writer->endObject();
+    }
+    writer->endArray();
+    writer->endObject();
+}
+
+bool SnapshotProfile::writeJson(StringView path) const {
+    JsonWriter writer(path.str());
+    if (!writer.isOpen()) {
+        return false;
+    }
+    writer.setIndent("  ");
+    write(&writer);
+    return true;
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,132 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+#include "android/base/StringView.h"
+#include "android/base/system/System.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+namespace base {
+class JsonWriter;
+}  // namespace base
+
+namespace snapshot {
+
+// Where the time of a snapshot load or save goes: the wall and CPU time of
+// each of its phases (QEMU device state, RAM, the renderer, the disks...),
+// along with counters such as the bytes and pages read. Tells which stage
+// regressed when loading gets slower.
+//
+// Phases nest: RAM and the renderer are restored while QEMU loads the
+// device state, so those phases are part of the "devices" one.
+class SnapshotProfile {
+public:
+    struct Phase {
+        std::string name;
+        int depth;  // 0 for the top level phases.
+        // Since the start of the operation.
+        base::System::WallDuration startUs;
+        base::System::WallDuration wallUs;
+        // Of the whole process, other threads included.
+        base::System::Duration cpuMs;
+        std::vector<std::pair<std::string, uint64_t>> counters;
+    };
+
+    // Starts the clock on |operation| ("load" or "save") of |snapshot|.
+    SnapshotProfile(base::StringView operation, base::StringView snapshot);
+
+    // Starts a phase nested in the current one.
+    void beginPhase(base::StringView name);
+    // Ends the current phase.
+    void endPhase();
+    // Ends the current phase and starts |name| at the same level.
+    void nextPhase(base::StringView name);
+
+    // Sets |counter| of the last phase called |phase|. Counters of a phase
+    // that was never timed, such as work done in the background, go to a
+    // phase of their own.
+    void setCounter(base::StringView phase,
+                    base::StringView counter,
+                    uint64_t value);
+
+    // Ends the phases still running and the operation.
+    void finish(bool succeeded);
+
+    // The duration the operation is expected to fit in, 0 for none.
+    void setBudgetMs(uint64_t budgetMs) { mBudgetMs = budgetMs; }
+    uint64_t budgetMs() const { return mBudgetMs; }
+    bool overBudget() const {
+        return mBudgetMs && durationUs() > mBudgetMs * 1000;
+    }
+
+    const std::string& operation() const { return mOperation; }
+    const std::string& snapshot() const { return mSnapshot; }
+    bool finished() const { return mFinished; }
+    bool succeeded() const { return mSucceeded; }
+    base::System::WallDuration durationUs() const { return mDurationUs; }
+    base::System::Duration cpuMs() const { return mCpuMs; }
+    const std::vector<Phase>& phases() const { return mPhases; }
+
+    // The longest top level phase, or null if there is none.
+    const Phase* slowestPhase() const;
+
+    void write(base::JsonWriter* writer) const;
+    bool writeJson(base::StringView path) const;
+
+private:
+    static base::System::Duration processCpuMs();
+
+    std::string mOperation;
+    std::string mSnapshot;
+    base::System::WallDuration mStartUs;
+    base::System::Duration mStartCpuMs;
+    base::System::WallDuration mDurationUs = 0;
+    base::System::Duration mCpuMs = 0;
+    uint64_t mBudgetMs = 0;
+    bool mFinished = false;
+    bool mSucceeded = false;
+
+    std::vector<Phase> mPhases;
+    // Indices into |mPhases| of the phases still running, outermost first.
+    std::vector<size_t> mOpenPhases;
+};
+
+// Times the enclosing scope as a phase of |profile|, which may be null.
+class ScopedSnapshotPhase {
+    DISALLOW_COPY_AND_ASSIGN(ScopedSnapshotPhase);
+
+public:
+    ScopedSnapshotPhase(SnapshotProfile* profile, base::StringView name)
+        : mProfile(profile) {
+        if (mProfile) {
+            mProfile->beginPhase(name);
+        }
+    }
+    ~ScopedSnapshotPhase() {
+        if (mProfile) {
+            mProfile->endPhase();
+        }
+    }
+
+private:
+    SnapshotProfile* const mProfile;
+};
+
+}  // namespace snapshot
+}  // namespace android
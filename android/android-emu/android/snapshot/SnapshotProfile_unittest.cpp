@@ -0,0 +1,165 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/SnapshotProfile.h"
+
+#include "android/base/files/PathUtils.h"
+#include "android/base/misc/FileUtils.h"
+#include "android/base/testing/TestSystem.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+using android::base::PathUtils;
+using android::base::System;
+using android::base::TestSystem;
+
+namespace android {
+namespace snapshot {
+
+class SnapshotProfileTest : public ::testing::Test {
+protected:
+    void SetUp() override { advance(0, 0); }
+
+    // Moves the clocks forward, |cpuMs| are spent in user mode.
+    void advance(System::WallDuration wallUs, System::Duration cpuMs) {
+        mNowUs += wallUs;
+        mTimes.userMs += cpuMs;
+        mTimes.wallClockMs = mNowUs / 1000;
+        mSystem.setUnixTimeUs(mNowUs);
+        mSystem.setProcessTimes(mTimes);
+    }
+
+    TestSystem mSystem{"/progdir", System::kProgramBitness, "/homedir",
+                       "/appdir"};
+    System::WallDuration mNowUs = 1000000;
+    System::Times mTimes = {};
+};
+
+TEST_F(SnapshotProfileTest, nestedPhases) {
+    SnapshotProfile profile("load", "default_boot");
+    profile.beginPhase("prepare");
+    advance(1000, 1);
+    profile.nextPhase("devices");
+    profile.beginPhase("ram");
+    advance(20000, 15);
+    profile.nextPhase("renderer");
+    advance(5000, 3);
+    profile.endPhase();
+    advance(1000, 1);
+    profile.setCounter("ram", "pagesRead", 42);
+    profile.finish(true);
+
+    EXPECT_TRUE(profile.finished());
+    EXPECT_TRUE(profile.succeeded());
+    EXPECT_EQ(27000, profile.durationUs());
+    EXPECT_EQ(20, profile.cpuMs());
+
+    const auto& phases = profile.phases();
+    ASSERT_EQ(4u, phases.size());
+    EXPECT_EQ("prepare", phases[0].name);
+    EXPECT_EQ(0, phases[0].depth);
+    EXPECT_EQ(0, phases[0].startUs);
+    EXPECT_EQ(1000, phases[0].wallUs);
+
+    EXPECT_EQ("devices", phases[1].name);
+    EXPECT_EQ(0, phases[1].depth);
+    EXPECT_EQ(1000, phases[1].startUs);
+    EXPECT_EQ(26000, phases[1].wallUs);
+    EXPECT_EQ(19, phases[1].cpuMs);
+
+    EXPECT_EQ("ram", phases[2].name);
+    EXPECT_EQ(1, phases[2].depth);
+    EXPECT_EQ(20000, phases[2].wallUs);
+    EXPECT_EQ(15, phases[2].cpuMs);
+    ASSERT_EQ(1u, phases[2].counters.size());
+    EXPECT_EQ("pagesRead", phases[2].counters[0].first);
+    EXPECT_EQ(42u, phases[2].counters[0].second);
+
+    EXPECT_EQ("renderer", phases[3].name);
+    EXPECT_EQ(1, phases[3].depth);
+    EXPECT_EQ(21000, phases[3].startUs);
+
+    ASSERT_NE(nullptr, profile.slowestPhase());
+    EXPECT_EQ("devices", profile.slowestPhase()->name);
+}
+
+TEST_F(SnapshotProfileTest, finishEndsOpenPhases) {
+    SnapshotProfile profile("save", "snap");
+    profile.beginPhase("devices");
+    profile.beginPhase("ram");
+    advance(3000, 0);
+    profile.finish(false);
+    // Too late to be part of the profile.
+    profile.beginPhase("disks");
+
+    EXPECT_FALSE(profile.succeeded());
+    ASSERT_EQ(2u, profile.phases().size());
+    EXPECT_EQ(3000, profile.phases()[0].wallUs);
+    EXPECT_EQ(3000, profile.phases()[1].wallUs);
+}
+
+TEST_F(SnapshotProfileTest, countersOfUntimedWork) {
+    SnapshotProfile profile("load", "snap");
+    profile.setCounter("background", "pagesRead", 1);
+    profile.setCounter("background", "pagesRead", 2);
+    profile.finish(true);
+
+    ASSERT_EQ(1u, profile.phases().size());
+    EXPECT_EQ("background", profile.phases()[0].name);
+    EXPECT_EQ(0, profile.phases()[0].wallUs);
+    ASSERT_EQ(1u, profile.phases()[0].counters.size());
+    EXPECT_EQ(2u, profile.phases()[0].counters[0].second);
+}
+
+TEST_F(SnapshotProfileTest, budget) {
+    SnapshotProfile profile("load", "snap");
+    profile.setBudgetMs(10);
+    advance(10000, 0);
+    profile.finish(true);
+    EXPECT_FALSE(profile.overBudget());
+
+    SnapshotProfile slow("load", "snap");
+    slow.setBudgetMs(10);
+    advance(10001, 0);
+    slow.finish(true);
+    EXPECT_TRUE(slow.overBudget());
+
+    SnapshotProfile unlimited("load", "snap");
+    advance(10000000, 0);
+    unlimited.finish(true);
+    EXPECT_FALSE(unlimited.overBudget());
+}
+
+TEST_F(SnapshotProfileTest, json) {
+    SnapshotProfile profile("load", "snap");
+    profile.setBudgetMs(1);
+    profile.beginPhase("ram");
+    // Past what 32 bits hold.
+    profile.setCounter("ram", "bytesRead", 5000000000ull);
+    advance(2000, 1);
+    profile.finish(true);
+
+    const std::string dir = mSystem.getTempRoot()->pathString();
+    const std::string path = PathUtils::join(dir, "profile.json");
+    ASSERT_TRUE(profile.writeJson(path));
+    const std::string json = readFileIntoString(path).valueOr(std::string());
+    EXPECT_NE(std::string::npos, json.find("\"operation\" : \"load\""));
+    EXPECT_NE(std::string::npos, json.find("\"durationUs\" : 2000"));
+    EXPECT_NE(std::string::npos, json.find("\"overBudget\" : true"));
+    EXPECT_NE(std::string::npos, json.find("\"name\" : \"ram\""));
+    EXPECT_NE(std::string::npos, json.find("\"bytesRead\" : 5000000000"));
+
+    EXPECT_FALSE(profile.writeJson(PathUtils::join(dir, "none", "x.json")));
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -15,6 +15,7 @@
 #include "android/base/memory/LazyInstance.h"
 #include "android/base/Stopwatch.h"
 #include "android/base/StringFormat.h"
+#include "android/cmdline-option.h"
 #include "android/crashreport/CrashReporter.h"
 #include "android/featurecontrol/FeatureControl.h"
 #include "android/emulation/VmLock.h"
@@ -31,6 +32,7 @@
 #include "android/opengl/emugl_config.h"
 #include "android/snapshot/Hierarchy.h"
 #include "android/snapshot/Loader.h"
+#include "android/snapshot/PageScan.h"
 #include "android/snapshot/PathUtils.h"
 #include "android/snapshot/Quickboot.h"
 #include "android/snapshot/Saver.h"
@@ -42,17 +44,9 @@
 #include "android/utils/system.h"
 
 #include <cassert>
+#include <cstdlib>
 #include <utility>
 
-#ifdef __x86_64__
-#define FAST_ZERO_CHECK 1
-extern "C" {
-#include <emmintrin.h>
-}
-#else
-#define FAST_ZERO_CHECK 0
-#endif
-
 using android::base::LazyInstance;
 using android::base::PathUtils;
 using android::base::Stopwatch;
@@ -62,66 +56,13 @@ using android::crashreport::CrashReporter;
 using android::metrics::MetricsReporter;
 namespace pb = android_studio;
 
-// Inspired by QEMU's bufferzero.c implementation, but simplified for the case
-// when checking the whole aligned memory page.
-static bool buffer_zero_sse2(const void* buf, int len) {
-#ifdef __x86_64__
-    buf = __builtin_assume_aligned(buf, 1024);
-    __m128i t = _mm_load_si128(static_cast<const __m128i*>(buf));
-    auto p = reinterpret_cast<__m128i*>(
-            (reinterpret_cast<intptr_t>(buf) + 5 * 16));
-    auto e =
-            reinterpret_cast<__m128i*>((reinterpret_cast<intptr_t>(buf) + len));
-    const __m128i zero = _mm_setzero_si128();
-
-    /* Loop over 16-byte aligned blocks of 64.  */
-    do {
-        __builtin_prefetch(p);
-        t = _mm_cmpeq_epi32(t, zero);
-        if (_mm_movemask_epi8(t) != 0xFFFF) {
-            return false;
-        }
-#ifdef _MSC_VER
-        t = _mm_or_si128(_mm_or_si128(p[-4], p[-3]), _mm_or_si128(p[-2], p[-1]));
-#else
-        t = p[-4] | p[-3] | p[-2] | p[-1];
-#endif
-        p += 4;
-    } while (p <= e);
-
-    /* Finish the aligned tail.  */
-#ifdef _WIN32
-    t = _mm_or_si128(t, e[-3]);
-    t = _mm_or_si128(t, e[-2]);
-    t = _mm_or_si128(t, e[-1]);
-#else
-    t |= e[-3];
-    t |= e[-2];
-    t |= e[-1];
-#endif
-    return _mm_movemask_epi8(_mm_cmpeq_epi32(t, zero)) == 0xFFFF;
-#else
-    // TODO(bohu): find faster implementation for aarch64
-    const char* bytes = (const char*)buf;
-    for (int i = 0; i < len; ++i) {
-        if (bytes[i])
-            return false;
-    }
-    return true;
-#endif
-}
-
 namespace android {
 namespace snapshot {
 
 static const System::Duration kSnapshotCrashThresholdMs = 120000; // 2 minutes
 
-// TODO: implement an optimized SSE4 version and dynamically select it if host
-// supports SSE4.
 bool isBufferZeroed(const void* ptr, int32_t size) {
-    assert((uintptr_t(ptr) & (1024 - 1)) == 0);  // page-aligned
-    assert(size >= 1024);  // at least one small page in |size|
-    return buffer_zero_sse2(ptr, size);
+    return isPageZeroed(ptr, size_t(size));
 }
 
 Snapshotter::Snapshotter() = default;
@@ -163,6 +104,13 @@ void Snapshotter::initialize(const QAndroidVmOperations& vmOperations,
                      [](void* opaque, const char* name) {
                          auto snapshot = static_cast<Snapshotter*>(opaque);
                          return snapshot->isSavingCanceled(name);
+                     },
+                     // onPhase
+                     [](void* opaque, const char* name) {
+                         auto snapshot = static_cast<Snapshotter*>(opaque);
+                         if (snapshot->mProfile) {
+                             snapshot->mProfile->nextPhase(name);
+                         }
                      }},
                     // load
                     {// onStart
@@ -184,6 +132,13 @@ void Snapshotter::initialize(const QAndroidVmOperations& vmOperations,
                      [](void* opaque, const char* name) {
                          // TODO: Implement load cancel if necessary
                          return false;
+                     },
+                     // onPhase
+                     [](void* opaque, const char* name) {
+                         auto snapshot = static_cast<Snapshotter*>(opaque);
+                         if (snapshot->mProfile) {
+                             snapshot->mProfile->nextPhase(name);
+                         }
                      }},
                     // del
                     {// onStart
@@ -202,7 +157,9 @@ void Snapshotter::initialize(const QAndroidVmOperations& vmOperations,
                      [](void* opaque, const char* name) {
                          // TODO: Implement delete cancel if necessary
                          return false;
-                     }},
+                     },
+                     // onPhase
+                     nullptr},
             },
             // ramOps
             {// registerBlock
@@ -218,8 +175,17 @@ void Snapshotter::initialize(const QAndroidVmOperations& vmOperations,
              // startLoading
              [](void* opaque) {
                  auto snapshot = static_cast<Snapshotter*>(opaque);
-                 snapshot->mLoader->ramLoader().start(snapshot->isQuickboot());
-                 return snapshot->mLoader->ramLoader().hasError() ? -1 : 0;
+                 ScopedSnapshotPhase phase(snapshot->profile(), "ram");
+                 auto& ramLoader = snapshot->mLoader->ramLoader();
+                 // A quickboot snapshot is saved over on exit, unless the
+                 // emulator runs read-only or without saving.
+                 ramLoader.setWriteSharedImage(
+                         !snapshot->isQuickboot() ||
+                         (android_cmdLineOptions &&
+                          (android_cmdLineOptions->read_only ||
+                           android_cmdLineOptions->no_snapshot_save)));
+                 ramLoader.start(snapshot->isQuickboot());
+                 return ramLoader.hasError() ? -1 : 0;
              },
              // savePage
              [](void* opaque, int64_t blockOffset, int64_t pageOffset,
@@ -231,6 +197,7 @@ void Snapshotter::initialize(const QAndroidVmOperations& vmOperations,
              // savingComplete
              [](void* opaque) {
                  auto snapshot = static_cast<Snapshotter*>(opaque);
+                 ScopedSnapshotPhase phase(snapshot->profile(), "ram");
                  snapshot->mSaver->ramSaver().join();
                  return snapshot->mSaver->ramSaver().hasError() ? -1 : 0;
              },
@@ -335,18 +302,122 @@ void Snapshotter::prepareLoaderForSaving(const char* name) {
     }
     if (mLoader->snapshot().name() != name ||
         mLoader->status() != OperationStatus::Ok) {
+        stopDirtyPageTracking();
         mLoader.reset();
     } else {
         mLoader->synchronize(mIsOnExit && (mRamFile.empty() || !mRamFileShared));
     }
 }
 
+void Snapshotter::startDirtyPageTracking() {
+    if (!mLoader || !mLoader->hasRamLoader() ||
+        !mVmOperations.startDirtyPageTracking ||
+        !mVmOperations.startDirtyPageTracking()) {
+        return;
+    }
+
+    // From now on saving this snapshot again only has to look at the pages
+    // the guest writes to.
+    mLoader->ramLoader().setDirtyPagesQuery(
+            [this](const RamBlock& block, std::vector<uint64_t>* bitmap) {
+                const int64_t pages = block.totalSize / kDefaultPageSize;
+                bitmap->assign(size_t((pages + 63) / 64), 0);
+                return mVmOperations.getDirtyPages(block.startOffset,
+                                                   block.totalSize,
+                                                   bitmap->data());
+            });
+}
+
+void Snapshotter::stopDirtyPageTracking() {
+    if (mLoader && mLoader->hasRamLoader()) {
+        mLoader->ramLoader().setDirtyPagesQuery({});
+    }
+    if (mVmOperations.stopDirtyPageTracking) {
+        mVmOperations.stopDirtyPageTracking();
+    }
+}
+
 void Snapshotter::callCallbacks(Operation op, Stage stage) {
     for (auto&& cb : mCallbacks) {
         cb(op, stage);
     }
 }
 
+void Snapshotter::startProfile(Operation op, const char* name) {
+    const bool save = op == Operation::Save;
+    mProfile.reset(new SnapshotProfile(save ? "save" : "load", name));
+    // E.g. ANDROID_EMU_SNAPSHOT_LOAD_BUDGET_MS=2000 warns about loads that
+    // take longer than 2 seconds.
+    const auto budget = System::get()->envGet(
+            save ? "ANDROID_EMU_SNAPSHOT_SAVE_BUDGET_MS"
+                 : "ANDROID_EMU_SNAPSHOT_LOAD_BUDGET_MS");
+    if (!budget.empty()) {
+        mProfile->setBudgetMs(strtoull(budget.c_str(), nullptr, 10));
+    }
+    mProfile->beginPhase("prepare");
+}
+
+void Snapshotter::finishProfile(Operation op, bool succeeded) {
+    if (!mProfile) {
+        return;
+    }
+    mProfile->finish(succeeded);
+
+    // RAM and textures may still be loading in the background, these are
+    // the counts as of the end of the load.
+    const Snapshot* snapshot = nullptr;
+    if (op == Operation::Load && mLoader) {
+        snapshot = &mLoader->snapshot();
+        if (mLoader->hasRamLoader()) {
+            auto& ramLoader = mLoader->ramLoader();
+            const auto ram = ramLoader.stats();
+            mProfile->setCounter("ram", "bytesRead", ram.bytesRead);
+            mProfile->setCounter("ram", "pagesRead", ram.pagesRead);
+            mProfile->setCounter("ram", "pagesDecompressed",
+                                 ram.pagesDecompressed);
+            mProfile->setCounter("ram", "pageFaults", ram.pageFaults);
+            mProfile->setCounter("ram", "sharedBytes", ram.sharedBytes);
+            mProfile->setCounter("ram", "onDemand",
+                                 ramLoader.onDemandEnabled());
+        }
+        const auto textures = mLoader->textureStats();
+        mProfile->setCounter("renderer", "texturesLoaded",
+                             textures.texturesLoaded);
+        mProfile->setCounter("renderer", "textureBytesRead",
+                             textures.bytesRead);
+    } else if (op == Operation::Save && mSaver) {
+        snapshot = &mSaver->snapshot();
+        if (mSaver->hasRamSaver()) {
+            mProfile->setCounter("ram", "bytesWritten",
+                                 mSaver->ramSaver().diskSize());
+        }
+        if (const auto textureSaver = mSaver->textureSaver()) {
+            mProfile->setCounter("renderer", "bytesWritten",
+                                 textureSaver->diskSize());
+        }
+    }
+
+    if (mProfile->overBudget()) {
+        const auto slowest = mProfile->slowestPhase();
+        dwarning("Snapshot %s of '%s' took %.03f ms, over its budget of "
+                 "%llu ms; the slowest phase was '%s' (%.03f ms)",
+                 mProfile->operation().c_str(), mProfile->snapshot().c_str(),
+                 mProfile->durationUs() / 1000.0,
+                 (unsigned long long)mProfile->budgetMs(),
+                 slowest ? slowest->name.c_str() : "none",
+                 slowest ? slowest->wallUs / 1000.0 : 0.0);
+    }
+    if (snapshot) {
+        mProfile->writeJson(PathUtils::join(
+                snapshot->dataDir(), op == Operation::Save
+                                             ? "save-profile.json"
+                                             : "load-profile.json"));
+    }
+
+    (op == Operation::Save ? mLastSaveProfile : mLastLoadProfile) =
+            std::move(mProfile);
+}
+
 void Snapshotter::fillSnapshotMetrics(pb::AndroidStudioEvent* event,
                                       const SnapshotOperationStats& stats) {
 #if SNAPSHOT_METRICS
@@ -817,7 +888,8 @@ void Snapshotter::invalidateSnapshot(const char* name) {
     mIsInvalidating = true;
     mVmOperations.snapshotDelete(name, this, nullptr);
 
-    // then delete kRamFileName / kTexturesFileName / kMappedRamFileName
+    // then delete kRamFileName / kTexturesFileName / kMappedRamFileName /
+    // kSharedRamFileName
     path_delete_file(
             PathUtils::join(getSnapshotDir(nameValidated), kRamFileName)
                     .c_str());
@@ -827,6 +899,9 @@ void Snapshotter::invalidateSnapshot(const char* name) {
     path_delete_file(
             PathUtils::join(getSnapshotDir(nameValidated), kMappedRamFileName)
                     .c_str());
+    path_delete_file(
+            PathUtils::join(getSnapshotDir(nameValidated), kSharedRamFileName)
+                    .c_str());
 
     tombstone.saveFailure(FailureReason::Tombstone);
 }
@@ -856,6 +931,7 @@ bool Snapshotter::onStartSaving(const char* name) {
 #ifndef AEMU_MIN
     CrashReporter::get()->hangDetector().pause(true);
 #endif
+    startProfile(Operation::Save, name);
     callCallbacks(Operation::Save, Stage::Start);
     prepareLoaderForSaving(name);
     if (!mSaver || isComplete(*mSaver)) {
@@ -885,6 +961,7 @@ bool Snapshotter::onSavingComplete(const char* name, int res) {
     callCallbacks(Operation::Save, Stage::End);
     bool good = mSaver->status() != OperationStatus::Error &&
                 mSaver->status() != OperationStatus::Canceled;
+    finishProfile(Operation::Save, good);
 
     // bug: 129763714
     // if (good) {
@@ -900,9 +977,11 @@ void Snapshotter::onSavingFailed(const char* name, int res) {
 
 bool Snapshotter::onStartLoading(const char* name) {
     mLoadedSnapshotFile.clear();
+    stopDirtyPageTracking();
 #ifndef AEMU_MIN
     CrashReporter::get()->hangDetector().pause(true);
 #endif
+    startProfile(Operation::Load, name);
     callCallbacks(Operation::Load, Stage::Start);
     mSaver.reset();
     if (!mLoader || isComplete(*mLoader)) {
@@ -934,6 +1013,8 @@ bool Snapshotter::onLoadingComplete(const char* name, int res) {
     mLastLoadUptimeMs =
             System::Duration(System::get()->getProcessTimes().wallClockMs);
     callCallbacks(Operation::Load, Stage::End);
+    finishProfile(Operation::Load,
+                  mLoader->status() != OperationStatus::Error);
     if (mLoader->status() == OperationStatus::Error) {
         auto failureReason = mLoader->snapshot().failureReason();
         int failureReasonForQemu =
@@ -944,6 +1025,7 @@ bool Snapshotter::onLoadingComplete(const char* name, int res) {
         return false;
     }
     mLoadedSnapshotFile = name;
+    startDirtyPageTracking();
     // bug: 129763714
     // if (good) {
     //     Hierarchy::get()->currentInfo();
@@ -960,6 +1042,7 @@ void Snapshotter::onLoadingFailed(const char* name, int err) {
         if (mLoader) mLoader->onInvalidSnapshotLoad();
         return;
     }
+    stopDirtyPageTracking();
     mLoader.reset(new Loader(name, -err));
     mLoader->complete(false);
     mLoadedSnapshotFile.clear();
@@ -983,6 +1066,7 @@ bool Snapshotter::onDeletingComplete(const char* name, int res) {
             mSaver.reset();
         }
         if (mLoader && mLoader->snapshot().name() == name) {
+            stopDirtyPageTracking();
             mLoader.reset();
         }
         if (!mIsInvalidating) {
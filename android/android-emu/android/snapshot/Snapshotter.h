@@ -14,12 +14,14 @@
 #include "android/base/Compiler.h"
 #include "android/base/Optional.h"
 #include "android/base/system/System.h"
+#include "android/snapshot/SnapshotProfile.h"
 #include "android/snapshot/common.h"
 
 #include "android/emulation/control/vm_operations.h"
 #include "android/emulation/control/window_agent.h"
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -128,6 +130,15 @@ public:
     using Callback = std::function<void(Operation, Stage)>;
     void addOperationCallback(Callback&& cb);
 
+    // The profile of the save or load in progress, null if there is none.
+    SnapshotProfile* profile() { return mProfile.get(); }
+    // The profile of the last save or load that completed, null if there
+    // was none.
+    const SnapshotProfile* lastProfile(Operation op) const {
+        return op == Operation::Save ? mLastSaveProfile.get()
+                                     : mLastLoadProfile.get();
+    }
+
     bool isQuickboot() const { return mIsQuickboot; }
     bool hasRamFile() const { return !mRamFile.empty(); }
     bool isRamFileShared() const { return !mRamFile.empty() && mRamFileShared; }
@@ -149,7 +160,11 @@ private:
     void finishLoading();
 
     void prepareLoaderForSaving(const char* name);
+    void startDirtyPageTracking();
+    void stopDirtyPageTracking();
     void callCallbacks(Operation op, Stage stage);
+    void startProfile(Operation op, const char* name);
+    void finishProfile(Operation op, bool succeeded);
 
     void appendSuccessfulSave(const char* name,
                               base::System::Duration durationMs);
@@ -166,6 +181,9 @@ private:
     std::unique_ptr<Saver> mSaver;
     std::unique_ptr<Loader> mLoader;
     std::vector<Callback> mCallbacks;
+    std::unique_ptr<SnapshotProfile> mProfile;
+    std::unique_ptr<SnapshotProfile> mLastSaveProfile;
+    std::unique_ptr<SnapshotProfile> mLastLoadProfile;
     std::string mLoadedSnapshotFile;
 
     base::System::Duration mLastSaveUptimeMs = 0;
@@ -41,7 +41,8 @@ bool TextureLoader::start() {
 void TextureLoader::loadTexture(uint32_t texId, const loader_t& loader) {
     android::base::AutoLock scopedLock(mLock);
     assert(mIndex.count(texId));
-    HANDLE_EINTR(fseeko64(mStream.get(), mIndex[texId], SEEK_SET));
+    const int64_t start = mIndex[texId];
+    HANDLE_EINTR(fseeko64(mStream.get(), start, SEEK_SET));
     switch (mVersion) {
         case 1:
             loader(&mStream);
@@ -54,6 +55,11 @@ void TextureLoader::loadTexture(uint32_t texId, const loader_t& loader) {
     if (ferror(mStream.get())) {
         mHasError = true;
     }
+    ++mTexturesLoaded;
+    const int64_t end = ftello64(mStream.get());
+    if (end > start) {
+        mBytesRead += end - start;
+    }
 }
 
 bool TextureLoader::readIndex() {
@@ -97,6 +97,15 @@ public:
         return true;
     }
 
+    struct Stats {
+        uint64_t texturesLoaded;
+        uint64_t bytesRead;
+    };
+    AEMU_EXPORT Stats stats() {
+        android::base::AutoLock lock(mLock);
+        return {mTexturesLoaded, mBytesRead};
+    }
+
 private:
     bool readIndex();
 
@@ -108,6 +117,8 @@ private:
     int mVersion = 0;
     uint64_t mDiskSize = 0;
     LoaderThreadPtr mLoaderThread;
+    uint64_t mTexturesLoaded = 0;
+    uint64_t mBytesRead = 0;
 
     base::System::Duration mStartTime = 0;
     base::System::Duration mEndTime = 0;
@@ -120,6 +120,7 @@ constexpr const char* kRamFileName = "ram.bin";
 constexpr const char* kTexturesFileName = "textures.bin";
 constexpr const char* kMappedRamFileName = "ram.img";
 constexpr const char* kMappedRamFileDirtyName = "ram.img.dirty";
+constexpr const char* kSharedRamFileName = "ram.shared";
 
 constexpr const char* kSnapshotProtobufName = "snapshot.pb";
 
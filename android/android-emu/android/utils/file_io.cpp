@@ -23,6 +23,11 @@
 #ifndef _MSC_VER
 #include <unistd.h>
 #endif
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
 
 #ifdef _WIN32
 #include <direct.h>
@@ -145,6 +150,11 @@ int android_rmdir(const char* path) {
     return WIDEN_CALL_1(rmdir, path);
 #endif
 }
+
+int android_utime_now(const char* path) {
+    return WIDEN_CALL_1(utime, path, nullptr);
+}
+
 // The code below uses the fact that GCC supports something called weak linking.
 // Several functions in glibc are weakly linked which means that if the same
 // function name is found in the application binary that function will be used
@@ -58,5 +58,8 @@ int android_chmod(const char* path, mode_t mode);
 
 int android_rmdir(const char* path);
 
+// Sets the access and modification times of |path| to the current time.
+int android_utime_now(const char* path);
+
 ANDROID_END_HEADER
 
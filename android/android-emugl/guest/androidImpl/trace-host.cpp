@@ -26,15 +26,15 @@ void atrace_set_tracing_enabled(bool /*enabled*/) {}
 void atrace_update_tags() { }
 
 void atrace_setup() {
-    if (android::base::shouldEnableTracing()) {
-        atrace_enabled_tags =
-            ATRACE_TAG_ALWAYS |
-            ATRACE_TAG_GRAPHICS |
-            ATRACE_TAG_INPUT |
-            ATRACE_TAG_AUDIO |
-            ATRACE_TAG_VIDEO |
-            ATRACE_TAG_HAL;
-    }
+    // A trace capture can be started at any time, and the tracing calls are
+    // cheap when neither the capture nor the printouts are on.
+    atrace_enabled_tags =
+        ATRACE_TAG_ALWAYS |
+        ATRACE_TAG_GRAPHICS |
+        ATRACE_TAG_INPUT |
+        ATRACE_TAG_AUDIO |
+        ATRACE_TAG_VIDEO |
+        ATRACE_TAG_HAL;
 }
 
 void atrace_begin_body(const char* name) {
@@ -47,5 +47,10 @@ void atrace_end_body() {
 
 void atrace_async_begin_body(const char* /*name*/, int32_t /*cookie*/) {}
 void atrace_async_end_body(const char* /*name*/, int32_t /*cookie*/) {}
-void atrace_int_body(const char* /*name*/, int32_t /*value*/) {}
-void atrace_int64_body(const char* /*name*/, int64_t /*value*/) {}
+void atrace_int_body(const char* name, int32_t value) {
+    android::base::traceCounter(name, value);
+}
+
+void atrace_int64_body(const char* name, int64_t value) {
+    android::base::traceCounter(name, value);
+}
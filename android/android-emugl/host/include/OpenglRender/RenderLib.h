@@ -29,6 +29,7 @@ namespace base {
 class CpuUsage;
 class MemoryTracker;
 class GLObjectCounter;
+class LatencyTracker;
 
 } // namespace base
 } // namespace android
@@ -80,6 +81,10 @@ public:
     virtual void setUsageTracker(android::base::CpuUsage* cpuUsage,
                                  android::base::MemoryTracker* memUsage) = 0;
 
+    // Sets the histograms the renderer records its latencies in, none if
+    // |tracker| is null.
+    virtual void setLatencyTracker(android::base::LatencyTracker* tracker) = 0;
+
     virtual void* getGLESv2Dispatch(void) = 0;
 
     virtual void* getEGLDispatch(void) = 0;
@@ -224,9 +224,15 @@ public:
                       const android::snapshot::ITextureLoaderPtr& textureLoader) = 0;
     // Fill GLES usage protobuf
     virtual void fillGLESUsages(android_studio::EmulatorGLESUsages*) = 0;
-    virtual void getScreenshot(unsigned int nChannels, unsigned int* width,
-        unsigned int* height, std::vector<unsigned char>& pixels, int displayId = 0,
-        int desiredWidth = 0, int desiredHeight = 0,
+    // Reads the last frame of |displayId| into |pixels|, with |nChannels|
+    // (3 for RGB, 4 for RGBA) tightly packed bytes per pixel. |*cPixels| is
+    // the size of |pixels| on input and the number of bytes the screenshot
+    // takes on output, so the caller can size a buffer of its own (or reuse
+    // one) and try again when false is returned. A |*cPixels| of 0 on
+    // return means there is nothing to capture.
+    virtual bool getScreenshot(unsigned int nChannels, unsigned int* width,
+        unsigned int* height, uint8_t* pixels, size_t* cPixels,
+        int displayId = 0, int desiredWidth = 0, int desiredHeight = 0,
         SkinRotation desiredRotation = SKIN_ROTATION_0) = 0;
     virtual void snapshotOperationCallback(
             android::snapshot::Snapshotter::Operation op,
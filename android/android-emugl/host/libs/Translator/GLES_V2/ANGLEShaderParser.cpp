@@ -18,6 +18,7 @@
 
 #include <map>
 #include <string>
+#include <tuple>
 
 #define GL_COMPUTE_SHADER 0x91B9
 
@@ -121,11 +122,17 @@ ShaderLinkInfo::ShaderLinkInfo(ShaderLinkInfo&& other) {
 }
 
 ShaderLinkInfo& ShaderLinkInfo::operator=(ShaderLinkInfo&& other) {
+    if (this == &other) {
+        return *this;
+    }
+    // The variables are owned by the translator, release ours first.
+    clear();
     esslVersion = other.esslVersion;
     uniforms = std::move(other.uniforms);
     varyings = std::move(other.varyings);
     attributes = std::move(other.attributes);
     outputVars = std::move(other.outputVars);
+    interfaceBlocks = std::move(other.interfaceBlocks);
     nameMap = std::move(other.nameMap);
     nameMapReverse = std::move(other.nameMapReverse);
 
@@ -231,6 +238,36 @@ static ST_Handle getShaderCompiler(bool coreProfileHost, ShaderSpecKey key) {
 
 android::base::Lock kCompilerLock;
 
+// Guests compile the same shaders over and over: every app start, and every
+// program restored from a snapshot is compiled again. Remember what they
+// translated to rather than running the translator each time.
+struct TranslatedShader {
+    bool compiled;
+    std::string infoLog;
+    std::string objCode;
+    ShaderLinkInfo linkInfo;
+};
+
+struct TranslationKey {
+    bool hostUsesCoreProfile;
+    GLenum shaderType;
+    std::string src;
+
+    bool operator<(const TranslationKey& other) const {
+        return std::tie(hostUsesCoreProfile, shaderType, src) <
+               std::tie(other.hostUsesCoreProfile, other.shaderType,
+                        other.src);
+    }
+};
+
+// Starts over once it holds this many shaders, they are cheap to translate
+// again compared to tracking which ones are still used.
+static constexpr size_t kMaxTranslatedShaders = 512;
+
+// Guarded by kCompilerLock.
+static android::base::LazyInstance<std::map<TranslationKey, TranslatedShader>>
+        sTranslatedShaders = LAZY_INSTANCE_INIT;
+
 void initializeResources(
     BuiltinResourcesEditCallback callback) {
 
@@ -395,6 +432,15 @@ bool translate(bool hostUsesCoreProfile,
     // at the same time.
     android::base::AutoLock autolock(kCompilerLock);
 
+    TranslationKey translationKey = {hostUsesCoreProfile, shaderType, src};
+    auto translated = sTranslatedShaders->find(translationKey);
+    if (translated != sTranslatedShaders->end()) {
+        *outInfolog = translated->second.infoLog;
+        *outObjCode = translated->second.objCode;
+        if (outShaderLinkInfo) *outShaderLinkInfo = translated->second.linkInfo;
+        return translated->second.compiled;
+    }
+
     ShaderSpecKey key;
     key.shaderType = shaderType;
     key.esslVersion = esslVersion;
@@ -419,11 +465,20 @@ bool translate(bool hostUsesCoreProfile,
     *outInfolog = std::string(res->infoLog);
     *outObjCode = std::string(res->translatedSource);
 
-    if (outShaderLinkInfo) getShaderLinkInfo(esslVersion, res, outShaderLinkInfo);
-
-    bool ret = res->compileStatus == 1;
+    TranslatedShader entry;
+    entry.compiled = res->compileStatus == 1;
+    entry.infoLog = *outInfolog;
+    entry.objCode = *outObjCode;
+    getShaderLinkInfo(esslVersion, res, &entry.linkInfo);
+    if (outShaderLinkInfo) *outShaderLinkInfo = entry.linkInfo;
 
     st->freeShaderResolveState(res);
+
+    if (sTranslatedShaders->size() >= kMaxTranslatedShaders) {
+        sTranslatedShaders->clear();
+    }
+    const bool ret = entry.compiled;
+    sTranslatedShaders->emplace(std::move(translationKey), std::move(entry));
     return ret;
 }
 
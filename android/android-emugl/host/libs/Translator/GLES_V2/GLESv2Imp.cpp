@@ -3108,8 +3108,7 @@ GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
         GLint vertexShader =  programData->getAttachedVertexShader();
 
         if (ctx->getMajorVersion() >= 3 && ctx->getMinorVersion() >= 1) {
-            ctx->dispatcher().glLinkProgram(globalProgramName);
-            ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+            linkStatus = programData->linkHostProgram(globalProgramName);
             programData->setHostLinkStatus(linkStatus);
         } else {
             if (vertexShader != 0 && fragmentShader!=0) {
@@ -3121,8 +3120,7 @@ GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
                 ShaderParser* vertSp = (ShaderParser*)vertObjData;
 
                 if(fragSp->getCompileStatus() && vertSp->getCompileStatus()) {
-                    ctx->dispatcher().glLinkProgram(globalProgramName);
-                    ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
+                    linkStatus = programData->linkHostProgram(globalProgramName);
                     programData->setHostLinkStatus(linkStatus);
                     if (!programData->validateLink(fragSp, vertSp)) {
                         programData->setLinkStatus(GL_FALSE);
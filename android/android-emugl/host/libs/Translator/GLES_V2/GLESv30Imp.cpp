@@ -841,6 +841,10 @@ EXTERN_PART GL_APICALL void GL_APIENTRY glTransformFeedbackVaryings(GLuint progr
     if (ctx->shareGroup().get()) {
         const GLuint globalProgramName = ctx->shareGroup()->getGlobalName(NamedObjectType::SHADER_OR_PROGRAM, program);
         ctx->dispatcher().glTransformFeedbackVaryings(globalProgramName, count, varyings, bufferMode);
+        auto objData = ctx->shareGroup()->getObjectData(NamedObjectType::SHADER_OR_PROGRAM, program);
+        if (objData && objData->getDataType() == PROGRAM_DATA) {
+            ((ProgramData*)objData)->setTransformFeedbackVaryings(count, varyings, bufferMode);
+        }
     }
 }
 
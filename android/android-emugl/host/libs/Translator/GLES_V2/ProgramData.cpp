@@ -18,7 +18,11 @@
 #include "OpenglCodecCommon/glUtils.h"
 
 #include "android/base/containers/Lookup.h"
+#include "android/base/files/PathUtils.h"
 #include "android/base/files/StreamSerializing.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/system/System.h"
+#include "android/emulation/ConfigDirs.h"
 #include "ANGLEShaderParser.h"
 #include "GLcommon/GLutils.h"
 #include "GLcommon/GLESmacros.h"
@@ -26,10 +30,14 @@
 
 #include <GLES3/gl31.h>
 #include <string.h>
+#include <map>
 #include <unordered_set>
 
 using android::base::c_str;
+using android::base::LazyInstance;
+using android::base::PathUtils;
 using android::base::StringView;
+using android::base::System;
 
 GLUniformDesc::GLUniformDesc(const char* name, GLint location, GLsizei count, GLboolean transpose,
             GLenum type, GLsizei size, unsigned char* val)
@@ -70,6 +78,55 @@ static int s_glShaderType2ShaderType(GLenum type) {
     return ProgramData::NUM_SHADER_TYPE;
 }
 
+namespace {
+
+// Bump when what goes into a program key changes.
+constexpr uint32_t kProgramKeyVersion = 1;
+
+// The program binary cache for the host driver, if the driver can hand out
+// program binaries. ANDROID_EMUGL_PROGRAM_BINARY_CACHE=0 turns it off.
+class HostProgramBinaries {
+public:
+    HostProgramBinaries() {
+        if (System::get()->envGet("ANDROID_EMUGL_PROGRAM_BINARY_CACHE") ==
+            "0") {
+            return;
+        }
+        GLDispatch& dispatcher = GLEScontext::dispatcher();
+        if (!dispatcher.glGetProgramBinary || !dispatcher.glProgramBinary ||
+            !dispatcher.glProgramParameteri) {
+            return;
+        }
+        GLint formats = 0;
+        dispatcher.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats <= 0) {
+            return;
+        }
+
+        // Binaries only load into the driver that linked them.
+        std::string hostId;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION,
+                            GL_SHADING_LANGUAGE_VERSION}) {
+            const GLubyte* value = dispatcher.glGetString(name);
+            hostId += value ? (const char*)value : "";
+            hostId += '\n';
+        }
+        mCache.reset(new ProgramBinaryCache(
+                PathUtils::join(android::ConfigDirs::getUserDirectory(),
+                                "gl-program-cache"),
+                hostId));
+    }
+
+    ProgramBinaryCache* get() { return mCache.get(); }
+
+private:
+    std::unique_ptr<ProgramBinaryCache> mCache;
+};
+
+LazyInstance<HostProgramBinaries> sHostProgramBinaries = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
 ProgramData::ProgramData(int glesMaj, int glesMin)
     : ObjectData(PROGRAM_DATA),
       ValidateStatus(false),
@@ -398,53 +455,52 @@ void ProgramData::restore(ObjectLocalName localName,
         // Really, each program name corresponds to 2 programs:
         // the one that is already linked, and the one that is not yet linked.
         // We need to restore both.
-        GLint tmpShaders[NUM_SHADER_TYPE];
+        GLint tmpShaders[NUM_SHADER_TYPE] = {};
+        GLenum types[NUM_SHADER_TYPE] = {};
+        std::string parsedSources[NUM_SHADER_TYPE];
+        const std::string* sources[NUM_SHADER_TYPE] = {};
         for (int i = 0; i < NUM_SHADER_TYPE; i++) {
             AttachedShader& s = attachedShaders[i];
             if (s.linkedSource.empty()) {
-                tmpShaders[i] = 0;
                 continue;
             }
-            GLenum type = 0;
             switch (i) {
             case VERTEX:
-                type = GL_VERTEX_SHADER;
+                types[i] = GL_VERTEX_SHADER;
                 break;
             case FRAGMENT:
-                type = GL_FRAGMENT_SHADER;
+                types[i] = GL_FRAGMENT_SHADER;
                 break;
             case COMPUTE:
-                type = GL_COMPUTE_SHADER;
+                types[i] = GL_COMPUTE_SHADER;
                 break;
             default:
                 assert(0);
             }
-            tmpShaders[i] = dispatcher.glCreateShader(type);
-            const GLchar* src = (const GLchar *)s.linkedSource.c_str();
-            std::string parsedSrc;
             if (!isGles2Gles()) {
                 std::string infoLog;
                 ANGLEShaderParser::translate(
                             isCoreProfile(),
-                            src,
-                            type,
+                            s.linkedSource.c_str(),
+                            types[i],
                             &infoLog,
-                            &parsedSrc,
+                            &parsedSources[i],
                             &s.linkInfo);
-                src = parsedSrc.c_str();
+            } else {
+                parsedSources[i] = s.linkedSource;
             }
-            dispatcher.glShaderSource(tmpShaders[i], 1, &src, NULL);
-            dispatcher.glCompileShader(tmpShaders[i]);
-            dispatcher.glAttachShader(globalName, tmpShaders[i]);
+            sources[i] = &parsedSources[i];
         }
-        for (const auto& attribLocs : linkedAttribLocs) {
+        std::unordered_map<std::string, GLuint> attribLocs;
+        for (const auto& attribLoc : linkedAttribLocs) {
             // Prefix "gl_" is reserved, we should skip those.
             // https://www.khronos.org/registry/OpenGL-Refpages/es3.0/html/glBindAttribLocation.xhtml
-            if  (strncmp(attribLocs.first.c_str(), "gl_", 3) == 0) {
+            if  (strncmp(attribLoc.first.c_str(), "gl_", 3) == 0) {
                 continue;
             }
-            dispatcher.glBindAttribLocation(globalName, attribLocs.second,
-                    attribLocs.first.c_str());
+            dispatcher.glBindAttribLocation(globalName, attribLoc.second,
+                    attribLoc.first.c_str());
+            attribLocs.insert(attribLoc);
         }
         if (mGlesMajorVersion >= 3) {
             std::vector<const char*> varyings;
@@ -455,9 +511,27 @@ void ProgramData::restore(ObjectLocalName localName,
             dispatcher.glTransformFeedbackVaryings(
                     globalName, mTransformFeedbacks.size(), varyings.data(),
                     mTransformFeedbackBufferMode);
+            mPendingTransformFeedbacks = std::move(mTransformFeedbacks);
+            mPendingTransformFeedbackBufferMode = mTransformFeedbackBufferMode;
             mTransformFeedbacks.clear();
         }
-        dispatcher.glLinkProgram(globalName);
+        ProgramBinaryCache::Key key;
+        const bool useCache = makeProgramKey(
+                sources, attribLocs, mPendingTransformFeedbacks,
+                mPendingTransformFeedbackBufferMode, &key);
+        // With a cached binary there is nothing to compile.
+        linkHostProgram(globalName, useCache ? &key : nullptr, [&]() {
+            for (int i = 0; i < NUM_SHADER_TYPE; i++) {
+                if (!sources[i]) {
+                    continue;
+                }
+                tmpShaders[i] = dispatcher.glCreateShader(types[i]);
+                const GLchar* src = sources[i]->c_str();
+                dispatcher.glShaderSource(tmpShaders[i], 1, &src, NULL);
+                dispatcher.glCompileShader(tmpShaders[i]);
+                dispatcher.glAttachShader(globalName, tmpShaders[i]);
+            }
+        });
         dispatcher.glUseProgram(globalName);
 #ifdef DEBUG
         for (const auto& attribLocs : linkedAttribLocs) {
@@ -722,6 +796,122 @@ bool ProgramData::detachShader(GLuint shader) {
     return false;
 }
 
+void ProgramData::setTransformFeedbackVaryings(GLsizei count,
+                                               const char* const* varyings,
+                                               GLenum bufferMode) {
+    mPendingTransformFeedbacks.assign(varyings, varyings + count);
+    mPendingTransformFeedbackBufferMode = bufferMode;
+}
+
+GLint ProgramData::linkHostProgram(GLuint globalName) {
+    const std::string* sources[NUM_SHADER_TYPE] = {};
+    std::string compiledSources[NUM_SHADER_TYPE];
+    bool useCache = true;
+    for (int i = 0; i < NUM_SHADER_TYPE; i++) {
+        const AttachedShader& s = attachedShaders[i];
+        if (!s.shader) {
+            continue;
+        }
+        // A shader that failed to compile makes the link fail, no binary
+        // must stand in for it.
+        useCache = useCache && s.shader->getCompileStatus();
+        compiledSources[i] = s.shader->getCompiledSrc();
+        sources[i] = &compiledSources[i];
+    }
+
+    ProgramBinaryCache::Key key;
+    useCache = useCache &&
+               makeProgramKey(sources, boundAttribLocs,
+                              mPendingTransformFeedbacks,
+                              mPendingTransformFeedbackBufferMode, &key);
+    // The program is set up already.
+    return linkHostProgram(globalName, useCache ? &key : nullptr, nullptr);
+}
+
+bool ProgramData::makeProgramKey(
+        const std::string* const sources[NUM_SHADER_TYPE],
+        const std::unordered_map<std::string, GLuint>& attribLocs,
+        const std::vector<std::string>& transformFeedbacks,
+        GLenum transformFeedbackBufferMode,
+        ProgramBinaryCache::Key* key) const {
+    ProgramBinaryCache* cache = sHostProgramBinaries->get();
+    if (!cache) {
+        return false;
+    }
+    *key = cache->newKey();
+    key->add(kProgramKeyVersion);
+    for (int i = 0; i < NUM_SHADER_TYPE; i++) {
+        if (sources[i]) {
+            key->add(uint32_t(i)).add(*sources[i]);
+        }
+    }
+    // Sorted, so the same bindings make the same key.
+    const std::map<std::string, GLuint> sortedAttribLocs(attribLocs.begin(),
+                                                         attribLocs.end());
+    key->add(uint32_t(sortedAttribLocs.size()));
+    for (const auto& attribLoc : sortedAttribLocs) {
+        key->add(attribLoc.first).add(attribLoc.second);
+    }
+    key->add(uint32_t(transformFeedbacks.size()));
+    for (const auto& feedback : transformFeedbacks) {
+        key->add(feedback);
+    }
+    key->add(transformFeedbackBufferMode);
+    return true;
+}
+
+// static
+GLint ProgramData::linkHostProgram(GLuint globalName,
+                                   const ProgramBinaryCache::Key* key,
+                                   const std::function<void()>& prepare) {
+    GLDispatch& dispatcher = GLEScontext::dispatcher();
+    ProgramBinaryCache* cache = key ? sHostProgramBinaries->get() : nullptr;
+    GLint linkStatus = GL_FALSE;
+    if (cache) {
+        ProgramBinaryCache::Binary binary;
+        if (cache->load(*key, &binary)) {
+            dispatcher.glProgramBinary(globalName, binary.format,
+                                       binary.data.data(),
+                                       (GLsizei)binary.data.size());
+            dispatcher.glGetProgramiv(globalName, GL_LINK_STATUS, &linkStatus);
+            if (linkStatus == GL_TRUE) {
+                return linkStatus;
+            }
+            // The driver was updated without changing its version strings,
+            // link the program again.
+        }
+        dispatcher.glProgramParameteri(
+                globalName, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    if (prepare) {
+        prepare();
+    }
+    dispatcher.glLinkProgram(globalName);
+    dispatcher.glGetProgramiv(globalName, GL_LINK_STATUS, &linkStatus);
+    if (!cache || linkStatus != GL_TRUE) {
+        return linkStatus;
+    }
+
+    GLint length = 0;
+    dispatcher.glGetProgramiv(globalName, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return linkStatus;
+    }
+    ProgramBinaryCache::Binary binary;
+    binary.data.resize(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    dispatcher.glGetProgramBinary(globalName, length, &written, &format,
+                                  binary.data.data());
+    if (written > 0) {
+        binary.data.resize(written);
+        binary.format = format;
+        cache->store(*key, binary);
+    }
+    return linkStatus;
+}
+
 void ProgramData::bindAttribLocation(const std::string& var, GLuint loc) {
     boundAttribLocs[var] = loc;
 }
@@ -18,8 +18,11 @@
 
 #include "ShaderParser.h"
 
+#include "GLcommon/ProgramBinaryCache.h"
+
 #include "android/base/StringView.h"
 
+#include <functional>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -82,6 +85,15 @@ public:
     void bindAttribLocation(const std::string& var, GLuint loc);
     void linkedAttribLocation(const std::string& var, GLuint loc);
 
+    // glTransformFeedbackVaryings; they take effect after glLinkProgram.
+    void setTransformFeedbackVaryings(GLsizei count,
+                                      const char* const* varyings,
+                                      GLenum bufferMode);
+
+    // Links the host program |globalName| from the attached shaders, or
+    // loads it from the program binary cache. Returns the link status.
+    GLint linkHostProgram(GLuint globalName);
+
     void appendValidationErrMsg(std::ostringstream& ss);
     bool validateLink(ShaderParser* frag, ShaderParser* vert);
 
@@ -123,6 +135,20 @@ public:
     int getHostUniformLocation(int guestLocation);
 
 private:
+    // Everything a host program is linked from goes into |key|.
+    // Returns false if there is no program binary cache.
+    bool makeProgramKey(const std::string* const sources[NUM_SHADER_TYPE],
+                        const std::unordered_map<std::string, GLuint>& attribLocs,
+                        const std::vector<std::string>& transformFeedbacks,
+                        GLenum transformFeedbackBufferMode,
+                        ProgramBinaryCache::Key* key) const;
+    // Loads the binary for |key| into the host program if there is one and
+    // the driver takes it. Otherwise calls |prepare| to set the program up
+    // and links it, adding the binary to the cache.
+    static GLint linkHostProgram(GLuint globalName,
+                                 const ProgramBinaryCache::Key* key,
+                                 const std::function<void()>& prepare);
+
     // linkedAttribLocs stores the attribute locations the guest might
     // know about. It includes all boundAttribLocs before the previous
     // glLinkProgram and all attribute locations retrieved by glGetAttribLocation
@@ -140,6 +166,9 @@ private:
     std::unordered_map<GLuint, GLuint> mUniformBlockBinding;
     std::vector<std::string> mTransformFeedbacks;
     GLenum mTransformFeedbackBufferMode = 0;
+    // Set by glTransformFeedbackVaryings for the next link.
+    std::vector<std::string> mPendingTransformFeedbacks;
+    GLenum mPendingTransformFeedbackBufferMode = 0;
 
     int mGlesMajorVersion = 2;
     int mGlesMinorVersion = 0;
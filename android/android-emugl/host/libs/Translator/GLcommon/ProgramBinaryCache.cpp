@@ -0,0 +1,214 @@
+/*
+* Copyright (C) 2020 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "GLcommon/ProgramBinaryCache.h"
+
+#include "android/base/files/PathUtils.h"
+#include "android/base/files/ScopedStdioFile.h"
+#include "android/base/system/System.h"
+#include "android/utils/file_io.h"
+#include "android/utils/path.h"
+
+#include "MurmurHash3.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+using android::base::AutoLock;
+using android::base::PathUtils;
+using android::base::ScopedStdioFile;
+using android::base::StringView;
+using android::base::System;
+
+namespace {
+
+constexpr uint32_t kMagic = 0x42504745;  // "EGPB"
+constexpr uint32_t kVersion = 1;
+constexpr char kExtension[] = ".bin";
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t size;
+    uint64_t checksum[2];  // Of the binary, catches truncated files.
+};
+
+std::array<uint64_t, 2> hash(const void* data, size_t size) {
+    std::array<uint64_t, 2> result;
+    MurmurHash3_x64_128(data, int(size), 0, result.data());
+    return result;
+}
+
+}  // namespace
+
+ProgramBinaryCache::Key& ProgramBinaryCache::Key::add(StringView data) {
+    add(uint32_t(data.size()));
+    mMaterial.append(data.data(), data.size());
+    return *this;
+}
+
+ProgramBinaryCache::Key& ProgramBinaryCache::Key::add(uint32_t value) {
+    mMaterial.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    return *this;
+}
+
+std::string ProgramBinaryCache::Key::name() const {
+    const auto digest = hash(mMaterial.data(), mMaterial.size());
+    char name[2 * 16 + sizeof(kExtension)];
+    snprintf(name, sizeof(name), "%016llx%016llx%s",
+             (unsigned long long)digest[0], (unsigned long long)digest[1],
+             kExtension);
+    return name;
+}
+
+ProgramBinaryCache::ProgramBinaryCache(StringView directory,
+                                       StringView hostId,
+                                       uint64_t maxBytes)
+    : mDirectory(directory), mHostId(hostId), mMaxBytes(maxBytes) {}
+
+ProgramBinaryCache::Key ProgramBinaryCache::newKey() const {
+    Key key;
+    key.add(mHostId);
+    return key;
+}
+
+bool ProgramBinaryCache::load(const Key& key, Binary* out) {
+    const std::string path = PathUtils::join(mDirectory, key.name());
+    ScopedStdioFile file(android_fopen(path.c_str(), "rb"));
+    if (!file) {
+        AutoLock lock(mLock);
+        ++mMisses;
+        return false;
+    }
+
+    // The size in the header is only trusted once the file agrees with it,
+    // and for binaries store() would have kept.
+    FileHeader header;
+    System::FileSize fileSize = 0;
+    bool valid = System::get()->fileSize(fileno(file.get()), &fileSize) &&
+                 fread(&header, sizeof(header), 1, file.get()) == 1 &&
+                 header.magic == kMagic && header.version == kVersion &&
+                 header.size > 0 && header.size <= maxBinaryBytes() &&
+                 fileSize == sizeof(header) + uint64_t(header.size);
+    if (valid) {
+        out->format = header.format;
+        out->data.resize(header.size);
+        valid = fread(out->data.data(), 1, header.size, file.get()) ==
+                        header.size &&
+                hash(out->data.data(), out->data.size()) ==
+                        std::array<uint64_t, 2>{
+                                {header.checksum[0], header.checksum[1]}};
+    }
+    file.reset();
+
+    AutoLock lock(mLock);
+    if (!valid) {
+        // Written by another version, or cut short.
+        ++mMisses;
+        android_unlink(path.c_str());
+        return false;
+    }
+    ++mHits;
+    // Keeps the binaries in use from being trimmed, see trim().
+    android_utime_now(path.c_str());
+    return true;
+}
+
+void ProgramBinaryCache::store(const Key& key, const Binary& binary) {
+    if (binary.data.empty() || binary.data.size() > maxBinaryBytes()) {
+        return;
+    }
+    if (path_mkdir_if_needed(mDirectory.c_str(), 0755) != 0) {
+        return;
+    }
+
+    const std::string path = PathUtils::join(mDirectory, key.name());
+    // Written under a name of its own and renamed into place, so nobody
+    // reads a file that is still being written.
+    const std::string tmpPath =
+            path + "." + std::to_string(System::get()->getCurrentProcessId()) +
+            ".tmp";
+    const auto checksum = hash(binary.data.data(), binary.data.size());
+    const FileHeader header = {kMagic, kVersion, binary.format,
+                               uint32_t(binary.data.size()),
+                               {checksum[0], checksum[1]}};
+    bool written;
+    {
+        ScopedStdioFile file(android_fopen(tmpPath.c_str(), "wb"));
+        written = file &&
+                  fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+                  fwrite(binary.data.data(), 1, binary.data.size(),
+                         file.get()) == binary.data.size();
+    }
+    if (!written || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        // Lost the race against another emulator writing the same binary
+        // (on Windows), or out of space.
+        android_unlink(tmpPath.c_str());
+        return;
+    }
+
+    AutoLock lock(mLock);
+    mWritten += sizeof(header) + binary.data.size();
+    if (mWritten > mMaxBytes / 4) {
+        trim();
+        mWritten = 0;
+    }
+}
+
+void ProgramBinaryCache::trim() {
+    struct Entry {
+        std::string path;
+        System::Duration modified;
+        System::FileSize size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    for (auto& path : System::get()->scanDirEntries(mDirectory, true)) {
+        if (PathUtils::extension(path).str() != kExtension) {
+            continue;
+        }
+        auto size = System::get()->pathFileSize(path);
+        auto modified = System::get()->pathModificationTime(path);
+        if (!size || !modified) {
+            continue;
+        }
+        total += *size;
+        entries.push_back({std::move(path), *modified, *size});
+    }
+    if (total <= mMaxBytes) {
+        return;
+    }
+
+    // Make room for a while, rather than trimming on every store. load()
+    // touches the files it reads, so the least recently used go first.
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) {
+                  return a.modified < b.modified;
+              });
+    for (const auto& entry : entries) {
+        if (total <= mMaxBytes / 4 * 3) {
+            break;
+        }
+        if (System::get()->deleteFile(entry.path)) {
+            total -= entry.size;
+        }
+    }
+}
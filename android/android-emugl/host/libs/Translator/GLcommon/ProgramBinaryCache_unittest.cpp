@@ -0,0 +1,171 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GLcommon/ProgramBinaryCache.h"
+
+#include "android/base/files/PathUtils.h"
+#include "android/base/system/System.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+using android::base::PathUtils;
+using android::base::System;
+using android::base::TestTempDir;
+
+namespace {
+
+ProgramBinaryCache::Binary makeBinary(size_t size, uint8_t seed) {
+    ProgramBinaryCache::Binary binary;
+    binary.format = 0x8740 + seed;
+    for (size_t i = 0; i < size; ++i) {
+        binary.data.push_back(uint8_t(i * 31 + seed));
+    }
+    return binary;
+}
+
+ProgramBinaryCache::Key programKey(const ProgramBinaryCache& cache,
+                                   const char* vertex,
+                                   const char* fragment) {
+    auto key = cache.newKey();
+    key.add(0x8B31).add(vertex).add(0x8B30).add(fragment);
+    return key;
+}
+
+uint64_t directorySize(const std::string& dir) {
+    uint64_t total = 0;
+    for (const auto& path : System::get()->scanDirEntries(dir, true)) {
+        total += System::get()->pathFileSize(path).valueOr(0);
+    }
+    return total;
+}
+
+}  // namespace
+
+TEST(ProgramBinaryCache, missThenHit) {
+    TestTempDir dir("programbinarycache");
+    ProgramBinaryCache cache(dir.path(), "renderer 1.0");
+    const auto key = programKey(cache, "void main() {}", "void main() {}");
+
+    ProgramBinaryCache::Binary loaded;
+    EXPECT_FALSE(cache.load(key, &loaded));
+    const auto binary = makeBinary(1000, 1);
+    cache.store(key, binary);
+    ASSERT_TRUE(cache.load(key, &loaded));
+    EXPECT_EQ(binary.format, loaded.format);
+    EXPECT_EQ(binary.data, loaded.data);
+    EXPECT_EQ(1u, cache.hits());
+    EXPECT_EQ(1u, cache.misses());
+
+    // Another emulator sharing the directory.
+    ProgramBinaryCache other(dir.path(), "renderer 1.0");
+    EXPECT_TRUE(other.load(programKey(other, "void main() {}",
+                                      "void main() {}"),
+                           &loaded));
+}
+
+TEST(ProgramBinaryCache, keysCoverEverything) {
+    TestTempDir dir("programbinarycache");
+    ProgramBinaryCache cache(dir.path(), "renderer 1.0");
+    ProgramBinaryCache newDriver(dir.path(), "renderer 1.1");
+    cache.store(programKey(cache, "a", "b"), makeBinary(100, 1));
+
+    ProgramBinaryCache::Binary loaded;
+    EXPECT_TRUE(cache.load(programKey(cache, "a", "b"), &loaded));
+    EXPECT_FALSE(newDriver.load(programKey(newDriver, "a", "b"), &loaded));
+    // The parts are delimited, moving a byte across them is another key.
+    EXPECT_FALSE(cache.load(programKey(cache, "ab", ""), &loaded));
+    EXPECT_FALSE(cache.load(programKey(cache, "b", "a"), &loaded));
+}
+
+TEST(ProgramBinaryCache, dropsDamagedFiles) {
+    TestTempDir dir("programbinarycache");
+    ProgramBinaryCache cache(dir.path(), "renderer 1.0");
+    const auto key = programKey(cache, "a", "b");
+    cache.store(key, makeBinary(1000, 1));
+
+    // Damage the binary, as a disk error might.
+    const std::string path = PathUtils::join(dir.path(), key.name());
+    FILE* file = fopen(path.c_str(), "r+b");
+    ASSERT_NE(nullptr, file);
+    fseek(file, -1, SEEK_END);
+    fputc(0x55, file);
+    fclose(file);
+
+    ProgramBinaryCache::Binary loaded;
+    EXPECT_FALSE(cache.load(key, &loaded));
+    EXPECT_FALSE(System::get()->pathExists(path));
+}
+
+TEST(ProgramBinaryCache, dropsFilesOfTheWrongSize) {
+    TestTempDir dir("programbinarycache");
+    ProgramBinaryCache cache(dir.path(), "renderer 1.0");
+    ProgramBinaryCache::Binary loaded;
+
+    // The size in the header, after the magic, version and format.
+    for (uint32_t size : {0u, 999u, 1001u, 0xffffffffu}) {
+        const auto key = programKey(cache, std::to_string(size).c_str(), "");
+        cache.store(key, makeBinary(1000, 1));
+
+        const std::string path = PathUtils::join(dir.path(), key.name());
+        FILE* file = fopen(path.c_str(), "r+b");
+        ASSERT_NE(nullptr, file);
+        fseek(file, 3 * sizeof(uint32_t), SEEK_SET);
+        fwrite(&size, sizeof(size), 1, file);
+        fclose(file);
+
+        EXPECT_FALSE(cache.load(key, &loaded));
+        EXPECT_FALSE(System::get()->pathExists(path));
+    }
+}
+
+TEST(ProgramBinaryCache, staysWithinItsSize) {
+    TestTempDir dir("programbinarycache");
+    const uint64_t maxBytes = 16 * 1024;
+    ProgramBinaryCache cache(dir.path(), "renderer 1.0", maxBytes);
+
+    for (int i = 0; i < 100; ++i) {
+        cache.store(programKey(cache, std::to_string(i).c_str(), ""),
+                    makeBinary(1000, uint8_t(i)));
+    }
+    EXPECT_LE(directorySize(dir.path()), maxBytes + maxBytes / 4);
+
+    // The latest binaries are kept.
+    ProgramBinaryCache::Binary loaded;
+    EXPECT_TRUE(cache.load(programKey(cache, "99", ""), &loaded));
+    EXPECT_EQ(makeBinary(1000, 99).data, loaded.data);
+
+    // Binaries too large for the cache are not kept at all.
+    cache.store(programKey(cache, "large", ""), makeBinary(maxBytes, 1));
+    EXPECT_FALSE(cache.load(programKey(cache, "large", ""), &loaded));
+}
+
+TEST(ProgramBinaryCache, keepsRecentlyUsed) {
+    TestTempDir dir("programbinarycache");
+    const uint64_t maxBytes = 16 * 1024;
+    ProgramBinaryCache cache(dir.path(), "renderer 1.0", maxBytes);
+    const auto used = programKey(cache, "used", "");
+    cache.store(used, makeBinary(1000, 1));
+
+    // The first binary stored, but loaded all along.
+    ProgramBinaryCache::Binary loaded;
+    for (int i = 0; i < 100; ++i) {
+        cache.store(programKey(cache, std::to_string(i).c_str(), ""),
+                    makeBinary(1000, uint8_t(i)));
+        ASSERT_TRUE(cache.load(used, &loaded)) << i;
+    }
+    EXPECT_FALSE(cache.load(programKey(cache, "0", ""), &loaded));
+}
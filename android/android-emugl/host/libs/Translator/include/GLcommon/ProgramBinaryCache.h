@@ -0,0 +1,89 @@
+/*
+* Copyright (C) 2020 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include "android/base/StringView.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A cache of linked host program binaries (glGetProgramBinary) on disk, so
+// the shaders a guest links on every boot and snapshot load are only
+// compiled and linked by the host driver once.
+//
+// Binaries are addressed by the content they were linked from: the
+// translated sources, the bound attribute locations and so on, plus the
+// identity of the host driver and the translator, as a binary is useless
+// (or worse) to any other driver. Files are written atomically, several
+// emulators can share a directory.
+class ProgramBinaryCache {
+public:
+    // Everything a binary depends on.
+    class Key {
+    public:
+        Key& add(android::base::StringView data);
+        Key& add(uint32_t value);
+        // The file name for the key.
+        std::string name() const;
+
+    private:
+        std::string mMaterial;
+    };
+
+    struct Binary {
+        uint32_t format = 0;
+        std::vector<uint8_t> data;
+    };
+
+    // |hostId| identifies the host driver and translator, it is part of
+    // every key. The cache keeps at most |maxBytes| of the most recently
+    // used binaries.
+    ProgramBinaryCache(android::base::StringView directory,
+                       android::base::StringView hostId,
+                       uint64_t maxBytes = kDefaultMaxBytes);
+
+    // A key for this cache, add the content of a program to it.
+    Key newKey() const;
+
+    bool load(const Key& key, Binary* out);
+    void store(const Key& key, const Binary& binary);
+
+    uint64_t hits() const { return mHits; }
+    uint64_t misses() const { return mMisses; }
+
+    static constexpr uint64_t kDefaultMaxBytes = 64 * 1024 * 1024;
+
+private:
+    // Removes the least recently used files once the cache outgrows
+    // |mMaxBytes|.
+    void trim();
+
+    // The largest binary worth keeping.
+    uint64_t maxBinaryBytes() const { return mMaxBytes / 16; }
+
+    const std::string mDirectory;
+    const std::string mHostId;
+    const uint64_t mMaxBytes;
+
+    android::base::Lock mLock;
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+    // Bytes written since the directory was last trimmed.
+    uint64_t mWritten = 0;
+};
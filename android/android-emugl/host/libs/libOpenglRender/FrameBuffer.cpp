@@ -30,6 +30,7 @@
 
 #include "android/base/LayoutResolver.h"
 #include "android/base/CpuUsage.h"
+#include "android/base/LatencyTracker.h"
 #include "android/base/containers/Lookup.h"
 #include "android/base/files/StreamSerializing.h"
 #include "android/base/memory/LazyInstance.h"
@@ -47,6 +48,7 @@
 #include <string.h>
 
 using android::base::AutoLock;
+using android::base::LatencyTracker;
 using android::base::LazyInstance;
 using android::base::Stream;
 using android::base::System;
@@ -2184,7 +2186,17 @@ void FrameBuffer::unbindAndDestroyTrivialSharedContext(EGLContext context,
 
 bool FrameBuffer::post(HandleType p_colorbuffer, bool needLockAndBind) {
     bool res = postImpl(p_colorbuffer, needLockAndBind);
-    if (res) setGuestPostedAFrame();
+    if (res) {
+        setGuestPostedAFrame();
+        if (auto latencyTracker = emugl::getLatencyTracker()) {
+            const uint64_t now = System::get()->getHighResTimeUs();
+            const uint64_t last = m_lastPostUs.exchange(now);
+            if (last) {
+                latencyTracker->record(LatencyTracker::Area::FramePost,
+                                       (now - last) * 1000);
+            }
+        }
+    }
     return res;
 }
 
@@ -2402,8 +2414,8 @@ static void loadProcOwnedCollection(Stream* stream, Collection* c) {
     });
 }
 
-void FrameBuffer::getScreenshot(unsigned int nChannels, unsigned int* width,
-        unsigned int* height, std::vector<unsigned char>& pixels, int displayId,
+bool FrameBuffer::getScreenshot(unsigned int nChannels, unsigned int* width,
+        unsigned int* height, uint8_t* pixels, size_t* cPixels, int displayId,
         int desiredWidth, int desiredHeight, SkinRotation desiredRotation) {
     AutoLock mutex(m_lock);
     uint32_t w, h, cb;
@@ -2418,15 +2430,15 @@ void FrameBuffer::getScreenshot(unsigned int nChannels, unsigned int* width,
         fprintf(stderr, "Screenshot of invalid display %d", displayId);
         *width = 0;
         *height = 0;
-        pixels.resize(0);
-        return;
+        *cPixels = 0;
+        return false;
     }
     if (nChannels != 3 && nChannels != 4) {
         fprintf(stderr, "Screenshot only support 3(RGB) or 4(RGBA) channels");
         *width = 0;
         *height = 0;
-        pixels.resize(0);
-        return;
+        *cPixels = 0;
+        return false;
     }
     emugl::get_emugl_multi_display_operations().getDisplayColorBuffer(displayId, &cb);
     if (displayId == 0) {
@@ -2436,8 +2448,8 @@ void FrameBuffer::getScreenshot(unsigned int nChannels, unsigned int* width,
     if (c == m_colorbuffers.end()) {
         *width = 0;
         *height = 0;
-        pixels.resize(0);
-        return;
+        *cPixels = 0;
+        return false;
     }
 
     *width = (desiredWidth == 0) ? w : desiredWidth;
@@ -2445,7 +2457,12 @@ void FrameBuffer::getScreenshot(unsigned int nChannels, unsigned int* width,
     if (desiredRotation == SKIN_ROTATION_90 || desiredRotation == SKIN_ROTATION_270) {
         std::swap(*width, *height);
     }
-    pixels.resize(4 * (*width) * (*height));
+    const size_t needed = nChannels * (*width) * (*height);
+    if (*cPixels < needed) {
+        *cPixels = needed;
+        return false;
+    }
+    *cPixels = needed;
 
     GLenum format = nChannels == 3 ? GL_RGB : GL_RGBA;
 
@@ -2457,9 +2474,10 @@ void FrameBuffer::getScreenshot(unsigned int nChannels, unsigned int* width,
     scrCmd.screenshot.format = format;
     scrCmd.screenshot.type = GL_UNSIGNED_BYTE;
     scrCmd.screenshot.rotation = desiredRotation;
-    scrCmd.screenshot.pixels = pixels.data();
+    scrCmd.screenshot.pixels = pixels;
 
     sendPostWorkerCmd(scrCmd);
+    return true;
 }
 
 void FrameBuffer::onLastColorBufferRef(uint32_t handle) {
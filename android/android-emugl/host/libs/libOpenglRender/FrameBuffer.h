@@ -37,6 +37,7 @@
 
 #include <EGL/egl.h>
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <unordered_map>
@@ -520,11 +521,13 @@ public:
 
     // Fill GLES usage protobuf
     void fillGLESUsages(android_studio::EmulatorGLESUsages*);
-    // Save a screenshot of the previous frame.
+    // Save a screenshot of the previous frame into |pixels|, which holds
+    // |*cPixels| bytes. If it is too small nothing is read, |*cPixels| is
+    // set to the size needed and false is returned.
     // nChannels should be 3 (RGB) or 4 (RGBA).
     // Note: swiftshader_indirect does not work with 3 channels
-    void getScreenshot(unsigned int nChannels, unsigned int* width,
-            unsigned int* height, std::vector<unsigned char>& pixels,
+    bool getScreenshot(unsigned int nChannels, unsigned int* width,
+            unsigned int* height, uint8_t* pixels, size_t* cPixels,
             int displayId, int desiredWidth, int desiredHeight,
             SkinRotation desiredRotation);
     void onLastColorBufferRef(uint32_t handle);
@@ -624,6 +627,8 @@ private:
     bool m_perfStats = false;
     int m_statsNumFrames = 0;
     long long m_statsStartTime = 0;
+    // Time of the last frame posted by the guest, for the post intervals.
+    std::atomic<uint64_t> m_lastPostUs{0};
 
     emugl::Mutex m_lock;
     emugl::ReadWriteMutex m_contextStructureLock;
@@ -96,6 +96,10 @@ void RenderLibImpl::setUsageTracker(android::base::CpuUsage* cpuUsage,
     emugl::setMemoryTracker(memUsage);
 }
 
+void RenderLibImpl::setLatencyTracker(android::base::LatencyTracker* tracker) {
+    emugl::setLatencyTracker(tracker);
+}
+
 void* RenderLibImpl::getGLESv2Dispatch(void) {
     return &s_gles2;
 }
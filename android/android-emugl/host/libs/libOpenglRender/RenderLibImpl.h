@@ -52,6 +52,9 @@ public:
     virtual void setUsageTracker(android::base::CpuUsage* cpuUsage,
                                  android::base::MemoryTracker* memUsage) override;
 
+    virtual void setLatencyTracker(
+            android::base::LatencyTracker* tracker) override;
+
     virtual void* getGLESv2Dispatch(void) override;
 
     virtual void* getEGLDispatch(void) override;
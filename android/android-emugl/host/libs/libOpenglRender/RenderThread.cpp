@@ -30,6 +30,7 @@
 #include "OpenGLESDispatch/GLESv1Dispatch.h"
 #include "../../../shared/OpenglCodecCommon/ChecksumCalculatorThreadInfo.h"
 
+#include "android/base/LatencyTracker.h"
 #include "android/base/system/System.h"
 #include "android/base/Tracing.h"
 #include "android/base/files/StreamSerializing.h"
@@ -39,10 +40,12 @@
 #define EMUGL_DEBUG_LEVEL 0
 #include "emugl/common/crash_reporter.h"
 #include "emugl/common/debug.h"
+#include "emugl/common/misc.h"
 
 #include <assert.h>
 
 using android::base::AutoLock;
+using android::base::LatencyTracker;
 
 namespace emugl {
 
@@ -390,6 +393,11 @@ intptr_t RenderThread::main() {
         }
 
         auto progressStart = currTimeUs(benchmarkEnabled);
+        auto latencyTracker = emugl::getLatencyTracker();
+        const uint64_t decodeStartUs =
+                latencyTracker
+                        ? android::base::System::get()->getHighResTimeUs()
+                        : 0;
         bool progress;
         do {
             progress = false;
@@ -468,6 +476,13 @@ intptr_t RenderThread::main() {
                 }
             }
         } while (progress);
+
+        if (latencyTracker) {
+            latencyTracker->record(
+                    LatencyTracker::Area::RenderDecode,
+                    (android::base::System::get()->getHighResTimeUs() -
+                     decodeStartUs) * 1000);
+        }
     }
 
     if (dumpFP) {
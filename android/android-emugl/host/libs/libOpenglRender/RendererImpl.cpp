@@ -323,12 +323,19 @@ void RendererImpl::fillGLESUsages(android_studio::EmulatorGLESUsages* usages) {
     if (fb) fb->fillGLESUsages(usages);
 }
 
-void RendererImpl::getScreenshot(unsigned int nChannels, unsigned int* width,
-        unsigned int* height, std::vector<unsigned char>& pixels, int displayId,
+bool RendererImpl::getScreenshot(unsigned int nChannels, unsigned int* width,
+        unsigned int* height, uint8_t* pixels, size_t* cPixels, int displayId,
         int desiredWidth, int desiredHeight, SkinRotation desiredRotation) {
     auto fb = FrameBuffer::getFB();
-    if (fb) fb->getScreenshot(nChannels, width, height, pixels, displayId,
-                              desiredWidth, desiredHeight, desiredRotation);
+    if (fb) {
+        return fb->getScreenshot(nChannels, width, height, pixels, cPixels,
+                                 displayId, desiredWidth, desiredHeight,
+                                 desiredRotation);
+    }
+    *width = 0;
+    *height = 0;
+    *cPixels = 0;
+    return false;
 }
 
 void RendererImpl::setMultiDisplay(uint32_t id,
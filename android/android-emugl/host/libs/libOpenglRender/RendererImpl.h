@@ -98,8 +98,8 @@ public:
     bool load(android::base::Stream* stream,
               const android::snapshot::ITextureLoaderPtr& textureLoader) final;
     void fillGLESUsages(android_studio::EmulatorGLESUsages*) final;
-    void getScreenshot(unsigned int nChannels, unsigned int* width,
-            unsigned int* height, std::vector<unsigned char>& pixels,
+    bool getScreenshot(unsigned int nChannels, unsigned int* width,
+            unsigned int* height, uint8_t* pixels, size_t* cPixels,
             int displayId, int desiredWidth, int desiredHeight,
             SkinRotation desiredRotation) final;
     void snapshotOperationCallback(
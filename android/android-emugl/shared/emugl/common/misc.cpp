@@ -31,6 +31,7 @@ android::base::GLObjectCounter* s_default_gl_object_counter = nullptr;
 android::base::GLObjectCounter* s_gl_object_counter = nullptr;
 android::base::CpuUsage* s_cpu_usage = nullptr;
 android::base::MemoryTracker* s_mem_usage = nullptr;
+android::base::LatencyTracker* s_latency_tracker = nullptr;
 
 static SelectedRenderer s_renderer =
     SELECTED_RENDERER_HOST;
@@ -103,3 +104,11 @@ void emugl::setMemoryTracker(android::base::MemoryTracker* usage) {
 android::base::MemoryTracker* emugl::getMemoryTracker() {
     return s_mem_usage;
 }
+
+void emugl::setLatencyTracker(android::base::LatencyTracker* tracker) {
+    s_latency_tracker = tracker;
+}
+
+android::base::LatencyTracker* emugl::getLatencyTracker() {
+    return s_latency_tracker;
+}
@@ -35,6 +35,7 @@ namespace base {
 class CpuUsage;
 class MemoryTracker;
 class GLObjectCounter;
+class LatencyTracker;
 
 } // namespace base
 } // namespace android
@@ -70,6 +71,11 @@ namespace emugl {
     EMUGL_COMMON_API void setMemoryTracker(android::base::MemoryTracker* usage);
     EMUGL_COMMON_API android::base::MemoryTracker* getMemoryTracker();
 
+    // Latency histograms get/set, null when latencies aren't recorded.
+    EMUGL_COMMON_API void setLatencyTracker(
+            android::base::LatencyTracker* tracker);
+    EMUGL_COMMON_API android::base::LatencyTracker* getLatencyTracker();
+
     // Window operation agent
     EMUGL_COMMON_API void set_emugl_window_operations(const QAndroidEmulatorWindowAgent &voperations);
     EMUGL_COMMON_API const QAndroidEmulatorWindowAgent &get_emugl_window_operations();
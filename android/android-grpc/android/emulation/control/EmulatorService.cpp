@@ -24,11 +24,14 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <ratio>
 #include <string>
 #include <tuple>
@@ -37,6 +40,7 @@
 #include <utility>
 #include <vector>
 
+#include "android/base/LatencyTracker.h"
 #include "android/base/Log.h"
 #include "android/base/Optional.h"
 #include "android/base/async/ThreadLooper.h"
@@ -54,7 +58,7 @@
 #include "android/emulation/control/keyboard/EmulatorKeyEventSender.h"
 #include "android/emulation/control/keyboard/TouchEventSender.h"
 #include "android/emulation/control/location_agent.h"
-#include "android/emulation/control/logcat/LogcatParser.h"
+#include "android/emulation/control/logcat/LogcatCache.h"
 #include "android/emulation/control/logcat/RingStreambuf.h"
 #include "android/emulation/control/sensors_agent.h"
 #include "android/emulation/control/telephony_agent.h"
@@ -63,6 +67,7 @@
 #include "android/emulation/control/utils/EventWaiter.h"
 #include "android/emulation/control/utils/ScreenshotUtils.h"
 #include "android/emulation/control/utils/ServiceUtils.h"
+#include "android/emulation/control/utils/SharedMemoryRing.h"
 #include "android/emulation/control/vm_operations.h"
 #include "android/emulation/control/window_agent.h"
 #include "android/globals.h"
@@ -73,6 +78,7 @@
 #include "android/recording/Frame.h"
 #include "android/recording/Producer.h"
 #include "android/recording/audio/AudioProducer.h"
+#include "android/recording/codecs/audio/AudioStreamEncoder.h"
 #include "android/skin/rect.h"
 #include "android/telephony/gsm.h"
 #include "android/telephony/modem.h"
@@ -88,6 +94,7 @@ class Empty;
 }  // namespace google
 
 using grpc::ServerContext;
+using grpc::ServerReader;
 using grpc::ServerWriter;
 using grpc::Status;
 using namespace android::base;
@@ -98,12 +105,26 @@ namespace android {
 namespace emulation {
 namespace control {
 
+// True if the peer, as reported by ServerContext::peer(), runs on this
+// machine.
+static bool isLocalPeer(const std::string& peer) {
+    static const char* const kLocalPeers[] = {"ipv4:127.", "ipv6:[::1]",
+                                              "ipv6:[::ffff:127.", "unix:"};
+    for (const char* prefix : kLocalPeers) {
+        if (peer.compare(0, strlen(prefix), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Logic and data behind the server's behavior.
 class EmulatorControllerImpl final : public EmulatorController::Service {
 public:
     EmulatorControllerImpl(const AndroidConsoleAgents* agents)
         : mAgents(agents),
           mLogcatBuffer(k128KB),
+          mLogcatCache(&mLogcatBuffer, k128KB),
           mKeyEventSender(agents),
           mTouchEventSender(agents),
           mClipboard(Clipboard::getClipboard(agents->clipboard)),
@@ -116,16 +137,20 @@ public:
     Status getLogcat(ServerContext* context,
                      const LogMessage* request,
                      LogMessage* reply) override {
-        auto message = mLogcatBuffer.bufferAtOffset(request->start(), kNoWait);
         if (request->sort() == LogMessage::Parsed) {
-            auto parsed = LogcatParser::parseLines(message.second);
-            reply->set_start(message.first);
-            for (auto entry : parsed.second) {
-                *reply->add_entries() = entry;
+            auto parsed = mLogcatCache.entriesAtOffset(request->start());
+            reply->set_start(parsed.start);
+            reply->set_dropped(parsed.dropped);
+            for (const auto& entry : parsed.entries) {
+                *reply->add_entries() = *entry;
             }
-            reply->set_next(message.first + parsed.first);
+            reply->set_next(parsed.next);
         } else {
+            auto message =
+                    mLogcatBuffer.bufferAtOffset(request->start(), kNoWait);
             reply->set_start(message.first);
+            reply->set_dropped(
+                    std::max<int64_t>(0, message.first - request->start()));
             reply->set_contents(message.second);
             reply->set_next(message.first + message.second.size());
         }
@@ -141,21 +166,31 @@ public:
             // When streaming, block at most 5 seconds before sending any status
             // This also makes sure we check that the clients is still around at
             // least once every 5 seconds.
-            auto message =
-                    mLogcatBuffer.bufferAtOffset(log.next(), k5SecondsWait);
+            //
+            // All the streams share the logcat ring buffer, and the parsed
+            // entries. A client that reads slower than the emulator logs will
+            // skip over the output that got overwritten, which is reported in
+            // the dropped field.
+            const int64_t requested = log.next();
             if (request->sort() == LogMessage::Parsed) {
-                auto parsed = LogcatParser::parseLines(message.second);
+                auto parsed = mLogcatCache.entriesAtOffset(
+                        requested, k5SecondsWait, kMaxStreamedEntries);
                 log.clear_entries();
-                log.set_start(message.first);
-                for (auto entry : parsed.second) {
-                    *log.add_entries() = entry;
+                log.set_start(parsed.start);
+                for (const auto& entry : parsed.entries) {
+                    *log.add_entries() = *entry;
                 }
-                log.set_next(message.first + parsed.first);
+                log.set_next(parsed.next);
             } else {
+                auto message =
+                        mLogcatBuffer.bufferAtOffset(requested, k5SecondsWait);
                 log.set_start(message.first);
                 log.set_contents(message.second);
                 log.set_next(message.first + message.second.size());
             }
+            if (log.start() > requested) {
+                log.set_dropped(log.dropped() + log.start() - requested);
+            }
         } while (writer->Write(log));
         return Status::OK;
     }
@@ -397,6 +432,64 @@ public:
         return Status::OK;
     }
 
+    Status streamInputEvent(ServerContext* context,
+                            ServerReader<InputEvent>* reader,
+                            ::google::protobuf::Empty* reply) override {
+        auto dropped = std::make_shared<std::atomic<int>>(0);
+        std::vector<InputEvent> pending;
+        int64_t pendingTimestampUs = 0;
+        int64_t firstTimestampUs = 0;
+        uint64_t firstArrivalUs = 0;
+
+        InputEvent event;
+        while (reader->Read(&event)) {
+            const int64_t timestampUs = event.timestamp_us();
+            if (!pending.empty() && timestampUs != pendingTimestampUs) {
+                dispatchInputEvents(std::move(pending), dropped);
+                pending.clear();
+            }
+
+            if (timestampUs == 0) {
+                pending.push_back(event);
+                dispatchInputEvents(std::move(pending), dropped);
+                pending.clear();
+                continue;
+            }
+
+            if (firstArrivalUs == 0) {
+                firstTimestampUs = timestampUs;
+                firstArrivalUs = System::get()->getHighResTimeUs();
+            } else if (pending.empty()) {
+                // Start of a new frame, wait until it is due.
+                const uint64_t dueUs =
+                        firstArrivalUs +
+                        std::max<int64_t>(0, timestampUs - firstTimestampUs);
+                const uint64_t nowUs = System::get()->getHighResTimeUs();
+                if (dueUs > nowUs) {
+                    System::get()->sleepUs(static_cast<unsigned>(dueUs - nowUs));
+                }
+            }
+            pendingTimestampUs = timestampUs;
+            pending.push_back(event);
+        }
+
+        if (!pending.empty()) {
+            dispatchInputEvents(std::move(pending), dropped);
+        }
+
+        // Wait for the events queued above to be delivered, so that drops
+        // can be reported to the client.
+        android::base::ThreadLooper::runOnMainLooperAndWaitForCompletion(
+                []() {});
+        if (*dropped) {
+            return Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                          std::to_string(dropped->load()) +
+                                  " input batch(es) were not fully delivered, "
+                                  "the device queue was full.");
+        }
+        return Status::OK;
+    }
+
     Status getStatus(ServerContext* context,
                      const Empty* request,
                      EmulatorStatus* reply) override {
@@ -420,6 +513,47 @@ public:
             response_entry->set_value(entry.second);
         };
 
+        using Area = LatencyTracker::Area;
+        static const std::pair<Area, LatencyHistogram::Source> kSources[] = {
+            {Area::MainLoopIteration, LatencyHistogram::MAIN_LOOP_ITERATION},
+            {Area::BqlHold, LatencyHistogram::BQL_HOLD},
+            {Area::VcpuExit, LatencyHistogram::VCPU_EXIT},
+            {Area::RenderDecode, LatencyHistogram::RENDER_THREAD_DECODE},
+            {Area::FramePost, LatencyHistogram::FRAME_POST_INTERVAL},
+            {Area::LooperCallback, LatencyHistogram::LOOPER_CALLBACK},
+        };
+        for (const auto& source : kSources) {
+            const auto summary =
+                    LatencyTracker::get()->histogram(source.first).summary();
+            if (!summary.count) {
+                continue;
+            }
+            auto latencies = reply->add_latencies();
+            latencies->set_source(source.second);
+            latencies->set_count(summary.count);
+            latencies->set_meanus(summary.mean / 1000);
+            latencies->set_minus(summary.min / 1000.0);
+            latencies->set_p50us(summary.p50 / 1000.0);
+            latencies->set_p90us(summary.p90 / 1000.0);
+            latencies->set_p99us(summary.p99 / 1000.0);
+            latencies->set_p999us(summary.p999 / 1000.0);
+            latencies->set_maxus(summary.max / 1000.0);
+            if (source.first == Area::LooperCallback) {
+                latencies->set_pending(
+                        LatencyTracker::get()->pendingCallbacks());
+                latencies->set_maxpending(
+                        LatencyTracker::get()->maxPendingCallbacks());
+            }
+        }
+
+        const auto mem = System::get()->getMemUsage();
+        auto memUsage = reply->mutable_memoryusage();
+        memUsage->set_residentbytes(mem.resident);
+        memUsage->set_residentmaxbytes(mem.resident_max);
+        memUsage->set_virtualbytes(mem.virt);
+        memUsage->set_residentsharedbytes(mem.resident_shared);
+        memUsage->set_residentprivatebytes(mem.resident_private);
+
         return Status::OK;
     }
 
@@ -428,7 +562,7 @@ public:
                        ServerWriter<AudioPacket>* writer) override {
         // The source number of samples per audio frame in Qemu, 512 samples is
         // fixed
-        constexpr int kSrcNumSamples = 512;
+        int srcNumSamples = 512;
 
         // Translate external settings to internal qemu settings.
         auto sampleFormat = AudioUtils::getSampleFormat(*request);
@@ -444,14 +578,54 @@ public:
         AudioFormat* format = packet.mutable_format();
         format->set_channels(request->channels());
         format->set_format(request->format());
+        format->set_codec(request->codec());
+
+        // Encoders work on signed 16 bit samples, of a rate they support,
+        // and produce a packet every frameSize() samples.
+        std::unique_ptr<android::recording::AudioStreamEncoder> encoder;
+        if (request->codec() != AudioFormat::PCM) {
+            uint32_t bitrate = request->bitrate();
+            if (bitrate == 0) {
+                bitrate = kDefaultAudioBitrate;
+            }
+            encoder = android::recording::AudioStreamEncoder::create(
+                    AudioUtils::getCodecId(*request), sampleRate, channels,
+                    bitrate);
+            if (!encoder) {
+                return Status(grpc::StatusCode::UNIMPLEMENTED,
+                              "The requested audio codec is not available.");
+            }
+            sampleFormat = android::recording::AudioFormat::AUD_FMT_S16;
+            sampleRate = encoder->sampleRate();
+            srcNumSamples = encoder->frameSize();
+            format->set_format(AudioFormat::AUD_FMT_S16);
+            packet.set_codecconfig(encoder->codecConfig());
+        }
         format->set_samplingrate(sampleRate);
 
+        // Local clients can pick up the audio straight from shared memory,
+        // the packets only tell them where to look.
+        std::unique_ptr<SharedMemoryRing> ring;
+        if (!request->sharedmemoryhandle().empty()) {
+            if (!isLocalPeer(context->peer())) {
+                return Status(grpc::StatusCode::PERMISSION_DENIED,
+                              "Shared memory is only available to local "
+                              "clients.");
+            }
+            ring.reset(new SharedMemoryRing(request->sharedmemoryhandle(),
+                                            kAudioRingCapacity));
+            if (ring->create() != 0) {
+                return Status(grpc::StatusCode::FAILED_PRECONDITION,
+                              "Unable to create the shared memory region.");
+            }
+        }
+
         constexpr int kMaxAudioFrames = 50;
         using TimedAudioFrame = std::pair<System::Duration, std::string>;
         android::base::MessageChannel<TimedAudioFrame, kMaxAudioFrames>
                 audioFrames;
         auto audioProducer = android::recording::createAudioProducer(
-                sampleRate, kSrcNumSamples, sampleFormat, channels);
+                sampleRate, srcNumSamples, sampleFormat, channels);
 
         // Callback that is responsible for copying the incoming packets
         // into the audioframe channel.
@@ -472,13 +646,43 @@ public:
         constexpr std::chrono::microseconds kTimeToWaitForAudioFrame =
                 std::chrono::milliseconds(125);
         bool clientAlive = true;
+        std::vector<std::string> payloads;
         do {
             auto audioFrame =
                     audioFrames.timedReceive(kTimeToWaitForAudioFrame.count());
             if (audioFrame) {
-                packet.set_timestamp(audioFrame->first);
-                packet.set_audio(std::move(audioFrame->second));
-                clientAlive = writer->Write(packet);
+                payloads.clear();
+                if (encoder) {
+                    // Encoding happens here rather than in the producer
+                    // callback, to keep the audio thread going.
+                    auto pcm = reinterpret_cast<const uint8_t*>(
+                            audioFrame->second.data());
+                    if (!encoder->encode(pcm, audioFrame->second.size(),
+                                         &payloads)) {
+                        break;
+                    }
+                } else {
+                    payloads.push_back(std::move(audioFrame->second));
+                }
+
+                for (auto& payload : payloads) {
+                    packet.set_timestamp(audioFrame->first);
+                    if (ring) {
+                        uint64_t offset;
+                        if (!ring->write(payload.data(), payload.size(),
+                                         &offset)) {
+                            // Can't be read back whole, the codec config
+                            // goes with the next packet.
+                            continue;
+                        }
+                        packet.set_offset(offset);
+                        packet.set_length(payload.size());
+                    } else {
+                        packet.set_audio(std::move(payload));
+                    }
+                    clientAlive = clientAlive && writer->Write(packet);
+                    packet.clear_codecconfig();
+                }
             }
             clientAlive = clientAlive && !context->IsCancelled();
         } while (clientAlive);
@@ -490,8 +694,24 @@ public:
     Status streamScreenshot(ServerContext* context,
                             const ImageFormat* request,
                             ServerWriter<Image>* writer) override {
-        EventWaiter frameEvent(&gpu_register_shared_memory_callback,
-                               &gpu_unregister_shared_memory_callback);
+        // The frames come from the frame hub of the display, which reads
+        // every frame back once for all its subscribers (other streams, the
+        // screen recorder, WebRTC). The screenshots are made from the frames
+        // on this thread.
+        std::mutex frameLock;
+        android::opengl::SharedFramePtr lastFrame;
+        EventWaiter frameEvent;
+        const uint32_t displayId = request->display();
+        const int subscription = gpu_frame_subscribe(
+                displayId,
+                [&frameLock, &lastFrame,
+                 &frameEvent](const android::opengl::SharedFramePtr& frame) {
+                    {
+                        std::lock_guard<std::mutex> lock(frameLock);
+                        lastFrame = frame;
+                    }
+                    frameEvent.newEvent();
+                });
 
         // Make sure we always write the first frame, this can be
         // a completely empty frame if the screen is not active.
@@ -505,8 +725,9 @@ public:
 
         bool lastFrameWasEmpty = first.format().width() == 0;
         int frame = 0;
+        // Reused for every frame, clearing keeps the storage of the image.
+        Image reply;
         while (clientAvailable) {
-            Image reply;
             const auto kTimeToWaitForFrame = std::chrono::milliseconds(125);
 
             // The next call will return the number of frames that are
@@ -518,7 +739,13 @@ public:
             if (arrived > 0 && !context->IsCancelled()) {
                 frame += arrived;
                 // TODO(jansene): Add metrics around dropped frames/timing?
-                getScreenshot(context, request, &reply);
+                android::opengl::SharedFramePtr pixels;
+                {
+                    std::lock_guard<std::mutex> lock(frameLock);
+                    pixels = std::move(lastFrame);
+                }
+                reply.Clear();
+                takeScreenshot(context, request, &reply, pixels.get());
                 reply.set_seq(frame);
 
                 // We send the first empty frame, after that we wait for frames
@@ -535,12 +762,22 @@ public:
             }
             clientAvailable = !context->IsCancelled() && clientAvailable;
         }
+        gpu_frame_unsubscribe(displayId, subscription);
         return Status::OK;
     }
 
     Status getScreenshot(ServerContext* context,
                          const ImageFormat* request,
                          Image* reply) override {
+        return takeScreenshot(context, request, reply, nullptr);
+    }
+
+    // Takes the screenshot described by |request| from |frame|, or reads it
+    // back from the renderer if there is no frame.
+    Status takeScreenshot(ServerContext* context,
+                          const ImageFormat* request,
+                          Image* reply,
+                          const android::opengl::SharedFrame* frame) {
         uint32_t width, height;
         bool enabled;
         bool multiDisplayQueryWorks = mAgents->emu->getMultiDisplay(
@@ -623,12 +860,19 @@ public:
             return Status::CANCELLED;
         }
 
-        android::emulation::Image img = android::emulation::takeScreenshot(
-                desiredFormat, desiredRotation, renderer.get(),
-                mAgents->display->getFrameBuffer, request->display(), newWidth,
-                newHeight);
-
-        reply->set_image(img.getPixelBuf(), img.getPixelCount());
+        // The image is written straight into the reply. Clients usually take
+        // a stream of screenshots, so favor encoding speed over size.
+        android::emulation::Image img =
+                frame ? android::emulation::takeScreenshot(
+                                reply->mutable_image(), desiredFormat,
+                                desiredRotation, *frame, newWidth, newHeight,
+                                android::emulation::PngCompression::Fast)
+                      : android::emulation::takeScreenshot(
+                                reply->mutable_image(), desiredFormat,
+                                desiredRotation, renderer.get(),
+                                mAgents->display->getFrameBuffer,
+                                request->display(), newWidth, newHeight,
+                                android::emulation::PngCompression::Fast);
 
         // Update format information with the retrieved width, height..
         auto format = reply->mutable_format();
@@ -771,6 +1015,49 @@ public:
     }
 
 private:
+    // Delivers |events| in order from a single main loop callback. Runs of
+    // touch events are merged into one batch for the input device; batches
+    // that the device could not queue entirely are counted in |*dropped|.
+    void dispatchInputEvents(std::vector<InputEvent>&& events,
+                             std::shared_ptr<std::atomic<int>> dropped) {
+        auto agent = mAgents->user_event;
+        android::base::ThreadLooper::runOnMainLooper(
+                [this, agent, dropped, events = std::move(events)]() {
+                    std::vector<TouchEvent> touches;
+                    auto flushTouches = [this, &touches, &dropped]() {
+                        if (!touches.empty()) {
+                            if (!mTouchEventSender.sendOnThisThread(touches)) {
+                                ++*dropped;
+                            }
+                            touches.clear();
+                        }
+                    };
+
+                    for (const auto& event : events) {
+                        switch (event.type_case()) {
+                            case InputEvent::kTouchEvent:
+                                touches.push_back(event.touch_event());
+                                break;
+                            case InputEvent::kKeyEvent:
+                                flushTouches();
+                                mKeyEventSender.sendOnThisThread(
+                                        &event.key_event());
+                                break;
+                            case InputEvent::kMouseEvent: {
+                                flushTouches();
+                                const auto& mouse = event.mouse_event();
+                                agent->sendMouseEvent(mouse.x(), mouse.y(), 0,
+                                                      mouse.buttons(), 0);
+                                break;
+                            }
+                            default:
+                                break;
+                        }
+                    }
+                    flushTouches();
+                });
+    }
+
     const AndroidConsoleAgents* mAgents;
     keyboard::EmulatorKeyEventSender mKeyEventSender;
     TouchEventSender mTouchEventSender;
@@ -779,9 +1066,15 @@ private:
     Looper* mLooper;
     RingStreambuf
             mLogcatBuffer;  // A ring buffer that tracks the logcat output.
+    LogcatCache mLogcatCache;  // Parsed entries shared by all logcat readers.
 
     static constexpr uint32_t k128KB = (128 * 1024) - 1;
+    // About a second of 48kHz stereo audio.
+    static constexpr uint32_t kAudioRingCapacity = 256 * 1024;
+    static constexpr uint32_t kDefaultAudioBitrate = 64000;
     static constexpr uint16_t k5SecondsWait = 5 * 1000;
+    // Upper bound of parsed entries in a single streamed message.
+    static constexpr size_t kMaxStreamedEntries = 1024;
     const uint16_t kNoWait = 0;
 };
 
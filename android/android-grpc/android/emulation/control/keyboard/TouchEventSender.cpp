@@ -46,6 +46,19 @@ bool TouchEventSender::sendOnThisThread(const TouchEvent* request) {
     return true;
 }
 
+bool TouchEventSender::sendOnThisThread(
+        const std::vector<TouchEvent>& requests) {
+    std::vector<SkinGenericEventCode> events;
+    for (const auto& request : requests) {
+        appendEvents(request, &events);
+    }
+    if (events.empty()) {
+        return true;
+    }
+    return mAgents->user_event->sendGenericEvents(events.data(),
+                                                  events.size()) == 0;
+}
+
 // Scales an axis to the proper EVDEV value..
 static int scaleAxis(int value,
                      int min_in,
@@ -62,7 +75,13 @@ static int scaleAxis(int value,
 }
 
 void TouchEventSender::doSend(const TouchEvent request) {
+    std::vector<SkinGenericEventCode> events;
+    appendEvents(request, &events);
+    mAgents->user_event->sendGenericEvents(events.data(), events.size());
+}
 
+void TouchEventSender::appendEvents(const TouchEvent& request,
+                                    std::vector<SkinGenericEventCode>* out) {
     // Obtain display width, height for the given display id.
     auto displayId = request.device();
     uint32_t w = 0;
@@ -73,7 +92,7 @@ void TouchEventSender::doSend(const TouchEvent request) {
     }
 
     // Sends a sequence of touch events to the linux kernel using "Protocol B"
-    std::vector<SkinGenericEventCode> events;
+    std::vector<SkinGenericEventCode>& events = *out;
 
     for (auto touch : request.touches()) {
         int slot = touch.identifier();
@@ -118,9 +137,8 @@ void TouchEventSender::doSend(const TouchEvent request) {
         }
     }
 
-    // Submit the events to kernel.
+    // Terminate the frame for the kernel.
     events.push_back({EV_SYN, LINUX_SYN_REPORT, 0, displayId});
-    mAgents->user_event->sendGenericEvents(events.data(), events.size());
 }
 }  // namespace control
 }  // namespace emulation
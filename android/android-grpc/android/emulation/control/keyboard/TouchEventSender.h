@@ -1,7 +1,9 @@
 
 #include <unordered_set>      // for unordered_set
+#include <vector>             // for vector
 
 #include "android/console.h"  // for AndroidConsoleAgents
+#include "android/skin/generic-event-buffer.h"  // for SkinGenericEventCode
 
 namespace android {
 namespace base {
@@ -22,8 +24,15 @@ public:
     bool send(const TouchEvent* request);
     bool sendOnThisThread(const TouchEvent* request);
 
+    // Sends all |requests| on the current thread as a single batch of
+    // input events, each TouchEvent being terminated by a SYN_REPORT.
+    // Returns false if the device dropped some of them.
+    bool sendOnThisThread(const std::vector<TouchEvent>& requests);
+
 private:
     void doSend(const TouchEvent touch);
+    void appendEvents(const TouchEvent& request,
+                      std::vector<SkinGenericEventCode>* out);
 
     const AndroidConsoleAgents* const mAgents;
     std::unordered_set<int> mUsedSlots;
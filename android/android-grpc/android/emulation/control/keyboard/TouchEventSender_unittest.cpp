@@ -0,0 +1,135 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/emulation/control/keyboard/TouchEventSender.h"
+
+#include <gtest/gtest.h>  // for Message, TestPartResult, EXPECT_EQ
+#include <vector>         // for vector
+
+#include "android/hw-events.h"             // for EV_ABS, EV_SYN
+#include "android/skin/linux_keycodes.h"   // for LINUX_ABS_MT_SLOT, LINUX_...
+#include "emulator_controller.pb.h"        // for TouchEvent, Touch
+
+namespace android {
+namespace emulation {
+namespace control {
+
+static std::vector<std::vector<SkinGenericEventCode>> sBatches;
+static int sQueueRoom = 0;
+
+// Pretends to be a device queue with room for |sQueueRoom| events, that
+// queues whole frames only, like goldfish_events does.
+static int fake_send_generic_events(SkinGenericEventCode* events, int count) {
+    sBatches.emplace_back(events, events + count);
+    int dropped = 0;
+    int frameLen = 0;
+    for (int i = 0; i < count; i++) {
+        frameLen++;
+        if (events[i].type != EV_SYN || events[i].code != LINUX_SYN_REPORT) {
+            continue;
+        }
+        if (frameLen > sQueueRoom) {
+            dropped += frameLen;
+        } else {
+            sQueueRoom -= frameLen;
+        }
+        frameLen = 0;
+    }
+    return dropped;
+}
+
+static bool fake_get_multi_display(uint32_t id,
+                                   int32_t* x,
+                                   int32_t* y,
+                                   uint32_t* w,
+                                   uint32_t* h,
+                                   uint32_t* dpi,
+                                   uint32_t* flag,
+                                   bool* enabled) {
+    *w = 1000;
+    *h = 2000;
+    return true;
+}
+
+class TouchEventSenderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        sBatches.clear();
+        sQueueRoom = 1 << 20;
+        mUserEvent.sendGenericEvents = fake_send_generic_events;
+        mWindow.getMultiDisplay = fake_get_multi_display;
+        mAgents.user_event = &mUserEvent;
+        mAgents.emu = &mWindow;
+    }
+
+    static TouchEvent touchAt(int id, int x, int y, int pressure) {
+        TouchEvent event;
+        auto touch = event.add_touches();
+        touch->set_identifier(id);
+        touch->set_x(x);
+        touch->set_y(y);
+        touch->set_pressure(pressure);
+        return event;
+    }
+
+    QAndroidUserEventAgent mUserEvent = {};
+    QAndroidEmulatorWindowAgent mWindow = {};
+    AndroidConsoleAgents mAgents = {};
+};
+
+TEST_F(TouchEventSenderTest, batch_keeps_frames_in_order) {
+    TouchEventSender sender(&mAgents);
+    std::vector<TouchEvent> touches;
+    for (int i = 0; i < 100; i++) {
+        touches.push_back(touchAt(1, i * 10, i * 20, 10));
+    }
+    EXPECT_TRUE(sender.sendOnThisThread(touches));
+
+    // A single batch, in which each TouchEvent makes a frame terminated by a
+    // SYN_REPORT, in the order they were given.
+    ASSERT_EQ(1u, sBatches.size());
+    int frame = 0;
+    int lastX = -1;
+    for (const auto& event : sBatches[0]) {
+        if (event.type == EV_ABS && event.code == LINUX_ABS_MT_POSITION_X) {
+            EXPECT_GT(event.value, lastX);
+            lastX = event.value;
+        }
+        if (event.type == EV_SYN && event.code == LINUX_SYN_REPORT) {
+            frame++;
+        }
+    }
+    EXPECT_EQ(100, frame);
+    EXPECT_EQ(EV_SYN, sBatches[0].back().type);
+}
+
+TEST_F(TouchEventSenderTest, reports_dropped_events) {
+    TouchEventSender sender(&mAgents);
+    std::vector<TouchEvent> touches;
+    for (int i = 0; i < 10; i++) {
+        touches.push_back(touchAt(1, i, i, 10));
+    }
+
+    // Room for only a few frames, the rest must be reported.
+    sQueueRoom = 12;
+    EXPECT_FALSE(sender.sendOnThisThread(touches));
+
+    sQueueRoom = 1 << 20;
+    EXPECT_TRUE(sender.sendOnThisThread(touches));
+    EXPECT_EQ(2u, sBatches.size());
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,125 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "android/emulation/control/logcat/LogcatCache.h"
+
+#include <algorithm>  // for max, upper_bound
+#include <iterator>   // for prev
+#include <utility>    // for pair
+
+#include "android/emulation/control/logcat/LogcatParser.h"   // for LogcatP...
+#include "android/emulation/control/logcat/RingStreambuf.h"  // for RingStr...
+
+namespace android {
+namespace emulation {
+namespace control {
+
+using base::AutoLock;
+using base::System;
+
+LogcatCache::LogcatCache(RingStreambuf* source, int64_t windowBytes)
+    : mSource(source), mWindowBytes(windowBytes) {}
+
+LogcatCache::Entries LogcatCache::entriesAtOffset(int64_t offset,
+                                                  System::Duration timeoutMs,
+                                                  size_t maxEntries) {
+    const System::Duration deadlineUs =
+            System::get()->getUnixTimeUs() + timeoutMs * 1000;
+    AutoLock lock(mLock);
+    while (true) {
+        if (!mRefreshing) {
+            // Pick up whatever was logged since the last refresh. Only block
+            // in the ring buffer if there is nothing for this reader yet.
+            System::Duration waitMs = 0;
+            const System::Duration now = System::get()->getUnixTimeUs();
+            if (offset >= mParsedUntil && now < deadlineUs) {
+                waitMs = (deadlineUs - now + 999) / 1000;
+            }
+            const int64_t from = mSeenUntil;
+            mRefreshing = true;
+            lock.unlock();
+            auto message = mSource->bufferAtOffset(from, waitMs);
+            lock.lock();
+            mRefreshing = false;
+            appendLocked(message.first, message.second);
+            mRefreshed.broadcast();
+        } else if (offset >= mParsedUntil) {
+            mRefreshed.timedWait(&mLock, deadlineUs);
+        }
+
+        if (offset < mParsedUntil ||
+            System::get()->getUnixTimeUs() >= deadlineUs) {
+            break;
+        }
+    }
+    return collectLocked(offset, maxEntries);
+}
+
+void LogcatCache::appendLocked(int64_t start, const std::string& data) {
+    if (data.empty()) {
+        return;
+    }
+
+    if (start > mSeenUntil) {
+        // The ring buffer wrapped before we got to it, whatever was pending
+        // is not going to be completed.
+        mPending.clear();
+        if (mEntries.empty()) {
+            mWindowStart = start;
+        }
+    }
+    mPending.append(data);
+    mSeenUntil = start + data.size();
+
+    const int64_t base = mSeenUntil - mPending.size();
+    int consumed = LogcatParser::parseLines(
+            mPending, [this, base](int end, const LogcatEntry& entry) {
+                mEntries.push_back(
+                        {base + end, std::make_shared<const LogcatEntry>(entry)});
+            });
+    mPending.erase(0, consumed);
+    mParsedUntil = base + consumed;
+
+    while (!mEntries.empty() &&
+           mParsedUntil - mWindowStart > mWindowBytes) {
+        mWindowStart = mEntries.front().end;
+        mEntries.pop_front();
+    }
+}
+
+LogcatCache::Entries LogcatCache::collectLocked(int64_t offset,
+                                                size_t maxEntries) const {
+    Entries result;
+    result.start = std::max(offset, mWindowStart);
+    result.dropped = result.start - offset;
+    result.next = std::max(result.start, mParsedUntil);
+
+    auto first = std::upper_bound(
+            mEntries.begin(), mEntries.end(), result.start,
+            [](int64_t value, const CachedEntry& entry) {
+                return value < entry.end;
+            });
+    for (auto it = first; it != mEntries.end(); ++it) {
+        if (result.entries.size() == maxEntries) {
+            // Resume right after the last entry we are handing out.
+            result.next = it == first ? result.start : std::prev(it)->end;
+            break;
+        }
+        result.entries.push_back(it->entry);
+    }
+    return result;
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
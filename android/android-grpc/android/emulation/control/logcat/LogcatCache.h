@@ -0,0 +1,92 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+#include <stddef.h>                                          // for size_t
+#include <stdint.h>                                          // for int64_t
+#include <deque>                                             // for deque
+#include <limits>                                            // for numeric_...
+#include <memory>                                            // for shared_ptr
+#include <string>                                            // for string
+#include <vector>                                            // for vector
+
+#include "android/base/synchronization/ConditionVariable.h"  // for Conditio...
+#include "android/base/synchronization/Lock.h"               // for Lock
+#include "android/base/system/System.h"                      // for System
+#include "emulator_controller.pb.h"                          // for LogcatEntry
+
+namespace android {
+namespace emulation {
+namespace control {
+
+class RingStreambuf;
+
+// LogcatCache - parses the logcat output in a RingStreambuf once, and shares
+// the parsed entries among any number of readers.
+//
+// Every reader keeps its own cursor, which is a byte offset in the logcat
+// stream, exactly like the offsets used by RingStreambuf::bufferAtOffset.
+// The cache retains the entries of (about) the last |windowBytes| of output,
+// readers that fall further behind than that will skip the evicted entries,
+// and are told how many bytes they missed.
+//
+// Only one reader at a time pulls new data out of the ring buffer, the others
+// wait until it has published the freshly parsed entries.
+class LogcatCache {
+public:
+    using EntryPtr = std::shared_ptr<const LogcatEntry>;
+
+    struct Entries {
+        int64_t start = 0;    // Offset of the first byte covered by |entries|
+        int64_t next = 0;     // Offset to use for the next read.
+        int64_t dropped = 0;  // Bytes that were evicted before they were read.
+        std::vector<EntryPtr> entries;
+    };
+
+    static constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+    // |source| must outlive the cache.
+    LogcatCache(RingStreambuf* source, int64_t windowBytes);
+
+    // Returns at most |maxEntries| entries that were logged at, or after,
+    // |offset|. Blocks at most |timeoutMs| if no new output is available.
+    Entries entriesAtOffset(int64_t offset,
+                            base::System::Duration timeoutMs = 0,
+                            size_t maxEntries = kUnlimited);
+
+private:
+    struct CachedEntry {
+        int64_t end;  // Offset right after the line of this entry.
+        EntryPtr entry;
+    };
+
+    void appendLocked(int64_t start, const std::string& data);
+    Entries collectLocked(int64_t offset, size_t maxEntries) const;
+
+    RingStreambuf* const mSource;
+    const int64_t mWindowBytes;
+
+    std::deque<CachedEntry> mEntries;
+    std::string mPending;         // Incomplete last line.
+    int64_t mWindowStart{0};      // Oldest offset still covered by the cache.
+    int64_t mParsedUntil{0};      // Everything before this offset is parsed.
+    int64_t mSeenUntil{0};        // Offset of the next byte to fetch.
+    bool mRefreshing{false};      // A reader is fetching from |mSource|.
+
+    base::Lock mLock;
+    base::ConditionVariable mRefreshed;
+};
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,161 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/emulation/control/logcat/LogcatCache.h"
+
+#include <gtest/gtest.h>  // for Test, Message, TestP...
+#include <memory>         // for unique_ptr
+#include <ostream>        // for ostream
+#include <string>         // for string
+#include <vector>         // for vector
+
+#include "android/base/threads/FunctorThread.h"              // for FunctorThread
+#include "android/emulation/control/logcat/RingStreambuf.h"  // for RingStr...
+
+namespace android {
+namespace emulation {
+namespace control {
+
+using base::FunctorThread;
+
+static std::string logLine(int pid) {
+    return "10-11 22:27:43.043  " + std::to_string(pid) +
+           "  2414 W ErrorReporter: reportError\n";
+}
+
+TEST(LogcatCache, parsesEntries) {
+    RingStreambuf buf(1024);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, 1024);
+    stream << logLine(1) << logLine(2);
+
+    auto res = cache.entriesAtOffset(0);
+    EXPECT_EQ(0, res.start);
+    EXPECT_EQ(0, res.dropped);
+    EXPECT_EQ(2 * logLine(1).size(), res.next);
+    ASSERT_EQ(2, res.entries.size());
+    EXPECT_EQ(1, res.entries[0]->pid());
+    EXPECT_EQ(2, res.entries[1]->pid());
+}
+
+TEST(LogcatCache, readersShareEntries) {
+    RingStreambuf buf(1024);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, 1024);
+    stream << logLine(1);
+
+    auto first = cache.entriesAtOffset(0);
+    auto second = cache.entriesAtOffset(0);
+    ASSERT_EQ(1, first.entries.size());
+    ASSERT_EQ(1, second.entries.size());
+    // Parsed once, handed out twice.
+    EXPECT_EQ(first.entries[0].get(), second.entries[0].get());
+}
+
+TEST(LogcatCache, readersHaveTheirOwnCursor) {
+    RingStreambuf buf(1024);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, 1024);
+    stream << logLine(1);
+    auto res = cache.entriesAtOffset(0);
+    stream << logLine(2);
+
+    auto fresh = cache.entriesAtOffset(res.next);
+    ASSERT_EQ(1, fresh.entries.size());
+    EXPECT_EQ(2, fresh.entries[0]->pid());
+
+    auto all = cache.entriesAtOffset(0);
+    EXPECT_EQ(2, all.entries.size());
+}
+
+TEST(LogcatCache, waitsForCompleteLines) {
+    RingStreambuf buf(1024);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, 1024);
+    std::string line = logLine(1);
+    stream << line.substr(0, 10);
+
+    auto res = cache.entriesAtOffset(0);
+    EXPECT_EQ(0, res.next);
+    EXPECT_TRUE(res.entries.empty());
+
+    stream << line.substr(10);
+    res = cache.entriesAtOffset(0);
+    EXPECT_EQ(line.size(), res.next);
+    ASSERT_EQ(1, res.entries.size());
+}
+
+TEST(LogcatCache, limitsEntries) {
+    RingStreambuf buf(1024);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, 1024);
+    stream << logLine(1) << logLine(2) << logLine(3);
+
+    auto res = cache.entriesAtOffset(0, 0, 2);
+    ASSERT_EQ(2, res.entries.size());
+    EXPECT_EQ(2 * logLine(1).size(), res.next);
+
+    res = cache.entriesAtOffset(res.next, 0, 2);
+    ASSERT_EQ(1, res.entries.size());
+    EXPECT_EQ(3, res.entries[0]->pid());
+}
+
+TEST(LogcatCache, slowReaderDrops) {
+    const int64_t lineSize = logLine(1).size();
+    RingStreambuf buf(lineSize * 8);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, lineSize * 2);
+    for (int i = 0; i < 5; i++) {
+        stream << logLine(i);
+    }
+
+    auto res = cache.entriesAtOffset(0);
+    EXPECT_EQ(lineSize * 3, res.start);
+    EXPECT_EQ(lineSize * 3, res.dropped);
+    EXPECT_EQ(lineSize * 5, res.next);
+    ASSERT_EQ(2, res.entries.size());
+    EXPECT_EQ(3, res.entries[0]->pid());
+}
+
+TEST(LogcatCache, blockedReadersWakeUp) {
+    RingStreambuf buf(1024);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, 1024);
+
+    static constexpr int kReaders = 4;
+    std::vector<LogcatCache::Entries> results(kReaders);
+    std::vector<std::unique_ptr<FunctorThread>> readers;
+    for (int i = 0; i < kReaders; i++) {
+        readers.emplace_back(new FunctorThread([&cache, &results, i]() {
+            // Keep reading until we see the entry, or give up after a while.
+            for (int tries = 0; tries < 10 && results[i].entries.empty();
+                 tries++) {
+                results[i] = cache.entriesAtOffset(0, 1000);
+            }
+            return 0;
+        }));
+        readers.back()->start();
+    }
+
+    stream << logLine(1);
+    for (int i = 0; i < kReaders; i++) {
+        readers[i]->wait();
+        ASSERT_EQ(1, results[i].entries.size());
+        EXPECT_EQ(1, results[i].entries[0]->pid());
+    }
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -71,6 +71,15 @@ static uint64_t parseTimeToEpochMs(std::string timestr) {
 
 std::pair<int, std::vector<LogcatEntry>> LogcatParser::parseLines(
         const std::string lines) {
+    std::vector<LogcatEntry> result;
+    int skip = parseLines(lines, [&result](int, const LogcatEntry& entry) {
+        result.push_back(entry);
+    });
+    return std::make_pair(skip, result);
+}
+
+int LogcatParser::parseLines(const std::string& lines,
+                             const EntryCallback& onEntry) {
     static const std::regex logline(
             // timestamp[1]
             "^(\\d{2}-\\d{2} \\d{2}:\\d{2}:\\d{2}.\\d{3})"
@@ -79,10 +88,8 @@ std::pair<int, std::vector<LogcatEntry>> LogcatParser::parseLines(
             // tag and message [5-6]
             "(.+?)\\s*: (.*)$");
 
-    int skip = 0;
     auto start = lines.begin();
     auto end = lines.begin();
-    std::vector<LogcatEntry> result;
     while (end != lines.end()) {
         if (*end == '\n') {
             std::smatch m;
@@ -94,7 +101,7 @@ std::pair<int, std::vector<LogcatEntry>> LogcatParser::parseLines(
                 entry.set_level(parseLevel(m[4]));
                 entry.set_tag(m[5]);
                 entry.set_msg(m[6]);
-                result.push_back(entry);
+                onEntry(end + 1 - lines.begin(), entry);
             }
             start = ++end;
         } else {
@@ -102,8 +109,7 @@ std::pair<int, std::vector<LogcatEntry>> LogcatParser::parseLines(
         }
     }
 
-    skip += (end - lines.begin()) - (end - start);
-    return std::make_pair(skip, result);
+    return start - lines.begin();
 }
 
 }  // namespace control
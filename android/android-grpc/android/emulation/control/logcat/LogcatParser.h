@@ -11,6 +11,7 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <functional>
 #include <utility>
 #include <string>
 #include <vector>
@@ -24,6 +25,15 @@ class LogcatParser {
 public:
     static std::pair<int, std::vector<LogcatEntry>> parseLines(
             const std::string lines);
+
+    // Called for every parsed entry, with the offset in |lines| right after
+    // the line the entry was parsed from.
+    using EntryCallback = std::function<void(int, const LogcatEntry&)>;
+
+    // Parses all the complete lines and returns the number of consumed
+    // characters, invoking |onEntry| for each line that is a logcat entry.
+    static int parseLines(const std::string& lines,
+                          const EntryCallback& onEntry);
 };
 
 }  // namespace control
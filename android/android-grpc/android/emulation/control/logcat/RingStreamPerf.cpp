@@ -18,10 +18,15 @@
 #include <iostream>                                          // for operator<<
 #include <string>                                            // for string
 #include <utility>                                           // for pair
+#include <vector>                                            // for vector
 
+#include "android/emulation/control/logcat/LogcatCache.h"    // for LogcatCache
+#include "android/emulation/control/logcat/LogcatParser.h"   // for LogcatP...
 #include "android/emulation/control/logcat/RingStreambuf.h"  // for RingStre...
 #include "benchmark/benchmark_api.h"                         // for State
 
+using android::emulation::control::LogcatCache;
+using android::emulation::control::LogcatParser;
 using android::emulation::control::RingStreambuf;
 
 #define BASIC_BENCHMARK_TEST(x) \
@@ -68,6 +73,73 @@ void BM_WriteLogcatScenario(benchmark::State& state) {
     }
 }
 
+// A chunk of |size| bytes worth of logcat lines.
+static std::string logcatLines(size_t size) {
+    static const std::string line =
+            "10-11 22:27:43.043  2233  2414 W ErrorReporter: reportError "
+            "[type: 211, code: 524300]: Error reading from input stream\n";
+    std::string lines;
+    while (lines.size() + line.size() <= size) {
+        lines += line;
+    }
+    return lines;
+}
+
+// Number of readers following the same logcat output.
+#define FANOUT_BENCHMARK_TEST(x) BENCHMARK(x)->Arg(1)->Arg(4)->Arg(16)
+
+void BM_FanOutText(benchmark::State& state) {
+    // Every reader gets the raw text, at its own offset.
+    std::string src = logcatLines(4096);
+    RingStreambuf buf(128 * 1024);
+    std::ostream stream(&buf);
+    std::vector<int64_t> offsets(state.range_x(), 0);
+
+    while (state.KeepRunning()) {
+        stream << src;
+        for (auto& offset : offsets) {
+            auto message = buf.bufferAtOffset(offset, 0);
+            offset = message.first + message.second.size();
+        }
+    }
+}
+
+void BM_FanOutParsedPerReader(benchmark::State& state) {
+    // What we used to do: every reader parses the output on its own.
+    std::string src = logcatLines(4096);
+    RingStreambuf buf(128 * 1024);
+    std::ostream stream(&buf);
+    std::vector<int64_t> offsets(state.range_x(), 0);
+
+    while (state.KeepRunning()) {
+        stream << src;
+        for (auto& offset : offsets) {
+            auto message = buf.bufferAtOffset(offset, 0);
+            auto parsed = LogcatParser::parseLines(message.second);
+            offset = message.first + parsed.first;
+        }
+    }
+}
+
+void BM_FanOutParsedShared(benchmark::State& state) {
+    // Readers share the entries parsed by the cache.
+    std::string src = logcatLines(4096);
+    RingStreambuf buf(128 * 1024);
+    std::ostream stream(&buf);
+    LogcatCache cache(&buf, 128 * 1024);
+    std::vector<int64_t> offsets(state.range_x(), 0);
+
+    while (state.KeepRunning()) {
+        stream << src;
+        for (auto& offset : offsets) {
+            offset = cache.entriesAtOffset(offset).next;
+        }
+    }
+}
+
 BASIC_BENCHMARK_TEST(BM_WriteData);
 BASIC_BENCHMARK_TEST(BM_WriteAndRead);
 BASIC_BENCHMARK_TEST(BM_WriteLogcatScenario);
+FANOUT_BENCHMARK_TEST(BM_FanOutText);
+FANOUT_BENCHMARK_TEST(BM_FanOutParsedPerReader);
+FANOUT_BENCHMARK_TEST(BM_FanOutParsedShared);
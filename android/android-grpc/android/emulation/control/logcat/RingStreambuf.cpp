@@ -45,7 +45,7 @@ std::streamsize RingStreambuf::xsputn(const char* s, std::streamsize n) {
         mHead = capacity;
         mTail = 0;
         mHeadOffset += n;
-        mCanRead.signal();
+        mCanRead.broadcast();
         return n;
     }
 
@@ -80,7 +80,7 @@ std::streamsize RingStreambuf::xsputn(const char* s, std::streamsize n) {
     if (updateTail)
         mTail = (mHead + 1) & (capacity - 1);
     mHeadOffset += n;
-    mCanRead.signal();
+    mCanRead.broadcast();
     return n;
 }
 
@@ -138,9 +138,9 @@ std::pair<int, std::string> RingStreambuf::bufferAtOffset(
         System::Duration timeoutMs) {
     AutoLock lock(mLock);
     std::string res;
+    const System::Duration waitUntilUs =
+            System::get()->getUnixTimeUs() + timeoutMs * 1000;
     while (offset >= mHeadOffset && timeoutMs > 0) {
-        System::Duration waitUntilUs =
-                System::get()->getUnixTimeUs() + timeoutMs * 1000;
         if (!mCanRead.timedWait(&mLock, waitUntilUs)) {
             return std::make_pair(mHeadOffset, res);
         }
@@ -154,7 +154,7 @@ std::pair<int, std::string> RingStreambuf::bufferAtOffset(
 
 
     // Let's find the starting point where we should be reading.
-    uint16_t read = (mTail + skip) & (capacity - 1);
+    uint32_t read = (mTail + skip) & (capacity - 1);
 
     // We are looking for an offset that is in the future...
     // Return the current start offset, without anything
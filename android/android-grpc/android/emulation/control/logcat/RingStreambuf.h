@@ -58,7 +58,9 @@ public:
     // It will block at most timeoutMs.
     // Returns the available data, and the offset at which
     // the first character was retrieved.
-    // This call will not modify any read pointers.
+    // This call will not modify any read pointers, so any number of readers
+    // can wait on the same buffer, each with their own offset. All of them
+    // are woken up when new data arrives.
     std::pair<int, std::string> bufferAtOffset(std::streamsize offset,
                                                System::Duration timeoutMs = 0);
 
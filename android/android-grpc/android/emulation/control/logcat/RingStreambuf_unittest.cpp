@@ -132,6 +132,17 @@ TEST(RingStreambuf, stream_not_yet_available_no_block_gives_proper_distance) {
     EXPECT_STREQ("", res.second.c_str());
 }
 
+TEST(RingStreambuf, stream_offset_in_large_ring) {
+    // Ring indices must not be truncated for buffers above 64KB.
+    RingStreambuf buf(128 * 1024);
+    std::ostream stream(&buf);
+    stream << std::string(70 * 1024, 'a');
+    stream << "bbbb";
+    auto res = buf.bufferAtOffset(70 * 1024);
+    EXPECT_EQ(res.first, 70 * 1024);
+    EXPECT_STREQ("bbbb", res.second.c_str());
+}
+
 TEST(RingStreambuf, stream_offset_blocks_until_available) {
     RingStreambuf buf(4);
     std::ostream stream(&buf);
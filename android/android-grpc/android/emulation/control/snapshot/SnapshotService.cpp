@@ -310,10 +310,12 @@ public:
         bool snapshot_success = false;
 
         android::base::ThreadLooper::runOnMainLooperAndWaitForCompletion(
-                [&snapshot_success, &slc, &snapshot]() {
+                [&snapshot_success, &slc, &snapshot, reply]() {
                     snapshot_success = gQAndroidVmOperations->snapshotLoad(
                             snapshot->name().data(), slc.opaque(),
                             LineConsumer::Callback);
+                    fillProfile(snapshot::Snapshotter::Operation::Load,
+                                snapshot->name(), reply);
                 });
         if (!snapshot_success) {
             slc.error();
@@ -342,10 +344,12 @@ public:
         SnapshotLineConsumer slc(reply);
         bool snapshot_success = false;
         android::base::ThreadLooper::runOnMainLooperAndWaitForCompletion(
-                [&snapshot_success, &slc, &request]() {
+                [&snapshot_success, &slc, &request, reply]() {
                     snapshot_success = gQAndroidVmOperations->snapshotSave(
                             request->snapshot_id().c_str(), slc.opaque(),
                             LineConsumer::Callback);
+                    fillProfile(snapshot::Snapshotter::Operation::Save,
+                                request->snapshot_id(), reply);
                 });
         if (!snapshot_success) {
             slc.error();
@@ -398,6 +402,36 @@ public:
     }
 
 private:
+    // Copies the profile of the operation on |name| that just completed, if
+    // it got far enough to be profiled. Must run on the main looper.
+    static void fillProfile(snapshot::Snapshotter::Operation op,
+                            StringView name,
+                            SnapshotPackage* reply) {
+        auto profile = snapshot::Snapshotter::get().lastProfile(op);
+        if (!profile || profile->snapshot() != name) {
+            return;
+        }
+        auto out = reply->mutable_profile();
+        out->set_operation(profile->operation());
+        out->set_succeeded(profile->succeeded());
+        out->set_duration_us(profile->durationUs());
+        out->set_cpu_ms(profile->cpuMs());
+        out->set_budget_ms(profile->budgetMs());
+        out->set_over_budget(profile->overBudget());
+        for (const auto& phase : profile->phases()) {
+            auto outPhase = out->add_phases();
+            outPhase->set_name(phase.name);
+            outPhase->set_depth(phase.depth);
+            outPhase->set_start_us(phase.startUs);
+            outPhase->set_wall_us(phase.wallUs);
+            outPhase->set_cpu_ms(phase.cpuMs);
+            for (const auto& counter : phase.counters) {
+                (*outPhase->mutable_counters())[counter.first] =
+                        counter.second;
+            }
+        }
+    }
+
     static constexpr uint32_t k256KB = 256 * 1024;
     static constexpr uint32_t k64KB = 64 * 1024;
 };  // namespace control
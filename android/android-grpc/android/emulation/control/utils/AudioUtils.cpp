@@ -42,6 +42,17 @@ int AudioUtils::getChannels(const AudioFormat& fmt) {
     }
 }
 
+AVCodecID AudioUtils::getCodecId(const AudioFormat& fmt) {
+    switch (fmt.codec()) {
+        case AudioFormat::OPUS:
+            return AV_CODEC_ID_OPUS;
+        case AudioFormat::VORBIS:
+            return AV_CODEC_ID_VORBIS;
+        default:
+            return AV_CODEC_ID_NONE;
+    }
+}
+
 }  // namespace control
 }  // namespace emulation
 }  // namespace android
@@ -15,6 +15,10 @@
 
 #include "android/recording/Frame.h"  // for AudioFormat
 
+extern "C" {
+#include <libavcodec/avcodec.h>       // for AVCodecID
+}
+
 namespace android {
 namespace emulation {
 namespace control {
@@ -28,6 +32,10 @@ public:
 
     // Extracts the number of channels from the enum for usage with qemu.
     static int getChannels(const AudioFormat& fmt);
+
+    // The ffmpeg encoder to use for the requested codec, AV_CODEC_ID_NONE
+    // for raw samples.
+    static AVCodecID getCodecId(const AudioFormat& fmt);
 };
 
 }  // namespace control
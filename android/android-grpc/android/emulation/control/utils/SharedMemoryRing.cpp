@@ -0,0 +1,108 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "android/emulation/control/utils/SharedMemoryRing.h"
+
+#include <string.h>     // for memcpy
+#include <algorithm>    // for min
+#include <new>          // for operator new
+
+namespace android {
+namespace emulation {
+namespace control {
+
+SharedMemoryRing::SharedMemoryRing(const std::string& handle,
+                                   uint32_t capacity)
+    : mCapacity(capacity), mMemory(handle, regionSize(capacity)) {}
+
+SharedMemoryRing::~SharedMemoryRing() {
+    mMemory.close();
+}
+
+// static
+size_t SharedMemoryRing::regionSize(uint32_t capacity) {
+    return sizeof(SharedMemoryRingHeader) + capacity;
+}
+
+int SharedMemoryRing::create() {
+    const mode_t userReadWrite = 0600;
+    int err = mMemory.create(userReadWrite);
+    if (err != 0) {
+        return err;
+    }
+
+    mHeader = new (*mMemory) SharedMemoryRingHeader();
+    mHeader->magic = kMagic;
+    mHeader->capacity = mCapacity;
+    mHeader->written.store(0, std::memory_order_relaxed);
+    mHeader->reserved.store(0, std::memory_order_relaxed);
+    mData = static_cast<uint8_t*>(*mMemory) + sizeof(SharedMemoryRingHeader);
+    return 0;
+}
+
+bool SharedMemoryRing::write(const void* data,
+                             size_t size,
+                             uint64_t* offset) {
+    if (!mHeader || size > mCapacity) {
+        return false;
+    }
+    const uint64_t start = mHeader->written.load(std::memory_order_relaxed);
+    auto src = static_cast<const uint8_t*>(data);
+
+    // Let the readers know we are about to overwrite this range, before
+    // touching it.
+    mHeader->reserved.store(start + size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const size_t pos = start % mCapacity;
+    const size_t untilTheEnd = std::min<size_t>(size, mCapacity - pos);
+    memcpy(mData + pos, src, untilTheEnd);
+    memcpy(mData, src + untilTheEnd, size - untilTheEnd);
+
+    mHeader->written.store(start + size, std::memory_order_release);
+    *offset = start;
+    return true;
+}
+
+// static
+bool SharedMemoryRing::read(const void* region,
+                            uint64_t offset,
+                            size_t size,
+                            std::string* out) {
+    auto header = static_cast<const SharedMemoryRingHeader*>(region);
+    if (header->magic != kMagic || size > header->capacity) {
+        return false;
+    }
+
+    const uint64_t capacity = header->capacity;
+    const uint64_t written = header->written.load(std::memory_order_acquire);
+    if (offset + size > written || written - offset > capacity) {
+        return false;
+    }
+
+    auto data = reinterpret_cast<const uint8_t*>(header + 1);
+    const size_t pos = offset % capacity;
+    const size_t untilTheEnd = std::min<size_t>(size, capacity - pos);
+    out->resize(size);
+    memcpy(&(*out)[0], data + pos, untilTheEnd);
+    memcpy(&(*out)[untilTheEnd], data, size - untilTheEnd);
+
+    // Make sure the writer did not start overwriting what we just copied.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t reserved = header->reserved.load(std::memory_order_relaxed);
+    return reserved - offset <= capacity;
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,94 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stddef.h>                            // for size_t
+#include <stdint.h>                            // for uint32_t, uint64_t
+#include <atomic>                              // for atomic
+#include <string>                              // for string
+
+#include "android/base/memory/SharedMemory.h"  // for SharedMemory
+
+namespace android {
+namespace emulation {
+namespace control {
+
+// The layout of the shared memory region, the data follows right after the
+// header. Both counters only go up, the data of byte |n| of the stream lives
+// at data[n % capacity].
+struct SharedMemoryRingHeader {
+    uint32_t magic;                  // kMagic
+    uint32_t capacity;               // Size of the data area in bytes.
+    std::atomic<uint64_t> written;   // Bytes that are completely written.
+    std::atomic<uint64_t> reserved;  // Bytes the writer is working on.
+};
+
+// A SharedMemoryRing is a single producer ring buffer in a shared memory
+// region, used to hand large amounts of data to a process on the same
+// machine, without copying it into protobuf messages.
+//
+// The writer never blocks, old data is simply overwritten. It reports
+// where every chunk was stored (usually through a gRPC stream), and the
+// reader copies the chunk out of the region. A reader detects that the chunk
+// was overwritten while it was copying it, and drops it:
+//
+//   // Emulator
+//   SharedMemoryRing ring("audio", 64 * 1024);
+//   ring.create();
+//   uint64_t offset;
+//   if (ring.write(data, size, &offset)) { ... }  // Send offset & size over.
+//
+//   // Client
+//   SharedMemory mem("audio", SharedMemoryRing::regionSize(64 * 1024));
+//   mem.open(SharedMemory::AccessMode::READ_ONLY);
+//   std::string chunk;
+//   if (SharedMemoryRing::read(*mem, offset, size, &chunk)) { ... }
+class SharedMemoryRing {
+public:
+    static constexpr uint32_t kMagic = 0x474e5245;  // "ERNG"
+
+    SharedMemoryRing(const std::string& handle, uint32_t capacity);
+    ~SharedMemoryRing();
+
+    // Creates the shared memory region, only the current user can open it.
+    // Returns 0 on success, or an errno value.
+    int create();
+
+    // Appends |size| bytes to the ring and stores the stream offset of the
+    // first byte in |offset|. Returns false, without writing anything, if
+    // the ring wasn't created or can't hold |size| bytes.
+    bool write(const void* data, size_t size, uint64_t* offset);
+
+    uint32_t capacity() const { return mCapacity; }
+
+    // The size of a region that can hold |capacity| bytes of data.
+    static size_t regionSize(uint32_t capacity);
+
+    // Copies |size| bytes written at |offset| out of the |region|. Returns
+    // false if (some of) the bytes were overwritten, or not written yet.
+    static bool read(const void* region,
+                     uint64_t offset,
+                     size_t size,
+                     std::string* out);
+
+private:
+    const uint32_t mCapacity;
+    base::SharedMemory mMemory;
+    SharedMemoryRingHeader* mHeader = nullptr;
+    uint8_t* mData = nullptr;
+};
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,109 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "android/emulation/control/utils/SharedMemoryRing.h"
+
+#include <gtest/gtest.h>  // for Test, Message, TestP...
+#include <string>         // for string
+
+#include "android/base/memory/SharedMemory.h"  // for SharedMemory
+
+namespace android {
+namespace emulation {
+namespace control {
+
+using base::SharedMemory;
+
+class SharedMemoryRingTest : public ::testing::Test {
+protected:
+    static constexpr uint32_t kCapacity = 16;
+
+    void SetUp() override {
+        ASSERT_EQ(0, mRing.create());
+        ASSERT_EQ(0, mReader.open(SharedMemory::AccessMode::READ_ONLY));
+    }
+
+    std::string read(uint64_t offset, size_t size) {
+        std::string out;
+        EXPECT_TRUE(SharedMemoryRing::read(*mReader, offset, size, &out));
+        return out;
+    }
+
+    uint64_t write(const std::string& data) {
+        uint64_t offset = 0;
+        EXPECT_TRUE(mRing.write(data.data(), data.size(), &offset));
+        return offset;
+    }
+
+    bool canRead(uint64_t offset, size_t size) {
+        std::string out;
+        return SharedMemoryRing::read(*mReader, offset, size, &out);
+    }
+
+    const std::string mHandle = "tst_ring_8467321";
+    SharedMemoryRing mRing{mHandle, kCapacity};
+    SharedMemory mReader{mHandle, SharedMemoryRing::regionSize(kCapacity)};
+};
+
+TEST_F(SharedMemoryRingTest, readsWhatWasWritten) {
+    EXPECT_EQ(0, write("hello"));
+    EXPECT_EQ(5, write("world"));
+    EXPECT_EQ("hello", read(0, 5));
+    EXPECT_EQ("world", read(5, 5));
+}
+
+TEST_F(SharedMemoryRingTest, wrapsAround) {
+    write("0123456789");
+    uint64_t offset = write("abcdefghij");
+    EXPECT_EQ("abcdefghij", read(offset, 10));
+}
+
+TEST_F(SharedMemoryRingTest, detectsOverwrittenData) {
+    write("0123456789");
+    write("abcdefghij");
+    EXPECT_FALSE(canRead(0, 10));
+    EXPECT_TRUE(canRead(4, 16));
+}
+
+TEST_F(SharedMemoryRingTest, cannotReadTheFuture) {
+    write("hello");
+    EXPECT_FALSE(canRead(3, 5));
+    EXPECT_FALSE(canRead(0, kCapacity + 1));
+}
+
+TEST_F(SharedMemoryRingTest, fillsTheRing) {
+    write("0123");
+    std::string full = "0123456789abcdef";
+    EXPECT_EQ(4, write(full));
+    EXPECT_EQ(full, read(4, kCapacity));
+}
+
+TEST_F(SharedMemoryRingTest, rejectsWritesLargerThanTheRing) {
+    write("hello");
+    std::string large = "0123456789abcdefghij";
+    uint64_t offset = 0;
+    EXPECT_FALSE(mRing.write(large.data(), large.size(), &offset));
+    // Nothing was overwritten, the stream goes on where it was.
+    EXPECT_EQ("hello", read(0, 5));
+    EXPECT_EQ(5, write("world"));
+}
+
+TEST(SharedMemoryRing, cannotWriteBeforeCreate) {
+    SharedMemoryRing ring("tst_ring_8467322", 16);
+    uint64_t offset;
+    EXPECT_FALSE(ring.write("hello", 5, &offset));
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -24,20 +24,20 @@
 #include "android/base/StringView.h"           // for StringView
 #include "android/base/memory/SharedMemory.h"  // for SharedMemory, StringView
 #include "api/video/i420_buffer.h"             // for I420Buffer
-#include "libyuv/convert.h"                    // for ConvertToI420
-#include "libyuv/rotate.h"                     // for kRotate0
-#include "libyuv/video_common.h"               // for FOURCC_ARGB, FourCC
+#include "libyuv/convert.h"                    // for NV12ToI420, ABGRToI420
+#include "libyuv/planar_functions.h"           // for I420Copy
 
 using android::base::SharedMemory;
 
 namespace emulator {
 namespace webrtc {
 
-static const int kRGB8888BytesPerPixel = 4;
+using android::recording::SharedFrameFormat;
 
 static bool openSharedMemory(SharedMemory& shm, std::string handle) {
     if (!shm.isOpen()) {
-        int err = shm.open(SharedMemory::AccessMode::READ_ONLY);
+        // Read write, frames are handed back through the shared memory.
+        int err = shm.open(SharedMemory::AccessMode::READ_WRITE);
         if (err != 0) {
             RTC_LOG(LERROR) << "Unable to open memory mapped handle: ["
                             << handle << "] due to " << err;
@@ -51,30 +51,30 @@ static bool openSharedMemory(SharedMemory& shm, std::string handle) {
 VideoShareCapturer::VideoShareCapturer(std::string handle)
     : mSharedMemory("", 0) {
     // First read the memory settings.
-    SharedMemory shm(handle, sizeof(VideoInfo));
+    SharedMemory shm(handle, sizeof(SharedFrameRing));
     if (!openSharedMemory(shm, handle)) {
         mName = "bad_" + handle;
         return;
     }
-    memcpy(&mVideoInfo, *shm, sizeof(VideoInfo));
-
-    mPixelBufferSize = getBytesPerFrame(mVideoInfo);
-    mSharedMemory = SharedMemory(handle, mPixelBufferSize + sizeof(VideoInfo));
+    auto ring = SharedFrameRing::attach(*shm, shm.size());
+    if (!ring) {
+        RTC_LOG(LERROR) << "Unexpected frame layout in: [" << handle << "]";
+        mName = "bad_" + handle;
+        return;
+    }
 
+    mSharedMemory = SharedMemory(
+            handle, SharedFrameRing::regionSize(ring->width(), ring->height()));
     if (!openSharedMemory(mSharedMemory, handle)) {
         mName = "bad_" + handle;
         return;
     }
 
     mName = "shm_" + handle;
-    mI420Buffer =
-            ::webrtc::I420Buffer::Create(mVideoInfo.width, mVideoInfo.height);
-    mPixelBuffer = (uint8_t*)*mSharedMemory + sizeof(VideoInfo);
-}
-
-size_t VideoShareCapturer::getBytesPerFrame(
-        const VideoShareCapturer::VideoInfo& capability) {
-    return (capability.width * capability.height * kRGB8888BytesPerPixel);
+    mRing = SharedFrameRing::attach(*mSharedMemory, mSharedMemory.size());
+    mRing->setFormat(SharedFrameFormat::I420);
+    mI420Buffer = ::webrtc::I420Buffer::Create(mRing->width(), mRing->height());
+    ::webrtc::I420Buffer::SetBlack(mI420Buffer.get());
 }
 
 std::string VideoShareCapturer::name() const {
@@ -82,19 +82,51 @@ std::string VideoShareCapturer::name() const {
 }
 
 uint32_t VideoShareCapturer::maxFps() const {
-    return mVideoInfo.fps;
+    return mRing ? mRing->fps() : 0;
 }
 
 bool VideoShareCapturer::isValid() const {
-    return mSharedMemory.isOpen() && mVideoInfo.fps > 0;
+    return mSharedMemory.isOpen() && mRing && mRing->fps() > 0;
 }
 
 int64_t VideoShareCapturer::frameNumber() {
     if (!isValid())
         return 0;
 
-    VideoInfo* info = (VideoInfo*)*mSharedMemory;
-    return info->frameNumber;
+    return mRing->published();
+}
+
+bool VideoShareCapturer::copyFrame(const SharedFrameRing::Slot* slot) {
+    const int width = mRing->width();
+    const int height = mRing->height();
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    const uint8_t* y = mRing->pixels(slot);
+    auto buffer = mI420Buffer.get();
+
+    switch (SharedFrameFormat(slot->format)) {
+        case SharedFrameFormat::I420: {
+            const uint8_t* u = y + width * height;
+            const uint8_t* v = u + chromaWidth * chromaHeight;
+            return libyuv::I420Copy(y, width, u, chromaWidth, v, chromaWidth,
+                                    buffer->MutableDataY(), buffer->StrideY(),
+                                    buffer->MutableDataU(), buffer->StrideU(),
+                                    buffer->MutableDataV(), buffer->StrideV(),
+                                    width, height) == 0;
+        }
+        case SharedFrameFormat::NV12:
+            return libyuv::NV12ToI420(y, width, y + width * height,
+                                      chromaWidth * 2, buffer->MutableDataY(),
+                                      buffer->StrideY(), buffer->MutableDataU(),
+                                      buffer->StrideU(), buffer->MutableDataV(),
+                                      buffer->StrideV(), width, height) == 0;
+        case SharedFrameFormat::RGBA:
+            return libyuv::ABGRToI420(y, width * 4, buffer->MutableDataY(),
+                                      buffer->StrideY(), buffer->MutableDataU(),
+                                      buffer->StrideU(), buffer->MutableDataV(),
+                                      buffer->StrideV(), width, height) == 0;
+    }
+    return false;
 }
 
 absl::optional<::webrtc::VideoFrame> VideoShareCapturer::getVideoFrame() {
@@ -102,18 +134,17 @@ absl::optional<::webrtc::VideoFrame> VideoShareCapturer::getVideoFrame() {
         return {};
     };
 
-    auto converted = libyuv::ConvertToI420(
-            mPixelBuffer, mPixelBufferSize, mI420Buffer.get()->MutableDataY(),
-            mI420Buffer.get()->StrideY(), mI420Buffer.get()->MutableDataU(),
-            mI420Buffer.get()->StrideU(), mI420Buffer.get()->MutableDataV(),
-            mI420Buffer.get()->StrideV(),
-            /*crop_x=*/0,
-            /*crop_y=*/0, mVideoInfo.width, mVideoInfo.height, mVideoInfo.width,
-            mVideoInfo.height, libyuv::kRotate0, libyuv::FourCC::FOURCC_ARGB);
-    if (converted != 0) {
-        RTC_LOG(INFO) << "Bad conversion frame." << frameNumber() << " "
-                      << mVideoInfo.width << "x" << mVideoInfo.height;
-        return {};
+    // Without a new frame the last one is delivered again.
+    if (auto slot = mRing->acquire()) {
+        const bool copied = copyFrame(slot);
+        const uint32_t format = slot->format;
+        mLastFrame = slot->seq;
+        if (!copied) {
+            RTC_LOG(INFO) << "Bad conversion frame." << mLastFrame << " "
+                          << mRing->width() << "x" << mRing->height()
+                          << ", format: " << format;
+            return {};
+        }
     }
 
     return ::webrtc::VideoFrame::Builder()
@@ -21,10 +21,12 @@
 
 #include <string>  // for string
 
-#include "android/base/memory/SharedMemory.h"       // for SharedMemory
-#include "emulator/webrtc/capture/VideoCapturer.h"  // for VideoCapturer
+#include "android/base/memory/SharedMemory.h"          // for SharedMemory
+#include "android/recording/video/SharedFrameRing.h"  // for SharedFrameRing
+#include "emulator/webrtc/capture/VideoCapturer.h"     // for VideoCapturer
 
 using android::base::SharedMemory;
+using android::recording::SharedFrameRing;
 
 namespace emulator {
 namespace webrtc {
@@ -32,6 +34,10 @@ namespace webrtc {
 // A VideoCapturer that provides a new frame from the emulator shared memory region.
 // A new frame will only be delivered if the shared memory region is valid and
 // the frame number has increased.
+//
+// The frames are taken from the SharedFrameRing in I420, the format the
+// encoders want. The ring always hands out the latest frame, the emulator
+// overwrites the ones we were too slow to take.
 class VideoShareCapturer : public VideoCapturer {
 public:
     VideoShareCapturer(std::string handle);
@@ -48,21 +54,13 @@ public:
     std::string name() const override;
 
 private:
-    struct VideoInfo {
-        uint32_t width;
-        uint32_t height;
-        uint32_t fps;          // Target framerate.
-        uint32_t frameNumber;  // Frame number.
-        uint64_t tsUs;         // Timestamp when this frame was received.
-    };
-
-    static size_t getBytesPerFrame(const VideoInfo& capability);
+    // Copies the frame in |slot| into mI420Buffer.
+    bool copyFrame(const SharedFrameRing::Slot* slot);
 
     SharedMemory mSharedMemory;
     std::string mName;
-    VideoInfo mVideoInfo{0};
-    uint8_t* mPixelBuffer{nullptr};
-    uint32_t mPixelBufferSize = 0;
+    SharedFrameRing* mRing{nullptr};
+    uint64_t mLastFrame = 0;  // Sequence number of the last frame taken.
     rtc::scoped_refptr<::webrtc::I420Buffer>
             mI420Buffer;  // Re-usable I420Buffer.
 };
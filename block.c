@@ -4163,6 +4163,22 @@ ImageInfoSpecific *bdrv_get_specific_info(BlockDriverState *bs)
     return NULL;
 }
 
+/* Goes down the backing chain of @bs, whose images may have caches too.  */
+void bdrv_dump_cache_info(BlockDriverState *bs,
+                          fprintf_function func_fprintf, void *f)
+{
+    for (; bs; bs = backing_bs(bs)) {
+        BlockDriver *drv = bs->drv;
+
+        if (drv && drv->bdrv_dump_cache_info) {
+            func_fprintf(f, "%s: %s (%s)\n",
+                         bdrv_get_device_or_node_name(bs), bs->filename,
+                         drv->format_name);
+            drv->bdrv_dump_cache_info(bs, func_fprintf, f);
+        }
+    }
+}
+
 void bdrv_debug_event(BlockDriverState *bs, BlkdebugEvent event)
 {
     if (!bs || !bs->drv || !bs->drv->bdrv_debug_event) {
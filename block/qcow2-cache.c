@@ -33,6 +33,7 @@ typedef struct Qcow2CachedTable {
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    bool     prefetched; /* and not used since */
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -44,6 +45,11 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    uint64_t                hits;
+    uint64_t                misses;
+    uint64_t                prefetches;
+    uint64_t                prefetch_hits;
+    uint64_t                generation;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -224,6 +230,7 @@ static int qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
         BLKDBG_EVENT(bs->file, BLKDBG_L2_UPDATE);
     }
 
+    c->generation++;
     ret = bdrv_pwrite(bs->file, c->entries[i].offset,
                       qcow2_cache_get_table_addr(c, i), c->table_size);
     if (ret < 0) {
@@ -319,7 +326,7 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 }
 
 static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
-    uint64_t offset, void **table, bool read_from_disk)
+    uint64_t offset, void **table, bool read_from_disk, bool prefetch)
 {
     BDRVQcow2State *s = bs->opaque;
     int i;
@@ -327,6 +334,7 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     int lookup_index;
     uint64_t min_lru_counter = UINT64_MAX;
     int min_lru_index = -1;
+    bool miss = false;
 
     assert(offset != 0);
 
@@ -389,9 +397,23 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     }
 
     c->entries[i].offset = offset;
+    c->entries[i].prefetched = prefetch;
+    if (prefetch) {
+        c->prefetches++;
+    } else if (read_from_disk) {
+        c->misses++;
+    }
+    miss = true;
 
     /* And return the right table */
 found:
+    if (!miss && !prefetch) {
+        c->hits++;
+        if (c->entries[i].prefetched) {
+            c->entries[i].prefetched = false;
+            c->prefetch_hits++;
+        }
+    }
     c->entries[i].ref++;
     *table = qcow2_cache_get_table_addr(c, i);
 
@@ -404,13 +426,36 @@ found:
 int qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table)
 {
-    return qcow2_cache_do_get(bs, c, offset, table, true);
+    return qcow2_cache_do_get(bs, c, offset, table, true, false);
 }
 
 int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table)
 {
-    return qcow2_cache_do_get(bs, c, offset, table, false);
+    return qcow2_cache_do_get(bs, c, offset, table, false, false);
+}
+
+uint64_t qcow2_cache_generation(Qcow2Cache *c)
+{
+    return c->generation;
+}
+
+int qcow2_cache_prefetch(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
+                         const void *table, uint64_t generation)
+{
+    void *cached;
+    int ret;
+
+    if (c->generation != generation || qcow2_cache_is_table_offset(c, offset)) {
+        return 0;
+    }
+    ret = qcow2_cache_do_get(bs, c, offset, &cached, false, true);
+    if (ret < 0) {
+        return ret;
+    }
+    memcpy(cached, table, c->table_size);
+    qcow2_cache_put(c, &cached);
+    return 0;
 }
 
 void qcow2_cache_put(Qcow2Cache *c, void **table)
@@ -458,3 +503,22 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     qcow2_cache_table_release(c, i, 1);
 }
+
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->entries = c->size;
+    stats->entry_size = c->table_size;
+    for (i = 0; i < c->size; i++) {
+        if (c->entries[i].offset) {
+            stats->used++;
+            stats->dirty += c->entries[i].dirty;
+        }
+    }
+    stats->hits = c->hits;
+    stats->misses = c->misses;
+    stats->prefetches = c->prefetches;
+    stats->prefetch_hits = c->prefetch_hits;
+}
@@ -207,15 +207,140 @@ int qcow2_grow_l1_table(BlockDriverState *bs, uint64_t min_size,
  * the cache is used; otherwise the L2 slice is loaded from the image
  * file.
  */
+static int l2_slice_start(BDRVQcow2State *s, uint64_t offset)
+{
+    return sizeof(uint64_t) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+}
+
+typedef struct Qcow2L2Prefetch {
+    BlockDriverState *bs;
+    uint64_t offset;
+} Qcow2L2Prefetch;
+
+/* Returns the image offset of the L2 slice that maps guest @offset, or 0 if
+ * there is none.  */
+static uint64_t l2_slice_offset(BDRVQcow2State *s, uint64_t offset)
+{
+    int l1_index = offset_to_l1_index(s, offset);
+    uint64_t l2_offset;
+
+    if (l1_index >= s->l1_size) {
+        return 0;
+    }
+    l2_offset = s->l1_table[l1_index] & L1E_OFFSET_MASK;
+    if (!l2_offset || offset_into_cluster(s, l2_offset)) {
+        return 0;
+    }
+    return l2_offset + l2_slice_start(s, offset);
+}
+
+static void coroutine_fn l2_prefetch_entry(void *opaque)
+{
+    Qcow2L2Prefetch *p = opaque;
+    BlockDriverState *bs = p->bs;
+    BDRVQcow2State *s = bs->opaque;
+    size_t slice_size = s->l2_slice_size * sizeof(uint64_t);
+    uint64_t slice_offset, generation;
+    void *slice = NULL;
+    int ret;
+
+    qemu_co_mutex_lock(&s->lock);
+    /* The L1 table may have changed since */
+    slice_offset = l2_slice_offset(s, p->offset);
+    if (!slice_offset ||
+        qcow2_cache_is_table_offset(s->l2_table_cache, slice_offset)) {
+        goto out;
+    }
+    slice = qemu_try_blockalign(bs->file->bs, slice_size);
+    if (!slice) {
+        goto out;
+    }
+
+    /* Guest requests don't wait for a read they may never need */
+    generation = qcow2_cache_generation(s->l2_table_cache);
+    qemu_co_mutex_unlock(&s->lock);
+    BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
+    ret = bdrv_pread(bs->file, slice_offset, slice, slice_size);
+    qemu_co_mutex_lock(&s->lock);
+
+    if (ret >= 0 && l2_slice_offset(s, p->offset) == slice_offset) {
+        qcow2_cache_prefetch(bs, s->l2_table_cache, slice_offset, slice,
+                             generation);
+    }
+out:
+    s->l2_prefetch_in_flight--;
+    qemu_co_mutex_unlock(&s->lock);
+
+    qemu_vfree(slice);
+    bdrv_dec_in_flight(bs);
+    g_free(p);
+}
+
+/* Once the guest goes from an L2 slice to the next one, reads the ones after
+ * in the background so that its requests don't wait for them.  */
+static void l2_prefetch(BlockDriverState *bs, uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int slice_bits = s->cluster_bits + ctz32(s->l2_slice_size);
+    uint64_t slice = offset >> slice_bits;
+    uint64_t next;
+    bool sequential;
+
+    if (slice == s->l2_prefetch_last_slice) {
+        return;
+    }
+    sequential = slice == s->l2_prefetch_last_slice + 1;
+    s->l2_prefetch_last_slice = slice;
+    if (!sequential) {
+        s->l2_prefetch_end_slice = slice;
+        return;
+    }
+    if (!qemu_in_coroutine()) {
+        return;
+    }
+
+    for (next = MAX(slice, s->l2_prefetch_end_slice) + 1;
+         next <= slice + L2_PREFETCH_SLICES &&
+         s->l2_prefetch_in_flight < L2_PREFETCH_SLICES;
+         next++) {
+        uint64_t next_offset = next << slice_bits;
+        uint64_t slice_offset;
+        Qcow2L2Prefetch *p;
+
+        if (next_offset >= bs->total_sectors * BDRV_SECTOR_SIZE) {
+            break;
+        }
+        s->l2_prefetch_end_slice = next;
+        slice_offset = l2_slice_offset(s, next_offset);
+        if (!slice_offset ||
+            qcow2_cache_is_table_offset(s->l2_table_cache, slice_offset)) {
+            continue;
+        }
+
+        p = g_new(Qcow2L2Prefetch, 1);
+        p->bs = bs;
+        p->offset = next_offset;
+        s->l2_prefetch_in_flight++;
+        bdrv_inc_in_flight(bs);
+        aio_co_schedule(bdrv_get_aio_context(bs),
+                        qemu_coroutine_create(l2_prefetch_entry, p));
+    }
+}
+
 static int l2_load(BlockDriverState *bs, uint64_t offset,
                    uint64_t l2_offset, uint64_t **l2_slice)
 {
     BDRVQcow2State *s = bs->opaque;
-    int start_of_slice = sizeof(uint64_t) *
-        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+    int ret;
 
-    return qcow2_cache_get(bs, s->l2_table_cache, l2_offset + start_of_slice,
-                           (void **)l2_slice);
+    ret = qcow2_cache_get(bs, s->l2_table_cache,
+                          l2_offset + l2_slice_start(s, offset),
+                          (void **)l2_slice);
+    if (ret == 0) {
+        l2_prefetch(bs, offset);
+    }
+    return ret;
 }
 
 /*
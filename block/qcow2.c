@@ -760,6 +760,47 @@ static void qcow2_attach_aio_context(BlockDriverState *bs,
     cache_clean_timer_init(bs, new_context);
 }
 
+static uint64_t host_available_memory(void)
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX mem = { .dwLength = sizeof(mem) };
+
+    if (GlobalMemoryStatusEx(&mem)) {
+        return mem.ullAvailPhys;
+    }
+#elif defined(_SC_AVPHYS_PAGES)
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+
+    if (pages > 0) {
+        return (uint64_t)pages * getpagesize();
+    }
+#endif
+    return UINT64_MAX;
+}
+
+/* Sizes the caches to map the whole virtual disk, within limits, and no
+ * smaller than the defaults of old.  */
+static void auto_cache_sizes(BlockDriverState *bs, uint64_t *l2_cache_size,
+                             uint64_t *refcount_cache_size)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t clusters = DIV_ROUND_UP(bs->total_sectors * BDRV_SECTOR_SIZE,
+                                     s->cluster_size);
+    uint64_t max_size = MIN(DEFAULT_L2_CACHE_MAX_SIZE,
+                            host_available_memory()
+                            / DEFAULT_CACHE_MAX_MEMORY_SHARE);
+    uint64_t min_size = MAX(DEFAULT_L2_CACHE_BYTE_SIZE,
+                            (uint64_t)DEFAULT_L2_CACHE_CLUSTERS
+                            * s->cluster_size);
+
+    *l2_cache_size = MAX(min_size, MIN(clusters * sizeof(uint64_t),
+                                       max_size));
+    *refcount_cache_size =
+        MAX(min_size / DEFAULT_L2_REFCOUNT_SIZE_RATIO,
+            MIN(DIV_ROUND_UP(clusters * s->refcount_bits, 8),
+                max_size / DEFAULT_L2_REFCOUNT_SIZE_RATIO));
+}
+
 static void read_cache_sizes(BlockDriverState *bs, QemuOpts *opts,
                              uint64_t *l2_cache_size,
                              uint64_t *l2_cache_entry_size,
@@ -808,11 +849,7 @@ static void read_cache_sizes(BlockDriverState *bs, QemuOpts *opts,
         }
     } else {
         if (!l2_cache_size_set && !refcount_cache_size_set) {
-            *l2_cache_size = MAX(DEFAULT_L2_CACHE_BYTE_SIZE,
-                                 (uint64_t)DEFAULT_L2_CACHE_CLUSTERS
-                                 * s->cluster_size);
-            *refcount_cache_size = *l2_cache_size
-                                 / DEFAULT_L2_REFCOUNT_SIZE_RATIO;
+            auto_cache_sizes(bs, l2_cache_size, refcount_cache_size);
         } else if (!l2_cache_size_set) {
             *l2_cache_size = *refcount_cache_size
                            * DEFAULT_L2_REFCOUNT_SIZE_RATIO;
@@ -3953,6 +3990,38 @@ static int qcow2_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
     return 0;
 }
 
+static void qcow2_dump_cache_info(BlockDriverState *bs,
+                                  fprintf_function func_fprintf, void *f)
+{
+    BDRVQcow2State *s = bs->opaque;
+    const struct {
+        const char *name;
+        Qcow2Cache *cache;
+    } caches[] = {
+        { "L2 tables", s->l2_table_cache },
+        { "refcount blocks", s->refcount_block_cache },
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(caches); i++) {
+        Qcow2CacheStats stats;
+        uint64_t lookups;
+
+        if (!caches[i].cache) {
+            continue;
+        }
+        qcow2_cache_get_stats(caches[i].cache, &stats);
+        lookups = stats.hits + stats.misses;
+        func_fprintf(f, "    %s: %d x %d bytes, %d used, %d dirty\n"
+                     "      %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hits)"
+                     ", %" PRIu64 " prefetched, %" PRIu64 " of them used\n",
+                     caches[i].name, stats.entries, stats.entry_size,
+                     stats.used, stats.dirty, stats.hits, stats.misses,
+                     lookups ? stats.hits * 100.0 / lookups : 0.0,
+                     stats.prefetches, stats.prefetch_hits);
+    }
+}
+
 static ImageInfoSpecific *qcow2_get_specific_info(BlockDriverState *bs)
 {
     BDRVQcow2State *s = bs->opaque;
@@ -4527,6 +4596,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_measure           = qcow2_measure,
     .bdrv_get_info          = qcow2_get_info,
     .bdrv_get_specific_info = qcow2_get_specific_info,
+    .bdrv_dump_cache_info   = qcow2_dump_cache_info,
 
     .bdrv_save_vmstate    = qcow2_save_vmstate,
     .bdrv_load_vmstate    = qcow2_load_vmstate,
@@ -81,6 +81,15 @@
  * clusters */
 #define DEFAULT_L2_REFCOUNT_SIZE_RATIO 4
 
+/* Unless set, the caches grow to cover the whole image, up to this size and to
+ * a 64th of the memory the host has available.  Only the tables read take up
+ * memory. */
+#define DEFAULT_L2_CACHE_MAX_SIZE (32 * 1048576) /* bytes */
+#define DEFAULT_CACHE_MAX_MEMORY_SHARE 64
+
+/* L2 slices read ahead of a guest going through the image sequentially */
+#define L2_PREFETCH_SLICES 2
+
 #define DEFAULT_CLUSTER_SIZE 65536
 
 
@@ -270,6 +279,12 @@ typedef struct BDRVQcow2State {
     QEMUTimer *cache_clean_timer;
     unsigned cache_clean_interval;
 
+    /* Guest ranges covered by an L2 slice, as last loaded and as prefetched
+     * up to */
+    uint64_t l2_prefetch_last_slice;
+    uint64_t l2_prefetch_end_slice;
+    int l2_prefetch_in_flight;
+
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
     uint64_t cluster_cache_offset;
@@ -667,6 +682,27 @@ void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
+/* Changes whenever the cache writes a table back to the image.  */
+uint64_t qcow2_cache_generation(Qcow2Cache *c);
+/* Adds a copy of @table, which the caller read from @offset without the lock,
+ * unless the cache has the table already or wrote tables back since
+ * @generation: the copy may then be older than the one on disk.  */
+int qcow2_cache_prefetch(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
+                         const void *table, uint64_t generation);
+
+typedef struct Qcow2CacheStats {
+    int entries;
+    int entry_size;
+    int used;
+    int dirty;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t prefetches;
+    uint64_t prefetch_hits;     /* prefetched tables used afterwards */
+} Qcow2CacheStats;
+
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats);
+
 /* qcow2-bitmap.c functions */
 int qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
                                   void **refcount_table,
@@ -52,6 +52,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/option.h"
 #include "qemu/bitmap.h"
+#include "qemu/latency.h"
 #include "qemu/seqlock.h"
 #include "tcg.h"
 #include "hw/nmi.h"
@@ -1108,6 +1109,8 @@ static void qemu_init_sigbus(void)
 #endif /* !CONFIG_LINUX */
 
 static QemuMutex qemu_global_mutex;
+/* When the BQL was taken by this thread, or 0 if not measured.  */
+QEMU_THREAD_LOCAL_DECLARE_INIT(int64_t, iothread_locked_at, 0);
 
 static QemuThread io_thread;
 
@@ -1126,9 +1129,22 @@ void qemu_init_cpu_loop(void)
     qemu_thread_get_self(&io_thread);
 }
 
+/* Waits on @cond, which releases the BQL: the hold measured for it stops
+   there and restarts once the wait is over.  */
+static void qemu_cond_wait_iothread(QemuCond *cond)
+{
+    qemu_latency_end(QEMU_LATENCY_BQL_HOLD,
+                     QEMU_THREAD_LOCAL_GET(iothread_locked_at));
+    qemu_cond_wait(cond, &qemu_global_mutex);
+    QEMU_THREAD_LOCAL_SET(iothread_locked_at, qemu_latency_start());
+}
+
 void run_on_cpu(CPUState *cpu, run_on_cpu_func func, run_on_cpu_data data)
 {
+    qemu_latency_end(QEMU_LATENCY_BQL_HOLD,
+                     QEMU_THREAD_LOCAL_GET(iothread_locked_at));
     do_run_on_cpu(cpu, func, data, &qemu_global_mutex);
+    QEMU_THREAD_LOCAL_SET(iothread_locked_at, qemu_latency_start());
 }
 
 static void qemu_kvm_destroy_vcpu(CPUState *cpu)
@@ -1175,7 +1191,7 @@ static void qemu_tcg_rr_wait_io_event(CPUState *cpu)
 {
     while (all_cpu_threads_idle()) {
         stop_tcg_kick_timer();
-        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(cpu->halt_cond);
     }
 
     start_tcg_kick_timer();
@@ -1187,7 +1203,7 @@ static void qemu_tcg_rr_wait_io_event(CPUState *cpu)
 static void qemu_hvf_wait_io_event(CPUState *cpu)
 {
     while (cpu_thread_is_idle(cpu)) {
-        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(cpu->halt_cond);
     }
     qemu_wait_io_event_common(cpu);
 }
@@ -1197,7 +1213,7 @@ static void qemu_hvf_wait_io_event(CPUState *cpu)
 static void qemu_wait_io_event(CPUState *cpu)
 {
     while (cpu_thread_is_idle(cpu)) {
-        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(cpu->halt_cond);
     }
 
 #ifdef _WIN32
@@ -1477,7 +1493,7 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 
     /* wait for initial kick-off after machine start */
     while (first_cpu->stopped) {
-        qemu_cond_wait(first_cpu->halt_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(first_cpu->halt_cond);
 
         /* process any pending work */
         CPU_FOREACH(cpu) {
@@ -1688,7 +1704,7 @@ static void *qemu_whpx_cpu_thread_fn(void *arg)
             }
         }
         while (cpu_thread_is_idle(cpu)) {
-            qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+            qemu_cond_wait_iothread(cpu->halt_cond);
         }
         qemu_wait_io_event_common(cpu);
     } while (!cpu->unplug || cpu_can_run(cpu));
@@ -1884,13 +1900,17 @@ void qemu_mutex_lock_iothread(void)
     g_assert(!qemu_mutex_iothread_locked());
     qemu_mutex_lock(&qemu_global_mutex);
      QEMU_THREAD_LOCAL_SET(iothread_locked, true);
+    QEMU_THREAD_LOCAL_SET(iothread_locked_at, qemu_latency_start());
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
+    int64_t locked_at = QEMU_THREAD_LOCAL_GET(iothread_locked_at);
+
     g_assert(qemu_mutex_iothread_locked());
     QEMU_THREAD_LOCAL_SET(iothread_locked, false);
     qemu_mutex_unlock(&qemu_global_mutex);
+    qemu_latency_end(QEMU_LATENCY_BQL_HOLD, locked_at);
 }
 
 static bool all_vcpus_paused(void)
@@ -1926,7 +1946,7 @@ void pause_all_vcpus(void)
     replay_mutex_unlock();
 
     while (!all_vcpus_paused()) {
-        qemu_cond_wait(&qemu_pause_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(&qemu_pause_cond);
         CPU_FOREACH(cpu) {
             qemu_cpu_kick(cpu);
         }
@@ -2121,7 +2141,7 @@ static void qemu_gvm_start_vcpu(CPUState *cpu)
     qemu_thread_create(cpu->thread, thread_name, qemu_gvm_cpu_thread_fn,
                        cpu, QEMU_THREAD_JOINABLE);
     while (!cpu->created) {
-        qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(&qemu_cpu_cond);
     }
 #ifdef _WIN32
     cpu->hThread = qemu_thread_get_handle(cpu->thread);
@@ -2174,7 +2194,7 @@ void qemu_init_vcpu(CPUState *cpu)
     }
 
     while (!cpu->created) {
-        qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(&qemu_cpu_cond);
     }
 }
 
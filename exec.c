@@ -876,6 +876,9 @@ void cpu_exec_unrealizefn(CPUState *cpu)
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
         vmstate_unregister(NULL, &vmstate_cpu_common, cpu);
     }
+#ifndef CONFIG_USER_ONLY
+    tlb_destroy(cpu);
+#endif
 }
 
 Property cpu_common_props[] = {
@@ -917,6 +920,8 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
     }
 
 #ifndef CONFIG_USER_ONLY
+    tlb_init(cpu);
+
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
         vmstate_register(NULL, cpu->cpu_index, &vmstate_cpu_common, cpu);
     }
@@ -3950,6 +3955,58 @@ flatview_extend_translation(FlatView *fv, hwaddr addr,
  * Use cpu_register_map_client() to know when retrying the map operation is
  * likely to succeed.
  */
+/*
+ * Android: the direct mappings of guest RAM that are still held, which the
+ * host may write through without the dirty log seeing it.  Only kept after
+ * qemu_ram_track_host_mappings().
+ */
+typedef struct HostMapping {
+    ram_addr_t addr;
+    hwaddr len;
+    int refs;
+} HostMapping;
+
+static bool host_mappings_tracked;
+static QemuMutex host_mappings_lock;
+static GHashTable *host_mappings;   /* host pointer -> HostMapping */
+
+void qemu_ram_track_host_mappings(void)
+{
+    if (!host_mappings_tracked) {
+        qemu_mutex_init(&host_mappings_lock);
+        host_mappings = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+        atomic_set(&host_mappings_tracked, true);
+    }
+}
+
+static void host_mapping_add(void *ptr, ram_addr_t addr, hwaddr len)
+{
+    HostMapping *m;
+
+    qemu_mutex_lock(&host_mappings_lock);
+    m = g_hash_table_lookup(host_mappings, ptr);
+    if (!m) {
+        m = g_new0(HostMapping, 1);
+        g_hash_table_insert(host_mappings, ptr, m);
+    }
+    m->addr = addr;
+    m->len = MAX(m->len, len);
+    m->refs++;
+    qemu_mutex_unlock(&host_mappings_lock);
+}
+
+static void host_mapping_remove(void *ptr)
+{
+    HostMapping *m;
+
+    qemu_mutex_lock(&host_mappings_lock);
+    m = g_hash_table_lookup(host_mappings, ptr);
+    if (m && --m->refs == 0) {
+        g_hash_table_remove(host_mappings, ptr);
+    }
+    qemu_mutex_unlock(&host_mappings_lock);
+}
+
 void *address_space_map(AddressSpace *as,
                         hwaddr addr,
                         hwaddr *plen,
@@ -3998,6 +4055,9 @@ void *address_space_map(AddressSpace *as,
     *plen = flatview_extend_translation(fv, addr, len, mr, xlat,
                                              l, is_write);
     ptr = qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
+    if (atomic_read(&host_mappings_tracked) && ptr) {
+        host_mapping_add(ptr, mr->ram_block->offset + xlat, *plen);
+    }
     rcu_read_unlock();
 
     return ptr;
@@ -4022,6 +4082,9 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
         if (xen_enabled()) {
             xen_invalidate_map_cache_entry(buffer);
         }
+        if (atomic_read(&host_mappings_tracked)) {
+            host_mapping_remove(buffer);
+        }
         memory_region_unref(mr);
         return;
     }
@@ -4233,6 +4296,87 @@ int qemu_ram_foreach_migrate_block_with_file_info(RAMBlockIterFuncWithFileInfo f
     return ret;
 }
 
+void qemu_ram_dirty_log_start(void)
+{
+    ram_addr_t ram_end = (ram_addr_t)last_ram_page() << TARGET_PAGE_BITS;
+
+    memory_global_dirty_log_start();
+
+    /* Forget about everything that happened before. */
+    memory_global_dirty_log_sync();
+    cpu_physical_memory_test_and_clear_dirty(0, ram_end,
+                                             DIRTY_MEMORY_MIGRATION);
+}
+
+void qemu_ram_dirty_log_stop(void)
+{
+    memory_global_dirty_log_stop();
+}
+
+void qemu_ram_dirty_log_collect(uint64_t page_size,
+                                RAMDirtyBitmapFunc func,
+                                void *opaque)
+{
+    ram_addr_t ram_end = (ram_addr_t)last_ram_page() << TARGET_PAGE_BITS;
+    DirtyBitmapSnapshot *snap;
+    RAMBlock *block;
+    unsigned long *bitmap;
+    ram_addr_t page, start, length;
+
+    memory_global_dirty_log_sync();
+
+    rcu_read_lock();
+    /*
+     * Take all blocks at once, the snapshot also clears the bits around the
+     * range it was asked for.
+     */
+    snap = cpu_physical_memory_snapshot_and_clear_dirty(
+            0, ram_end, DIRTY_MEMORY_MIGRATION);
+    if (host_mappings_tracked) {
+        qemu_mutex_lock(&host_mappings_lock);
+    }
+    RAMBLOCK_FOREACH(block) {
+        if (!block->migrate) {
+            continue;
+        }
+        bitmap = func(block->idstr, block->offset, block->used_length, opaque);
+        if (!bitmap) {
+            continue;
+        }
+        for (page = 0; page * page_size < block->used_length; page++) {
+            start = block->offset + page * page_size;
+            length = MIN(page_size, block->used_length - page * page_size);
+            if (cpu_physical_memory_snapshot_get_dirty(snap, start, length)) {
+                set_bit(page, bitmap);
+            }
+        }
+
+        /* What the host may have written through its mappings is dirty */
+        if (host_mappings_tracked) {
+            GHashTableIter iter;
+            gpointer value;
+
+            g_hash_table_iter_init(&iter, host_mappings);
+            while (g_hash_table_iter_next(&iter, NULL, &value)) {
+                HostMapping *m = value;
+                ram_addr_t first = MAX(m->addr, block->offset);
+                ram_addr_t end = MIN(m->addr + m->len,
+                                     block->offset + block->used_length);
+
+                for (start = first; start < end;
+                     start = QEMU_ALIGN_DOWN(start, page_size) + page_size) {
+                    set_bit((start - block->offset) / page_size, bitmap);
+                }
+            }
+        }
+    }
+    if (host_mappings_tracked) {
+        qemu_mutex_unlock(&host_mappings_lock);
+    }
+    rcu_read_unlock();
+    g_free(snap);
+}
+
 /*
  * Unmap pages of memory from start to start+length such that
  * they a) read as 0, b) Trigger whatever fault mechanism
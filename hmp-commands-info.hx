@@ -96,6 +96,21 @@ STEXI
 @item info block-jobs
 @findex info block-jobs
 Show progress of ongoing block device operations.
+ETEXI
+
+    {
+        .name       = "block-cache",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the metadata caches of the block devices",
+        .cmd        = hmp_info_block_cache,
+    },
+
+STEXI
+@item info block-cache
+@findex info block-cache
+Show the size, use and hit rate of the metadata caches of the block devices
+and their backing images, such as the qcow2 L2 table and refcount block caches.
 ETEXI
 
     {
@@ -293,6 +308,23 @@ STEXI
 @item info opcount
 @findex info opcount
 Show dynamic compiler opcode counters
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb_profile",
+        .args_type  = "max:i?",
+        .params     = "[max]",
+        .help       = "show the translated blocks that ran the most host code",
+        .cmd        = hmp_info_tb_profile,
+    },
+#endif
+
+STEXI
+@item info tb_profile [@var{max}]
+@findex info tb_profile
+Show the @var{max} (20 by default) translated blocks, and guest symbols,
+that ran the most host code since @code{tb_profile on}.
 ETEXI
 
     {
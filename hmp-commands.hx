@@ -388,6 +388,26 @@ STEXI
 @findex singlestep
 Run the emulation in single step mode.
 If called with option off, the emulation returns to normal mode.
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb_profile",
+        .args_type  = "action:s,path:F?",
+        .params     = "on|off|reset|perfmap [path]",
+        .help       = "count the executions of translated blocks, or write a perf map of them",
+        .cmd        = hmp_tb_profile,
+    },
+#endif
+
+STEXI
+@item tb_profile on|off|reset|perfmap [@var{path}]
+@findex tb_profile
+Start or stop counting the executions of the translated blocks, or clear
+the counts. The translated code is flushed on start and stop.
+@code{perfmap} writes the host address range of each translated block to
+@var{path}, @file{/tmp/perf-<pid>.map} by default, for @command{perf} to
+name the generated code it samples.
 ETEXI
 
     {
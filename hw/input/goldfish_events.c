@@ -455,6 +455,16 @@ int goldfish_event_send(int type, int code, int value)
     return 0;
 }
 
+int goldfish_event_send_batch(const GoldfishEvent* events, int count)
+{
+    GoldfishEvDevState *dev = s_evdev;
+
+    if (!dev) {
+        return count;
+    }
+    return goldfish_enqueue_events(dev, events, count);
+}
+
 static const MemoryRegionOps goldfish_evdev_ops = {
     .read = goldfish_events_read,
     .write = goldfish_events_write,
@@ -136,57 +136,130 @@ void goldfish_evdev_unlock(GoldfishEvDevState* s) {
 #endif
 }
 
-void goldfish_enqueue_event(GoldfishEvDevState *s,
-                   unsigned int type, unsigned int code, int value)
+/* Protected by s->lock. Returns the number of free slots in the queue. */
+static int get_free_event_slots(GoldfishEvDevState *s)
 {
-    goldfish_evdev_lock(s);
-
-    int  enqueued = s->last - s->first;
+    int enqueued = s->last - s->first;
 
     if (enqueued < 0) {
         enqueued += MAX_EVENTS;
     }
+    return MAX_EVENTS - enqueued;
+}
+
+/* Protected by s->lock. Raises the IRQ, or remembers to do it once the
+ * driver is ready, see goldfish_events_read(). */
+static void notify_events(GoldfishEvDevState *s)
+{
+    if (s->state == STATE_LIVE) {
+        qemu_irq_lower(s->irq);
+        qemu_irq_raise(s->irq);
+    } else {
+        s->state = STATE_BUFFERED;
+    }
+}
+
+/* Protected by s->lock. The caller must have checked there is room for
+ * the 3 words of the event. */
+static void enqueue_event_locked(GoldfishEvDevState *s,
+                                 unsigned int type, unsigned int code,
+                                 int value, uint64_t ev_time_us)
+{
+    unsigned int ev_index_0;
+    unsigned int ev_index_1;
+    unsigned int ev_index_2;
+
+    ev_index_0 = s->last;
+    s->events[s->last] = type;
+    s->last = (s->last + 1) & (MAX_EVENTS-1);
+
+    ev_index_1 = s->last;
+    s->events[s->last] = code;
+    s->last = (s->last + 1) & (MAX_EVENTS-1);
+
+    ev_index_2 = s->last;
+    s->events[s->last] = value;
+    s->last = (s->last + 1) & (MAX_EVENTS-1);
+
+    if (s->measure_latency) {
+        s->enqueue_times_us[ev_index_0] = ev_time_us;
+        s->enqueue_times_us[ev_index_1] = ev_time_us;
+        s->enqueue_times_us[ev_index_2] = ev_time_us;
+    }
+}
+
+static uint64_t get_event_time_us(GoldfishEvDevState *s)
+{
+    struct timeval tv;
 
-    if (enqueued + 3 > MAX_EVENTS) {
+    if (!s->measure_latency) {
+        return 0;
+    }
+    gettimeofday(&tv, 0);
+    return tv.tv_usec + tv.tv_sec * 1000000ULL;
+}
+
+void goldfish_enqueue_event(GoldfishEvDevState *s,
+                   unsigned int type, unsigned int code, int value)
+{
+    goldfish_evdev_lock(s);
+
+    if (get_free_event_slots(s) < 3) {
         g_events_dropped++;
         fprintf(stderr, "##KBD: Full queue, dropping event, current drop count: %d\n", g_events_dropped);
     } else {
-        unsigned int ev_index_0;
-        unsigned int ev_index_1;
-        unsigned int ev_index_2;
-        uint64_t ev_time_us = 0;
-        struct timeval tv;
-
         g_events_dropped = 0;
-        if (s->state == STATE_LIVE) {
-            qemu_irq_lower(s->irq);
-            qemu_irq_raise(s->irq);
-        } else {
-            s->state = STATE_BUFFERED;
-        }
+        notify_events(s);
+        enqueue_event_locked(s, type, code, value, get_event_time_us(s));
+    }
 
-        ev_index_0 = s->last;
-        s->events[s->last] = type;
-        s->last = (s->last + 1) & (MAX_EVENTS-1);
+    goldfish_evdev_unlock(s);
+}
 
-        ev_index_1 = s->last;
-        s->events[s->last] = code;
-        s->last = (s->last + 1) & (MAX_EVENTS-1);
+int goldfish_enqueue_events(GoldfishEvDevState *s,
+                            const GoldfishEvent *events, int count)
+{
+    uint64_t ev_time_us;
+    int dropped = 0;
+    int queued = 0;
+    int i, j, len;
+
+    if (count <= 0) {
+        return 0;
+    }
 
-        ev_index_2 = s->last;
-        s->events[s->last] = value;
-        s->last = (s->last + 1) & (MAX_EVENTS-1);
+    goldfish_evdev_lock(s);
 
-        if (s->measure_latency) {
-            gettimeofday(&tv, 0);
-            ev_time_us = tv.tv_usec + tv.tv_sec * 1000000ULL;
-            s->enqueue_times_us[ev_index_0] = ev_time_us;
-            s->enqueue_times_us[ev_index_1] = ev_time_us;
-            s->enqueue_times_us[ev_index_2] = ev_time_us;
+    /* Queue the batch one input frame at a time, so that a batch larger than
+     * the queue still delivers the frames that fit, and a frame is never
+     * truncated: one that doesn't fit is dropped as a whole. */
+    ev_time_us = get_event_time_us(s);
+    for (i = 0; i < count; i += len) {
+        len = goldfish_event_frame_len(events + i, count - i);
+        if (get_free_event_slots(s) < 3 * len) {
+            dropped += len;
+            continue;
         }
+        for (j = i; j < i + len; j++) {
+            enqueue_event_locked(s, events[j].type, events[j].code,
+                                 events[j].value, ev_time_us);
+        }
+        queued += len;
+    }
+
+    if (dropped) {
+        g_events_dropped += dropped;
+        fprintf(stderr, "##KBD: Full queue, dropping %d events, current drop count: %d\n",
+                dropped, g_events_dropped);
+    } else {
+        g_events_dropped = 0;
+    }
+    if (queued) {
+        notify_events(s);
     }
 
     goldfish_evdev_unlock(s);
+    return dropped;
 }
 
 uint64_t goldfish_events_read(void *opaque, hwaddr offset, unsigned size)
@@ -24,6 +24,7 @@
 #include "ui/input.h"
 #include "ui/console.h"
 #include "hw/input/android_keycodes.h"
+#include "hw/input/goldfish_events.h"
 #include "hw/input/linux_keycodes.h"
 
 #ifdef _WIN32
@@ -248,6 +249,11 @@ typedef struct GoldfishEvDevState {
     OBJECT_CHECK(GoldfishEvDevState, (obj), (type_name))
 void goldfish_enqueue_event(GoldfishEvDevState *s,
                    unsigned int type, unsigned int code, int value);
+/* Enqueues |count| events at once, raising the IRQ a single time. Each
+ * input frame either fits in the queue or is dropped as a whole; returns the
+ * number of dropped events. */
+int goldfish_enqueue_events(GoldfishEvDevState *s,
+                            const GoldfishEvent *events, int count);
 uint64_t goldfish_events_read(void *opaque, hwaddr offset, unsigned size);
 void goldfish_events_write(void *opaque, hwaddr offset, uint64_t val, unsigned size);
 void goldfish_events_set_bits(GoldfishEvDevState *s, int type, int bitl, int bith);
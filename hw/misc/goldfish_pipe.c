@@ -103,6 +103,12 @@ typedef enum PipeRegs {
 
     PIPE_REG_GET_SIGNALLED = 48,
 
+    // Batched command submission, see PipeBatchBuffer below.
+    PIPE_REG_FEATURES = 52,  /* read: PipeFeatures bitmask */
+    PIPE_REG_BATCH_BUFFER_HIGH = 56,
+    PIPE_REG_BATCH_BUFFER = 60,
+    PIPE_REG_BATCH_CMD = 64,  /* write: number of commands in the batch */
+
     // v1-specific registers
     PIPE_REG_STATUS = 0x04,  /* read */
     PIPE_REG_CHANNEL = 0x08,  /* read/write: channel id */
@@ -139,6 +145,12 @@ enum {
     COMMAND_BUFFER_SIZE = 4096,
 };
 
+/* Optional device capabilities reported through PIPE_REG_FEATURES. Older
+ * devices return 0 for unknown registers, so a driver can always probe it. */
+typedef enum PipeFeatures {
+    PIPE_FEATURE_BATCH = (1 << 0),
+} PipeFeatures;
+
 #define TYPE_GOLDFISH_PIPE "goldfish_pipe"
 #define GOLDFISH_PIPE(obj) \
     OBJECT_CHECK(GoldfishPipeState, (obj), TYPE_GOLDFISH_PIPE)
@@ -147,10 +159,14 @@ enum {
 enum {
     PIPE_DEVICE_VERSION = 2,
     PIPE_DEVICE_VERSION_v1 = 1,
-    // Currently we support {v3,v4} driver for v2 pipe device, and anything
+    // Currently we support {v4,v5} driver for v2 pipe device, and anything
     // else for v1 device.
-    MAX_SUPPORTED_DRIVER_VERSION = 4,
+    MAX_SUPPORTED_DRIVER_VERSION = 5,
     PIPE_DRIVER_VERSION_v1 = 0,  // used to not report its version at all
+    PIPE_DRIVER_VERSION_v2 = 4,  // first driver to talk to the v2 device
+    // Drivers starting from this version may register a batch buffer; its
+    // address is only saved into snapshots for such drivers.
+    PIPE_DRIVER_VERSION_BATCH = 5,
 };
 
 /* These default callbacks are provided to detect when emulation setup
@@ -319,6 +335,28 @@ typedef struct OpenCommandParams {
     uint32_t rw_params_max_count;
 } OpenCommandParams;
 
+// A single page shared with the guest that lists several pipe commands to
+// execute in one PIPE_REG_BATCH_CMD write (whose value is the number of
+// entries), instead of one PIPE_REG_CMD write (i.e. one VM exit) per command.
+// Each pipe still uses its own command buffer for the parameters and the
+// result; |status| duplicates the result so the driver can complete every
+// entry independently, in any order.
+typedef struct PipeBatchEntry {
+    uint32_t id;
+    int32_t status;
+} PipeBatchEntry;
+
+typedef struct PipeBatchBuffer {
+    uint32_t completed;  // out: number of entries the device has executed
+    uint32_t padding;
+    PipeBatchEntry entries[];
+} PipeBatchBuffer;
+
+enum {
+    MAX_BATCH_ENTRIES = (COMMAND_BUFFER_SIZE - sizeof(PipeBatchBuffer)) /
+                        sizeof(PipeBatchEntry),
+};
+
 struct PipeDevice {
     GoldfishPipeState* ps;  // backlink to instance state
     int device_version;    // host device verion
@@ -342,6 +380,14 @@ struct PipeDevice {
 
     OpenCommandParams* open_command;
 
+    uint64_t batch_buffer_addr;
+    PipeBatchBuffer* batch_buffer;
+
+    // While > 0, goldfish_pipe_signal_wake() only records that the IRQ has
+    // to be raised, and the last goldfish_pipe_end_wake_batch() raises it.
+    int wake_batch_depth;
+    bool wake_batch_irq_pending;
+
     // v1-specific fields
 
     // The list of all pipes.
@@ -638,9 +684,20 @@ static void close_all_pipes_v2(PipeDevice* dev, GoldfishPipeCloseReason reason)
     }
 }
 
+static void unmap_batch_buffer(PipeDevice* dev) {
+    if (dev->batch_buffer) {
+        cpu_physical_memory_unmap(dev->batch_buffer, COMMAND_BUFFER_SIZE, 1,
+                                  COMMAND_BUFFER_SIZE);
+        dev->batch_buffer = NULL;
+    }
+}
+
 static void reset_pipe_device(PipeDevice* dev) {
     dev->wanted_pipes_first = NULL;
     dev->wanted_pipe_after_channel_high = NULL;
+    dev->wake_batch_irq_pending = false;
+    unmap_batch_buffer(dev);
+    dev->batch_buffer_addr = 0;
     g_hash_table_remove_all(dev->pipes_by_channel);
     qemu_set_irq(dev->ps->irq, 0);
     service_ops->dma_reset_host_mappings();
@@ -1088,7 +1145,7 @@ static uint64_t pipe_dev_read(void* opaque, hwaddr offset, unsigned size) {
         // This helps keep the right state on rebooting.
         dev->ops->close_all(dev, GOLDFISH_PIPE_CLOSE_REBOOT);
         reset_pipe_device(dev);
-        if (dev->driver_version < MAX_SUPPORTED_DRIVER_VERSION) {
+        if (dev->driver_version < PIPE_DRIVER_VERSION_v2) {
             // Old driver used to not report its version at all.
             dev->device_version = PIPE_DEVICE_VERSION_v1;
             dev->ops = &pipe_ops_v1;
@@ -1212,6 +1269,66 @@ static void pipe_dev_warn_long_duration(
     }
 }
 
+static void pipe_dev_do_command_v2(PipeDevice* dev, unsigned id) {
+    if (id < dev->pipes_capacity && dev->pipes[id]) {
+        pipeDevice_doCommand_v2(dev->pipes[id]);
+    } else {
+        pipeDevice_doOpenClose_v2(dev, id);
+    }
+}
+
+static int32_t pipe_dev_get_command_status_v2(PipeDevice* dev, unsigned id) {
+    // CMD_CLOSE frees the pipe, and open/close errors are reported through
+    // the shared open command buffer, so there may be no pipe to look at.
+    if (id < dev->pipes_capacity && dev->pipes[id]) {
+        return dev->pipes[id]->command_buffer->status;
+    }
+    return 0;
+}
+
+static void pipe_dev_begin_wake_batch(PipeDevice* dev) {
+    ++dev->wake_batch_depth;
+}
+
+static void pipe_dev_end_wake_batch(PipeDevice* dev) {
+    assert(dev->wake_batch_depth > 0);
+    if (--dev->wake_batch_depth > 0 || !dev->wake_batch_irq_pending) {
+        return;
+    }
+    dev->wake_batch_irq_pending = false;
+    qemu_set_irq(dev->ps->irq, 1);
+    DD("%s: raising IRQ", __func__);
+
+    if (dev->measure_latency) {
+        dev->wake_us = pipe_dev_curr_time_us();
+    }
+}
+
+// Executes all commands listed in the batch buffer. Wakes signalled while
+// doing so are coalesced into a single IRQ raised at the end of the batch.
+static void pipe_dev_do_batch_v2(PipeDevice* dev, uint32_t count) {
+    PipeBatchBuffer* batch = dev->batch_buffer;
+    if (!batch) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: batch command without a batch buffer\n", __func__);
+        return;
+    }
+    if (count > MAX_BATCH_ENTRIES) {
+        count = MAX_BATCH_ENTRIES;
+    }
+
+    pipe_dev_begin_wake_batch(dev);
+    uint32_t i;
+    for (i = 0; i < count; ++i) {
+        const unsigned id = batch->entries[i].id;
+        pipe_dev_do_command_v2(dev, id);
+        batch->entries[i].status = pipe_dev_get_command_status_v2(dev, id);
+    }
+    batch->completed = count;
+    DD("%s: executed %u commands", __func__, count);
+    pipe_dev_end_wake_batch(dev);
+}
+
 static void pipe_dev_write_v2(PipeDevice* dev,
                                   hwaddr offset,
                                   uint64_t value) {
@@ -1249,15 +1366,25 @@ static void pipe_dev_write_v2(PipeDevice* dev,
                 APANIC("%s: failed to map open command buffer\n", __func__);
             }
             break;
-        case PIPE_REG_CMD: {
-            unsigned id = value;
-            if (id < dev->pipes_capacity && dev->pipes[id]) {
-                pipeDevice_doCommand_v2(dev->pipes[id]);
-            } else {
-                pipeDevice_doOpenClose_v2(dev, id);
+        case PIPE_REG_CMD:
+            pipe_dev_do_command_v2(dev, value);
+            break;
+        case PIPE_REG_BATCH_BUFFER_HIGH:
+            dev->batch_buffer_addr = value << 32;
+            break;
+        case PIPE_REG_BATCH_BUFFER:
+            unmap_batch_buffer(dev);
+            dev->batch_buffer_addr |= (uintptr_t)value;
+            dev->batch_buffer = (PipeBatchBuffer*)map_guest_buffer(
+                    dev->batch_buffer_addr, COMMAND_BUFFER_SIZE,
+                    /*is_write*/1);
+            if (!dev->batch_buffer) {
+                APANIC("%s: failed to map batch buffer\n", __func__);
             }
             break;
-        }
+        case PIPE_REG_BATCH_CMD:
+            pipe_dev_do_batch_v2(dev, value);
+            break;
         default:
             qemu_log_mask(LOG_GUEST_ERROR,
                           "%s: unknown register offset = 0x%" HWADDR_PRIx
@@ -1357,6 +1484,9 @@ static uint64_t pipe_dev_read_v2(PipeDevice* dev, hwaddr offset) {
             res = count;
             break;
         }
+        case PIPE_REG_FEATURES:
+            res = PIPE_FEATURE_BATCH;
+            break;
         default:
             qemu_log_mask(LOG_GUEST_ERROR, "%s: unknown register %" HWADDR_PRId
                                            " (0x%" HWADDR_PRIx ")\n",
@@ -1458,6 +1588,9 @@ static void goldfish_pipe_save_v2(QEMUFile* file, PipeDevice* dev) {
     qemu_put_be32(file, dev->signalled_pipe_buffer_size);
     qemu_put_be64(file, dev->signalled_pipe_buffer_addr);
     qemu_put_be64(file, dev->open_command_addr);
+    if (dev->driver_version >= PIPE_DRIVER_VERSION_BATCH) {
+        qemu_put_be64(file, dev->batch_buffer_addr);
+    }
     qemu_put_be32(file, dev->pipes_capacity);
 
     /* Save the pipes. */
@@ -1659,6 +1792,19 @@ static int goldfish_pipe_load_v2(QEMUFile* file, PipeDevice* dev) {
     if (!dev->open_command) {
         goto done;
     }
+    unmap_batch_buffer(dev);
+    dev->batch_buffer_addr = 0;
+    if (dev->driver_version >= PIPE_DRIVER_VERSION_BATCH) {
+        dev->batch_buffer_addr = qemu_get_be64(file);
+        if (dev->batch_buffer_addr) {
+            dev->batch_buffer = (PipeBatchBuffer*)map_guest_buffer(
+                    dev->batch_buffer_addr, COMMAND_BUFFER_SIZE,
+                    /*is_write*/1);
+            if (!dev->batch_buffer) {
+                goto done;
+            }
+        }
+    }
 
     dev->ops = &pipe_ops_v2;
 
@@ -1843,6 +1989,12 @@ void goldfish_pipe_signal_wake(GoldfishHwPipe *pipe,
     hwpipe_set_wanted(pipe, (unsigned char)flags);
     dev->ops->wanted_list_add(dev, pipe);
 
+    if (dev->wake_batch_depth > 0) {
+        dev->wake_batch_irq_pending = true;
+        DD("%s: deferring IRQ until the end of the batch", __func__);
+        return;
+    }
+
     /* Raise IRQ to indicate there are items on our list ! */
     qemu_set_irq(dev->ps->irq, 1);
     DD("%s: raising IRQ", __func__);
@@ -1852,6 +2004,18 @@ void goldfish_pipe_signal_wake(GoldfishHwPipe *pipe,
     }
 }
 
+void goldfish_pipe_begin_wake_batch(void) {
+    if (s_goldfish_pipe_state) {
+        pipe_dev_begin_wake_batch(s_goldfish_pipe_state->dev);
+    }
+}
+
+void goldfish_pipe_end_wake_batch(void) {
+    if (s_goldfish_pipe_state) {
+        pipe_dev_end_wake_batch(s_goldfish_pipe_state->dev);
+    }
+}
+
 /* Function to look up hwpipe by pipe id and vice versa. */
 int goldfish_pipe_get_id(GoldfishHwPipe* pipe) {
     assert(pipe->dev->device_version == PIPE_DEVICE_VERSION);
@@ -288,6 +288,9 @@ struct BlockDriver {
                                   Error **errp);
     int (*bdrv_get_info)(BlockDriverState *bs, BlockDriverInfo *bdi);
     ImageInfoSpecific *(*bdrv_get_specific_info)(BlockDriverState *bs);
+    /* Prints the size and hit rate of the metadata caches of @bs */
+    void (*bdrv_dump_cache_info)(BlockDriverState *bs,
+                                 fprintf_function func_fprintf, void *f);
 
     int coroutine_fn (*bdrv_save_vmstate)(BlockDriverState *bs,
                                           QEMUIOVector *qiov,
@@ -143,6 +143,40 @@ int qemu_ram_foreach_migrate_block_with_file_info(
     RAMBlockIterFuncWithFileInfo func,
     void *opaque);
 
+/*
+ * Android: tracks the guest RAM pages written since the last
+ * qemu_ram_dirty_log_start() for incremental snapshots, through the
+ * migration dirty log.
+ */
+void qemu_ram_dirty_log_start(void);
+void qemu_ram_dirty_log_stop(void);
+
+/*
+ * Returns the bitmap the dirty pages of a migratable RAM block get set in,
+ * one bit per page, or NULL to skip the block.
+ */
+typedef unsigned long *(RAMDirtyBitmapFunc)(const char *block_name,
+    ram_addr_t offset,
+    ram_addr_t length,
+    void *opaque);
+
+/*
+ * Sets the bits of the pages of @page_size bytes written since the last
+ * call, in the bitmaps returned by @func, and clears them from the log.
+ * The pages of the mappings held since qemu_ram_track_host_mappings()
+ * count as written, the host writes through them aren't logged.
+ */
+void qemu_ram_dirty_log_collect(uint64_t page_size,
+    RAMDirtyBitmapFunc func,
+    void *opaque);
+
+/*
+ * Keeps track of the direct mappings of guest RAM made by
+ * address_space_map() until they are unmapped.  Called before the guest
+ * starts, as those made earlier aren't known.
+ */
+void qemu_ram_track_host_mappings(void);
+
 #endif
 
 #endif /* CPU_COMMON_H */
@@ -28,6 +28,9 @@
 #ifdef CONFIG_TCG
 #include "tcg-target.h"
 #endif
+#if defined(CONFIG_TCG) && TCG_TARGET_IMPLEMENTS_DYN_TLB
+#include "qemu/thread.h"
+#endif
 #ifndef CONFIG_USER_ONLY
 #include "exec/hwaddr.h"
 #endif
@@ -66,6 +69,30 @@ typedef uint64_t target_ulong;
 #define CPU_TLB_ENTRY_BITS 5
 #endif
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* The size of each MMU mode's TLB is picked at run time, see
+ * tlb_mmu_resize_locked() in cputlb.c.  The generated code reads the
+ * table and its mask from env, so there is no displacement limit.
+ */
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_DEFAULT_BITS 8
+
+# if HOST_LONG_BITS == 32
+/* Make sure we do not require a double-word shift for the TLB load */
+#  define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
+# else
+/*
+ * Assuming TARGET_PAGE_BITS==12, with 2**22 entries we can cover 2**(22+12) ==
+ * 2**34 == 16G of address space. This is roughly what one would expect a
+ * TLB reach to be for 64-bit hosts, and it avoids the TLB tables alone
+ * using hundreds of MB per vCPU.
+ */
+#  define CPU_TLB_DYN_MAX_BITS                                  \
+    MIN(22, TARGET_VIRT_ADDR_SPACE_BITS - TARGET_PAGE_BITS)
+# endif
+
+#else /* !TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 /* TCG_TARGET_TLB_DISPLACEMENT_BITS is used in CPU_TLB_BITS to ensure that
  * the TLB is not unnecessarily small, but still small enough for the
  * TLB lookup instruction sequence used by the TCG target.
@@ -98,6 +125,8 @@ typedef uint64_t target_ulong;
 
 #define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
 
+#endif /* TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 typedef struct CPUTLBEntry {
     /* bit TARGET_LONG_BITS to TARGET_PAGE_BITS : virtual address
        bit TARGET_PAGE_BITS-1..4  : Nonzero for accesses that should not
@@ -131,12 +160,47 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/* Bookkeeping of the TLB of one MMU mode, only ever updated by the
+ * vCPU that owns it.  The counters only see the lookups that leave the
+ * generated code, the fast path hits are not counted.
+ */
+typedef struct CPUTLBDesc {
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    /* Largest number of entries in use since window_begin_ns. */
+    int64_t window_begin_ns;
+    size_t window_max_entries;
+    size_t n_used_entries;
+#endif
+    /* Lookups missing the main TLB, the ones found in the victim TLB,
+     * and the entries filled through tlb_fill().
+     */
+    size_t n_misses;
+    size_t n_victim_hits;
+    size_t n_fills;
+    size_t n_flushes;
+    size_t n_resizes;
+} CPUTLBDesc;
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+#define CPU_COMMON_TLB_TABLES \
+    /* tlb_mask[i] contains (n_entries - 1) << CPU_TLB_ENTRY_BITS */   \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];                               \
+    CPUIOTLBEntry *iotlb[NB_MMU_MODES];                                 \
+    /* Held while the tables are resized, or read by another thread. */ \
+    QemuSpin tlb_lock;
+#else
+#define CPU_COMMON_TLB_TABLES \
+    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];
+#endif
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
-    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    CPU_COMMON_TLB_TABLES                                               \
     CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
-    CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
     CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+    CPUTLBDesc tlb_d[NB_MMU_MODES];                                     \
     size_t tlb_flush_count;                                             \
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;                                        \
@@ -19,10 +19,13 @@
 #ifndef CPUTLB_H
 #define CPUTLB_H
 
+#include "qemu/fprintf-fn.h"
+
 #if !defined(CONFIG_USER_ONLY)
 /* cputlb.c */
 void tlb_protect_code(ram_addr_t ram_addr);
 void tlb_unprotect_code(ram_addr_t ram_addr);
 size_t tlb_flush_count(void);
+void dump_tlb_info(FILE *f, fprintf_function cpu_fprintf);
 #endif
 #endif
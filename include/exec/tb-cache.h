@@ -0,0 +1,123 @@
+/*
+ * On-disk cache of translated code
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef EXEC_TB_CACHE_H
+#define EXEC_TB_CACHE_H
+
+/* Where the code of a TB refers to something outside of itself, so that
+   it can be moved to another process.  */
+typedef enum TCGHostRelocKind {
+    TCG_HOST_RELOC_SYMBOL,      /* a helper, by tcg_host_symbol() index */
+    TCG_HOST_RELOC_PROLOGUE,    /* an offset into the prologue */
+    TCG_HOST_RELOC_TB,          /* an offset from the TranslationBlock */
+    TCG_HOST_RELOC_CODE,        /* an offset from the start of the code */
+} TCGHostRelocKind;
+
+typedef enum TCGHostRelocForm {
+    TCG_HOST_RELOC_PC32,        /* displacement from the end of the field */
+    TCG_HOST_RELOC_ABS32,
+    TCG_HOST_RELOC_ABS64,
+} TCGHostRelocForm;
+
+typedef struct TCGHostReloc {
+    uint32_t offset;            /* of the field, from the start of the code */
+    uint8_t kind;
+    uint8_t form;
+    uint16_t unused;
+    uint64_t target;
+} TCGHostReloc;
+
+#define TCG_MAX_HOST_RELOCS 512
+
+/* A TB of the cache file.  Followed by the guest code, the host code and
+   search data, and the relocations.  */
+typedef struct TBCacheEntryHeader {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    uint16_t size;
+    uint16_t icount;
+    uint32_t code_size;
+    uint32_t search_size;
+    uint32_t nb_relocs;
+    uint16_t jmp_reset_offset[2];
+    uint32_t jmp_insn_offset[2];
+    uint32_t crc;           /* of what follows */
+} TBCacheEntryHeader;
+
+typedef struct TBCacheEntry {
+    TBCacheEntryHeader h;
+    uint8_t *data;          /* guest code, then host code and search data */
+    TCGHostReloc *relocs;
+} TBCacheEntry;
+
+size_t tb_cache_entry_bytes(const TBCacheEntryHeader *h);
+uint32_t tb_cache_entry_crc(const TBCacheEntry *e);
+void tb_cache_entry_free(TBCacheEntry *e);
+
+/* Starts the contents of a cache file in @buf, for the code made for @key
+   and @abi, and adds @e to it.  */
+void tb_cache_file_start(GByteArray *buf, const char *key, uint32_t abi);
+void tb_cache_file_add(GByteArray *buf, const TBCacheEntry *e);
+
+/* Takes @e, returns false to stop at it.  */
+typedef bool TBCacheEntryFunc(TBCacheEntry *e, void *opaque);
+
+/* Hands the entries of the cache file @data to @func, up to anything cut
+   short or damaged.  Returns how many, or -1 if the file was made for
+   another @key or @abi.  */
+int tb_cache_file_parse(const uint8_t *data, size_t length, const char *key,
+                        uint32_t abi, TBCacheEntryFunc *func, void *opaque);
+
+/*
+ * Keeps the host code of the TBs translated during a run in a file of
+ * @dir, to be reused by the next run instead of translating them again.
+ * @key names what the guest runs, such as its system image build, and
+ * the emulator build; it picks the file.  The accelerator, host, CPU model
+ * and the layout of its state are added to it.  The file is loaded now and
+ * saved on exit.
+ *
+ * Returns false if the cache can't be used here, e.g. without TCG or
+ * on a host whose backend can't relocate code.
+ */
+bool tb_cache_init(const char *dir, const char *key);
+
+#ifdef NEED_CPU_H
+#include "exec/exec-all.h"
+#include "qemu/fprintf-fn.h"
+
+#ifdef CONFIG_SOFTMMU
+/* Fills @tb, already set up with its pc, flags and code buffer, from the
+ * cache.  On a miss, arranges for the translation about to be made to be
+ * offered to tb_cache_store().  */
+bool tb_cache_load(CPUState *cpu, TranslationBlock *tb,
+                   tb_page_addr_t phys_pc, int *code_size, int *search_size);
+void tb_cache_store(CPUState *cpu, TranslationBlock *tb,
+                    tb_page_addr_t phys_pc, int code_size, int search_size);
+void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf);
+#else
+static inline bool tb_cache_load(CPUState *cpu, TranslationBlock *tb,
+                                 tb_page_addr_t phys_pc, int *code_size,
+                                 int *search_size)
+{
+    return false;
+}
+static inline void tb_cache_store(CPUState *cpu, TranslationBlock *tb,
+                                  tb_page_addr_t phys_pc, int code_size,
+                                  int search_size)
+{
+}
+static inline void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf)
+{
+}
+#endif
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * Execution counts of translated blocks
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef EXEC_TB_PROFILE_H
+#define EXEC_TB_PROFILE_H
+
+#include "qemu/fprintf-fn.h"
+
+/* Set while the TBs being translated count their executions.  */
+extern bool tb_profile_enabled;
+
+/* Starting and stopping flush the code buffer, so that all the TBs run
+ * from then on are (or are no longer) counted.  The counts are kept
+ * until reset.  */
+void tb_profile_start(void);
+void tb_profile_stop(void);
+void tb_profile_reset(void);
+
+/* Ranks the blocks, and the guest symbols they are in, by the host code
+ * they ran; at most @max of each.  */
+void tb_profile_dump(FILE *f, fprintf_function cpu_fprintf, int max);
+
+/* Writes the host address range of each TB, named after its guest pc,
+ * in the format of the perf-<pid>.map files of perf.  */
+bool tb_profile_write_perf_map(const char *path, Error **errp);
+
+/* Called by the translator and by tb_gen_code() for @tb.  */
+void tb_profile_gen_count(struct TranslationBlock *tb);
+void tb_profile_translated(struct TranslationBlock *tb);
+
+#endif
@@ -66,4 +66,33 @@ extern int goldfish_get_event_code_name(const char *typename, unsigned int code,
 extern int goldfish_get_event_code_value(int typeval, char *codename);
 extern int goldfish_event_send(int type, int code, int value);
 
+typedef struct GoldfishEvent {
+    unsigned int type;
+    unsigned int code;
+    int value;
+} GoldfishEvent;
+
+// Returns the length of the input frame that starts at |events|, that is
+// the number of events up to and including the next EV_SYN/SYN_REPORT, or
+// |count| if none of them terminates the frame.
+static inline int goldfish_event_frame_len(const GoldfishEvent* events,
+                                           int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (events[i].type == 0 /* EV_SYN */ &&
+            events[i].code == 0 /* SYN_REPORT */) {
+            return i + 1;
+        }
+    }
+    return count;
+}
+
+// Sends |count| events to the device in one go, in order. Compared to
+// calling goldfish_event_send() for each of them, the guest is interrupted
+// once for the whole batch. The batch is queued frame by frame (see
+// goldfish_event_frame_len()): a frame that does not fit in the device queue
+// is dropped entirely instead of being truncated.
+// Returns the number of events that were dropped.
+extern int goldfish_event_send_batch(const GoldfishEvent* events, int count);
+
 #endif
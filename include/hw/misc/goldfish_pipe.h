@@ -184,4 +184,10 @@ extern void goldfish_pipe_close_from_host(GoldfishHwPipe *hw_pipe);
 extern void goldfish_pipe_signal_wake(GoldfishHwPipe *hw_pipe,
                                       GoldfishPipeWakeFlags flags);
 
+/* Called by the host around a group of goldfish_pipe_signal_wake() and
+ * goldfish_pipe_close_from_host() calls to have the device raise a single
+ * IRQ for all of them once the outermost batch ends. Calls can be nested. */
+extern void goldfish_pipe_begin_wake_batch(void);
+extern void goldfish_pipe_end_wake_batch(void);
+
 #endif /* _HW_GOLDFISH_PIPE_H */
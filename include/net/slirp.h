@@ -42,16 +42,31 @@ void hmp_info_usernet(Monitor *mon, const QDict *qdict);
 /* |opaque| is the result of net_slirp_set_shapers(). */
 void net_slirp_output_raw(void *opaque, const uint8_t *pkt, int pkt_len);
 void net_slirp_receive_raw(void* opaque, const uint8_t *buf, size_t size);
+/* Like net_slirp_receive_raw(), with the |frame_opaque| that |in_send| was
+ * given along with the frame. */
+void net_slirp_receive_shaped(void *frame_opaque, const uint8_t *buf,
+                              size_t size);
 
 /* Return a Slirp instance, or NULL if the network stack is not initialized */
 void* net_slirp_state(void);
 
 typedef void (*SlirpShaperSendFunc)(void* opaque, const void* data, int len);
+typedef void (*SlirpShaperReceiveFunc)(void* opaque, const void* data, int len,
+                                       void* frame_opaque);
 
 void* net_slirp_set_shapers(void* out_opaque,
                             SlirpShaperSendFunc out_send,
                             void* in_opaque,
-                            SlirpShaperSendFunc in_send);
+                            SlirpShaperReceiveFunc in_send);
+
+/* Polls the sockets of slirp from a thread of their own rather than
+ * from the main loop.  Returns false if the host can't. */
+bool net_slirp_start_thread(void);
+
+/* Lets a virtio-net device in front of slirp offload checksums and TCP
+ * segmentation to it, in both directions.  Takes effect on the devices
+ * realized afterwards. */
+void net_slirp_allow_offload(bool allow);
 
 #endif
 
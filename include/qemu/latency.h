@@ -0,0 +1,49 @@
+/*
+ * Latency of the main loop, the BQL and vCPU exits
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_LATENCY_H
+#define QEMU_LATENCY_H
+
+#include "qemu/atomic.h"
+#include "qemu/timer.h"
+
+typedef enum QemuLatency {
+    /* One iteration of main_loop_wait(), less the time blocked polling.  */
+    QEMU_LATENCY_MAIN_LOOP,
+    /* From taking the BQL to releasing it, waits on it excepted.  */
+    QEMU_LATENCY_BQL_HOLD,
+    /* From the return of the accelerator to the vCPU thread until the
+     * exit is handled.  */
+    QEMU_LATENCY_VCPU_EXIT,
+    QEMU_LATENCY__MAX,
+} QemuLatency;
+
+/* Called by the thread that measured, with the duration in nanoseconds.  */
+typedef void QemuLatencyRecorder(QemuLatency which, int64_t ns);
+
+extern QemuLatencyRecorder *qemu_latency_recorder;
+
+/* Nothing is measured until the embedder sets a recorder.  */
+void qemu_set_latency_recorder(QemuLatencyRecorder *recorder);
+
+/* Returns the start of a measurement, 0 when nothing records them.  */
+static inline int64_t qemu_latency_start(void)
+{
+    return atomic_read(&qemu_latency_recorder) ? get_clock() : 0;
+}
+
+static inline void qemu_latency_end(QemuLatency which, int64_t start)
+{
+    QemuLatencyRecorder *recorder = atomic_read(&qemu_latency_recorder);
+
+    if (start && recorder) {
+        recorder(which, get_clock() - start);
+    }
+}
+
+#endif
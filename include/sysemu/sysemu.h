@@ -101,6 +101,8 @@ typedef struct {
     void (*on_end)(const char* name, int res);
     void (*on_quick_fail)(const char* name, int res);
     bool (*is_canceled)(const char* name);
+    /* Marks the start of the next stage of the operation, for profiling. */
+    void (*on_phase)(const char* name);
 } QEMUCallbackSet;
 
 typedef struct {
@@ -1363,6 +1363,13 @@ void migrate_set_file_hooks(const QEMUFileHooks* save_hooks,
     sLoadFileHooks = load_hooks;
 }
 
+static void snapshot_phase(const QEMUCallbackSet *callbacks, const char *name)
+{
+    if (callbacks->on_phase) {
+        callbacks->on_phase(name);
+    }
+}
+
 static int qemu_savevm_state(QEMUFile *f, Error **errp)
 {
     int ret;
@@ -2503,6 +2510,7 @@ int qemu_savevm(const char* name, const QEMUMessageCallback* messages)
            (beginSaveStateTime - beginTime)/1000000.0);
 #endif
 
+    snapshot_phase(&s_snapshot_callbacks.savevm, "devices");
     ret = qemu_savevm_state(f, &local_err);
     vm_state_size = qemu_ftell(f);
     qemu_fclose(f);
@@ -2524,6 +2532,7 @@ int qemu_savevm(const char* name, const QEMUMessageCallback* messages)
     aio_context_release(aio_context);
     aio_context = NULL;
 
+    snapshot_phase(&s_snapshot_callbacks.savevm, "disks");
     ret = bdrv_all_create_snapshot(sn, bs, vm_state_size, &bs);
     if (ret < 0) {
         messages->out(messages->opaque, "Error while creating snapshot on '%s'\n",
@@ -2745,6 +2754,7 @@ int qemu_loadvm(const char* name, const QEMUMessageCallback* messages)
     printf("preparation time %.03f ms\n", (gotoTime - beginTime)/1000000.0);
 #endif
 
+    snapshot_phase(&s_snapshot_callbacks.loadvm, "disks");
     ret = bdrv_all_goto_snapshot(name, &bs, &local_err);
     if (ret < 0) {
         if (s_snapshot_callbacks.loadvm.on_end) {
@@ -2773,6 +2783,7 @@ int qemu_loadvm(const char* name, const QEMUMessageCallback* messages)
     }
     qemu_file_set_hooks(f, sLoadFileHooks);
 
+    snapshot_phase(&s_snapshot_callbacks.loadvm, "reset");
     qemu_system_reset(SHUTDOWN_CAUSE_NONE);
     mis->from_src_file = f;
 
@@ -2782,6 +2793,7 @@ int qemu_loadvm(const char* name, const QEMUMessageCallback* messages)
            (resetEndTime - gotoEndTime)/1000000.0);
 #endif
 
+    snapshot_phase(&s_snapshot_callbacks.loadvm, "devices");
     aio_context_acquire(aio_context);
     ret = qemu_loadvm_state(f);
     migration_incoming_state_destroy();
@@ -75,6 +75,7 @@
 #endif
 #include "exec/memory.h"
 #include "exec/exec-all.h"
+#include "exec/tb-profile.h"
 #include "qemu/log.h"
 #include "qemu/option.h"
 #include "hmp.h"
@@ -1412,6 +1413,49 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info((FILE *)mon, monitor_fprintf);
 }
+
+static void hmp_info_tb_profile(Monitor *mon, const QDict *qdict)
+{
+    if (!tcg_enabled()) {
+        error_report("TB profiles are only available with accel=tcg");
+        return;
+    }
+
+    tb_profile_dump((FILE *)mon, monitor_fprintf,
+                    qdict_get_try_int(qdict, "max", 20));
+}
+
+static void hmp_tb_profile(Monitor *mon, const QDict *qdict)
+{
+    const char *action = qdict_get_str(qdict, "action");
+    const char *path = qdict_get_try_str(qdict, "path");
+    Error *err = NULL;
+
+    if (!tcg_enabled()) {
+        error_report("TB profiles are only available with accel=tcg");
+        return;
+    }
+
+    if (!strcmp(action, "on")) {
+        tb_profile_start();
+    } else if (!strcmp(action, "off")) {
+        tb_profile_stop();
+    } else if (!strcmp(action, "reset")) {
+        tb_profile_reset();
+    } else if (!strcmp(action, "perfmap")) {
+        char *map_path = path ? g_strdup(path)
+                              : g_strdup_printf("/tmp/perf-%d.map", getpid());
+
+        if (tb_profile_write_perf_map(map_path, &err)) {
+            monitor_printf(mon, "Wrote %s\n", map_path);
+        } else {
+            error_report_err(err);
+        }
+        g_free(map_path);
+    } else {
+        monitor_printf(mon, "unexpected action %s\n", action);
+    }
+}
 #endif
 
 static void hmp_info_history(Monitor *mon, const QDict *qdict)
@@ -44,6 +44,8 @@
 #include "qemu/cutils.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
+#include "standard-headers/linux/virtio_net.h"
+#include "net/checksum.h"
 
 static int get_str_sep(char *buf, int buf_size, const char **pp, int sep)
 {
@@ -83,13 +85,32 @@ typedef struct SlirpShaper {
     void (*send)(void *peer, const void *packet, int packet_len);
 } SlirpShaper;
 
+typedef struct SlirpInShaper {
+    void *peer;
+    SlirpShaperReceiveFunc send;
+} SlirpInShaper;
+
+/* What comes back from the inbound shaper along with a frame */
+typedef struct SlirpShapedFrame {
+    struct SlirpState *s;
+    bool csum_valid;    /* its checksums are not to be verified again */
+} SlirpShapedFrame;
+
 typedef struct SlirpState {
     NetClientState nc;
     QTAILQ_ENTRY(SlirpState) entry;
     Slirp *slirp;
     Notifier exit_notifier;
     SlirpShaper shaper_out;
-    SlirpShaper shaper_in;
+    SlirpInShaper shaper_in;
+    SlirpShapedFrame shaped;
+    SlirpShapedFrame shaped_csum_valid;
+    /* Frames in both directions start with a struct virtio_net_hdr. */
+    bool using_vnet_hdr;
+    int vnet_hdr_len;
+    /* Copy of the frame being checksummed for the shaper */
+    uint8_t *csum_buf;
+    size_t csum_buf_size;
 #ifndef _WIN32
     gchar *smb_dir;
 #endif
@@ -100,6 +121,7 @@ const char *legacy_tftp_prefix;
 const char *legacy_bootp_filename;
 static QTAILQ_HEAD(slirp_stacks, SlirpState) slirp_stacks =
     QTAILQ_HEAD_INITIALIZER(slirp_stacks);
+static bool slirp_offload_allowed;
 
 static int slirp_hostfwd(SlirpState *s, const char *redir_str,
                          int legacy_format, Error **errp);
@@ -121,6 +143,18 @@ static inline void slirp_smb_cleanup(SlirpState *s) { }
 void net_slirp_output_raw(void *opaque, const uint8_t *pkt, int pkt_len)
 {
     SlirpState *s = opaque;
+
+    if (s->using_vnet_hdr) {
+        struct virtio_net_hdr_mrg_rxbuf hdr = {};
+        struct iovec iov[2] = {
+            { .iov_base = &hdr, .iov_len = s->vnet_hdr_len },
+            { .iov_base = (void *)pkt, .iov_len = pkt_len },
+        };
+
+        slirp_offload_header(s->slirp, pkt, pkt_len, &hdr.hdr);
+        qemu_sendv_packet(&s->nc, iov, 2);
+        return;
+    }
     qemu_send_packet(&s->nc, pkt, pkt_len);
 }
 
@@ -142,16 +176,88 @@ void net_slirp_receive_raw(void* opaque, const uint8_t *buf, size_t size)
     slirp_input(s->slirp, buf, size);
 }
 
+void net_slirp_receive_shaped(void *frame_opaque, const uint8_t *buf,
+                              size_t size)
+{
+    SlirpShapedFrame *frame = frame_opaque;
+    static const struct virtio_net_hdr valid = {
+        .flags = VIRTIO_NET_HDR_F_DATA_VALID,
+    };
+
+    if (frame->csum_valid) {
+        slirp_input_offload(frame->s->slirp, buf, size, &valid);
+    } else {
+        slirp_input(frame->s->slirp, buf, size);
+    }
+}
+
+/*
+ * Returns a copy of @buf with the checksum the guest left to be computed
+ * filled in, or NULL if @hdr doesn't locate it within the frame.
+ */
+static const uint8_t *net_slirp_complete_csum(SlirpState *s,
+                                              const struct virtio_net_hdr *hdr,
+                                              const uint8_t *buf, size_t size)
+{
+    size_t start = hdr->csum_start;
+    size_t offset = start + hdr->csum_offset;
+
+    if (start >= size || offset + 2 > size) {
+        return NULL;
+    }
+    if (s->csum_buf_size < size) {
+        s->csum_buf = g_realloc(s->csum_buf, size);
+        s->csum_buf_size = size;
+    }
+    memcpy(s->csum_buf, buf, size);
+    /* The field holds the sum of the pseudo-header already */
+    stw_be_p(s->csum_buf + offset,
+             net_checksum_finish_nozero(
+                     net_checksum_add(size - start, s->csum_buf + start)));
+    return s->csum_buf;
+}
+
 static ssize_t net_slirp_receive(NetClientState *nc, const uint8_t *buf, size_t size)
 {
     SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
-    SlirpShaper *shaper = &s->shaper_in;
+    SlirpInShaper *shaper = &s->shaper_in;
+    const uint8_t *frame = buf;
+    size_t frame_size = size;
+    struct virtio_net_hdr hdr;
+
+    if (!s->using_vnet_hdr) {
+        if (shaper->send) {
+            shaper->send(shaper->peer, buf, size, &s->shaped);
+        } else {
+            net_slirp_receive_raw(s, buf, size);
+        }
+        return size;
+    }
 
-    if (shaper->send) {
-        shaper->send(shaper->peer, buf, size);
-    } else {
-        net_slirp_receive_raw(s, buf, size);
+    if (size < s->vnet_hdr_len) {
+        return size;
     }
+    memcpy(&hdr, buf, sizeof(hdr));
+    frame += s->vnet_hdr_len;
+    frame_size -= s->vnet_hdr_len;
+    if (!shaper->send) {
+        slirp_input_offload(s->slirp, frame, frame_size, &hdr);
+        return size;
+    }
+
+    /* The shapers look into the Ethernet frame and only pass it on, so the
+     * checksums the guest left undone are completed here.  slirp doesn't
+     * verify them again when the frame comes back. */
+    if (hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+        frame = net_slirp_complete_csum(s, &hdr, frame, frame_size);
+        if (!frame) {
+            return size;
+        }
+    }
+    shaper->send(shaper->peer, frame, frame_size,
+                 hdr.flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM |
+                              VIRTIO_NET_HDR_F_DATA_VALID) ?
+                 &s->shaped_csum_valid : &s->shaped);
     return size;
 }
 
@@ -166,6 +272,7 @@ static void net_slirp_cleanup(NetClientState *nc)
     SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
 
     slirp_cleanup(s->slirp);
+    g_free(s->csum_buf);
     if (s->exit_notifier.notify) {
         qemu_remove_exit_notifier(&s->exit_notifier);
     }
@@ -173,11 +280,51 @@ static void net_slirp_cleanup(NetClientState *nc)
     QTAILQ_REMOVE(&slirp_stacks, s, entry);
 }
 
+static bool net_slirp_has_vnet_hdr(NetClientState *nc)
+{
+    return slirp_offload_allowed;
+}
+
+static bool net_slirp_has_vnet_hdr_len(NetClientState *nc, int len)
+{
+    return len == sizeof(struct virtio_net_hdr) ||
+           len == sizeof(struct virtio_net_hdr_mrg_rxbuf);
+}
+
+static void net_slirp_using_vnet_hdr(NetClientState *nc, bool enable)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    s->using_vnet_hdr = enable;
+    slirp_set_offload(s->slirp, enable, false, false, false);
+}
+
+static void net_slirp_set_vnet_hdr_len(NetClientState *nc, int len)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    assert(net_slirp_has_vnet_hdr_len(nc, len));
+    s->vnet_hdr_len = len;
+}
+
+static void net_slirp_set_offload(NetClientState *nc, int csum, int tso4,
+                                  int tso6, int ecn, int ufo)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    slirp_set_offload(s->slirp, s->using_vnet_hdr, csum, tso4, tso6);
+}
+
 static NetClientInfo net_slirp_info = {
     .type = NET_CLIENT_DRIVER_USER,
     .size = sizeof(SlirpState),
     .receive = net_slirp_receive,
     .cleanup = net_slirp_cleanup,
+    .has_vnet_hdr = net_slirp_has_vnet_hdr,
+    .has_vnet_hdr_len = net_slirp_has_vnet_hdr_len,
+    .using_vnet_hdr = net_slirp_using_vnet_hdr,
+    .set_vnet_hdr_len = net_slirp_set_vnet_hdr_len,
+    .set_offload = net_slirp_set_offload,
 };
 
 static int net_slirp_init(NetClientState *peer, const char *model,
@@ -399,6 +546,7 @@ static int net_slirp_init(NetClientState *peer, const char *model,
              restricted ? "on" : "off");
 
     s = DO_UPCAST(SlirpState, nc, nc);
+    s->vnet_hdr_len = sizeof(struct virtio_net_hdr);
 
     s->slirp = slirp_init(restricted, ipv4, net, mask, host,
                           ipv6, ip6_prefix, vprefix6_len, ip6_host,
@@ -1263,7 +1411,7 @@ int net_slirp_parse_legacy(QemuOptsList *opts_list, const char *optarg, int *ret
 void* net_slirp_set_shapers(void* out_opaque,
                             SlirpShaperSendFunc out_send,
                             void* in_opaque,
-                            SlirpShaperSendFunc in_send)
+                            SlirpShaperReceiveFunc in_send)
 {
     SlirpState *s = QTAILQ_FIRST(&slirp_stacks);
     if (!s) {
@@ -1274,6 +1422,20 @@ void* net_slirp_set_shapers(void* out_opaque,
     s->shaper_out.send = out_send;
     s->shaper_in.peer = in_opaque;
     s->shaper_in.send = in_send;
+    s->shaped.s = s;
+    s->shaped.csum_valid = false;
+    s->shaped_csum_valid.s = s;
+    s->shaped_csum_valid.csum_valid = true;
 
     return s;
 }
+
+bool net_slirp_start_thread(void)
+{
+    return slirp_start_thread();
+}
+
+void net_slirp_allow_offload(bool allow)
+{
+    slirp_offload_allowed = allow;
+}
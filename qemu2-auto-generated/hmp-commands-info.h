@@ -55,6 +55,15 @@
 },
 
 
+{
+.name       = "block-cache",
+.args_type  = "",
+.params     = "",
+.help       = "show the metadata caches of the block devices",
+.cmd        = hmp_info_block_cache,
+},
+
+
 {
 .name       = "registers",
 .args_type  = "cpustate_all:-a",
@@ -187,6 +196,17 @@ defined(TARGET_PPC) || defined(TARGET_XTENSA) || defined(TARGET_M68K)
 #endif
 
 
+#if defined(CONFIG_TCG)
+{
+.name       = "tb_profile",
+.args_type  = "max:i?",
+.params     = "[max]",
+.help       = "show the translated blocks that ran the most host code",
+.cmd        = hmp_info_tb_profile,
+},
+#endif
+
+
 {
 .name       = "kvm",
 .args_type  = "",
@@ -207,6 +207,17 @@
 },
 
 
+#if defined(CONFIG_TCG)
+{
+.name       = "tb_profile",
+.args_type  = "action:s,path:F?",
+.params     = "on|off|reset|perfmap [path]",
+.help       = "count the executions of translated blocks, or write a perf map of them",
+.cmd        = hmp_tb_profile,
+},
+#endif
+
+
 {
 .name       = "stop",
 .args_type  = "",
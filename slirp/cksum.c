@@ -42,100 +42,79 @@
  * XXX Since we will never span more than 1 mbuf, we can optimise this
  */
 
-#define ADDCARRY(x)  (x > 65535 ? x -= 65535 : x)
-#define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1];        \
-        (void)ADDCARRY(sum);}
-
-int cksum(struct mbuf *m, int len)
+/*
+ * The data is added up 64 bits at a time, in four independent sums whose
+ * carries are counted apart, and folded at the end: the ones' complement
+ * sum doesn't depend on the size nor on the order of the additions as
+ * long as all the carries are added back (RFC 1071).  This is as fast as
+ * what a vectorizing compiler makes of a loop on 16-bit words, and still
+ * several times faster without one.  The loads don't need any alignment.
+ */
+static uint64_t cksum_add(const uint8_t *p, int len)
 {
-	register uint16_t *w;
-	register int sum = 0;
-	register int mlen = 0;
-	int byte_swapped = 0;
-
-	union {
-		uint8_t  c[2];
-		uint16_t s;
-	} s_util;
-	union {
-		uint16_t s[2];
-		uint32_t l;
-	} l_util;
-
-	if (m->m_len == 0)
-	   goto cont;
-	w = mtod(m, uint16_t *);
-
-	mlen = m->m_len;
-
-	if (len < mlen)
-	   mlen = len;
-#ifdef DEBUG
-	len -= mlen;
-#endif
-	/*
-	 * Force to even boundary.
-	 */
-	if ((1 & (uintptr_t)w) && (mlen > 0)) {
-		REDUCE;
-		sum <<= 8;
-		s_util.c[0] = *(uint8_t *)w;
-		w = (uint16_t *)((int8_t *)w + 1);
-		mlen--;
-		byte_swapped = 1;
-	}
-	/*
-	 * Unroll the loop to make overhead from
-	 * branches &c small.
-	 */
-	while ((mlen -= 32) >= 0) {
-		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-		sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
-		sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
-		sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
-		w += 16;
+	uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+	uint64_t sum;
+
+	while (len >= 32) {
+		uint64_t w0 = ldq_he_p(p), w1 = ldq_he_p(p + 8);
+		uint64_t w2 = ldq_he_p(p + 16), w3 = ldq_he_p(p + 24);
+
+		s0 += w0;
+		c0 += s0 < w0;
+		s1 += w1;
+		c1 += s1 < w1;
+		s2 += w2;
+		c2 += s2 < w2;
+		s3 += w3;
+		c3 += s3 < w3;
+		p += 32;
+		len -= 32;
 	}
-	mlen += 32;
-	while ((mlen -= 8) >= 0) {
-		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-		w += 4;
+	sum = (s0 & 0xffffffff) + (s0 >> 32) + (s1 & 0xffffffff) + (s1 >> 32) +
+	      (s2 & 0xffffffff) + (s2 >> 32) + (s3 & 0xffffffff) + (s3 >> 32) +
+	      c0 + c1 + c2 + c3;
+
+	while (len >= 4) {
+		sum += (uint32_t)ldl_he_p(p);
+		p += 4;
+		len -= 4;
 	}
-	mlen += 8;
-	if (mlen == 0 && byte_swapped == 0)
-	   goto cont;
-	REDUCE;
-	while ((mlen -= 2) >= 0) {
-		sum += *w++;
+	if (len >= 2) {
+		sum += (uint16_t)lduw_he_p(p);
+		p += 2;
+		len -= 2;
 	}
+	if (len) {
+		/* The odd byte, padded with a zero */
+		union {
+			uint8_t  c[2];
+			uint16_t s;
+		} s_util = { .c = { *p, 0 } };
 
-	if (byte_swapped) {
-		REDUCE;
-		sum <<= 8;
-		if (mlen == -1) {
-			s_util.c[1] = *(uint8_t *)w;
-			sum += s_util.s;
-			mlen = 0;
-		} else
+		sum += s_util.s;
+	}
+	return sum;
+}
 
-		   mlen = -1;
-	} else if (mlen == -1)
-	   s_util.c[0] = *(uint8_t *)w;
+int cksum(struct mbuf *m, int len)
+{
+	uint64_t sum;
 
-cont:
+	if (len > m->m_len) {
 #ifdef DEBUG
-	if (len) {
 		DEBUG_ERROR((dfd, "cksum: out of data\n"));
-		DEBUG_ERROR((dfd, " len = %d\n", len));
-	}
+		DEBUG_ERROR((dfd, " len = %d\n", len - m->m_len));
 #endif
-	if (mlen == -1) {
-		/* The last mbuf has odd # of bytes. Follow the
-		 standard (the odd byte may be shifted left by 8 bits
-			   or not as determined by endian-ness of the machine) */
-		s_util.c[1] = 0;
-		sum += s_util.s;
+		len = m->m_len;
 	}
-	REDUCE;
+
+	sum = cksum_add(mtod(m, const uint8_t *), len);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
 	return (~sum & 0xffff);
 }
 
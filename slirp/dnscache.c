@@ -0,0 +1,632 @@
+/*
+ * Cache of the answers to the DNS queries of the guest
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This code is licensed under the GPL version 2 or later. See the
+ * COPYING file in the top-level directory.
+ *
+ * The queries the guest sends to the nameservers of slirp are answered
+ * from the cache when the same question was answered before, for as long
+ * as the TTLs of the answer allow, with the TTLs aged accordingly.  Names
+ * that don't exist, or have no record of the type asked, are cached too,
+ * for the minimum of their SOA record (RFC 2308).  Only the answers to
+ * the queries forwarded, coming from the nameserver asked with the same id
+ * and question, are cached.  The cache can be kept in a file shared by the
+ * instances of slirp, which load it on start and merge their new answers
+ * back into it from a thread.
+ */
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/thread.h"
+#include "slirp.h"
+
+#define DNS_HDR_LEN             12
+#define DNS_FLAG_QR             0x8000
+#define DNS_FLAG_TC             0x0200
+#define DNS_FLAG_RD             0x0100
+#define DNS_FLAG_CD             0x0010
+#define DNS_OPCODE_MASK         0x7800
+#define DNS_RCODE_MASK          0x000f
+#define DNS_RCODE_NXDOMAIN      3
+#define DNS_TYPE_SOA            6
+#define DNS_TYPE_OPT            41
+
+#define DNS_CACHE_MAX_ENTRIES   1024
+#define DNS_CACHE_MAX_LEN       4096    /* of an answer */
+#define DNS_CACHE_MAX_TTL       86400
+#define DNS_CACHE_MAX_NEG_TTL   900
+#define DNS_CACHE_SAVE_INTERVAL 60      /* seconds */
+#define DNS_CACHE_MAX_QUERIES   16      /* awaiting an answer, per socket */
+
+/* Records of the file: key and data lengths, stored and expires, key,
+ * data; little endian */
+#define DNS_CACHE_RECORD_LEN    24
+static const char dns_cache_magic[8] = "SLDNSC1\n";
+
+typedef struct DnsCacheEntry {
+    int64_t stored;         /* wall clock seconds */
+    int64_t expires;
+    int len;
+    bool unsaved;           /* not merged into the file yet */
+    uint8_t data[];         /* the answer */
+} DnsCacheEntry;
+
+/* A query forwarded to a nameserver, awaiting its answer */
+typedef struct DnsCacheQuery {
+    uint16_t id;
+    int len;
+    uint8_t question[];     /* the question section, as sent */
+} DnsCacheQuery;
+
+/* The answers a thread merges into the file */
+typedef struct DnsCacheSave {
+    char *path;
+    GHashTable *entries;
+    int *done;
+} DnsCacheSave;
+
+static int64_t dns_now(void)
+{
+    return g_get_real_time() / G_USEC_PER_SEC;
+}
+
+/* Returns the offset past the name at @off, or -1 if it overruns @len */
+static int dns_skip_name(const uint8_t *p, int len, int off)
+{
+    while (off < len) {
+        if (p[off] == 0) {
+            return off + 1;
+        }
+        if ((p[off] & 0xc0) == 0xc0) {
+            return off + 2 <= len ? off + 2 : -1;
+        }
+        if (p[off] & 0xc0) {
+            return -1;
+        }
+        off += p[off] + 1;
+    }
+    return -1;
+}
+
+/*
+ * Walks the records of the message @p, past its question ending at @off,
+ * taking @age off their TTL.  Returns the smallest TTL left, counting the
+ * minimum of SOA records, INT64_MAX without records, or -1 if @p is
+ * malformed.  *@has_opt tells whether an EDNS record came along, and
+ * *@has_soa whether the authority section has an SOA record.
+ */
+static int64_t dns_walk_records(uint8_t *p, int len, int off, uint32_t age,
+                                bool *has_opt, bool *has_soa)
+{
+    int ancount = lduw_be_p(p + 6), nscount = lduw_be_p(p + 8);
+    int n = ancount + nscount + lduw_be_p(p + 10);
+    int i;
+    int64_t min = INT64_MAX;
+
+    *has_opt = false;
+    *has_soa = false;
+    for (i = 0; i < n; i++) {
+        int type, rdlen, end;
+        uint32_t ttl;
+
+        off = dns_skip_name(p, len, off);
+        if (off < 0 || off + 10 > len) {
+            return -1;
+        }
+        type = lduw_be_p(p + off);
+        ttl = ldl_be_p(p + off + 4);
+        rdlen = lduw_be_p(p + off + 8);
+        end = off + 10 + rdlen;
+        if (end > len) {
+            return -1;
+        }
+
+        if (type == DNS_TYPE_OPT) {
+            /* Its TTL holds flags */
+            *has_opt = true;
+        } else {
+            /* TTLs with the high bit set mean 0 (RFC 2181) */
+            ttl = ttl < age || ttl >= 0x80000000 ? 0 : ttl - age;
+            if (age) {
+                stl_be_p(p + off + 4, ttl);
+            }
+            min = MIN(min, ttl);
+        }
+        if (type == DNS_TYPE_SOA) {
+            int soa = dns_skip_name(p, end, off + 10);
+
+            soa = soa < 0 ? -1 : dns_skip_name(p, end, soa);
+            if (soa < 0 || soa + 20 != end) {
+                return -1;
+            }
+            min = MIN(min, ldl_be_p(p + soa + 16) & 0x7fffffff);
+            if (i >= ancount && i < ancount + nscount) {
+                *has_soa = true;
+            }
+        }
+        off = end;
+    }
+    return min;
+}
+
+/*
+ * Returns the end of the question of @p, or -1 if @p isn't a standard
+ * message with one question.
+ */
+static int dns_question_end(const uint8_t *p, int len)
+{
+    int off;
+
+    if (len < DNS_HDR_LEN || lduw_be_p(p + 4) != 1 ||
+        lduw_be_p(p + 2) & (DNS_OPCODE_MASK | DNS_FLAG_TC)) {
+        return -1;
+    }
+
+    /* The name of the question is never compressed */
+    off = DNS_HDR_LEN;
+    while (off < len && p[off]) {
+        if (p[off] & 0xc0) {
+            return -1;
+        }
+        off += p[off] + 1;
+    }
+    off += 1 + 4;   /* the root label, type and class */
+    return off <= len ? off : -1;
+}
+
+/*
+ * Returns the key the answers to the question of @p are cached by, or
+ * NULL if @p isn't a standard message with one question.  Sets *@qend
+ * to the end of the question, and *@ttl and *@has_soa as
+ * dns_walk_records() does.
+ */
+static GBytes *dns_question_key(uint8_t *p, int len, int *qend, int64_t *ttl,
+                                bool *has_soa)
+{
+    int flags, off, i;
+    bool has_opt;
+    uint8_t *key;
+
+    off = dns_question_end(p, len);
+    if (off < 0) {
+        return NULL;
+    }
+    flags = lduw_be_p(p + 2);
+    *qend = off;
+    *ttl = dns_walk_records(p, len, off, 0, &has_opt, has_soa);
+    if (*ttl < 0) {
+        return NULL;
+    }
+
+    /* Names are case insensitive.  Whether recursion or DNSSEC checking
+     * is wanted, and whether EDNS is used, may change the answer. */
+    key = g_malloc(off - DNS_HDR_LEN + 2);
+    memcpy(key, p + DNS_HDR_LEN, off - DNS_HDR_LEN);
+    for (i = 0; key[i]; i += key[i] + 1) {
+        int j;
+
+        for (j = i + 1; j <= i + key[i]; j++) {
+            key[j] = g_ascii_tolower(key[j]);
+        }
+    }
+    key[off - DNS_HDR_LEN] = (flags & DNS_FLAG_RD ? 1 : 0) |
+                             (flags & DNS_FLAG_CD ? 2 : 0);
+    key[off - DNS_HDR_LEN + 1] = has_opt;
+    return g_bytes_new_take(key, off - DNS_HDR_LEN + 2);
+}
+
+/* Whether @so carries DNS queries for the nameservers of slirp */
+static bool dns_cache_wanted(struct socket *so)
+{
+    Slirp *slirp = so->slirp;
+    uint32_t n;
+
+    if (!slirp->dns_cache || so->so_fport != htons(kDnsPort)) {
+        return false;
+    }
+    switch (so->so_ffamily) {
+    case AF_INET:
+        n = ntohl(so->so_faddr.s_addr) - ntohl(slirp->vnameserver_addr.s_addr);
+        return n < MAX(slirp->host_dns_count, 1);
+    case AF_INET6:
+        return in6_equal_net(&so->so_faddr6, &slirp->vprefix_addr6,
+                             slirp->vprefix_len) &&
+               !in6_equal_mach(&so->so_faddr6, &slirp->vhost_addr6,
+                               slirp->vprefix_len);
+    default:
+        return false;
+    }
+}
+
+/* Makes room for one more entry, at the expense of the expired ones or
+ * else of the one to expire first */
+static void dns_cache_evict(GHashTable *cache, int64_t now)
+{
+    GHashTableIter iter;
+    gpointer key, value, first = NULL;
+    int64_t first_expires = INT64_MAX;
+    bool removed = false;
+
+    g_hash_table_iter_init(&iter, cache);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        DnsCacheEntry *e = value;
+
+        if (e->expires <= now) {
+            g_hash_table_iter_remove(&iter);
+            removed = true;
+        } else if (e->expires < first_expires) {
+            first = key;
+            first_expires = e->expires;
+        }
+    }
+    if (!removed && first) {
+        g_hash_table_remove(cache, first);
+    }
+}
+
+static GHashTable *dns_cache_new(void)
+{
+    return g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                                 (GDestroyNotify)g_bytes_unref, g_free);
+}
+
+/* Takes @key, and keeps @data unless a fresher answer is cached */
+static void dns_cache_insert(GHashTable *cache, GBytes *key,
+                             const uint8_t *data, int len, int64_t stored,
+                             int64_t expires, bool unsaved)
+{
+    DnsCacheEntry *e = g_hash_table_lookup(cache, key);
+
+    if (e && e->expires >= expires) {
+        g_bytes_unref(key);
+        return;
+    }
+    if (!e && g_hash_table_size(cache) >= DNS_CACHE_MAX_ENTRIES) {
+        dns_cache_evict(cache, dns_now());
+    }
+    e = g_malloc(sizeof(*e) + len);
+    e->stored = stored;
+    e->expires = expires;
+    e->len = len;
+    e->unsaved = unsaved;
+    memcpy(e->data, data, len);
+    g_hash_table_replace(cache, key, e);
+}
+
+/* Adds the unexpired answers of the file at @path */
+static void dns_cache_load(GHashTable *cache, const char *path, int64_t now)
+{
+    gchar *buf;
+    gsize len, off = sizeof(dns_cache_magic);
+
+    if (!g_file_get_contents(path, &buf, &len, NULL)) {
+        return;
+    }
+    if (len < off || memcmp(buf, dns_cache_magic, off)) {
+        g_free(buf);
+        return;
+    }
+    while (off + DNS_CACHE_RECORD_LEN <= len) {
+        uint32_t klen = ldl_le_p(buf + off);
+        uint32_t dlen = ldl_le_p(buf + off + 4);
+        int64_t stored = ldq_le_p(buf + off + 8);
+        int64_t expires = ldq_le_p(buf + off + 16);
+
+        off += DNS_CACHE_RECORD_LEN;
+        if (klen > len - off || dlen > len - off - klen ||
+            dlen < DNS_HDR_LEN || dlen > DNS_CACHE_MAX_LEN) {
+            break;
+        }
+        if (expires > now && stored <= now) {
+            dns_cache_insert(cache, g_bytes_new(buf + off, klen),
+                             (uint8_t *)buf + off + klen, dlen,
+                             stored, expires, false);
+        }
+        off += klen + dlen;
+    }
+    g_free(buf);
+}
+
+/* Merges the answers of @save into the file at its path, where other
+ * instances may have added theirs, off the main loop */
+static void *dns_cache_save_thread(void *opaque)
+{
+    DnsCacheSave *save = opaque;
+    int64_t now = dns_now();
+    GByteArray *buf = g_byte_array_new();
+    GHashTableIter iter;
+    gpointer key, value;
+
+    dns_cache_load(save->entries, save->path, now);
+
+    g_byte_array_append(buf, (const guint8 *)dns_cache_magic,
+                        sizeof(dns_cache_magic));
+    g_hash_table_iter_init(&iter, save->entries);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        DnsCacheEntry *e = value;
+        uint8_t rec[DNS_CACHE_RECORD_LEN];
+        gsize klen;
+        const void *k = g_bytes_get_data(key, &klen);
+
+        if (e->expires <= now) {
+            continue;
+        }
+        stl_le_p(rec, klen);
+        stl_le_p(rec + 4, e->len);
+        stq_le_p(rec + 8, e->stored);
+        stq_le_p(rec + 16, e->expires);
+        g_byte_array_append(buf, rec, sizeof(rec));
+        g_byte_array_append(buf, k, klen);
+        g_byte_array_append(buf, e->data, e->len);
+    }
+    /* Replaced at once, the readers never see it half written */
+    if (!g_file_set_contents(save->path, (const gchar *)buf->data,
+                             buf->len, NULL)) {
+        DEBUG_MISC((dfd, " could not save the dns cache to %s\n",
+                    save->path));
+    }
+    g_byte_array_free(buf, true);
+
+    atomic_set(save->done, 1);
+    g_hash_table_destroy(save->entries);
+    g_free(save->path);
+    g_free(save);
+    return NULL;
+}
+
+/* Waits for the thread merging answers into the file, if any */
+static void dns_cache_save_join(Slirp *slirp)
+{
+    if (slirp->dns_cache_saving) {
+        qemu_thread_join(&slirp->dns_cache_thread);
+        slirp->dns_cache_saving = false;
+    }
+}
+
+/* Hands the answers not in the file yet to a thread merging them into it.
+ * Unless @wait, nothing is done while the previous merge is under way. */
+static void dns_cache_save(Slirp *slirp, bool wait)
+{
+    int64_t now = dns_now();
+    DnsCacheSave *save;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    if (slirp->dns_cache_saving && !wait &&
+        !atomic_read(&slirp->dns_cache_save_done)) {
+        return;
+    }
+    dns_cache_save_join(slirp);
+
+    save = g_new(DnsCacheSave, 1);
+    save->path = g_strdup(slirp->dns_cache_path);
+    save->entries = dns_cache_new();
+    save->done = &slirp->dns_cache_save_done;
+    g_hash_table_iter_init(&iter, slirp->dns_cache);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        DnsCacheEntry *e = value;
+
+        if (e->unsaved && e->expires > now) {
+            g_hash_table_insert(save->entries, g_bytes_ref(key),
+                                g_memdup(e, sizeof(*e) + e->len));
+        }
+        e->unsaved = false;
+    }
+    slirp->dns_cache_saved = now;
+    slirp->dns_cache_dirty = false;
+
+    atomic_set(&slirp->dns_cache_save_done, 0);
+    qemu_thread_create(&slirp->dns_cache_thread, "slirp-dns-cache",
+                       dns_cache_save_thread, save, QEMU_THREAD_JOINABLE);
+    slirp->dns_cache_saving = true;
+    if (wait) {
+        dns_cache_save_join(slirp);
+    }
+}
+
+bool dns_cache_answer(struct socket *so, struct mbuf *m)
+{
+    Slirp *slirp = so->slirp;
+    struct sockaddr_storage saddr = so->fhost.ss, daddr = so->lhost.ss;
+    DnsCacheEntry *e;
+    GBytes *key;
+    struct mbuf *r;
+    uint8_t *p;
+    int qend;
+    int64_t ttl, now;
+    bool has_opt, has_soa;
+
+    if (!dns_cache_wanted(so)) {
+        return false;
+    }
+    p = (uint8_t *)m->m_data;
+    key = dns_question_key(p, m->m_len, &qend, &ttl, &has_soa);
+    if (!key) {
+        return false;
+    }
+    e = lduw_be_p(p + 2) & DNS_FLAG_QR ? NULL :
+        g_hash_table_lookup(slirp->dns_cache, key);
+    g_bytes_unref(key);
+    now = dns_now();
+    if (!e || e->expires <= now || e->stored > now) {
+        return false;
+    }
+
+    r = m_get(slirp);
+    if (!r) {
+        return false;
+    }
+    switch (so->so_ffamily) {
+    case AF_INET:
+        r->m_data += IF_MAXLINKHDR + sizeof(struct udpiphdr);
+        break;
+    case AF_INET6:
+        r->m_data += IF_MAXLINKHDR + sizeof(struct ip6) + sizeof(struct udphdr);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    if (e->len > M_FREEROOM(r)) {
+        m_inc(r, (r->m_data - r->m_dat) + e->len);
+    }
+    memcpy(r->m_data, e->data, e->len);
+    r->m_len = e->len;
+
+    /* The id and the question as asked, and the TTLs left */
+    memcpy(r->m_data, p, 2);
+    memcpy(r->m_data + DNS_HDR_LEN, p + DNS_HDR_LEN, qend - DNS_HDR_LEN);
+    dns_walk_records((uint8_t *)r->m_data, r->m_len, qend, now - e->stored,
+                     &has_opt, &has_soa);
+
+    DEBUG_MISC((dfd, " dns answer from the cache, %d bytes\n", r->m_len));
+    switch (so->so_ffamily) {
+    case AF_INET:
+        udp_output(so, r, (struct sockaddr_in *)&saddr,
+                   (struct sockaddr_in *)&daddr, so->so_iptos);
+        break;
+    case AF_INET6:
+        udp6_output(so, r, (struct sockaddr_in6 *)&saddr,
+                    (struct sockaddr_in6 *)&daddr);
+        break;
+    }
+    return true;
+}
+
+void dns_cache_query_sent(struct socket *so, struct mbuf *m)
+{
+    uint8_t *p = (uint8_t *)m->m_data;
+    DnsCacheQuery *q;
+    GSList *last;
+    int qend;
+
+    if (!dns_cache_wanted(so)) {
+        return;
+    }
+    qend = dns_question_end(p, m->m_len);
+    if (qend < 0 || lduw_be_p(p + 2) & DNS_FLAG_QR) {
+        return;
+    }
+
+    /* The oldest queries are deemed unanswered */
+    if (g_slist_length(so->so_dns_queries) >= DNS_CACHE_MAX_QUERIES) {
+        last = g_slist_last(so->so_dns_queries);
+        g_free(last->data);
+        so->so_dns_queries = g_slist_delete_link(so->so_dns_queries, last);
+    }
+    q = g_malloc(sizeof(*q) + qend - DNS_HDR_LEN);
+    q->id = lduw_be_p(p);
+    q->len = qend - DNS_HDR_LEN;
+    memcpy(q->question, p + DNS_HDR_LEN, q->len);
+    so->so_dns_queries = g_slist_prepend(so->so_dns_queries, q);
+}
+
+/* Whether @p answers a query forwarded on @so, which it then consumes */
+static bool dns_cache_query_answered(struct socket *so, const uint8_t *p,
+                                     int qend)
+{
+    GSList *l;
+
+    for (l = so->so_dns_queries; l; l = l->next) {
+        DnsCacheQuery *q = l->data;
+
+        if (q->id == lduw_be_p(p) && q->len == qend - DNS_HDR_LEN &&
+            !memcmp(q->question, p + DNS_HDR_LEN, q->len)) {
+            g_free(q);
+            so->so_dns_queries = g_slist_delete_link(so->so_dns_queries, l);
+            return true;
+        }
+    }
+    return false;
+}
+
+void dns_cache_forget(struct socket *so)
+{
+    g_slist_free_full(so->so_dns_queries, g_free);
+    so->so_dns_queries = NULL;
+}
+
+void dns_cache_store(struct socket *so, struct mbuf *m,
+                     struct sockaddr_storage *from)
+{
+    Slirp *slirp = so->slirp;
+    uint8_t *p = (uint8_t *)m->m_data;
+    struct sockaddr_storage server = so->fhost.ss;
+    GBytes *key;
+    int flags, qend;
+    int64_t ttl, now;
+    bool has_soa;
+
+    if (!dns_cache_wanted(so) || m->m_len > DNS_CACHE_MAX_LEN) {
+        return;
+    }
+    /* Only the nameserver asked may answer, to the query it was sent */
+    sotranslate_out(so, &server);
+    if (!sockaddr_equal(from, &server)) {
+        return;
+    }
+    key = dns_question_key(p, m->m_len, &qend, &ttl, &has_soa);
+    if (!key) {
+        return;
+    }
+    if (!dns_cache_query_answered(so, p, qend)) {
+        g_bytes_unref(key);
+        return;
+    }
+
+    flags = lduw_be_p(p + 2);
+    if (!(flags & DNS_FLAG_QR)) {
+        ttl = 0;
+    } else if ((flags & DNS_RCODE_MASK) == 0 && lduw_be_p(p + 6)) {
+        ttl = MIN(ttl, DNS_CACHE_MAX_TTL);
+    } else if ((flags & DNS_RCODE_MASK) == 0 ||
+               (flags & DNS_RCODE_MASK) == DNS_RCODE_NXDOMAIN) {
+        /* Negative answers last as long as the SOA that comes with them
+         * says, and aren't cached without one */
+        ttl = has_soa ? MIN(ttl, DNS_CACHE_MAX_NEG_TTL) : 0;
+    } else {
+        ttl = 0;
+    }
+    if (ttl <= 0) {
+        g_bytes_unref(key);
+        return;
+    }
+
+    now = dns_now();
+    dns_cache_insert(slirp->dns_cache, key, p, m->m_len, now, now + ttl,
+                     true);
+    slirp->dns_cache_dirty = true;
+    if (slirp->dns_cache_path &&
+        now - slirp->dns_cache_saved >= DNS_CACHE_SAVE_INTERVAL) {
+        dns_cache_save(slirp, false);
+    }
+}
+
+void dns_cache_cleanup(Slirp *slirp)
+{
+    if (!slirp->dns_cache) {
+        return;
+    }
+    if (slirp->dns_cache_path && slirp->dns_cache_dirty) {
+        dns_cache_save(slirp, true);
+    }
+    dns_cache_save_join(slirp);
+    g_hash_table_destroy(slirp->dns_cache);
+    g_free(slirp->dns_cache_path);
+}
+
+void slirp_dns_cache_enable(Slirp *slirp, const char *path)
+{
+    slirp_lock();
+    if (!slirp->dns_cache) {
+        slirp->dns_cache = dns_cache_new();
+    }
+    g_free(slirp->dns_cache_path);
+    slirp->dns_cache_path = g_strdup(path);
+    if (path) {
+        dns_cache_load(slirp->dns_cache, path, dns_now());
+        slirp->dns_cache_saved = dns_now();
+    }
+    slirp_unlock();
+}
@@ -18,7 +18,9 @@ static void ra_timer_handler(void *opaque)
     Slirp *slirp = opaque;
     timer_mod(slirp->ra_timer,
               qemu_clock_get_ms(QEMU_CLOCK_VIRTUAL) + NDP_Interval);
+    slirp_lock();
     ndp_send_ra(slirp);
+    slirp_unlock();
 }
 
 void icmp6_init(Slirp *slirp)
@@ -44,7 +44,7 @@ void ip6_input(struct mbuf *m)
         goto bad;
     }
 
-    if (ntohs(ip6->ip_pl) > IF_MTU) {
+    if (ntohs(ip6->ip_pl) > IF_MTU && !slirp->host_offload) {
         icmp6_send_error(m, ICMP6_TOOBIG, 0);
         goto bad;
     }
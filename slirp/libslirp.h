@@ -4,6 +4,7 @@
 #include "qemu-common.h"
 
 typedef struct Slirp Slirp;
+struct virtio_net_hdr;
 
 int get_dns6_addr(struct in6_addr *pdns6_addr, uint32_t *scope_id);
 Slirp *slirp_init(int restricted, bool in_enabled, struct in_addr vnetwork,
@@ -25,6 +26,12 @@ void slirp_init_custom_dns_servers(Slirp *slirp,
                                    const struct sockaddr_storage *dns_servers,
                                    int num_dns_servers);
 
+/* Answers the DNS queries of the guest from the answers to the same
+ * questions received before, for as long as their TTL allows.  With
+ * |path|, the answers are also kept in that file, where the other
+ * instances using it find them. */
+void slirp_dns_cache_enable(Slirp *slirp, const char *path);
+
 
 /* Check whether |guest_ip| is the IPv4 address of a guest DNS server.
  * If that's the case, set |*host_ip| to the corresponding host DNS server
@@ -44,7 +51,31 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout);
 
 void slirp_pollfds_poll(GArray *pollfds, int select_error);
 
+/* Moves the polling of the sockets of all the instances out of the main
+ * loop, to a thread waiting on them with epoll.  The two functions above
+ * do nothing from then on.  Returns false if the host can't do it. */
+bool slirp_start_thread(void);
+
 void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len);
+/* Same for a frame received with the virtio-net header @hdr: its TCP or
+ * UDP checksum isn't verified if the header says it doesn't need to be */
+void slirp_input_offload(Slirp *slirp, const uint8_t *pkt, int pkt_len,
+                         const struct virtio_net_hdr *hdr);
+
+/*
+ * Offloads of the link with the guest, for a guest NIC exchanging frames
+ * with a virtio-net header.  With @host, the frames of the guest may have
+ * TCP and UDP checksums left to be computed, which aren't checked when
+ * their header says so, and be TCP super-packets larger than the MTU.
+ * The guest completes the TCP checksums of the frames sent to it with
+ * @guest_csum, and segments the super-packets it is sent with @guest_tso4
+ * and @guest_tso6.
+ */
+void slirp_set_offload(Slirp *slirp, bool host, bool guest_csum,
+                       bool guest_tso4, bool guest_tso6);
+/* Fills the virtio-net header of a frame passed to slirp_output() */
+void slirp_offload_header(Slirp *slirp, const uint8_t *pkt, int pkt_len,
+                          struct virtio_net_hdr *hdr);
 
 /* you must provide the following functions: */
 void slirp_output(void *opaque, const uint8_t *pkt, int pkt_len);
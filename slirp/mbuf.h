@@ -108,6 +108,9 @@ struct mbuf {
 #define M_USEDLIST		0x04	/* XXX mbuf is on used list (for dtom()) */
 #define M_DOFREE		0x08	/* when m_free is called on the mbuf, free()
 					 * it rather than putting it on the free list */
+#define M_NOCSUM		0x10	/* the guest left the TCP/UDP checksum to
+					 * be computed, or validated it: don't
+					 * verify it */
 
 void m_init(Slirp *);
 void m_cleanup(Slirp *slirp);
@@ -0,0 +1,132 @@
+/*
+ * epoll set of the slirp poll thread
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This code is licensed under the GPL version 2 or later. See the
+ * COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "pollset.h"
+
+#define POLLSET_TAG(slot, gen)  (((uint64_t)(gen) << 32) | (uint32_t)(slot))
+#define POLLSET_TAG_SLOT(tag)   ((uint32_t)(tag))
+#define POLLSET_TAG_GEN(tag)    ((uint32_t)((tag) >> 32))
+
+int slirp_pollset_init(SlirpPollSet *ps)
+{
+    memset(ps, 0, sizeof(*ps));
+    ps->free_slot = -1;
+    ps->epfd = epoll_create1(EPOLL_CLOEXEC);
+    return ps->epfd < 0 ? -errno : 0;
+}
+
+void slirp_pollset_cleanup(SlirpPollSet *ps)
+{
+    if (ps->epfd >= 0) {
+        close(ps->epfd);
+    }
+    g_free(ps->slots);
+    memset(ps, 0, sizeof(*ps));
+    ps->epfd = -1;
+    ps->free_slot = -1;
+}
+
+static int slirp_pollset_alloc(SlirpPollSet *ps, void *owner)
+{
+    int slot = ps->free_slot;
+
+    if (slot < 0) {
+        slot = ps->nslots++;
+        ps->slots = g_renew(SlirpPollSlot, ps->slots, ps->nslots);
+        ps->slots[slot].gen = 0;
+    } else {
+        ps->free_slot = ps->slots[slot].next_free;
+    }
+    ps->slots[slot].owner = owner;
+    ps->slots[slot].next_free = -1;
+    return slot;
+}
+
+static void slirp_pollset_free(SlirpPollSet *ps, int slot)
+{
+    ps->slots[slot].owner = NULL;
+    ps->slots[slot].gen++;
+    ps->slots[slot].next_free = ps->free_slot;
+    ps->free_slot = slot;
+}
+
+int slirp_pollset_update(SlirpPollSet *ps, SlirpPollEntry *e, void *owner,
+                         int fd, int events)
+{
+    struct epoll_event ev;
+    int ret;
+
+    if (!events) {
+        if (e->fd >= 0 && e->fd == fd) {
+            epoll_ctl(ps->epfd, EPOLL_CTL_DEL, fd, NULL);
+        }
+        /* else the old descriptor was closed, which took it out of the set */
+        e->fd = -1;
+        e->events = 0;
+        return 0;
+    }
+    if (e->fd == fd && e->events == events) {
+        return 0;
+    }
+
+    if (e->slot < 0) {
+        e->slot = slirp_pollset_alloc(ps, owner);
+    }
+    ev.events = events;
+    ev.data.u64 = POLLSET_TAG(e->slot, ps->slots[e->slot].gen);
+
+    if (e->fd == fd) {
+        ret = epoll_ctl(ps->epfd, EPOLL_CTL_MOD, fd, &ev);
+    } else {
+        if (e->fd >= 0) {
+            epoll_ctl(ps->epfd, EPOLL_CTL_DEL, e->fd, NULL);
+        }
+        ret = epoll_ctl(ps->epfd, EPOLL_CTL_ADD, fd, &ev);
+        if (ret < 0 && errno == EEXIST) {
+            ret = epoll_ctl(ps->epfd, EPOLL_CTL_MOD, fd, &ev);
+        }
+    }
+    if (ret < 0) {
+        ret = -errno;
+        e->fd = -1;
+        e->events = 0;
+        return ret;
+    }
+    e->fd = fd;
+    e->events = events;
+    return 0;
+}
+
+void slirp_pollset_forget(SlirpPollSet *ps, SlirpPollEntry *e)
+{
+    if (e->fd >= 0) {
+        epoll_ctl(ps->epfd, EPOLL_CTL_DEL, e->fd, NULL);
+    }
+    if (e->slot >= 0) {
+        slirp_pollset_free(ps, e->slot);
+    }
+    slirp_poll_entry_init(e);
+}
+
+int slirp_pollset_wait(SlirpPollSet *ps, struct epoll_event *events,
+                       int maxevents, int timeout)
+{
+    return epoll_wait(ps->epfd, events, maxevents, timeout);
+}
+
+void *slirp_pollset_owner(SlirpPollSet *ps, const struct epoll_event *ev)
+{
+    uint32_t slot = POLLSET_TAG_SLOT(ev->data.u64);
+
+    if (slot >= ps->nslots ||
+        ps->slots[slot].gen != POLLSET_TAG_GEN(ev->data.u64)) {
+        return NULL;
+    }
+    return ps->slots[slot].owner;
+}
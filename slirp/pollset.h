@@ -0,0 +1,79 @@
+/*
+ * epoll set of the slirp poll thread
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This code is licensed under the GPL version 2 or later. See the
+ * COPYING file in the top-level directory.
+ */
+#ifndef SLIRP_POLLSET_H
+#define SLIRP_POLLSET_H
+
+/* Where an owner, such as a socket, is in the set */
+typedef struct SlirpPollEntry {
+    int slot;                   /* slot of the owner, or -1 */
+    int fd;                     /* descriptor registered, or -1 */
+    int events;                 /* and the events it is registered for */
+} SlirpPollEntry;
+
+static inline void slirp_poll_entry_init(SlirpPollEntry *e)
+{
+    e->slot = -1;
+    e->fd = -1;
+    e->events = 0;
+}
+
+#ifdef CONFIG_EPOLL
+
+#include <sys/epoll.h>
+
+/*
+ * The events returned by epoll carry the slot of their owner and the
+ * generation of that slot rather than a pointer to the owner.  The owner
+ * can thus be freed while a thread waits on the set, or dispatches other
+ * events: the slot is freed with it, which bumps its generation, and the
+ * events still pending for it are recognized as stale instead of pointing
+ * to freed memory, while those of the other owners remain valid.
+ *
+ * The set itself is not thread safe: the owners must be added, updated,
+ * forgotten and looked up with the same lock held.  Only
+ * slirp_pollset_wait() can be called without it.
+ */
+typedef struct SlirpPollSlot {
+    void *owner;                /* NULL while the slot is free */
+    uint32_t gen;               /* bumped each time the slot is freed */
+    int next_free;
+} SlirpPollSlot;
+
+typedef struct SlirpPollSet {
+    int epfd;
+    SlirpPollSlot *slots;
+    int nslots;
+    int free_slot;              /* head of the free slots, or -1 */
+} SlirpPollSet;
+
+int slirp_pollset_init(SlirpPollSet *ps);
+void slirp_pollset_cleanup(SlirpPollSet *ps);
+
+/*
+ * Makes the set wait for @events on @fd, the current descriptor of
+ * @owner, or for nothing when @events is 0.  epoll is only called when
+ * this differs from what @e is registered for.  Returns 0, or a negative
+ * errno if epoll failed, @e is then left out of the set.
+ */
+int slirp_pollset_update(SlirpPollSet *ps, SlirpPollEntry *e, void *owner,
+                         int fd, int events);
+
+/* Takes @e out of the set, before its owner is freed */
+void slirp_pollset_forget(SlirpPollSet *ps, SlirpPollEntry *e);
+
+/* epoll_wait() on the set */
+int slirp_pollset_wait(SlirpPollSet *ps, struct epoll_event *events,
+                       int maxevents, int timeout);
+
+/* The owner @ev was returned for, or NULL if it was forgotten since */
+void *slirp_pollset_owner(SlirpPollSet *ps, const struct epoll_event *ev);
+
+#endif
+
+#endif
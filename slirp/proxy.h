@@ -41,4 +41,14 @@ struct SlirpProxyOps {
 
 extern bool http_proxy_on;
 
+/* Whether the stack runs in a thread of its own (see slirp_start_thread())
+ * rather than in the main loop. The methods of |slirp_proxy| are then called
+ * from that thread, with the lock below held: a proxy that only runs in the
+ * main loop has to post its work there, and to hold the lock around the
+ * calls to |connect_func| and while it looks up the |connect_opaque| it
+ * gives to them, since remove() may have been called meanwhile. */
+bool slirp_proxy_threaded(void);
+void slirp_proxy_lock(void);
+void slirp_proxy_unlock(void);
+
 #endif /* SLIRP_PROXY_H */
@@ -7,7 +7,6 @@
 
 #include "qemu/osdep.h"
 #include "slirp.h"
-#include "qemu/main-loop.h"
 
 static void sbappendsb(struct sbuf *sb, struct mbuf *m);
 
@@ -34,7 +33,7 @@ sbdrop(struct sbuf *sb, int num)
 		sb->sb_rptr -= sb->sb_datalen;
 
     if (sb->sb_cc < limit && sb->sb_cc + num >= limit) {
-        qemu_notify_event();
+        slirp_poll_update();
     }
 }
 
@@ -61,6 +60,29 @@ sbreserve(struct sbuf *sb, int size)
 	}
 }
 
+/*
+ * Double the size of sb, up to max, keeping its data.
+ * For the connections that keep their buffer full, to open
+ * their window wider
+ */
+void
+sbgrow(struct sbuf *sb, int max)
+{
+	int size = MIN(sb->sb_datalen * 2, max);
+	char *data;
+
+	if (size <= sb->sb_datalen)
+		return;
+	data = (char *)malloc(size);
+	if (!data)
+		return;
+	sbcopy(sb, 0, sb->sb_cc, data);
+	free(sb->sb_data);
+	sb->sb_data = sb->sb_rptr = data;
+	sb->sb_wptr = data + sb->sb_cc;
+	sb->sb_datalen = size;
+}
+
 /*
  * Try and write() to the socket, whatever doesn't get written
  * append to the buffer... for a host with a fast net connection,
@@ -121,6 +143,10 @@ sbappend(struct socket *so, struct mbuf *m)
 	} /* else */
 	/* Whatever happened, we free the mbuf */
 	m_free(m);
+
+	/* The host is slower than the guest, let the guest send more */
+	if (so->so_rcv.sb_cc > so->so_rcv.sb_datalen / 2)
+		sbgrow(&so->so_rcv, TCP_RCVSPACE_MAX);
 }
 
 /*
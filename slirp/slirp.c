@@ -30,6 +30,11 @@
 #include "slirp.h"
 #include "hw/hw.h"
 #include "qemu/cutils.h"
+#include "qemu/event_notifier.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "standard-headers/linux/virtio_net.h"
 
 #ifndef _WIN32
 #include <net/if.h>
@@ -370,6 +375,8 @@ void slirp_init_custom_dns_servers(Slirp *slirp,
                                    int dns_count)
 {
     int n = 0;
+
+    slirp_lock();
     for (; n < dns_count; ++n) {
         switch (dns[n].ss_family) {
         case AF_INET:
@@ -387,6 +394,7 @@ void slirp_init_custom_dns_servers(Slirp *slirp,
             ;
         }
     }
+    slirp_unlock();
 }
 
 static void slirp_init_once(void)
@@ -412,6 +420,8 @@ static void slirp_init_once(void)
 
 static void slirp_state_save(QEMUFile *f, void *opaque);
 static int slirp_state_load(QEMUFile *f, void *opaque, int version_id);
+static void slirp_thread_attach(Slirp *slirp);
+static void slirp_thread_detach(Slirp *slirp);
 
 static SaveVMHandlers savevm_slirp_state = {
     .save_state = slirp_state_save,
@@ -471,20 +481,31 @@ Slirp *slirp_init(int restricted, bool in_enabled, struct in_addr vnetwork,
 
     register_savevm_live(NULL, "slirp", 0, 4, &savevm_slirp_state, slirp);
 
+    QSIMPLEQ_INIT(&slirp->out_frames);
+    if (slirp_poll_threaded()) {
+        slirp_thread_attach(slirp);
+    }
+
+    slirp_lock();
     QTAILQ_INSERT_TAIL(&slirp_instances, slirp, entry);
+    slirp_unlock();
 
     return slirp;
 }
 
 void slirp_cleanup(Slirp *slirp)
 {
+    slirp_lock();
     QTAILQ_REMOVE(&slirp_instances, slirp, entry);
+    slirp_thread_detach(slirp);
 
     unregister_savevm(NULL, "slirp", slirp);
 
     ip_cleanup(slirp);
     ip6_cleanup(slirp);
     m_cleanup(slirp);
+    slirp_unlock();
+    dns_cache_cleanup(slirp);
 
     g_rand_free(slirp->grand);
 
@@ -523,15 +544,14 @@ static void slirp_update_timeout(uint32_t *timeout)
     *timeout = t;
 }
 
-void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
+/* Called for each socket with the events to wait for on it, 0 if none.  */
+typedef void SlirpAddPoll(struct socket *so, int events, void *opaque);
+
+static void slirp_fill_sockets(SlirpAddPoll *add_poll, void *opaque)
 {
     Slirp *slirp;
     struct socket *so, *so_next;
 
-    if (QTAILQ_EMPTY(&slirp_instances)) {
-        return;
-    }
-
     /*
      * First, TCP sockets
      */
@@ -550,8 +570,6 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
 
             so_next = so->so_next;
 
-            so->pollfds_idx = -1;
-
             /*
              * See if we need a tcp_fasttimo
              */
@@ -565,6 +583,7 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * newly socreated() sockets etc. Don't want to select these.
              */
             if (so->so_state & SS_NOFDREF || so->s == -1) {
+                add_poll(so, 0, opaque);
                 continue;
             }
 
@@ -572,12 +591,7 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * Set for reading sockets which are accepting
              */
             if (so->so_state & SS_FACCEPTCONN) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_IN | G_IO_HUP | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                add_poll(so, G_IO_IN | G_IO_HUP | G_IO_ERR, opaque);
                 continue;
             }
 
@@ -585,12 +599,7 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * Set for writing sockets which are connecting
              */
             if (so->so_state & SS_ISFCONNECTING) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_OUT | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                add_poll(so, G_IO_OUT | G_IO_ERR, opaque);
                 continue;
             }
 
@@ -611,14 +620,7 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
                 events |= G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_PRI;
             }
 
-            if (events) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = events,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
-            }
+            add_poll(so, events, opaque);
         }
 
         /*
@@ -628,8 +630,6 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
                 so = so_next) {
             so_next = so->so_next;
 
-            so->pollfds_idx = -1;
-
             /*
              * See if it's timed out
              */
@@ -653,12 +653,9 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
              * (XXX <= 4 ?)
              */
             if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_IN | G_IO_HUP | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                add_poll(so, G_IO_IN | G_IO_HUP | G_IO_ERR, opaque);
+            } else {
+                add_poll(so, 0, opaque);
             }
         }
 
@@ -669,8 +666,6 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
                 so = so_next) {
             so_next = so->so_next;
 
-            so->pollfds_idx = -1;
-
             /*
              * See if it's timed out
              */
@@ -684,236 +679,256 @@ void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
             }
 
             if (so->so_state & SS_ISFCONNECTED) {
-                GPollFD pfd = {
-                    .fd = so->s,
-                    .events = G_IO_IN | G_IO_HUP | G_IO_ERR,
-                };
-                so->pollfds_idx = pollfds->len;
-                g_array_append_val(pollfds, pfd);
+                add_poll(so, G_IO_IN | G_IO_HUP | G_IO_ERR, opaque);
+            } else {
+                add_poll(so, 0, opaque);
             }
         }
     }
-    slirp_update_timeout(timeout);
 }
 
-void slirp_pollfds_poll(GArray *pollfds, int select_error)
+static void slirp_run_timers(Slirp *slirp)
+{
+    /*
+     * See if anything has timed out
+     */
+    if (slirp->time_fasttimo &&
+        ((curtime - slirp->time_fasttimo) >= TIMEOUT_FAST)) {
+        tcp_fasttimo(slirp);
+        slirp->time_fasttimo = 0;
+    }
+    if (slirp->do_slowtimo &&
+        ((curtime - slirp->last_slowtimo) >= TIMEOUT_SLOW)) {
+        ip_slowtimo(slirp);
+        tcp_slowtimo(slirp);
+        slirp->last_slowtimo = curtime;
+    }
+}
+
+static void slirp_tcp_dispatch(struct socket *so, int revents)
 {
-    Slirp *slirp;
-    struct socket *so, *so_next;
     int ret;
 
-    if (QTAILQ_EMPTY(&slirp_instances)) {
+    if (so->so_state & SS_NOFDREF || so->s == -1) {
         return;
     }
 
-    curtime = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
-
-    QTAILQ_FOREACH(slirp, &slirp_instances, entry) {
+    /*
+     * Check for URG data
+     * This will soread as well, so no need to
+     * test for G_IO_IN below if this succeeds
+     */
+    if (revents & G_IO_PRI) {
+        ret = sorecvoob(so);
+        if (ret < 0) {
+            /* Socket error might have resulted in the socket being
+             * removed, do not try to do anything more with it. */
+            return;
+        }
+    }
+    /*
+     * Check sockets for reading
+     */
+    else if (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) {
         /*
-         * See if anything has timed out
+         * Check for incoming connections
          */
-        if (slirp->time_fasttimo &&
-            ((curtime - slirp->time_fasttimo) >= TIMEOUT_FAST)) {
-            tcp_fasttimo(slirp);
-            slirp->time_fasttimo = 0;
+        if (so->so_state & SS_FACCEPTCONN) {
+            tcp_connect(so);
+            return;
+        } /* else */
+        ret = soread(so);
+
+        /* Output it if we read something */
+        if (ret > 0) {
+            tcp_output(sototcpcb(so));
         }
-        if (slirp->do_slowtimo &&
-            ((curtime - slirp->last_slowtimo) >= TIMEOUT_SLOW)) {
-            ip_slowtimo(slirp);
-            tcp_slowtimo(slirp);
-            slirp->last_slowtimo = curtime;
+        if (ret < 0) {
+            /* Socket error might have resulted in the socket being
+             * removed, do not try to do anything more with it. */
+            return;
         }
+    }
 
+    /*
+     * Check sockets for writing
+     */
+    if (!(so->so_state & SS_NOFDREF) &&
+            (revents & (G_IO_OUT | G_IO_ERR))) {
         /*
-         * Check sockets
+         * Check for non-blocking, still-connecting sockets
          */
-        if (!select_error) {
+        if (so->so_state & SS_ISFCONNECTING) {
+            /* Connected */
+            so->so_state &= ~SS_ISFCONNECTING;
+
+            ret = send(so->s, (const void *) &ret, 0, 0);
+            if (ret < 0) {
+                /* XXXXX Must fix, zero bytes is a NOP */
+                if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINPROGRESS || errno == ENOTCONN) {
+                    return;
+                }
+
+                /* else failed */
+                so->so_state &= SS_PERSISTENT_MASK;
+                so->so_state |= SS_NOFDREF;
+            }
+            /* else so->so_state &= ~SS_ISFCONNECTING; */
+
             /*
-             * Check TCP sockets
+             * Continue tcp_input
              */
-            for (so = slirp->tcb.so_next; so != &slirp->tcb;
-                    so = so_next) {
-                int revents;
-
-                so_next = so->so_next;
+            tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
+                      so->so_ffamily);
+            /* continue; */
+        } else {
+            ret = sowrite(so);
+            if (ret > 0) {
+                /* Call tcp_output in case we need to send a window
+                 * update to the guest, otherwise it will be stuck
+                 * until it sends a window probe. */
+                tcp_output(sototcpcb(so));
+            }
+        }
+    }
 
-                revents = 0;
-                if (so->pollfds_idx != -1) {
-                    revents = g_array_index(pollfds, GPollFD,
-                                            so->pollfds_idx).revents;
-                }
+    /*
+     * Probe a still-connecting, non-blocking socket
+     * to check if it's still alive
+     */
+#ifdef PROBE_CONN
+    if (so->so_state & SS_ISFCONNECTING) {
+        ret = qemu_recv(so->s, &ret, 0, 0);
 
-                if (so->so_state & SS_NOFDREF || so->s == -1) {
-                    continue;
-                }
+        if (ret < 0) {
+            /* XXX */
+            if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                errno == EINPROGRESS || errno == ENOTCONN) {
+                return; /* Still connecting, continue */
+            }
 
-                /*
-                 * Check for URG data
-                 * This will soread as well, so no need to
-                 * test for G_IO_IN below if this succeeds
-                 */
-                if (revents & G_IO_PRI) {
-                    ret = sorecvoob(so);
-                    if (ret < 0) {
-                        /* Socket error might have resulted in the socket being
-                         * removed, do not try to do anything more with it. */
-                        continue;
-                    }
-                }
-                /*
-                 * Check sockets for reading
-                 */
-                else if (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) {
-                    /*
-                     * Check for incoming connections
-                     */
-                    if (so->so_state & SS_FACCEPTCONN) {
-                        tcp_connect(so);
-                        continue;
-                    } /* else */
-                    ret = soread(so);
-
-                    /* Output it if we read something */
-                    if (ret > 0) {
-                        tcp_output(sototcpcb(so));
-                    }
-                    if (ret < 0) {
-                        /* Socket error might have resulted in the socket being
-                         * removed, do not try to do anything more with it. */
-                        continue;
-                    }
-                }
+            /* else failed */
+            so->so_state &= SS_PERSISTENT_MASK;
+            so->so_state |= SS_NOFDREF;
 
-                /*
-                 * Check sockets for writing
-                 */
-                if (!(so->so_state & SS_NOFDREF) &&
-                        (revents & (G_IO_OUT | G_IO_ERR))) {
-                    /*
-                     * Check for non-blocking, still-connecting sockets
-                     */
-                    if (so->so_state & SS_ISFCONNECTING) {
-                        /* Connected */
-                        so->so_state &= ~SS_ISFCONNECTING;
-
-                        ret = send(so->s, (const void *) &ret, 0, 0);
-                        if (ret < 0) {
-                            /* XXXXX Must fix, zero bytes is a NOP */
-                            if (errno == EAGAIN || errno == EWOULDBLOCK ||
-                                errno == EINPROGRESS || errno == ENOTCONN) {
-                                continue;
-                            }
-
-                            /* else failed */
-                            so->so_state &= SS_PERSISTENT_MASK;
-                            so->so_state |= SS_NOFDREF;
-                        }
-                        /* else so->so_state &= ~SS_ISFCONNECTING; */
-
-                        /*
-                         * Continue tcp_input
-                         */
-                        tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
-                                  so->so_ffamily);
-                        /* continue; */
-                    } else {
-                        ret = sowrite(so);
-                        if (ret > 0) {
-                            /* Call tcp_output in case we need to send a window
-                             * update to the guest, otherwise it will be stuck
-                             * until it sends a window probe. */
-                            tcp_output(sototcpcb(so));
-                        }
-                    }
+            /* tcp_input will take care of it */
+        } else {
+            ret = send(so->s, &ret, 0, 0);
+            if (ret < 0) {
+                /* XXX */
+                if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINPROGRESS || errno == ENOTCONN) {
+                    return;
                 }
+                /* else failed */
+                so->so_state &= SS_PERSISTENT_MASK;
+                so->so_state |= SS_NOFDREF;
+            } else {
+                so->so_state &= ~SS_ISFCONNECTING;
+            }
 
-                /*
-                 * Probe a still-connecting, non-blocking socket
-                 * to check if it's still alive
-                 */
-#ifdef PROBE_CONN
-                if (so->so_state & SS_ISFCONNECTING) {
-                    ret = qemu_recv(so->s, &ret, 0, 0);
-
-                    if (ret < 0) {
-                        /* XXX */
-                        if (errno == EAGAIN || errno == EWOULDBLOCK ||
-                            errno == EINPROGRESS || errno == ENOTCONN) {
-                            continue; /* Still connecting, continue */
-                        }
-
-                        /* else failed */
-                        so->so_state &= SS_PERSISTENT_MASK;
-                        so->so_state |= SS_NOFDREF;
-
-                        /* tcp_input will take care of it */
-                    } else {
-                        ret = send(so->s, &ret, 0, 0);
-                        if (ret < 0) {
-                            /* XXX */
-                            if (errno == EAGAIN || errno == EWOULDBLOCK ||
-                                errno == EINPROGRESS || errno == ENOTCONN) {
-                                continue;
-                            }
-                            /* else failed */
-                            so->so_state &= SS_PERSISTENT_MASK;
-                            so->so_state |= SS_NOFDREF;
-                        } else {
-                            so->so_state &= ~SS_ISFCONNECTING;
-                        }
-
-                    }
-                    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
-                              so->so_ffamily);
-                } /* SS_ISFCONNECTING */
+        }
+        tcp_input((struct mbuf *)NULL, sizeof(struct ip), so,
+                  so->so_ffamily);
+    } /* SS_ISFCONNECTING */
 #endif
+}
+
+/*
+ * Incoming packets are sent straight away, they're not buffered.
+ * Incoming UDP data isn't buffered either.
+ */
+static void slirp_udp_dispatch(struct socket *so, int revents)
+{
+    if (so->s != -1 &&
+        (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
+        sorecvfrom(so);
+    }
+}
+
+/*
+ * Check incoming ICMP relies.
+ */
+static void slirp_icmp_dispatch(struct socket *so, int revents)
+{
+    if (so->s != -1 &&
+        (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
+        if (so->so_type == IPPROTO_ICMPV6)
+            icmp6_receive(so);
+        else
+            icmp_receive(so);
+    }
+}
+
+static void slirp_pollfds_add(struct socket *so, int events, void *opaque)
+{
+    GArray *pollfds = opaque;
+    GPollFD pfd = {
+        .fd = so->s,
+        .events = events,
+    };
+
+    if (!events) {
+        so->pollfds_idx = -1;
+        return;
+    }
+    so->pollfds_idx = pollfds->len;
+    g_array_append_val(pollfds, pfd);
+}
+
+static int slirp_pollfds_revents(GArray *pollfds, struct socket *so)
+{
+    if (so->pollfds_idx == -1) {
+        return 0;
+    }
+    return g_array_index(pollfds, GPollFD, so->pollfds_idx).revents;
+}
+
+void slirp_pollfds_fill(GArray *pollfds, uint32_t *timeout)
+{
+    if (QTAILQ_EMPTY(&slirp_instances) || slirp_poll_threaded()) {
+        return;
+    }
+
+    slirp_fill_sockets(slirp_pollfds_add, pollfds);
+    slirp_update_timeout(timeout);
+}
+
+void slirp_pollfds_poll(GArray *pollfds, int select_error)
+{
+    Slirp *slirp;
+    struct socket *so, *so_next;
+
+    if (QTAILQ_EMPTY(&slirp_instances) || slirp_poll_threaded()) {
+        return;
+    }
+
+    curtime = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+
+    QTAILQ_FOREACH(slirp, &slirp_instances, entry) {
+        slirp_run_timers(slirp);
+
+        /*
+         * Check sockets
+         */
+        if (!select_error) {
+            for (so = slirp->tcb.so_next; so != &slirp->tcb;
+                    so = so_next) {
+                so_next = so->so_next;
+                slirp_tcp_dispatch(so, slirp_pollfds_revents(pollfds, so));
             }
 
-            /*
-             * Now UDP sockets.
-             * Incoming packets are sent straight away, they're not buffered.
-             * Incoming UDP data isn't buffered either.
-             */
             for (so = slirp->udb.so_next; so != &slirp->udb;
                     so = so_next) {
-                int revents;
-
                 so_next = so->so_next;
-
-                revents = 0;
-                if (so->pollfds_idx != -1) {
-                    revents = g_array_index(pollfds, GPollFD,
-                            so->pollfds_idx).revents;
-                }
-
-                if (so->s != -1 &&
-                    (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
-                    sorecvfrom(so);
-                }
+                slirp_udp_dispatch(so, slirp_pollfds_revents(pollfds, so));
             }
 
-            /*
-             * Check incoming ICMP relies.
-             */
             for (so = slirp->icmp.so_next; so != &slirp->icmp;
                     so = so_next) {
-                    int revents;
-
-                    so_next = so->so_next;
-
-                    revents = 0;
-                    if (so->pollfds_idx != -1) {
-                        revents = g_array_index(pollfds, GPollFD,
-                                                so->pollfds_idx).revents;
-                    }
-
-                    if (so->s != -1 &&
-                        (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
-                        if (so->so_type == IPPROTO_ICMPV6)
-                            icmp6_receive(so);
-                        else
-                            icmp_receive(so);
-                }
+                so_next = so->so_next;
+                slirp_icmp_dispatch(so, slirp_pollfds_revents(pollfds, so));
             }
         }
 
@@ -921,6 +936,296 @@ void slirp_pollfds_poll(GArray *pollfds, int select_error)
     }
 }
 
+/*
+ * On hosts with epoll, the sockets can be polled by a thread of their own
+ * rather than by the main loop, which then no longer goes over all of them
+ * on each of its iterations.  The thread keeps an epoll set in step with
+ * the events each socket wants, which only costs a system call when those
+ * change, and dispatches the sockets that are ready.
+ *
+ * The slirp state is then protected by a lock of its own rather than by the
+ * iothread lock, so that the thread doesn't contend with the vCPUs and the
+ * main loop for it: the thread takes it to look at the sockets, and the
+ * entry points of slirp used from the main loop take it too.
+ *
+ * Frames for the guest produced meanwhile are queued, and handed to the
+ * net layer in one go by a bottom half of the main loop.
+ */
+#ifdef CONFIG_EPOLL
+
+#define SLIRP_THREAD_MAX_EVENTS 128
+
+static struct {
+    bool running;
+    QemuThread thread;
+    QemuRecMutex lock;
+    SlirpPollSet set;
+    EventNotifier kick;
+    SlirpPollEntry kick_entry;
+} slirp_thread;
+
+/* The events wanted by the sockets are passed to epoll as they are */
+QEMU_BUILD_BUG_ON((int)G_IO_IN != EPOLLIN || (int)G_IO_OUT != EPOLLOUT ||
+                  (int)G_IO_PRI != EPOLLPRI || (int)G_IO_ERR != EPOLLERR ||
+                  (int)G_IO_HUP != EPOLLHUP);
+
+bool slirp_poll_threaded(void)
+{
+    return slirp_thread.running;
+}
+
+static bool slirp_in_poll_thread(void)
+{
+    return slirp_thread.running && qemu_thread_is_self(&slirp_thread.thread);
+}
+
+void slirp_lock(void)
+{
+    if (slirp_thread.running) {
+        qemu_rec_mutex_lock(&slirp_thread.lock);
+    }
+}
+
+void slirp_unlock(void)
+{
+    if (slirp_thread.running) {
+        qemu_rec_mutex_unlock(&slirp_thread.lock);
+    }
+}
+
+void slirp_poll_kick(void)
+{
+    if (slirp_thread.running && !qemu_thread_is_self(&slirp_thread.thread)) {
+        event_notifier_set(&slirp_thread.kick);
+    }
+}
+
+void slirp_poll_forget(struct socket *so)
+{
+    if (slirp_thread.running) {
+        slirp_pollset_forget(&slirp_thread.set, &so->poll);
+    }
+}
+
+static void slirp_thread_add_poll(struct socket *so, int events, void *opaque)
+{
+    int ret = slirp_pollset_update(&slirp_thread.set, &so->poll, so, so->s,
+                                   events);
+
+    if (ret < 0) {
+        DEBUG_ERROR((dfd, " slirp: cannot poll socket %d: %s\n",
+                     so->s, strerror(-ret)));
+    }
+}
+
+static void slirp_thread_dispatch(struct epoll_event *events, int n)
+{
+    Slirp *slirp;
+    int i;
+
+    curtime = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+
+    QTAILQ_FOREACH(slirp, &slirp_instances, entry) {
+        slirp_run_timers(slirp);
+    }
+
+    for (i = 0; i < n; i++) {
+        /* NULL for the sockets freed while the thread was waiting, or by
+         * the dispatch of an earlier event */
+        void *owner = slirp_pollset_owner(&slirp_thread.set, &events[i]);
+        struct socket *so = owner;
+        int revents = events[i].events;
+
+        if (!owner) {
+            continue;
+        } else if (owner == &slirp_thread.kick) {
+            event_notifier_test_and_clear(&slirp_thread.kick);
+        } else if (so->so_type == IPPROTO_ICMP ||
+                   so->so_type == IPPROTO_ICMPV6) {
+            slirp_icmp_dispatch(so, revents);
+        } else if (so->so_tcpcb) {
+            slirp_tcp_dispatch(so, revents);
+        } else {
+            slirp_udp_dispatch(so, revents);
+        }
+    }
+
+    QTAILQ_FOREACH(slirp, &slirp_instances, entry) {
+        if_start(slirp);
+    }
+}
+
+static void *slirp_thread_run(void *opaque)
+{
+    struct epoll_event events[SLIRP_THREAD_MAX_EVENTS];
+
+    rcu_register_thread();
+
+    for (;;) {
+        uint32_t timeout = UINT32_MAX;
+        int n;
+
+        qemu_rec_mutex_lock(&slirp_thread.lock);
+        slirp_fill_sockets(slirp_thread_add_poll, NULL);
+        slirp_update_timeout(&timeout);
+        qemu_rec_mutex_unlock(&slirp_thread.lock);
+
+        n = slirp_pollset_wait(&slirp_thread.set, events,
+                               SLIRP_THREAD_MAX_EVENTS,
+                               timeout == UINT32_MAX ? -1 : (int)timeout);
+
+        qemu_rec_mutex_lock(&slirp_thread.lock);
+        slirp_thread_dispatch(events, MAX(n, 0));
+        qemu_rec_mutex_unlock(&slirp_thread.lock);
+    }
+
+    return NULL;
+}
+
+static void slirp_output_bh(void *opaque)
+{
+    Slirp *slirp = opaque;
+    QSIMPLEQ_HEAD(, SlirpFrame) frames = QSIMPLEQ_HEAD_INITIALIZER(frames);
+    SlirpFrame *frame;
+
+    /* The frames are handed to the net layer without holding the lock */
+    qemu_rec_mutex_lock(&slirp_thread.lock);
+    QSIMPLEQ_CONCAT(&frames, &slirp->out_frames);
+    qemu_rec_mutex_unlock(&slirp_thread.lock);
+
+    while ((frame = QSIMPLEQ_FIRST(&frames)) != NULL) {
+        QSIMPLEQ_REMOVE_HEAD(&frames, next);
+        slirp_output(slirp->opaque, frame->data, frame->len);
+        g_free(frame);
+    }
+}
+
+static void slirp_thread_attach(Slirp *slirp)
+{
+    slirp->output_bh = qemu_bh_new(slirp_output_bh, slirp);
+}
+
+static void slirp_thread_detach(Slirp *slirp)
+{
+    SlirpFrame *frame;
+
+    if (!slirp->output_bh) {
+        return;
+    }
+    qemu_bh_delete(slirp->output_bh);
+    slirp->output_bh = NULL;
+    while ((frame = QSIMPLEQ_FIRST(&slirp->out_frames)) != NULL) {
+        QSIMPLEQ_REMOVE_HEAD(&slirp->out_frames, next);
+        g_free(frame);
+    }
+}
+
+bool slirp_start_thread(void)
+{
+    Slirp *slirp;
+
+    if (slirp_thread.running) {
+        return true;
+    }
+
+    if (slirp_pollset_init(&slirp_thread.set) < 0) {
+        return false;
+    }
+    if (event_notifier_init(&slirp_thread.kick, false) < 0) {
+        slirp_pollset_cleanup(&slirp_thread.set);
+        return false;
+    }
+    slirp_poll_entry_init(&slirp_thread.kick_entry);
+    if (slirp_pollset_update(&slirp_thread.set, &slirp_thread.kick_entry,
+                             &slirp_thread.kick,
+                             event_notifier_get_fd(&slirp_thread.kick),
+                             EPOLLIN) < 0) {
+        event_notifier_cleanup(&slirp_thread.kick);
+        slirp_pollset_cleanup(&slirp_thread.set);
+        return false;
+    }
+
+    QTAILQ_FOREACH(slirp, &slirp_instances, entry) {
+        slirp_thread_attach(slirp);
+    }
+    qemu_rec_mutex_init(&slirp_thread.lock);
+    slirp_thread.running = true;
+    qemu_thread_create(&slirp_thread.thread, "slirp", slirp_thread_run,
+                       NULL, QEMU_THREAD_DETACHED);
+    return true;
+}
+
+#else
+
+bool slirp_poll_threaded(void)
+{
+    return false;
+}
+
+static bool slirp_in_poll_thread(void)
+{
+    return false;
+}
+
+void slirp_lock(void)
+{
+}
+
+void slirp_unlock(void)
+{
+}
+
+void slirp_poll_kick(void)
+{
+}
+
+void slirp_poll_forget(struct socket *so)
+{
+}
+
+static void slirp_thread_attach(Slirp *slirp)
+{
+}
+
+static void slirp_thread_detach(Slirp *slirp)
+{
+}
+
+bool slirp_start_thread(void)
+{
+    return false;
+}
+
+#endif
+
+void slirp_poll_update(void)
+{
+    if (slirp_poll_threaded()) {
+        slirp_poll_kick();
+    } else {
+        qemu_notify_event();
+    }
+}
+
+void slirp_send_frame(Slirp *slirp, const uint8_t *pkt, int pkt_len)
+{
+    SlirpFrame *frame;
+
+    /* Frames from the main loop go straight out unless they would overtake
+     * some from the thread.  */
+    if (!slirp->output_bh ||
+        (!slirp_in_poll_thread() && QSIMPLEQ_EMPTY(&slirp->out_frames))) {
+        slirp_output(slirp->opaque, pkt, pkt_len);
+        return;
+    }
+
+    frame = g_malloc(sizeof(*frame) + pkt_len);
+    frame->len = pkt_len;
+    memcpy(frame->data, pkt, pkt_len);
+    QSIMPLEQ_INSERT_TAIL(&slirp->out_frames, frame, next);
+    qemu_bh_schedule(slirp->output_bh);
+}
+
 static void arp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
 {
     struct slirp_arphdr *ah = (struct slirp_arphdr *)(pkt + ETH_HLEN);
@@ -973,7 +1278,7 @@ static void arp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
             rah->ar_sip = ah->ar_tip;
             memcpy(rah->ar_tha, ah->ar_sha, ETH_ALEN);
             rah->ar_tip = ah->ar_sip;
-            slirp_output(slirp->opaque, arp_reply, sizeof(arp_reply));
+            slirp_send_frame(slirp, arp_reply, sizeof(arp_reply));
         }
         break;
     case ARPOP_REPLY:
@@ -984,7 +1289,8 @@ static void arp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
     }
 }
 
-void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
+static void slirp_input_locked(Slirp *slirp, const uint8_t *pkt, int pkt_len,
+                               bool nocsum)
 {
     struct mbuf *m;
     int proto;
@@ -1012,6 +1318,9 @@ void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
 
         m->m_data += TCPIPHDR_DELTA + 2 + ETH_HLEN;
         m->m_len -= TCPIPHDR_DELTA + 2 + ETH_HLEN;
+        if (nocsum) {
+            m->m_flags |= M_NOCSUM;
+        }
 
         if (proto == ETH_P_IP) {
             ip_input(m);
@@ -1027,6 +1336,27 @@ void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
     default:
         break;
     }
+
+    /* The packet may have opened sockets, or given them data to send */
+    slirp_poll_kick();
+}
+
+void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
+{
+    slirp_lock();
+    slirp_input_locked(slirp, pkt, pkt_len, false);
+    slirp_unlock();
+}
+
+void slirp_input_offload(Slirp *slirp, const uint8_t *pkt, int pkt_len,
+                         const struct virtio_net_hdr *hdr)
+{
+    slirp_lock();
+    slirp_input_locked(slirp, pkt, pkt_len,
+                       slirp->host_offload &&
+                       (hdr->flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM |
+                                      VIRTIO_NET_HDR_F_DATA_VALID)));
+    slirp_unlock();
 }
 
 /* Prepare the IPv4 packet to be sent to the ethernet device. Returns 1 if no
@@ -1073,7 +1403,7 @@ static int if_encap4(Slirp *slirp, struct mbuf *ifm, struct ethhdr *eh,
             /* target IP */
             rah->ar_tip = iph->ip_dst.s_addr;
             slirp->client_ipaddr = iph->ip_dst;
-            slirp_output(slirp->opaque, arp_req, sizeof(arp_req));
+            slirp_send_frame(slirp, arp_req, sizeof(arp_req));
             ifm->resolution_requested = true;
 
             /* Expire request and drop outgoing packet after 1 second */
@@ -1125,9 +1455,14 @@ int if_encap(Slirp *slirp, struct mbuf *ifm)
     struct ethhdr *eh = (struct ethhdr *)buf;
     uint8_t ethaddr[ETH_ALEN];
     const struct ip *iph = (const struct ip *)ifm->m_data;
+    char *start = (ifm->m_flags & M_EXT) ? ifm->m_ext : ifm->m_dat;
     int ret;
 
-    if (ifm->m_len + ETH_HLEN > sizeof(buf)) {
+    /* The Ethernet header goes in front of the packet when the mbuf has
+     * room for it, which spares copying the packet */
+    if (ifm->m_data - start >= ETH_HLEN) {
+        eh = (struct ethhdr *)(ifm->m_data - ETH_HLEN);
+    } else if (ifm->m_len + ETH_HLEN > sizeof(buf)) {
         return 1;
     }
 
@@ -1158,14 +1493,82 @@ int if_encap(Slirp *slirp, struct mbuf *ifm)
     DEBUG_ARGS((dfd, " dst = %02x:%02x:%02x:%02x:%02x:%02x\n",
                 eh->h_dest[0], eh->h_dest[1], eh->h_dest[2],
                 eh->h_dest[3], eh->h_dest[4], eh->h_dest[5]));
-    memcpy(buf + sizeof(struct ethhdr), ifm->m_data, ifm->m_len);
-    slirp_output(slirp->opaque, buf, ifm->m_len + ETH_HLEN);
+    if (eh == (struct ethhdr *)buf) {
+        memcpy(buf + sizeof(struct ethhdr), ifm->m_data, ifm->m_len);
+    }
+    slirp_send_frame(slirp, (uint8_t *)eh, ifm->m_len + ETH_HLEN);
     return 1;
 }
 
+void slirp_set_offload(Slirp *slirp, bool host, bool guest_csum,
+                       bool guest_tso4, bool guest_tso6)
+{
+    slirp_lock();
+    slirp->host_offload = host;
+    slirp->guest_csum = guest_csum;
+    /* The super-packets have their checksum left to the guest too */
+    slirp->guest_tso4 = guest_csum && guest_tso4;
+    slirp->guest_tso6 = guest_csum && guest_tso6;
+    slirp_unlock();
+}
+
+/*
+ * When the guest completes the TCP checksums, all the TCP segments are
+ * sent with only the sum of their pseudo-header in it (see tcp_output()
+ * and tcp_respond()), and the frames larger than the MTU are the
+ * super-packets of tcp_output(), made of segments as large as the MTU
+ * allows.
+ */
+void slirp_offload_header(Slirp *slirp, const uint8_t *pkt, int pkt_len,
+                          struct virtio_net_hdr *hdr)
+{
+    int iphlen, thlen, proto;
+    uint8_t gso_type;
+
+    memset(hdr, 0, sizeof(*hdr));
+    if (!slirp->guest_csum || pkt_len < ETH_HLEN) {
+        return;
+    }
+
+    switch (lduw_be_p(pkt + 12)) {
+    case ETH_P_IP:
+        if (pkt_len < ETH_HLEN + sizeof(struct ip)) {
+            return;
+        }
+        iphlen = (pkt[ETH_HLEN] & 0xf) << 2;
+        proto = pkt[ETH_HLEN + offsetof(struct ip, ip_p)];
+        gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+        break;
+    case ETH_P_IPV6:
+        iphlen = sizeof(struct ip6);
+        if (pkt_len < ETH_HLEN + iphlen) {
+            return;
+        }
+        proto = pkt[ETH_HLEN + offsetof(struct ip6, ip_nh)];
+        gso_type = VIRTIO_NET_HDR_GSO_TCPV6;
+        break;
+    default:
+        return;
+    }
+    if (proto != IPPROTO_TCP ||
+        pkt_len < ETH_HLEN + iphlen + sizeof(struct tcphdr)) {
+        return;
+    }
+    thlen = (pkt[ETH_HLEN + iphlen + 12] >> 4) << 2;
+
+    hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr->csum_start = ETH_HLEN + iphlen;
+    hdr->csum_offset = offsetof(struct tcphdr, th_sum);
+    if (pkt_len > ETH_HLEN + IF_MTU) {
+        hdr->gso_type = gso_type;
+        hdr->hdr_len = ETH_HLEN + iphlen + thlen;
+        hdr->gso_size = IF_MTU - iphlen - thlen;
+    }
+}
+
 /* Drop host forwarding rule, return 0 if found. */
-int slirp_remove_hostfwd(Slirp *slirp, int is_udp, struct in_addr host_addr,
-                         int host_port)
+static int slirp_remove_hostfwd_locked(Slirp *slirp, int is_udp,
+                                       struct in_addr host_addr, int host_port)
 {
     struct socket *so;
     struct socket *head = (is_udp ? &slirp->udb : &slirp->tcb);
@@ -1188,8 +1591,20 @@ int slirp_remove_hostfwd(Slirp *slirp, int is_udp, struct in_addr host_addr,
     return -1;
 }
 
-int slirp_add_hostfwd(Slirp *slirp, int is_udp, struct in_addr host_addr,
-                      int host_port, struct in_addr guest_addr, int guest_port)
+int slirp_remove_hostfwd(Slirp *slirp, int is_udp, struct in_addr host_addr,
+                         int host_port)
+{
+    int ret;
+
+    slirp_lock();
+    ret = slirp_remove_hostfwd_locked(slirp, is_udp, host_addr, host_port);
+    slirp_unlock();
+    return ret;
+}
+
+static int slirp_add_hostfwd_locked(Slirp *slirp, int is_udp,
+                                    struct in_addr host_addr, int host_port,
+                                    struct in_addr guest_addr, int guest_port)
 {
     if (!guest_addr.s_addr) {
         guest_addr = slirp->vdhcp_startaddr;
@@ -1203,12 +1618,26 @@ int slirp_add_hostfwd(Slirp *slirp, int is_udp, struct in_addr host_addr,
                         guest_addr.s_addr, htons(guest_port), SS_HOSTFWD))
             return -1;
     }
+    slirp_poll_kick();
     return 0;
 }
 
+int slirp_add_hostfwd(Slirp *slirp, int is_udp, struct in_addr host_addr,
+                      int host_port, struct in_addr guest_addr, int guest_port)
+{
+    int ret;
+
+    slirp_lock();
+    ret = slirp_add_hostfwd_locked(slirp, is_udp, host_addr, host_port,
+                                   guest_addr, guest_port);
+    slirp_unlock();
+    return ret;
+}
+
 /* Drop host forwarding rule, return 0 if found. */
-int slirp_remove_ipv6_hostfwd(Slirp *slirp, int is_udp, struct in6_addr host_addr,
-                         int host_port)
+static int slirp_remove_ipv6_hostfwd_locked(Slirp *slirp, int is_udp,
+                                            struct in6_addr host_addr,
+                                            int host_port)
 {
     struct socket *so;
     struct socket *head = (is_udp ? &slirp->udb : &slirp->tcb);
@@ -1232,8 +1661,23 @@ int slirp_remove_ipv6_hostfwd(Slirp *slirp, int is_udp, struct in6_addr host_add
     return -1;
 }
 
-int slirp_add_ipv6_hostfwd(Slirp *slirp, int is_udp, struct in6_addr host_addr,
-                      int host_port, struct in6_addr guest_addr, int guest_port)
+int slirp_remove_ipv6_hostfwd(Slirp *slirp, int is_udp,
+                              struct in6_addr host_addr, int host_port)
+{
+    int ret;
+
+    slirp_lock();
+    ret = slirp_remove_ipv6_hostfwd_locked(slirp, is_udp, host_addr,
+                                           host_port);
+    slirp_unlock();
+    return ret;
+}
+
+static int slirp_add_ipv6_hostfwd_locked(Slirp *slirp, int is_udp,
+                                         struct in6_addr host_addr,
+                                         int host_port,
+                                         struct in6_addr guest_addr,
+                                         int guest_port)
 {
     // TODO
     // if (!guest_addr.s_addr) {
@@ -1250,11 +1694,25 @@ int slirp_add_ipv6_hostfwd(Slirp *slirp, int is_udp, struct in6_addr host_addr,
             return -1;
     }
 
+    slirp_poll_kick();
     return 0;
 }
 
-int slirp_add_exec(Slirp *slirp, int do_pty, const void *args,
-                   struct in_addr *guest_addr, int guest_port)
+int slirp_add_ipv6_hostfwd(Slirp *slirp, int is_udp,
+                           struct in6_addr host_addr, int host_port,
+                           struct in6_addr guest_addr, int guest_port)
+{
+    int ret;
+
+    slirp_lock();
+    ret = slirp_add_ipv6_hostfwd_locked(slirp, is_udp, host_addr, host_port,
+                                        guest_addr, guest_port);
+    slirp_unlock();
+    return ret;
+}
+
+static int slirp_add_exec_locked(Slirp *slirp, int do_pty, const void *args,
+                                 struct in_addr *guest_addr, int guest_port)
 {
     if (!guest_addr->s_addr) {
         guest_addr->s_addr = slirp->vnetwork_addr.s_addr |
@@ -1270,6 +1728,17 @@ int slirp_add_exec(Slirp *slirp, int do_pty, const void *args,
                     htons(guest_port));
 }
 
+int slirp_add_exec(Slirp *slirp, int do_pty, const void *args,
+                   struct in_addr *guest_addr, int guest_port)
+{
+    int ret;
+
+    slirp_lock();
+    ret = slirp_add_exec_locked(slirp, do_pty, args, guest_addr, guest_port);
+    slirp_unlock();
+    return ret;
+}
+
 ssize_t slirp_send(struct socket *so, const void *buf, size_t len, int flags)
 {
     if (so->s == -1 && so->extra) {
@@ -1296,8 +1765,9 @@ slirp_find_ctl_socket(Slirp *slirp, struct in_addr guest_addr, int guest_port)
     return NULL;
 }
 
-size_t slirp_socket_can_recv(Slirp *slirp, struct in_addr guest_addr,
-                             int guest_port)
+static size_t slirp_socket_can_recv_locked(Slirp *slirp,
+                                           struct in_addr guest_addr,
+                                           int guest_port)
 {
     struct iovec iov[2];
     struct socket *so;
@@ -1315,8 +1785,20 @@ size_t slirp_socket_can_recv(Slirp *slirp, struct in_addr guest_addr,
     return sopreprbuf(so, iov, NULL);
 }
 
-void slirp_socket_recv(Slirp *slirp, struct in_addr guest_addr, int guest_port,
-                       const uint8_t *buf, int size)
+size_t slirp_socket_can_recv(Slirp *slirp, struct in_addr guest_addr,
+                             int guest_port)
+{
+    size_t ret;
+
+    slirp_lock();
+    ret = slirp_socket_can_recv_locked(slirp, guest_addr, guest_port);
+    slirp_unlock();
+    return ret;
+}
+
+static void slirp_socket_recv_locked(Slirp *slirp, struct in_addr guest_addr,
+                                     int guest_port, const uint8_t *buf,
+                                     int size)
 {
     int ret;
     struct socket *so = slirp_find_ctl_socket(slirp, guest_addr, guest_port);
@@ -1330,6 +1812,14 @@ void slirp_socket_recv(Slirp *slirp, struct in_addr guest_addr, int guest_port,
         tcp_output(sototcpcb(so));
 }
 
+void slirp_socket_recv(Slirp *slirp, struct in_addr guest_addr, int guest_port,
+                       const uint8_t *buf, int size)
+{
+    slirp_lock();
+    slirp_socket_recv_locked(slirp, guest_addr, guest_port, buf, size);
+    slirp_unlock();
+}
+
 static int slirp_tcp_post_load(void *opaque, int version)
 {
     tcp_template((struct tcpcb *)opaque);
@@ -1623,9 +2113,8 @@ static const VMStateDescription vmstate_slirp = {
     }
 };
 
-static void slirp_state_save(QEMUFile *f, void *opaque)
+static void slirp_state_save_locked(QEMUFile *f, Slirp *slirp)
 {
-    Slirp *slirp = opaque;
     struct socket *so;
     struct ex_list *ex_ptr;
 
@@ -1653,6 +2142,13 @@ static void slirp_state_save(QEMUFile *f, void *opaque)
     vmstate_save_state(f, &vmstate_slirp, slirp, NULL);
 }
 
+static void slirp_state_save(QEMUFile *f, void *opaque)
+{
+    slirp_lock();
+    slirp_state_save_locked(f, opaque);
+    slirp_unlock();
+}
+
 #ifdef DEBUG
 static void print_so_list(struct socket* head, struct socket* tail) {
     struct socket *tmpSocket;
@@ -1709,6 +2205,7 @@ static int cleanup_old_so_list(struct socket *old_head, struct socket *old_tail,
             closesocket(old_head->s);
             // TODO: should we call slirp_proxy->remove(so)?
         }
+        slirp_poll_forget(old_head);
         free(old_head->so_rcv.sb_data);
         free(old_head->so_snd.sb_data);
         free(old_head);
@@ -1716,11 +2213,11 @@ static int cleanup_old_so_list(struct socket *old_head, struct socket *old_tail,
     }
 }
 
-static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
+static int slirp_state_load_locked(QEMUFile *f, Slirp *slirp, int version_id)
 {
-    Slirp *slirp = opaque;
     struct ex_list *ex_ptr;
     struct socket *tcp_old_head = slirp->tcb.so_next;
+    int ret;
 
 #ifdef DEBUG
     printf("So before snapshot load:\n");
@@ -1747,7 +2244,6 @@ static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
     slirp->tcp_last_so = &slirp->tcb;
 
     while (qemu_get_byte(f)) {
-        int ret;
         struct socket *so = socreate(slirp);
 
         if (!so) {
@@ -1766,7 +2262,6 @@ static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
     cleanup_old_so_list(tcp_old_head, &slirp->tcb, &slirp->tcb, &slirp->tcb);
 
     while (qemu_get_byte(f)) {
-        int ret;
         struct socket *so = socreate(slirp);
 
         if (!so)
@@ -1808,6 +2303,17 @@ static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
     return vmstate_load_state(f, &vmstate_slirp, slirp, version_id);
 }
 
+static int slirp_state_load(QEMUFile *f, void *opaque, int version_id)
+{
+    int ret;
+
+    slirp_lock();
+    ret = slirp_state_load_locked(f, opaque, version_id);
+    slirp_unlock();
+    slirp_poll_kick();
+    return ret;
+}
+
 void slirp_set_cleanup_ip_on_load(bool enable) {
     enable_cleanup_ip_on_load = enable;
 }
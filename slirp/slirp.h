@@ -73,6 +73,7 @@ typedef char *caddr_t;
 #include "debug.h"
 
 #include "qemu/queue.h"
+#include "qemu/thread.h"
 #include "qemu/sockets.h"
 #include "net/eth.h"
 
@@ -88,6 +89,7 @@ typedef char *caddr_t;
 #include "ip6_icmp.h"
 #include "mbuf.h"
 #include "sbuf.h"
+#include "pollset.h"
 #include "socket.h"
 #include "if.h"
 #include "main.h"
@@ -152,6 +154,13 @@ bool ndp_table_search(Slirp *slirp, struct in6_addr ip_addr,
 
 #define SLIRP_MAX_DNS_SERVERS 4
 
+/* A frame for the guest, queued by the poll thread */
+typedef struct SlirpFrame {
+    QSIMPLEQ_ENTRY(SlirpFrame) next;
+    int len;
+    uint8_t data[];
+} SlirpFrame;
+
 struct Slirp {
     QTAILQ_ENTRY(Slirp) entry;
     u_int time_fasttimo;
@@ -224,6 +233,25 @@ struct Slirp {
     GRand *grand;
     QEMUTimer *ra_timer;
 
+    /* dns cache states, see slirp_dns_cache_enable() */
+    GHashTable *dns_cache;
+    char *dns_cache_path;
+    int64_t dns_cache_saved;
+    bool dns_cache_dirty;
+    bool dns_cache_saving;
+    int dns_cache_save_done;
+    QemuThread dns_cache_thread;    /* merging answers into the file */
+
+    /* offloads of the link with the guest, see slirp_set_offload() */
+    bool host_offload;      /* guest frames skip checksums and the MTU */
+    bool guest_csum;        /* TCP checksums are left to the guest */
+    bool guest_tso4;        /* TCP super-packets are sent to the guest */
+    bool guest_tso6;
+
+    /* frames for the guest, when sockets are polled by a thread */
+    QSIMPLEQ_HEAD(, SlirpFrame) out_frames;
+    QEMUBH *output_bh;
+
     void *opaque;
 };
 
@@ -235,6 +263,25 @@ extern Slirp *slirp_instance;
 
 void if_start(Slirp *);
 
+/* Hands a frame to the guest, from whichever thread the sockets are
+ * polled by */
+void slirp_send_frame(Slirp *slirp, const uint8_t *pkt, int pkt_len);
+
+/* Whether the sockets are polled by a thread rather than the main loop */
+bool slirp_poll_threaded(void);
+/* Makes the poll thread look at the sockets again, e.g. after new ones
+ * were created or were given data to send; a no-op on the thread itself */
+void slirp_poll_kick(void);
+/* Same as slirp_poll_kick(), or wakes up the main loop */
+void slirp_poll_update(void);
+/* Called before @so is freed */
+void slirp_poll_forget(struct socket *so);
+/* Serialize the code using the state of slirp on the main loop with the
+ * poll thread, which runs without the iothread lock; no-ops without it.
+ * They nest. */
+void slirp_lock(void);
+void slirp_unlock(void);
+
 /* ncsi.c */
 void ncsi_input(Slirp *slirp, const uint8_t *pkt, int pkt_len);
 
@@ -250,6 +297,14 @@ static const short kDnsPort = 53;
 /* dnssearch.c */
 int translate_dnssearch(Slirp *s, const char ** names);
 
+/* dnscache.c */
+bool dns_cache_answer(struct socket *so, struct mbuf *m);
+void dns_cache_query_sent(struct socket *so, struct mbuf *m);
+void dns_cache_store(struct socket *so, struct mbuf *m,
+                     struct sockaddr_storage *from);
+void dns_cache_forget(struct socket *so);
+void dns_cache_cleanup(Slirp *slirp);
+
 /* cksum.c */
 int cksum(struct mbuf *m, int len);
 int ip6_cksum(struct mbuf *m);
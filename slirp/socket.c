@@ -56,6 +56,7 @@ socreate(Slirp *slirp)
     so->s = -1;
     so->slirp = slirp;
     so->pollfds_idx = -1;
+    slirp_poll_entry_init(&so->poll);
   }
   return(so);
 }
@@ -91,6 +92,8 @@ sofree(struct socket *so)
 
   soqfree(so, &slirp->if_fastq);
   soqfree(so, &slirp->if_batchq);
+  slirp_poll_forget(so);
+  dns_cache_forget(so);
 
   if (so->so_state) {
 	slirp_proxy->remove(so);
@@ -262,6 +265,10 @@ soread(struct socket *so)
 	sb->sb_wptr += nn;
 	if (sb->sb_wptr >= (sb->sb_data + sb->sb_datalen))
 		sb->sb_wptr -= sb->sb_datalen;
+
+	/* The host had more than we could take, take more next time */
+	if (sbspace(sb) < so->so_tcpcb->t_maxseg)
+		sbgrow(sb, TCP_SNDSPACE_MAX);
 	return nn;
 }
 
@@ -638,6 +645,7 @@ sorecvfrom(struct socket *so)
 	      else
 		so->so_expire = curtime + SO_EXPIRE;
 	    }
+	    dns_cache_store(so, m, &addr);
 
 	    /*
 	     * If this packet was destined for CTL_ADDR,
@@ -678,6 +686,13 @@ sosendto(struct socket *so, struct mbuf *m)
 	DEBUG_ARG("so = %p", so);
 	DEBUG_ARG("m = %p", m);
 
+	/* Answered without asking, the socket is done with */
+	if (dns_cache_answer(so, m)) {
+		if (so->so_expire)
+			so->so_expire = curtime + SO_EXPIREFAST;
+		return 0;
+	}
+
 	addr = so->fhost.ss;
 	DEBUG_CALL(" sendto()ing)");
 	sotranslate_out(so, &addr);
@@ -688,6 +703,7 @@ sosendto(struct socket *so, struct mbuf *m)
 		     (struct sockaddr *)&addr, sockaddr_size(&addr));
 	if (ret < 0)
 		return -1;
+	dns_cache_query_sent(so, m);
 
 	/*
 	 * Kill the socket if there's no reply in 4 minutes,
@@ -1060,3 +1076,18 @@ const char* sockaddr_to_string(const struct sockaddr_storage* ss) {
 
 const struct SlirpProxyOps *slirp_proxy;
 bool http_proxy_on = false;
+
+bool slirp_proxy_threaded(void)
+{
+    return slirp_poll_threaded();
+}
+
+void slirp_proxy_lock(void)
+{
+    slirp_lock();
+}
+
+void slirp_proxy_unlock(void)
+{
+    slirp_unlock();
+}
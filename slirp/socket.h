@@ -31,6 +31,7 @@ struct socket {
 #endif
 
   int pollfds_idx;                 /* GPollFD GArray index */
+  SlirpPollEntry poll;             /* in the set of the poll thread */
 
   Slirp *slirp;			   /* managing slirp instance */
 
@@ -72,6 +73,7 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+  GSList *so_dns_queries;	/* DNS queries awaiting an answer, see dnscache.c */
 };
 
 
@@ -40,6 +40,9 @@ typedef	uint32_t tcp_seq;
 
 #define TCP_SNDSPACE 8192
 #define TCP_RCVSPACE 8192
+/* what the buffers of the connections that keep them full grow up to */
+#define TCP_SNDSPACE_MAX 65535
+#define TCP_RCVSPACE_MAX 65535
 
 /*
  * TCP header.
@@ -335,7 +335,7 @@ tcp_input(struct mbuf *m, int iphlen, struct socket *inso, unsigned short af)
 	}
 
 	len = ((sizeof(struct tcpiphdr) - sizeof(struct tcphdr)) + tlen);
-	if (cksum(m, len)) {
+	if (!(m->m_flags & M_NOCSUM) && cksum(m, len)) {
 	    goto drop;
 	}
 
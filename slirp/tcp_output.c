@@ -52,6 +52,30 @@ static const u_char  tcp_outflags[TCP_NSTATES] = {
 #undef MAX_TCPOPTLEN
 #define MAX_TCPOPTLEN	32	/* max # bytes that go in options */
 
+/*
+ * The most data to put in a segment: one maximum segment, or when the
+ * guest takes super-packets, as many as fit in 64K.  The guest is told
+ * their segments are as large as the MTU allows (see
+ * slirp_offload_header()), so this is only done when they are.
+ */
+static long
+tcp_maxlen(struct tcpcb *tp)
+{
+	struct socket *so = tp->t_socket;
+	int hdrlen;
+
+	if (so->so_ffamily == AF_INET && so->slirp->guest_tso4)
+		hdrlen = sizeof(struct ip) + sizeof(struct tcphdr);
+	else if (so->so_ffamily == AF_INET6 && so->slirp->guest_tso6)
+		hdrlen = sizeof(struct ip6) + sizeof(struct tcphdr);
+	else
+		return tp->t_maxseg;
+
+	if (tp->t_maxseg != IF_MTU - hdrlen)
+		return tp->t_maxseg;
+	return (IP_MAXPACKET - hdrlen) / tp->t_maxseg * tp->t_maxseg;
+}
+
 /*
  * Tcp output routine: figure out what should be sent and send it.
  */
@@ -59,7 +83,7 @@ int
 tcp_output(struct tcpcb *tp)
 {
 	register struct socket *so;
-	register long len, win;
+	register long len, win, maxlen;
 	int off, flags, error;
 	register struct mbuf *m;
 	register struct tcpiphdr *ti, tcpiph_save;
@@ -93,6 +117,7 @@ tcp_output(struct tcpcb *tp)
 		 * slow start to get ack "clock" running again.
 		 */
 		tp->snd_cwnd = tp->t_maxseg;
+	maxlen = tcp_maxlen(tp);
 again:
 	sendalot = 0;
 	off = tp->snd_nxt - tp->snd_una;
@@ -155,8 +180,8 @@ again:
 		}
 	}
 
-	if (len > tp->t_maxseg) {
-		len = tp->t_maxseg;
+	if (len > maxlen) {
+		len = maxlen;
 		sendalot = 1;
 	}
 	if (SEQ_LT(tp->snd_nxt + len, tp->snd_una + so->so_snd.sb_cc))
@@ -175,7 +200,7 @@ again:
 	 * to send into a small window), then must resend.
 	 */
 	if (len) {
-		if (len == tp->t_maxseg)
+		if (len >= tp->t_maxseg)
 			goto send;
 		if ((1 || idle || tp->t_flags & TF_NODELAY) &&
 		    len + off >= so->so_snd.sb_cc)
@@ -291,8 +316,8 @@ send:
 	 * Adjust data length if insertion of options will
 	 * bump the packet length beyond the t_maxseg length.
 	 */
-	 if (len > tp->t_maxseg - optlen) {
-		len = tp->t_maxseg - optlen;
+	 if (len > maxlen - optlen) {
+		len = maxlen - optlen;
 		sendalot = 1;
 	 }
 
@@ -309,6 +334,8 @@ send:
 		}
 		m->m_data += IF_MAXLINKHDR;
 		m->m_len = hdrlen;
+		/* Super-packets don't fit in an mbuf */
+		m_inc(m, hdrlen + len);
 
 		sbcopy(&so->so_snd, off, (int) len, mtod(m, caddr_t) + hdrlen);
 		m->m_len += len;
@@ -392,12 +419,17 @@ send:
 
 	/*
 	 * Put TCP length in extended header, and then
-	 * checksum extended header and data.
+	 * checksum extended header and data, or only the
+	 * extended header when the guest completes it.
 	 */
 	if (len + optlen)
 		ti->ti_len = htons((uint16_t)(sizeof (struct tcphdr) +
 		    optlen + len));
-	ti->ti_sum = cksum(m, (int)(hdrlen + len));
+	if (so->slirp->guest_csum)
+		ti->ti_sum = ~cksum(m, sizeof(struct tcpiphdr) -
+				       sizeof(struct tcphdr));
+	else
+		ti->ti_sum = cksum(m, (int)(hdrlen + len));
 
 	/*
 	 * In transmit state, time the transmission and arrange for
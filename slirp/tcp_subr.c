@@ -201,7 +201,11 @@ tcp_respond(struct tcpcb *tp, struct tcpiphdr *ti, struct mbuf *m,
 		ti->ti_win = htons((uint16_t)win);
 	ti->ti_urp = 0;
 	ti->ti_sum = 0;
-	ti->ti_sum = cksum(m, tlen);
+	if (m->slirp->guest_csum)
+		ti->ti_sum = ~cksum(m, sizeof(struct tcpiphdr) -
+				       sizeof(struct tcphdr));
+	else
+		ti->ti_sum = cksum(m, tlen);
 
 	struct tcpiphdr tcpiph_save = *(mtod(m, struct tcpiphdr *));
 	struct ip *ip;
@@ -394,6 +398,9 @@ tcp_sockclosed(struct tcpcb *tp)
 static void
 tcp_on_proxy_connection(void *opaque, int fd, int af) {
         struct socket *so = opaque;
+
+        /* Called by the proxy from the main loop */
+        slirp_lock();
         so->so_state &= ~SS_PROXIFIED;
 	if (fd >= 0) {
 		so->s = fd;
@@ -405,6 +412,9 @@ tcp_on_proxy_connection(void *opaque, int fd, int af) {
 	tcp_input(NULL,
                   (af == AF_INET6) ? sizeof(struct ip6) : sizeof(struct ip),
                   so, af);
+	slirp_unlock();
+	/* The socket has a descriptor to poll now */
+	slirp_poll_kick();
 }
 
 /* If addr is 127.0.0.1 and we can't create IPv4 socket, create IPv6 socket and
@@ -33,7 +33,7 @@ void udp6_input(struct mbuf *m)
     m->m_len += iphlen;
     m->m_data -= iphlen;
 
-    if (ip6_cksum(m)) {
+    if (!(m->m_flags & M_NOCSUM) && ip6_cksum(m)) {
         goto bad;
     }
 
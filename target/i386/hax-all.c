@@ -33,6 +33,7 @@
 #include "hax-i386.h"
 #include "sysemu/accel.h"
 #include "sysemu/sysemu.h"
+#include "qemu/latency.h"
 #include "qemu/main-loop.h"
 #include "hw/boards.h"
 
@@ -648,6 +649,7 @@ static int hax_vcpu_hax_exec(CPUArchState *env, int ug_platform)
     X86CPU *x86_cpu = X86_CPU(cpu);
     struct hax_vcpu_state *vcpu = cpu->hax_vcpu;
     struct hax_tunnel *ht = vcpu->tunnel;
+    int64_t exit_start;
 
     if (!ug_platform) {
         if (hax_vcpu_emulation_mode(cpu)) {
@@ -758,6 +760,7 @@ vcpu_run:
             qemu_mutex_lock_iothread();
             current_cpu = cpu;
         }
+        exit_start = qemu_latency_start();
 
         /* Simply continue the vcpu_run if system call interrupted */
         if (hax_ret == -EINTR || hax_ret == -EAGAIN) {
@@ -838,6 +841,7 @@ vcpu_run:
             ret = HAX_EMUL_EXITLOOP;
             break;
         }
+        qemu_latency_end(QEMU_LATENCY_VCPU_EXIT, exit_start);
     } while (!ret);
 
     if (cpu->exit_request) {
@@ -33,6 +33,7 @@
 #include "qemu/cutils.h"
 #include "qemu/host-utils.h"
 #include "qemu/timer.h"
+#include "qemu/crc32c.h"
 
 /* Note: the long term plan is to reduce the dependencies on the QEMU
    CPU definitions. Currently they are used for qemu_ld/st
@@ -128,6 +129,9 @@ static int tcg_target_const_match(tcg_target_long val, TCGType type,
 #ifdef TCG_TARGET_NEED_LDST_LABELS
 static bool tcg_out_ldst_finalize(TCGContext *s);
 #endif
+#ifdef TCG_TARGET_NEED_HOST_RELOCS
+static uint32_t tcg_target_code_features(void);
+#endif
 
 #define TCG_HIGHWATER 1024
 
@@ -816,6 +820,7 @@ void tcg_prologue_init(TCGContext *s)
     s->code_gen_ptr = buf1;
     s->code_gen_buffer = buf1;
     s->code_buf = buf1;
+    s->code_gen_prologue_size = prologue_size;
     total_size -= prologue_size;
     s->code_gen_buffer_size = total_size;
 
@@ -858,6 +863,232 @@ void tcg_prologue_init(TCGContext *s)
     }
 }
 
+/* Host relocations: the code of a TB refers to the helpers it calls, to
+   the prologue and to its own TranslationBlock, all of which live
+   elsewhere in another process.  Recording these lets the code be copied
+   to another process and fixed up there.  */
+
+#if defined(TCG_TARGET_NEED_HOST_RELOCS) && defined(CONFIG_SOFTMMU)
+#define TCG_HOST_LDST_SYMBOLS
+#define TCG_NB_LDST_HELPERS ARRAY_SIZE(qemu_ld_helpers)
+#else
+#define TCG_NB_LDST_HELPERS 0
+#endif
+
+/* Symbols are numbered by their place in all_helpers, followed by the
+   load and store helpers of the backend.  */
+static const void *tcg_host_symbol(uint64_t index)
+{
+    if (index < ARRAY_SIZE(all_helpers)) {
+        return all_helpers[index].func;
+    }
+    index -= ARRAY_SIZE(all_helpers);
+#ifdef TCG_HOST_LDST_SYMBOLS
+    if (index < TCG_NB_LDST_HELPERS) {
+        return qemu_ld_helpers[index];
+    }
+    index -= TCG_NB_LDST_HELPERS;
+    if (index < TCG_NB_LDST_HELPERS) {
+        return qemu_st_helpers[index];
+    }
+#endif
+    return NULL;
+}
+
+static bool tcg_host_symbol_index(const void *addr, uint64_t *index)
+{
+    const TCGHelperInfo *info = g_hash_table_lookup(helper_table, addr);
+    size_t i;
+
+    if (info) {
+        *index = info - all_helpers;
+        return true;
+    }
+    for (i = 0; i < 2 * TCG_NB_LDST_HELPERS; ++i) {
+        if (tcg_host_symbol(ARRAY_SIZE(all_helpers) + i) == addr) {
+            *index = ARRAY_SIZE(all_helpers) + i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void tcg_host_reloc_add(TCGContext *s, tcg_insn_unit *site,
+                               TCGHostRelocForm form, TCGHostRelocKind kind,
+                               uint64_t target)
+{
+    TCGHostReloc *r;
+
+    if (s->nb_host_relocs == TCG_MAX_HOST_RELOCS) {
+        s->host_relocs_failed = true;
+        return;
+    }
+    r = &s->host_relocs[s->nb_host_relocs++];
+    r->offset = tcg_ptr_byte_diff(site, s->code_buf);
+    r->kind = kind;
+    r->form = form;
+    r->unused = 0;
+    r->target = target;
+}
+
+/* Records that the field at |site| holds |addr| in |form|.  */
+void tcg_host_reloc(TCGContext *s, tcg_insn_unit *site,
+                    TCGHostRelocForm form, uintptr_t addr)
+{
+    void *ptr = (void *)addr;
+    uint64_t index;
+
+    if (!s->record_host_relocs) {
+        return;
+    }
+    if (ptr >= s->code_gen_prologue
+        && ptr < s->code_gen_prologue + s->code_gen_prologue_size) {
+        tcg_host_reloc_add(s, site, form, TCG_HOST_RELOC_PROLOGUE,
+                           ptr - s->code_gen_prologue);
+    } else if (ptr >= (void *)s->code_buf
+               && ptr < s->code_gen_highwater + TCG_HIGHWATER) {
+        /* Displacements within the TB hold wherever it lives.  */
+        if (form != TCG_HOST_RELOC_PC32) {
+            tcg_host_reloc_add(s, site, form, TCG_HOST_RELOC_CODE,
+                               ptr - (void *)s->code_buf);
+        }
+    } else if (tcg_host_symbol_index(ptr, &index)) {
+        tcg_host_reloc_add(s, site, form, TCG_HOST_RELOC_SYMBOL, index);
+    } else {
+        s->host_relocs_failed = true;
+    }
+}
+
+/* Records that the field at |site| holds |tb_addr|, which points into
+   the TranslationBlock of the code, such as the value of exit_tb.  */
+void tcg_host_reloc_tb(TCGContext *s, tcg_insn_unit *site,
+                       TCGHostRelocForm form, uintptr_t tb_addr)
+{
+    if (s->record_host_relocs) {
+        /* Made relative to the TB by tcg_gen_code.  */
+        tcg_host_reloc_add(s, site, form, TCG_HOST_RELOC_TB, tb_addr);
+    }
+}
+
+/* Fixes up the code of |tb|, copied from another process, for this one.
+   Fails if the relocations don't make sense or don't reach.  */
+bool tcg_host_reloc_apply(TCGContext *s, TranslationBlock *tb,
+                          const TCGHostReloc *relocs, int nb_relocs)
+{
+    int i;
+
+    for (i = 0; i < nb_relocs; ++i) {
+        const TCGHostReloc *r = &relocs[i];
+        void *site = tb->tc.ptr + r->offset;
+        uintptr_t addr;
+        intptr_t disp;
+
+        switch (r->kind) {
+        case TCG_HOST_RELOC_SYMBOL:
+            addr = (uintptr_t)tcg_host_symbol(r->target);
+            if (!addr) {
+                return false;
+            }
+            break;
+        case TCG_HOST_RELOC_PROLOGUE:
+            if (r->target >= s->code_gen_prologue_size) {
+                return false;
+            }
+            addr = (uintptr_t)s->code_gen_prologue + r->target;
+            break;
+        case TCG_HOST_RELOC_TB:
+            if (r->target >= sizeof(*tb)) {
+                return false;
+            }
+            addr = (uintptr_t)tb + r->target;
+            break;
+        case TCG_HOST_RELOC_CODE:
+            if (r->target >= tb->tc.size) {
+                return false;
+            }
+            addr = (uintptr_t)tb->tc.ptr + r->target;
+            break;
+        default:
+            return false;
+        }
+
+        switch (r->form) {
+        case TCG_HOST_RELOC_PC32:
+            disp = addr - ((uintptr_t)site + 4);
+            if (r->offset + 4 > tb->tc.size || disp != (int32_t)disp) {
+                return false;
+            }
+            tcg_patch32(site, disp);
+            break;
+        case TCG_HOST_RELOC_ABS32:
+            if (r->offset + 4 > tb->tc.size || addr != (uint32_t)addr) {
+                return false;
+            }
+            tcg_patch32(site, addr);
+            break;
+        case TCG_HOST_RELOC_ABS64:
+            if (r->offset + 8 > tb->tc.size) {
+                return false;
+            }
+            tcg_patch64(site, addr);
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Identifies what the code of a TB assumes beyond its relocations: the
+   meaning of the symbol numbers, the host features it was made for, the
+   layout of the CPU state and the prologue.  */
+uint32_t tcg_host_code_abi(void)
+{
+    uint32_t crc = crc32c(0, (const uint8_t *)"tcg", 3);
+    uint32_t value;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(all_helpers); ++i) {
+        const char *name = all_helpers[i].name;
+
+        crc = crc32c(crc, (const uint8_t *)name, strlen(name) + 1);
+    }
+    value = TCG_NB_LDST_HELPERS;
+    crc = crc32c(crc, (const uint8_t *)&value, sizeof(value));
+#ifdef TCG_TARGET_NEED_HOST_RELOCS
+    value = tcg_target_code_features();
+    crc = crc32c(crc, (const uint8_t *)&value, sizeof(value));
+#endif
+
+    /* The code reaches into the CPU state by offsets, and returns through
+       the prologue; another build may have moved either.  */
+    {
+        const uint64_t layout[] = {
+            sizeof(CPUArchState),
+            ENV_OFFSET,
+            offsetof(CPUState, icount_decr),
+#ifdef CONFIG_SOFTMMU
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+            offsetof(CPUArchState, tlb_mask),
+#else
+            CPU_TLB_SIZE,
+#endif
+            offsetof(CPUArchState, tlb_table),
+            offsetof(CPUArchState, iotlb),
+            offsetof(CPUArchState, tlb_v_table),
+            sizeof(CPUTLBEntry),
+#endif
+            TARGET_PAGE_BITS,
+            NB_MMU_MODES,
+        };
+
+        crc = crc32c(crc, (const uint8_t *)layout, sizeof(layout));
+    }
+    crc = crc32c(crc, tcg_init_ctx.code_gen_prologue,
+                 tcg_init_ctx.code_gen_prologue_size);
+    return crc;
+}
+
 void tcg_func_start(TCGContext *s)
 {
     tcg_pool_reset(s);
@@ -873,6 +1104,9 @@ void tcg_func_start(TCGContext *s)
     s->goto_tb_issue_mask = 0;
 #endif
 
+    s->nb_host_relocs = 0;
+    s->host_relocs_failed = false;
+
     QTAILQ_INIT(&s->ops);
     QTAILQ_INIT(&s->free_ops);
 }
@@ -3409,6 +3643,14 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     }
 #endif
 
+    if (s->record_host_relocs) {
+        for (i = 0; i < s->nb_host_relocs; ++i) {
+            if (s->host_relocs[i].kind == TCG_HOST_RELOC_TB) {
+                s->host_relocs[i].target -= (uintptr_t)tb;
+            }
+        }
+    }
+
     /* flush instruction cache */
     flush_icache_range((uintptr_t)s->code_buf, (uintptr_t)s->code_ptr);
 
@@ -28,6 +28,7 @@
 #include "qemu-common.h"
 #include "cpu.h"
 #include "exec/tb-context.h"
+#include "exec/tb-cache.h"
 #include "qemu/bitops.h"
 #include "qemu/queue.h"
 #include "tcg-mo.h"
@@ -686,6 +687,7 @@ struct TCGContext {
        extension that allows arithmetic on void*.  */
     void *code_gen_prologue;
     void *code_gen_epilogue;
+    size_t code_gen_prologue_size;
     void *code_gen_buffer;
     size_t code_gen_buffer_size;
     void *code_gen_ptr;
@@ -697,6 +699,14 @@ struct TCGContext {
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
 
+    /* Host relocations of the current TB, when record_host_relocs is set.
+       host_relocs_failed tells the code depends on where it lives in a
+       way that can't be described.  */
+    bool record_host_relocs;
+    bool host_relocs_failed;
+    int nb_host_relocs;
+    TCGHostReloc host_relocs[TCG_MAX_HOST_RELOCS];
+
     /* These structures are private to tcg-target.inc.c.  */
 #ifdef TCG_TARGET_NEED_LDST_LABELS
     struct TCGLabelQemuLdst *ldst_labels;
@@ -886,6 +896,14 @@ void tcg_func_start(TCGContext *s);
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb);
 
+void tcg_host_reloc(TCGContext *s, tcg_insn_unit *site,
+                    TCGHostRelocForm form, uintptr_t addr);
+void tcg_host_reloc_tb(TCGContext *s, tcg_insn_unit *site,
+                       TCGHostRelocForm form, uintptr_t tb_addr);
+bool tcg_host_reloc_apply(TCGContext *s, TranslationBlock *tb,
+                          const TCGHostReloc *relocs, int nb_relocs);
+uint32_t tcg_host_code_abi(void);
+
 void tcg_set_frame(TCGContext *s, TCGReg reg, intptr_t start, intptr_t size);
 
 TCGTemp *tcg_global_mem_new_internal(TCGType, TCGv_ptr,
@@ -1013,7 +1031,10 @@ do {\
 static inline TCGv_ptr TCGV_NAT_TO_PTR(TCGv_i32 n) { return (TCGv_ptr)n; }
 static inline TCGv_i32 TCGV_PTR_TO_NAT(TCGv_ptr n) { return (TCGv_i32)n; }
 
-#define tcg_const_ptr(V) TCGV_NAT_TO_PTR(tcg_const_i32((intptr_t)(V)))
+/* Host pointers tie the code to this process.  */
+#define tcg_const_ptr(V) \
+    (tcg_ctx->host_relocs_failed = true, \
+     TCGV_NAT_TO_PTR(tcg_const_i32((intptr_t)(V))))
 #define tcg_global_mem_new_ptr(R, O, N) \
     TCGV_NAT_TO_PTR(tcg_global_mem_new_i32((R), (O), (N)))
 #define tcg_temp_new_ptr() TCGV_NAT_TO_PTR(tcg_temp_new_i32())
@@ -1022,7 +1043,10 @@ static inline TCGv_i32 TCGV_PTR_TO_NAT(TCGv_ptr n) { return (TCGv_i32)n; }
 static inline TCGv_ptr TCGV_NAT_TO_PTR(TCGv_i64 n) { return (TCGv_ptr)n; }
 static inline TCGv_i64 TCGV_PTR_TO_NAT(TCGv_ptr n) { return (TCGv_i64)n; }
 
-#define tcg_const_ptr(V) TCGV_NAT_TO_PTR(tcg_const_i64((intptr_t)(V)))
+/* Host pointers tie the code to this process.  */
+#define tcg_const_ptr(V) \
+    (tcg_ctx->host_relocs_failed = true, \
+     TCGV_NAT_TO_PTR(tcg_const_i64((intptr_t)(V))))
 #define tcg_global_mem_new_ptr(R, O, N) \
     TCGV_NAT_TO_PTR(tcg_global_mem_new_i64((R), (O), (N)))
 #define tcg_temp_new_ptr() TCGV_NAT_TO_PTR(tcg_temp_new_i64())
@@ -0,0 +1,101 @@
+/*
+ * Splitting of goldfish_events batches into input frames
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "hw/input/goldfish_events.h"
+
+#define EV_SYN 0x00
+#define EV_KEY 0x01
+#define EV_ABS 0x03
+#define SYN_REPORT 0
+#define SYN_MT_REPORT 2
+#define ABS_MT_SLOT 0x2f
+#define ABS_MT_POSITION_X 0x35
+#define ABS_MT_POSITION_Y 0x36
+
+/* Appends one multi-touch frame moving |slot| to (x, y). */
+static int add_frame(GoldfishEvent *events, int n, int slot, int x, int y)
+{
+    events[n++] = (GoldfishEvent) { EV_ABS, ABS_MT_SLOT, slot };
+    events[n++] = (GoldfishEvent) { EV_ABS, ABS_MT_POSITION_X, x };
+    events[n++] = (GoldfishEvent) { EV_ABS, ABS_MT_POSITION_Y, y };
+    events[n++] = (GoldfishEvent) { EV_SYN, SYN_REPORT, 0 };
+    return n;
+}
+
+static void test_single_frame(void)
+{
+    GoldfishEvent events[4];
+    int n = add_frame(events, 0, 0, 10, 20);
+
+    g_assert_cmpint(goldfish_event_frame_len(events, n), ==, n);
+    g_assert_cmpint(goldfish_event_frame_len(events, 0), ==, 0);
+}
+
+static void test_split_in_order(void)
+{
+    /* Far more frames than the 341 events the device queue can hold. */
+    enum { FRAMES = 200 };
+    GoldfishEvent events[FRAMES * 4];
+    int n = 0, i, len, frame = 0;
+
+    for (i = 0; i < FRAMES; i++) {
+        n = add_frame(events, n, i % 10, i, 2 * i);
+    }
+
+    for (i = 0; i < n; i += len) {
+        len = goldfish_event_frame_len(events + i, n - i);
+        g_assert_cmpint(len, ==, 4);
+        g_assert_cmpint(events[i].code, ==, ABS_MT_SLOT);
+        g_assert_cmpint(events[i + 1].value, ==, frame);
+        g_assert_cmpint(events[i + len - 1].type, ==, EV_SYN);
+        g_assert_cmpint(events[i + len - 1].code, ==, SYN_REPORT);
+        frame++;
+    }
+    g_assert_cmpint(i, ==, n);
+    g_assert_cmpint(frame, ==, FRAMES);
+}
+
+static void test_unterminated_tail(void)
+{
+    GoldfishEvent events[8];
+    int n = add_frame(events, 0, 1, 5, 6);
+
+    events[n++] = (GoldfishEvent) { EV_KEY, 0x74, 1 };
+    events[n++] = (GoldfishEvent) { EV_KEY, 0x74, 0 };
+
+    g_assert_cmpint(goldfish_event_frame_len(events, n), ==, 4);
+    g_assert_cmpint(goldfish_event_frame_len(events + 4, n - 4), ==, 2);
+}
+
+static void test_only_syn_report_ends_frame(void)
+{
+    GoldfishEvent events[6];
+    int n = 0;
+
+    events[n++] = (GoldfishEvent) { EV_ABS, ABS_MT_POSITION_X, 1 };
+    events[n++] = (GoldfishEvent) { EV_SYN, SYN_MT_REPORT, 0 };
+    events[n++] = (GoldfishEvent) { EV_ABS, ABS_MT_POSITION_X, 2 };
+    events[n++] = (GoldfishEvent) { EV_SYN, SYN_MT_REPORT, 0 };
+    events[n++] = (GoldfishEvent) { EV_ABS, SYN_REPORT, 0 };
+    events[n++] = (GoldfishEvent) { EV_SYN, SYN_REPORT, 0 };
+
+    g_assert_cmpint(goldfish_event_frame_len(events, n), ==, n);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/goldfish-events/single-frame", test_single_frame);
+    g_test_add_func("/goldfish-events/split-in-order", test_split_in_order);
+    g_test_add_func("/goldfish-events/unterminated-tail",
+                    test_unterminated_tail);
+    g_test_add_func("/goldfish-events/only-syn-report-ends-frame",
+                    test_only_syn_report_ends_frame);
+    return g_test_run();
+}
@@ -0,0 +1,171 @@
+/*
+ * Internet checksum of slirp mbufs
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "slirp/slirp.h"
+
+#define MAX_LEN 65536
+
+/* RFC 1071, one 16-bit word at a time */
+static int ref_cksum(const uint8_t *p, int len)
+{
+    uint32_t sum = 0;
+
+    while (len > 1) {
+        sum += lduw_he_p(p);
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        uint8_t last[2] = { *p, 0 };
+
+        sum += lduw_he_p(last);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum & 0xffff;
+}
+
+static void fill_random(uint8_t *p, int len, uint32_t seed)
+{
+    while (len-- > 0) {
+        seed = seed * 1103515245 + 12345;
+        *p++ = seed >> 16;
+    }
+}
+
+static int mbuf_cksum(uint8_t *data, int m_len, int len)
+{
+    struct mbuf m;
+
+    memset(&m, 0, sizeof(m));
+    m.m_data = (char *)data;
+    m.m_len = m_len;
+    return cksum(&m, len);
+}
+
+/* The checksum as it reads in the packet, independently of the host */
+static void assert_cksum_bytes(int sum, uint8_t hi, uint8_t lo)
+{
+    uint16_t s = sum;
+    const uint8_t *b = (const uint8_t *)&s;
+
+    g_assert_cmpint(b[0], ==, hi);
+    g_assert_cmpint(b[1], ==, lo);
+}
+
+static void test_known_answers(void)
+{
+    /* RFC 1071 section 3: the sum is ddf2 */
+    uint8_t rfc1071[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+    /* An IPv4 header, its checksum is b861 */
+    uint8_t iphdr[] = {
+        0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+        0x00, 0x00, 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7,
+    };
+    /* Odd length: the last byte is padded with a zero */
+    uint8_t odd[] = { 0x12, 0x34, 0x56 };
+
+    assert_cksum_bytes(mbuf_cksum(rfc1071, sizeof(rfc1071), sizeof(rfc1071)),
+                       0x22, 0x0d);
+    assert_cksum_bytes(mbuf_cksum(iphdr, sizeof(iphdr), sizeof(iphdr)),
+                       0xb8, 0x61);
+    assert_cksum_bytes(mbuf_cksum(odd, sizeof(odd), sizeof(odd)), 0x97, 0xcb);
+
+    /* A header holding its checksum sums to zero */
+    iphdr[10] = 0xb8;
+    iphdr[11] = 0x61;
+    g_assert_cmpint(mbuf_cksum(iphdr, sizeof(iphdr), sizeof(iphdr)), ==, 0);
+
+    /* Nothing to sum */
+    g_assert_cmpint(mbuf_cksum(odd, 0, 0), ==, 0xffff);
+}
+
+static void test_lengths(void)
+{
+    uint8_t *buf = g_malloc(MAX_LEN);
+    int len;
+
+    fill_random(buf, MAX_LEN, 1);
+    /* Every tail of the 32-, 4- and 2-byte loops, and then some */
+    for (len = 0; len <= 300; len++) {
+        g_assert_cmpint(mbuf_cksum(buf, len, len), ==, ref_cksum(buf, len));
+    }
+    for (len = 1499; len <= 1501; len++) {
+        g_assert_cmpint(mbuf_cksum(buf, len, len), ==, ref_cksum(buf, len));
+    }
+    g_assert_cmpint(mbuf_cksum(buf, MAX_LEN - 1, MAX_LEN - 1), ==,
+                    ref_cksum(buf, MAX_LEN - 1));
+    g_free(buf);
+}
+
+static void test_offsets(void)
+{
+    static const int lens[] = { 1, 2, 3, 31, 32, 33, 63, 1500, 9001 };
+    uint8_t *buf = g_malloc(MAX_LEN);
+    int offset;
+    size_t i;
+
+    fill_random(buf, MAX_LEN, 2);
+    /* The loads don't need any alignment */
+    for (offset = 0; offset < 8; offset++) {
+        for (i = 0; i < ARRAY_SIZE(lens); i++) {
+            g_assert_cmpint(mbuf_cksum(buf + offset, lens[i], lens[i]), ==,
+                            ref_cksum(buf + offset, lens[i]));
+        }
+    }
+    g_free(buf);
+}
+
+static void test_carries(void)
+{
+    uint8_t *buf = g_malloc(MAX_LEN);
+    int len;
+
+    /* All ones: each addition of the 64-bit chains carries */
+    memset(buf, 0xff, MAX_LEN);
+    for (len = MAX_LEN - 64; len <= MAX_LEN; len++) {
+        g_assert_cmpint(mbuf_cksum(buf, len, len), ==, ref_cksum(buf, len));
+    }
+    g_free(buf);
+}
+
+static void test_ext_mbuf(void)
+{
+    struct mbuf m;
+    int len = MAX_LEN - 3;
+
+    /* A guest TCP super-packet, in storage of its own (M_EXT) */
+    memset(&m, 0, sizeof(m));
+    m.m_flags = M_EXT;
+    m.m_size = MAX_LEN;
+    m.m_ext = g_malloc(MAX_LEN);
+    fill_random((uint8_t *)m.m_ext, MAX_LEN, 3);
+    m.m_data = m.m_ext + 3;
+    m.m_len = len;
+    g_assert_cmpint(cksum(&m, len), ==,
+                    ref_cksum((uint8_t *)m.m_data, len));
+
+    /* Only the data of the mbuf is summed */
+    m.m_len = 1001;
+    g_assert_cmpint(cksum(&m, len), ==,
+                    ref_cksum((uint8_t *)m.m_data, 1001));
+    g_free(m.m_ext);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/slirp/cksum/known_answers", test_known_answers);
+    g_test_add_func("/slirp/cksum/lengths", test_lengths);
+    g_test_add_func("/slirp/cksum/offsets", test_offsets);
+    g_test_add_func("/slirp/cksum/carries", test_carries);
+    g_test_add_func("/slirp/cksum/ext_mbuf", test_ext_mbuf);
+    return g_test_run();
+}
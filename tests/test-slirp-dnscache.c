@@ -0,0 +1,421 @@
+/*
+ * Cache of the answers to the DNS queries of the slirp guest
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "../slirp/dnscache.c"
+
+/* What dnscache.c uses of the rest of slirp */
+
+#define MBUF_SIZE 4096
+
+static GByteArray *sent;
+
+void slirp_lock(void)
+{
+}
+
+void slirp_unlock(void)
+{
+}
+
+void sotranslate_out(struct socket *so, struct sockaddr_storage *addr)
+{
+}
+
+struct mbuf *m_get(Slirp *slirp)
+{
+    struct mbuf *m = g_malloc0(sizeof(*m) + MBUF_SIZE);
+
+    m->m_size = MBUF_SIZE;
+    m->m_data = m->m_dat;
+    m->slirp = slirp;
+    return m;
+}
+
+void m_inc(struct mbuf *m, int size)
+{
+    g_assert_not_reached();
+}
+
+static int output(struct mbuf *m)
+{
+    g_byte_array_append(sent, (const guint8 *)m->m_data, m->m_len);
+    g_free(m);
+    return 0;
+}
+
+int udp_output(struct socket *so, struct mbuf *m, struct sockaddr_in *saddr,
+               struct sockaddr_in *daddr, int iptos)
+{
+    return output(m);
+}
+
+int udp6_output(struct socket *so, struct mbuf *m, struct sockaddr_in6 *saddr,
+                struct sockaddr_in6 *daddr)
+{
+    return output(m);
+}
+
+/* Messages about example.com, records point at the name of the question */
+
+#define QUESTION_END    (DNS_HDR_LEN + 13 + 4)
+#define DNS_TYPE_A      1
+#define DNS_TYPE_NS     2
+
+typedef struct Msg {
+    uint8_t p[512];
+    int len;
+} Msg;
+
+static void msg_init(Msg *msg, uint16_t flags, int an, int ns, int ar)
+{
+    static const uint8_t question[] = "\7example\3com\0\0\1\0\1";
+
+    memset(msg, 0, sizeof(*msg));
+    stw_be_p(msg->p, 0x1234);
+    stw_be_p(msg->p + 2, flags);
+    stw_be_p(msg->p + 4, 1);
+    stw_be_p(msg->p + 6, an);
+    stw_be_p(msg->p + 8, ns);
+    stw_be_p(msg->p + 10, ar);
+    memcpy(msg->p + DNS_HDR_LEN, question, sizeof(question) - 1);
+    msg->len = QUESTION_END;
+}
+
+static void msg_add(Msg *msg, uint16_t type, uint32_t ttl,
+                    const uint8_t *rdata, int rdlen)
+{
+    uint8_t *r = msg->p + msg->len;
+
+    stw_be_p(r, 0xc000 | DNS_HDR_LEN);
+    stw_be_p(r + 2, type);
+    stw_be_p(r + 4, 1);
+    stl_be_p(r + 6, ttl);
+    stw_be_p(r + 10, rdlen);
+    memcpy(r + 12, rdata, rdlen);
+    msg->len += 12 + rdlen;
+}
+
+static void msg_add_a(Msg *msg, uint32_t ttl)
+{
+    static const uint8_t addr[] = { 93, 184, 216, 34 };
+
+    msg_add(msg, DNS_TYPE_A, ttl, addr, sizeof(addr));
+}
+
+static void msg_add_soa(Msg *msg, uint32_t ttl, uint32_t minimum)
+{
+    /* The root as the names, then serial, refresh, retry, expire */
+    uint8_t rdata[22] = { 0 };
+
+    stl_be_p(rdata + 18, minimum);
+    msg_add(msg, DNS_TYPE_SOA, ttl, rdata, sizeof(rdata));
+}
+
+static uint32_t msg_ttl(const uint8_t *p, int record)
+{
+    int off = QUESTION_END;
+
+    while (record--) {
+        off += 12 + lduw_be_p(p + off + 10);
+    }
+    return ldl_be_p(p + off + 6);
+}
+
+static void test_question_key(void)
+{
+    Msg msg, other;
+    GBytes *key, *key2;
+    int qend, len;
+    int64_t ttl;
+    bool has_soa;
+
+    msg_init(&msg, DNS_FLAG_RD, 0, 0, 0);
+    key = dns_question_key(msg.p, msg.len, &qend, &ttl, &has_soa);
+    g_assert(key);
+    g_assert_cmpint(qend, ==, QUESTION_END);
+    g_assert_cmpint(ttl, ==, INT64_MAX);
+    g_assert_false(has_soa);
+
+    /* Names are case insensitive, not recursion */
+    msg_init(&other, DNS_FLAG_RD, 0, 0, 0);
+    memcpy(other.p + DNS_HDR_LEN + 1, "ExAmPlE", 7);
+    key2 = dns_question_key(other.p, other.len, &qend, &ttl, &has_soa);
+    g_assert(g_bytes_equal(key, key2));
+    g_bytes_unref(key2);
+    msg_init(&other, 0, 0, 0, 0);
+    key2 = dns_question_key(other.p, other.len, &qend, &ttl, &has_soa);
+    g_assert_false(g_bytes_equal(key, key2));
+    g_bytes_unref(key2);
+    g_bytes_unref(key);
+
+    /* Truncated questions */
+    for (len = 0; len < QUESTION_END; len++) {
+        g_assert_null(dns_question_key(msg.p, len, &qend, &ttl, &has_soa));
+    }
+
+    /* Truncated records */
+    msg_init(&msg, DNS_FLAG_QR, 1, 1, 0);
+    msg_add_a(&msg, 300);
+    msg_add_soa(&msg, 300, 60);
+    for (len = QUESTION_END; len < msg.len; len++) {
+        g_assert_null(dns_question_key(msg.p, len, &qend, &ttl, &has_soa));
+    }
+    key = dns_question_key(msg.p, msg.len, &qend, &ttl, &has_soa);
+    g_assert(key);
+    g_bytes_unref(key);
+
+    /* Not one standard question */
+    msg_init(&msg, DNS_FLAG_TC, 0, 0, 0);
+    g_assert_null(dns_question_key(msg.p, msg.len, &qend, &ttl, &has_soa));
+    msg_init(&msg, 0, 0, 0, 0);
+    stw_be_p(msg.p + 4, 2);
+    g_assert_null(dns_question_key(msg.p, msg.len, &qend, &ttl, &has_soa));
+    msg_init(&msg, 0, 0, 0, 0);
+    msg.p[DNS_HDR_LEN] = 0xc0;
+    g_assert_null(dns_question_key(msg.p, msg.len, &qend, &ttl, &has_soa));
+}
+
+static void test_walk_records(void)
+{
+    Msg msg;
+    bool has_opt, has_soa;
+
+    /* The smallest TTL, counting the minimum of the SOA */
+    msg_init(&msg, DNS_FLAG_QR, 1, 1, 0);
+    msg_add_a(&msg, 300);
+    msg_add_soa(&msg, 600, 60);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, 60);
+    g_assert_false(has_opt);
+    g_assert_true(has_soa);
+
+    /* Aged, in place */
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 100,
+                                     &has_opt, &has_soa), ==, 60);
+    g_assert_cmpint(msg_ttl(msg.p, 0), ==, 200);
+    g_assert_cmpint(msg_ttl(msg.p, 1), ==, 500);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 400,
+                                     &has_opt, &has_soa), ==, 0);
+    g_assert_cmpint(msg_ttl(msg.p, 0), ==, 0);
+
+    /* High bit TTLs mean 0, the TTL of EDNS records holds flags */
+    msg_init(&msg, DNS_FLAG_QR, 1, 0, 1);
+    msg_add_a(&msg, 0x80000000);
+    msg_add(&msg, DNS_TYPE_OPT, 0x8000, (const uint8_t *)"", 0);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, 0);
+    g_assert_true(has_opt);
+    msg_init(&msg, DNS_FLAG_QR, 0, 0, 1);
+    msg_add(&msg, DNS_TYPE_OPT, 0, (const uint8_t *)"", 0);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, INT64_MAX);
+
+    /* Only an SOA of the authority section is one of a negative answer */
+    msg_init(&msg, DNS_FLAG_QR, 1, 0, 0);
+    msg_add_soa(&msg, 300, 60);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, 60);
+    g_assert_false(has_soa);
+
+    /* Malformed */
+    msg_init(&msg, DNS_FLAG_QR, 2, 0, 0);
+    msg_add_a(&msg, 300);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, -1);
+    msg_init(&msg, DNS_FLAG_QR, 1, 0, 0);
+    msg_add_a(&msg, 300);
+    stw_be_p(msg.p + QUESTION_END + 10, 5);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, -1);
+    msg_init(&msg, DNS_FLAG_QR, 1, 0, 0);
+    msg_add_a(&msg, 300);
+    msg.p[QUESTION_END] = 0x40;
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, -1);
+    msg_init(&msg, DNS_FLAG_QR, 0, 1, 0);
+    msg_add(&msg, DNS_TYPE_SOA, 300, (const uint8_t *)"\0\0", 2);
+    g_assert_cmpint(dns_walk_records(msg.p, msg.len, QUESTION_END, 0,
+                                     &has_opt, &has_soa), ==, -1);
+}
+
+/* A socket of the guest to the nameserver of slirp */
+
+typedef struct Fixture {
+    Slirp slirp;
+    struct socket so;
+} Fixture;
+
+static void fixture_init(Fixture *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->slirp.vnameserver_addr.s_addr = htonl(0x0a000203);
+    f->slirp.dns_cache = dns_cache_new();
+    f->so.slirp = &f->slirp;
+    f->so.so_ffamily = AF_INET;
+    f->so.so_faddr = f->slirp.vnameserver_addr;
+    f->so.so_fport = htons(kDnsPort);
+    sent = g_byte_array_new();
+}
+
+static void fixture_cleanup(Fixture *f)
+{
+    dns_cache_forget(&f->so);
+    dns_cache_cleanup(&f->slirp);
+    g_byte_array_free(sent, true);
+}
+
+static void fixture_mbuf(struct mbuf *m, Msg *msg)
+{
+    memset(m, 0, sizeof(*m));
+    m->m_data = (caddr_t)msg->p;
+    m->m_len = msg->len;
+}
+
+/* Forwards the query about example.com and gets @answer back */
+static void forward(Fixture *f, Msg *answer)
+{
+    struct sockaddr_storage from = f->so.fhost.ss;
+    struct mbuf m;
+    Msg query;
+
+    msg_init(&query, 0, 0, 0, 0);
+    fixture_mbuf(&m, &query);
+    g_assert_false(dns_cache_answer(&f->so, &m));
+    dns_cache_query_sent(&f->so, &m);
+    fixture_mbuf(&m, answer);
+    dns_cache_store(&f->so, &m, &from);
+}
+
+static DnsCacheEntry *lookup(Fixture *f)
+{
+    DnsCacheEntry *e;
+    GBytes *key;
+    Msg query;
+    int qend;
+    int64_t ttl;
+    bool has_soa;
+
+    msg_init(&query, 0, 0, 0, 0);
+    key = dns_question_key(query.p, query.len, &qend, &ttl, &has_soa);
+    e = g_hash_table_lookup(f->slirp.dns_cache, key);
+    g_bytes_unref(key);
+    return e;
+}
+
+static bool answered(Fixture *f)
+{
+    struct mbuf m;
+    Msg query;
+
+    msg_init(&query, 0, 0, 0, 0);
+    stw_be_p(query.p, 0x5678);
+    fixture_mbuf(&m, &query);
+    g_byte_array_set_size(sent, 0);
+    return dns_cache_answer(&f->so, &m);
+}
+
+static void test_store_positive(void)
+{
+    struct sockaddr_storage from;
+    struct mbuf m;
+    DnsCacheEntry *e;
+    Fixture f;
+    Msg answer;
+
+    fixture_init(&f);
+    msg_init(&answer, DNS_FLAG_QR, 1, 0, 0);
+    msg_add_a(&answer, 300);
+
+    /* Unasked, or from another server */
+    fixture_mbuf(&m, &answer);
+    from = f.so.fhost.ss;
+    dns_cache_store(&f.so, &m, &from);
+    g_assert_null(lookup(&f));
+    ((struct sockaddr_in *)&from)->sin_addr.s_addr = htonl(0x08080808);
+    dns_cache_query_sent(&f.so, &m);
+    dns_cache_store(&f.so, &m, &from);
+    g_assert_null(lookup(&f));
+
+    forward(&f, &answer);
+    e = lookup(&f);
+    g_assert(e);
+    g_assert_cmpint(e->expires - e->stored, ==, 300);
+
+    /* Answered with the id asked and the TTL left */
+    e->stored -= 100;
+    e->expires -= 100;
+    g_assert_true(answered(&f));
+    g_assert_cmpint(sent->len, ==, answer.len);
+    g_assert_cmpint(lduw_be_p(sent->data), ==, 0x5678);
+    g_assert_cmpint(msg_ttl(sent->data, 0), ==, 200);
+
+    /* Expired */
+    e->expires = dns_now();
+    g_assert_false(answered(&f));
+    fixture_cleanup(&f);
+}
+
+static void test_store_negative(void)
+{
+    DnsCacheEntry *e;
+    Fixture f;
+    Msg answer;
+
+    /* NXDOMAIN for the minimum of the SOA */
+    fixture_init(&f);
+    msg_init(&answer, DNS_FLAG_QR | DNS_RCODE_NXDOMAIN, 0, 1, 0);
+    msg_add_soa(&answer, 3600, 60);
+    forward(&f, &answer);
+    e = lookup(&f);
+    g_assert(e);
+    g_assert_cmpint(e->expires - e->stored, ==, 60);
+    g_assert_true(answered(&f));
+    fixture_cleanup(&f);
+
+    /* No record of the type asked, for no longer than the limit */
+    fixture_init(&f);
+    msg_init(&answer, DNS_FLAG_QR, 0, 1, 0);
+    msg_add_soa(&answer, 86400, 86400);
+    forward(&f, &answer);
+    e = lookup(&f);
+    g_assert(e);
+    g_assert_cmpint(e->expires - e->stored, ==, DNS_CACHE_MAX_NEG_TTL);
+    fixture_cleanup(&f);
+
+    /* Not without an SOA */
+    fixture_init(&f);
+    msg_init(&answer, DNS_FLAG_QR | DNS_RCODE_NXDOMAIN, 0, 0, 0);
+    forward(&f, &answer);
+    g_assert_null(lookup(&f));
+    fixture_cleanup(&f);
+
+    fixture_init(&f);
+    msg_init(&answer, DNS_FLAG_QR, 0, 1, 0);
+    msg_add(&answer, DNS_TYPE_NS, 300, (const uint8_t *)"\0", 1);
+    forward(&f, &answer);
+    g_assert_null(lookup(&f));
+    fixture_cleanup(&f);
+
+    /* Nor as a failure */
+    fixture_init(&f);
+    msg_init(&answer, DNS_FLAG_QR | 2, 0, 1, 0);
+    msg_add_soa(&answer, 300, 60);
+    forward(&f, &answer);
+    g_assert_null(lookup(&f));
+    fixture_cleanup(&f);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/slirp/dnscache/question_key", test_question_key);
+    g_test_add_func("/slirp/dnscache/walk_records", test_walk_records);
+    g_test_add_func("/slirp/dnscache/store_positive", test_store_positive);
+    g_test_add_func("/slirp/dnscache/store_negative", test_store_negative);
+    return g_test_run();
+}
@@ -0,0 +1,240 @@
+/*
+ * Generation tagged epoll set of the slirp poll thread
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "slirp/pollset.h"
+#include <sys/eventfd.h>
+
+typedef struct TestOwner {
+    SlirpPollEntry poll;
+    int fd;
+} TestOwner;
+
+static void owner_init(SlirpPollSet *ps, TestOwner *o)
+{
+    slirp_poll_entry_init(&o->poll);
+    o->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_assert(o->fd >= 0);
+    g_assert_cmpint(slirp_pollset_update(ps, &o->poll, o, o->fd, EPOLLIN),
+                    ==, 0);
+}
+
+static void owner_signal(TestOwner *o)
+{
+    uint64_t one = 1;
+
+    g_assert_cmpint(write(o->fd, &one, sizeof(one)), ==, sizeof(one));
+}
+
+static void owner_cleanup(SlirpPollSet *ps, TestOwner *o)
+{
+    slirp_pollset_forget(ps, &o->poll);
+    close(o->fd);
+}
+
+/* The event tagged @tag among the @n of @events */
+static struct epoll_event *find_event(struct epoll_event *events, int n,
+                                      uint64_t tag)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (events[i].data.u64 == tag) {
+            return &events[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t owner_tag(SlirpPollSet *ps, TestOwner *o)
+{
+    return ((uint64_t)ps->slots[o->poll.slot].gen << 32) | o->poll.slot;
+}
+
+static void test_owner(void)
+{
+    SlirpPollSet ps;
+    TestOwner a, b;
+    struct epoll_event events[4];
+    int i, n;
+
+    g_assert_cmpint(slirp_pollset_init(&ps), ==, 0);
+    owner_init(&ps, &a);
+    owner_init(&ps, &b);
+    g_assert_cmpint(a.poll.slot, !=, b.poll.slot);
+
+    /* Nothing is ready yet */
+    g_assert_cmpint(slirp_pollset_wait(&ps, events, 4, 0), ==, 0);
+
+    owner_signal(&a);
+    owner_signal(&b);
+    n = slirp_pollset_wait(&ps, events, 4, 0);
+    g_assert_cmpint(n, ==, 2);
+    for (i = 0; i < n; i++) {
+        TestOwner *o = slirp_pollset_owner(&ps, &events[i]);
+        g_assert(o == &a || o == &b);
+        g_assert(events[i].events & EPOLLIN);
+    }
+
+    /* Waiting for nothing takes the descriptor out of the set */
+    g_assert_cmpint(slirp_pollset_update(&ps, &a.poll, &a, a.fd, 0), ==, 0);
+    n = slirp_pollset_wait(&ps, events, 4, 0);
+    g_assert_cmpint(n, ==, 1);
+    g_assert(slirp_pollset_owner(&ps, &events[0]) == &b);
+
+    owner_cleanup(&ps, &a);
+    owner_cleanup(&ps, &b);
+    slirp_pollset_cleanup(&ps);
+}
+
+static void test_forget_pending(void)
+{
+    SlirpPollSet ps;
+    TestOwner a, b;
+    struct epoll_event events[4];
+    uint64_t tag_a, tag_b;
+    int n;
+
+    g_assert_cmpint(slirp_pollset_init(&ps), ==, 0);
+    owner_init(&ps, &a);
+    owner_init(&ps, &b);
+    tag_a = owner_tag(&ps, &a);
+    tag_b = owner_tag(&ps, &b);
+
+    owner_signal(&a);
+    owner_signal(&b);
+    n = slirp_pollset_wait(&ps, events, 4, 0);
+    g_assert_cmpint(n, ==, 2);
+
+    /* a goes away while its event is pending, b's event is kept */
+    owner_cleanup(&ps, &a);
+    g_assert(slirp_pollset_owner(&ps, find_event(events, n, tag_a)) ==
+             NULL);
+    g_assert(slirp_pollset_owner(&ps, find_event(events, n, tag_b)) ==
+             &b);
+
+    owner_cleanup(&ps, &b);
+    slirp_pollset_cleanup(&ps);
+}
+
+static void test_reused_slot(void)
+{
+    SlirpPollSet ps;
+    TestOwner a, c;
+    struct epoll_event events[4];
+    struct epoll_event stale;
+    int slot, n;
+
+    g_assert_cmpint(slirp_pollset_init(&ps), ==, 0);
+    owner_init(&ps, &a);
+    slot = a.poll.slot;
+
+    owner_signal(&a);
+    n = slirp_pollset_wait(&ps, events, 4, 0);
+    g_assert_cmpint(n, ==, 1);
+    stale = events[0];
+
+    /* c takes the slot of a, the event of a must not be handed to c */
+    owner_cleanup(&ps, &a);
+    owner_init(&ps, &c);
+    g_assert_cmpint(c.poll.slot, ==, slot);
+    g_assert(slirp_pollset_owner(&ps, &stale) == NULL);
+
+    owner_signal(&c);
+    n = slirp_pollset_wait(&ps, events, 4, 0);
+    g_assert_cmpint(n, ==, 1);
+    g_assert(slirp_pollset_owner(&ps, &events[0]) == &c);
+
+    owner_cleanup(&ps, &c);
+    slirp_pollset_cleanup(&ps);
+}
+
+typedef struct ThreadData {
+    SlirpPollSet ps;
+    QemuMutex lock;
+    QemuSemaphore waited;
+    QemuSemaphore forgotten;
+    struct epoll_event events[4];
+    int n;
+    void *owners[4];
+} ThreadData;
+
+static void *poll_thread(void *opaque)
+{
+    ThreadData *t = opaque;
+    int i;
+
+    /* As the slirp thread, waits without the lock... */
+    t->n = slirp_pollset_wait(&t->ps, t->events, 4, 5000);
+    qemu_sem_post(&t->waited);
+    qemu_sem_wait(&t->forgotten);
+
+    /* ...and dispatches with it */
+    qemu_mutex_lock(&t->lock);
+    for (i = 0; i < t->n; i++) {
+        t->owners[i] = slirp_pollset_owner(&t->ps, &t->events[i]);
+    }
+    qemu_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static void test_thread(void)
+{
+    ThreadData t = { 0 };
+    QemuThread thread;
+    TestOwner a, b, c;
+    int i, seen_b = 0;
+
+    g_assert_cmpint(slirp_pollset_init(&t.ps), ==, 0);
+    qemu_mutex_init(&t.lock);
+    qemu_sem_init(&t.waited, 0);
+    qemu_sem_init(&t.forgotten, 0);
+    owner_init(&t.ps, &a);
+    owner_init(&t.ps, &b);
+    owner_signal(&a);
+    owner_signal(&b);
+
+    qemu_thread_create(&thread, "slirp-poll", poll_thread, &t,
+                       QEMU_THREAD_JOINABLE);
+    qemu_sem_wait(&t.waited);
+
+    /* Between the wait and the dispatch, a is freed and c reuses its slot */
+    qemu_mutex_lock(&t.lock);
+    owner_cleanup(&t.ps, &a);
+    owner_init(&t.ps, &c);
+    qemu_mutex_unlock(&t.lock);
+    qemu_sem_post(&t.forgotten);
+    qemu_thread_join(&thread);
+
+    g_assert_cmpint(t.n, ==, 2);
+    for (i = 0; i < t.n; i++) {
+        g_assert(t.owners[i] != &a && t.owners[i] != &c);
+        if (t.owners[i] == &b) {
+            seen_b++;
+        }
+    }
+    g_assert_cmpint(seen_b, ==, 1);
+
+    owner_cleanup(&t.ps, &b);
+    owner_cleanup(&t.ps, &c);
+    qemu_sem_destroy(&t.waited);
+    qemu_sem_destroy(&t.forgotten);
+    qemu_mutex_destroy(&t.lock);
+    slirp_pollset_cleanup(&t.ps);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/slirp/pollset/owner", test_owner);
+    g_test_add_func("/slirp/pollset/forget_pending", test_forget_pending);
+    g_test_add_func("/slirp/pollset/reused_slot", test_reused_slot);
+    g_test_add_func("/slirp/pollset/thread", test_thread);
+    return g_test_run();
+}
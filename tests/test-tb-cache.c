@@ -0,0 +1,190 @@
+/*
+ * File format of the on-disk cache of translated code
+ *
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "exec/tb-cache.h"
+
+#define KEY "build|x86_64|qemu64-x86_64-cpu|2.12.0|0123abcd"
+#define ABI 0x1234
+
+static TBCacheEntry *make_entry(uint64_t pc, int nb_relocs)
+{
+    TBCacheEntry *e = g_new0(TBCacheEntry, 1);
+    size_t i, data_size;
+
+    e->h.pc = pc;
+    e->h.cs_base = pc >> 4;
+    e->h.flags = 0x40;
+    e->h.cflags = 1;
+    e->h.size = 13;
+    e->h.icount = 3;
+    e->h.code_size = 57;
+    e->h.search_size = 6;
+    e->h.nb_relocs = nb_relocs;
+    e->h.jmp_reset_offset[0] = 20;
+    e->h.jmp_reset_offset[1] = 0xffff;
+    e->h.jmp_insn_offset[0] = 16;
+    e->h.jmp_insn_offset[1] = 0;
+
+    data_size = e->h.size + e->h.code_size + e->h.search_size;
+    e->data = g_malloc(data_size);
+    for (i = 0; i < data_size; i++) {
+        e->data[i] = pc + i * 7;
+    }
+    e->relocs = g_new0(TCGHostReloc, nb_relocs);
+    for (i = 0; i < nb_relocs; i++) {
+        e->relocs[i].offset = 4 + i * 8;
+        e->relocs[i].kind = TCG_HOST_RELOC_SYMBOL;
+        e->relocs[i].form = TCG_HOST_RELOC_PC32;
+        e->relocs[i].target = i;
+    }
+    e->h.crc = tb_cache_entry_crc(e);
+    return e;
+}
+
+static void assert_entry_equal(const TBCacheEntry *a, const TBCacheEntry *b)
+{
+    g_assert(!memcmp(&a->h, &b->h, sizeof(a->h)));
+    g_assert(!memcmp(a->data, b->data,
+                     a->h.size + a->h.code_size + a->h.search_size));
+    g_assert(!memcmp(a->relocs, b->relocs,
+                     a->h.nb_relocs * sizeof(TCGHostReloc)));
+}
+
+static bool collect(TBCacheEntry *e, void *opaque)
+{
+    g_ptr_array_add(opaque, e);
+    return true;
+}
+
+/* Encodes three entries, with no, one and the most relocations.  */
+static GByteArray *make_file(GPtrArray *entries)
+{
+    GByteArray *buf = g_byte_array_new();
+    int i;
+
+    g_ptr_array_add(entries, make_entry(0x1000, 0));
+    g_ptr_array_add(entries, make_entry(0xc0de0, 1));
+    g_ptr_array_add(entries, make_entry(0xffffffff80001000ULL,
+                                        TCG_MAX_HOST_RELOCS));
+    tb_cache_file_start(buf, KEY, ABI);
+    for (i = 0; i < entries->len; i++) {
+        tb_cache_file_add(buf, g_ptr_array_index(entries, i));
+    }
+    return buf;
+}
+
+static void test_round_trip(void)
+{
+    GPtrArray *written = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)tb_cache_entry_free);
+    GPtrArray *read = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)tb_cache_entry_free);
+    GByteArray *buf = make_file(written);
+    int i;
+
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len, KEY, ABI,
+                                        collect, read), ==, 3);
+    g_assert_cmpint(read->len, ==, 3);
+    for (i = 0; i < read->len; i++) {
+        TBCacheEntry *e = g_ptr_array_index(read, i);
+
+        assert_entry_equal(g_ptr_array_index(written, i), e);
+        g_assert_cmpint(tb_cache_entry_crc(e), ==, e->h.crc);
+    }
+
+    g_byte_array_free(buf, true);
+    g_ptr_array_free(read, true);
+    g_ptr_array_free(written, true);
+}
+
+static void test_other_build(void)
+{
+    GPtrArray *written = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)tb_cache_entry_free);
+    GPtrArray *read = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)tb_cache_entry_free);
+    GByteArray *buf = make_file(written);
+
+    /* Another emulator build, CPU layout or prologue.  */
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len, KEY, ABI + 1,
+                                        collect, read), ==, -1);
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len, KEY "0", ABI,
+                                        collect, read), ==, -1);
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len, "build", ABI,
+                                        collect, read), ==, -1);
+    g_assert_cmpint(tb_cache_file_parse(buf->data, 8, KEY, ABI,
+                                        collect, read), ==, -1);
+    g_assert_cmpint(read->len, ==, 0);
+
+    g_byte_array_free(buf, true);
+    g_ptr_array_free(read, true);
+    g_ptr_array_free(written, true);
+}
+
+static void test_damaged(void)
+{
+    GPtrArray *written = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)tb_cache_entry_free);
+    GPtrArray *read = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)tb_cache_entry_free);
+    GByteArray *buf = make_file(written);
+    TBCacheEntry *last = g_ptr_array_index(written, 2);
+    size_t last_size = tb_cache_entry_bytes(&last->h);
+
+    /* A flipped bit in the host code of the last entry drops it alone.  */
+    buf->data[buf->len - last_size + sizeof(TBCacheEntryHeader) + 20] ^= 1;
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len, KEY, ABI,
+                                        collect, read), ==, 2);
+    g_ptr_array_set_size(read, 0);
+    buf->data[buf->len - last_size + sizeof(TBCacheEntryHeader) + 20] ^= 1;
+
+    /* So does a file cut short.  */
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len - 1, KEY, ABI,
+                                        collect, read), ==, 2);
+    g_ptr_array_set_size(read, 0);
+
+    /* And more relocations than any TB has.  */
+    ((TBCacheEntryHeader *)(buf->data + buf->len - last_size))->nb_relocs =
+        TCG_MAX_HOST_RELOCS + 1;
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len, KEY, ABI,
+                                        collect, read), ==, 2);
+
+    g_byte_array_free(buf, true);
+    g_ptr_array_free(read, true);
+    g_ptr_array_free(written, true);
+}
+
+static bool take_one(TBCacheEntry *e, void *opaque)
+{
+    tb_cache_entry_free(e);
+    return false;
+}
+
+static void test_stop(void)
+{
+    GPtrArray *written = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)tb_cache_entry_free);
+    GByteArray *buf = make_file(written);
+
+    g_assert_cmpint(tb_cache_file_parse(buf->data, buf->len, KEY, ABI,
+                                        take_one, NULL), ==, 1);
+
+    g_byte_array_free(buf, true);
+    g_ptr_array_free(written, true);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/tb-cache/round-trip", test_round_trip);
+    g_test_add_func("/tb-cache/other-build", test_other_build);
+    g_test_add_func("/tb-cache/damaged", test_damaged);
+    g_test_add_func("/tb-cache/stop", test_stop);
+    return g_test_run();
+}
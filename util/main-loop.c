@@ -34,6 +34,7 @@
 #include "qemu/main-loop.h"
 #include "block/aio.h"
 #include "qemu/error-report.h"
+#include "qemu/latency.h"
 
 #define DEBUG_MAIN_LOOP_PERF 0
 
@@ -44,6 +45,28 @@ void main_loop_register_poll_callback(MainLoopPollCallback poll_func)
     main_loop_poll_callback = poll_func;
 }
 
+QemuLatencyRecorder *qemu_latency_recorder;
+
+void qemu_set_latency_recorder(QemuLatencyRecorder *recorder)
+{
+    atomic_set(&qemu_latency_recorder, recorder);
+}
+
+/* Time the current iteration spent blocked polling, which is left out of
+   its latency.  */
+static int64_t main_loop_idle_ns;
+
+static int main_loop_poll(GPollFD *fds, guint nfds, int64_t timeout)
+{
+    int64_t start = qemu_latency_start();
+    int ret = qemu_poll_ns(fds, nfds, timeout);
+
+    if (start) {
+        main_loop_idle_ns += get_clock() - start;
+    }
+    return ret;
+}
+
 #ifndef _WIN32
 
 /* If we have signalfd, we mask out the signals we want to handle and then
@@ -264,7 +287,7 @@ static int os_host_main_loop_wait(int64_t timeout)
     qemu_mutex_unlock_iothread();
     replay_mutex_unlock();
 
-    ret = qemu_poll_ns((GPollFD *)gpollfds->data, gpollfds->len, timeout);
+    ret = main_loop_poll((GPollFD *)gpollfds->data, gpollfds->len, timeout);
 
     replay_mutex_lock();
     qemu_mutex_lock_iothread();
@@ -476,7 +499,7 @@ static int os_host_main_loop_wait(int64_t timeout)
 
     replay_mutex_unlock();
 
-    g_poll_ret = qemu_poll_ns(poll_fds, n_poll_fds + w->num, poll_timeout_ns);
+    g_poll_ret = main_loop_poll(poll_fds, n_poll_fds + w->num, poll_timeout_ns);
 
     replay_mutex_lock();
 
@@ -507,7 +530,9 @@ void main_loop_wait(int nonblocking)
     int ret;
     uint32_t timeout = UINT32_MAX;
     int64_t timeout_ns;
+    int64_t start = qemu_latency_start();
 
+    main_loop_idle_ns = 0;
     if (nonblocking) {
         timeout = 0;
     }
@@ -556,6 +581,10 @@ void main_loop_wait(int nonblocking)
        missing the warp */
     qemu_start_warp_timer();
     qemu_clock_run_all_timers();
+
+    if (start) {
+        qemu_latency_end(QEMU_LATENCY_MAIN_LOOP, start + main_loop_idle_ns);
+    }
 }
 
 /* Functions to operate on the main QEMU AioContext.  */
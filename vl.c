@@ -5225,6 +5225,7 @@ static int main_impl(int argc, char** argv, void (*on_main_loop_done)(void))
             }
         }
         slirp_set_cleanup_ip_on_load(feature_is_enabled(kFeature_IpDisconnectOnLoad));
+        net_slirp_allow_offload(feature_is_enabled(kFeature_SlirpOffload));
         qemu_android_emulation_init_slirp();
     }
 #endif